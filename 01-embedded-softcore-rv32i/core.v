@@ -65,7 +65,8 @@ module core
 
    // Program Counter
    wire 	     FD_initiate_illinst, FD_initiate_misaligned;
-   reg [31:0] 	     FD_PC, nextPC;
+   reg [31:0] 	     FD_PC /*verilator public*/;
+   reg [31:0] 	     nextPC;
 
    // FD ALU
    wire [31:0] FD_aluout;
@@ -16,7 +16,7 @@ module core_top
 
    wire 	      dm_we;
    wire [31:0] 	      im_addr;
-   wire [31:0] 	      im_do;
+   wire [31:0] 	      im_do /*verilator public*/;
    wire [31:0] 	      dm_addr;
    wire [31:0] 	      dm_di;
    wire [31:0] 	      dm_do;
@@ -0,0 +1,229 @@
+// Subarch tests of core_top on Verilator, checked as in project 02
+//
+// The tests and what they must do are in test/subarch.txt, read with
+// subarch_manifest.h of project 02. The ROM and the IO port are
+// modelled here, the IO port as 64 words of memory. Each test prints
+// PASSED or FAILED, and the run reports the clocks simulated per second.
+//
+// core_top_vl [+manifest=<file>] [+repeat=<n>] [+trace] [test]...
+//
+// +repeat runs the tests n times, for a steadier clock rate
+
+#include <verilated.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Vcore_top.h"
+#include "Vcore_top_core_top.h"
+#include "Vcore_top_core.h"
+#include "Vcore_top_regfile.h"
+#include "disasm.h"
+#include "subarch_manifest.h"
+
+class core_top_run_t
+{
+public:
+  Vcore_top* dut;
+  uint32_t rom[1024];
+  uint32_t io[64];
+  bool trace = false;
+  uint64_t clocks = 0;
+
+  core_top_run_t() : dut(new Vcore_top)
+  {
+    for (int i=0; i<64; ++i) io[i] = 4096 + i;
+    dut->clk = 1;
+    dut->resetb = 1;
+    dut->eval();
+  }
+
+  ~core_top_run_t()
+  {
+    dut->final();
+    delete dut;
+  }
+
+  bool load_program(const std::string& path)
+  {
+    std::memset(rom, 0, sizeof(rom));
+    std::ifstream f(path, std::ios::binary);
+    if (!f.is_open()) return false;
+    f.seekg(0, f.end);
+    size_t size = f.tellg();
+    if (size == 0 || size > sizeof(rom) || size % 4 != 0) return false;
+    f.seekg(0, f.beg);
+    f.read(reinterpret_cast<char*>(rom), size);
+    return true;
+  }
+
+  // One clock. ROM and IO read data follow the addresses the MMU puts
+  // out, and the IO write the MMU holds is done at the edge
+  void tick()
+  {
+    dut->clk = 0;
+    for (int settle=0; settle<2; ++settle) {
+      dut->rom_data = rom[dut->rom_addr % 1024];
+      dut->io_data_read = io[(dut->io_addr >> 2) % 64];
+      dut->eval();
+    }
+    if (dut->io_en && dut->io_we) {
+      io[(dut->io_addr >> 2) % 64] = dut->io_data_write;
+    }
+    dut->clk = 1;
+    dut->eval();
+    ++clocks;
+  }
+
+  void reset()
+  {
+    dut->resetb = 0;
+    tick();
+    dut->resetb = 1;
+    tick();
+  }
+
+  uint32_t pc() { return dut->core_top->CPU0->FD_PC; }
+  uint32_t inst() { return dut->core_top->im_do; }
+  uint32_t reg(int r) { return dut->core_top->CPU0->RF->data[r]; }
+
+  bool run_test(const subarch_test_t& t, std::ostream& out);
+};
+
+bool core_top_run_t::run_test(const subarch_test_t& t, std::ostream& out)
+{
+  out << "(TT) --------------------------------------------------" << std::endl
+      << "(TT) Test " << t.name << ": " << t.program << std::endl;
+  if (!load_program(t.program)) {
+    out << "(TT) Test failed! Program loading failed" << std::endl
+	<< "(TT) Test " << t.name << " FAILED" << std::endl;
+    return false;
+  }
+  reset();
+
+  // Values of FD_PC or a register, repeats dropped
+  std::vector<std::vector<uint32_t>> traces(t.sequences.size());
+  std::vector<int> visits(t.visits.size(), 0);
+  bool passed = true;
+  uint32_t prev_PC = 0;
+  for (int i=0; i<t.clocks; ++i) {
+    uint32_t pc = this->pc();
+    if (trace) {
+      out << "(TT) Opcode=" << disasm(inst()) << ", FD_PC=0x" << std::hex
+	  << pc << ", x1 = 0x" << reg(1) << std::dec << std::endl;
+    }
+    if ((t.has_fail_pc && pc == t.fail_pc) || disasm(inst()) == "ILLEGAL ") {
+      out << "(TT) Test failed! prevPC = 0x"
+	  << std::hex << prev_PC << std::dec << std::endl;
+      passed = false;
+      break;
+    }
+    for (size_t k=0; k<t.sequences.size(); ++k) {
+      int r = t.sequences[k].reg;
+      uint32_t value = (r == subarch_test_t::sequence_t::PC) ? pc : reg(r);
+      if (traces[k].empty() || traces[k].back() != value) {
+	traces[k].push_back(value);
+      }
+    }
+    for (size_t k=0; k<t.visits.size(); ++k) {
+      if (pc == t.visits[k].pc && prev_PC != pc) ++visits[k];
+    }
+    prev_PC = pc;
+    tick();
+  }
+
+  for (size_t k=0; passed && k<t.sequences.size(); ++k) {
+    if (!subarch_test_t::contains(traces[k], t.sequences[k].values)) {
+      int r = t.sequences[k].reg;
+      out << "(TT) Test failed! ";
+      if (r == subarch_test_t::sequence_t::PC) out << "FD_PC";
+      else out << "x" << r;
+      out << " went through" << std::hex;
+      for (uint32_t v : traces[k]) out << " 0x" << v;
+      out << std::dec << std::endl;
+      passed = false;
+    }
+  }
+  for (size_t k=0; passed && k<t.visits.size(); ++k) {
+    if (visits[k] < t.visits[k].count) {
+      out << "(TT) Test failed! 0x" << std::hex << t.visits[k].pc
+	  << std::dec << " reached " << visits[k] << " times, expected "
+	  << t.visits[k].count << std::endl;
+      passed = false;
+    }
+  }
+  out << "(TT) Test " << t.name << (passed ? " passed" : " FAILED")
+      << std::endl;
+  return passed;
+}
+
+int main(int argc, char** argv)
+{
+  Verilated::commandArgs(argc, argv);
+
+  std::string manifest = "test/subarch.txt";
+  int repeat = 1;
+  bool trace = false;
+  std::vector<std::string> names;
+  for (int i=1; i<argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 10, "+manifest=") == 0) manifest = arg.substr(10);
+    else if (arg.compare(0, 8, "+repeat=") == 0) repeat = std::max(1, std::atoi(&argv[i][8]));
+    else if (arg == "+trace") trace = true;
+    else if (arg[0] != '+') names.push_back(arg);
+  }
+
+  std::vector<subarch_test_t> tests;
+  if (!parse_subarch_manifest(manifest, tests)) return 1;
+  std::vector<const subarch_test_t*> selected;
+  if (names.empty()) {
+    for (auto& t : tests) {
+      if (t.needs.empty()) selected.push_back(&t);
+    }
+  }
+  for (auto& name : names) {
+    auto it = std::find_if(tests.begin(), tests.end(),
+			   [&](const subarch_test_t& t) {
+			     return t.name == name;
+			   });
+    if (it == tests.end()) {
+      std::cerr << "No such test: " << name << std::endl;
+      return 1;
+    }
+    selected.push_back(&*it);
+  }
+
+  core_top_run_t tb;
+  tb.trace = trace;
+  int passed = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int n=0; n<repeat; ++n) {
+    passed = 0;
+    for (auto t : selected) {
+      // Only the last round is printed
+      std::ostringstream quiet;
+      std::ostream& out = (n == repeat - 1) ? std::cout : quiet;
+      passed += tb.run_test(*t, out);
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+
+  std::cout << "(TT) --------------------------------------------------"
+	    << std::endl
+	    << "(TT) " << passed << " of " << selected.size()
+	    << " tests passed" << std::endl;
+  std::printf("(TT) %llu clocks in %.2f s, %.2f M clocks/s\n",
+	      (unsigned long long)tb.clocks, seconds,
+	      tb.clocks / seconds / 1e6);
+  return (passed == static_cast<int>(selected.size())) ? 0 : 1;
+}
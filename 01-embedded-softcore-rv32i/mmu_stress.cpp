@@ -0,0 +1,214 @@
+// Randomized stress test of the MMU on Verilator
+//
+// Aligned loads and stores of bytes, halfwords and words, signed and
+// unsigned, to the 64 words of main memory, which wrap every 256 bytes,
+// and to the IO port. The IO port does not put out byte enables, so
+// only words are stored to it. Every load is checked against a model
+// of the memory, and every clock the fetch port against the ROM. Accesses
+// are those of mmu_model.h of project 02, printed the same way.
+//
+// mmu_vl [+seed=<n>] [+count=<n>]
+
+#include <verilated.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "Vmmu.h"
+#include "mmu_model.h"
+
+// xorshift64*
+struct rng_t
+{
+  uint64_t s;
+
+  explicit rng_t(uint64_t seed) : s(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+  uint32_t next()
+  {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return (s * 0x2545F4914F6CDD1Dull) >> 32;
+  }
+
+  // 0 .. n-1
+  uint32_t below(uint32_t n)
+  {
+    return (static_cast<uint64_t>(next()) * n) >> 32;
+  }
+};
+
+class mmu_stress_t
+{
+public:
+  uint64_t clocks = 0;
+  // Data memory and IO as the loads must see them, and the IO port as
+  // written by the MMU
+  uint32_t ram[64], io[64], io_port[64];
+  uint32_t rom[1024];
+
+  explicit mmu_stress_t(uint64_t seed) : dut(new Vmmu), rng(seed)
+  {
+    for (auto& w : rom) w = rng.next();
+    for (int i=0; i<64; ++i) io[i] = io_port[i] = rng.next();
+    // The RAM is not initialized, store every word first
+    dut->clk = 1;
+    dut->resetb = 0;
+    dut->eval();
+    dut->resetb = 1;
+    dut->eval();
+    for (uint32_t i=0; i<64; ++i) {
+      mmu_access_t a = {};
+      a.addr = 0x10000000 + 4 * i;
+      a.size = 4;
+      a.we = true;
+      a.data = rng.next();
+      run(a);
+    }
+  }
+
+  ~mmu_stress_t()
+  {
+    dut->final();
+    delete dut;
+  }
+
+  mmu_access_t next()
+  {
+    mmu_access_t a = {};
+    static const uint8_t sizes[] = {1, 2, 4};
+    a.size = sizes[rng.below(3)];
+    a.we = rng.below(2);
+    a.data = rng.next();
+    a.gap = rng.below(8) == 0 ? 1 : 0;
+    bool is_io = rng.below(4) == 0;
+    if (is_io && a.we) a.size = 4;
+    a.is_signed = !a.we && a.size < 4 && rng.below(2);
+    uint32_t offset = a.size == 4 ? 0 : a.size * rng.below(4 / a.size);
+    if (is_io) {
+      a.addr = 0x80000000 + 4 * rng.below(64) + offset;
+    }
+    else {
+      static const uint32_t bases[] = {0x10000000, 0x10000100, 0x7FFFFF00};
+      a.addr = bases[rng.below(3)] + 4 * rng.below(64) + offset;
+    }
+    return a;
+  }
+
+  // false with error set on a mismatch
+  bool run(const mmu_access_t& a)
+  {
+    for (unsigned i=0; i<a.gap; ++i) {
+      if (!tick()) return false;
+    }
+    dut->dm_addr = a.addr;
+    dut->dm_be = a.be();
+    dut->dm_we = a.we;
+    dut->dm_di = a.data;
+    dut->is_signed = a.is_signed;
+    if (!tick()) return false;
+    dut->dm_be = 0;
+    dut->dm_we = 0;
+    uint32_t* w = (a.addr >> 31) ? &io[(a.addr >> 2) % 64]
+      : &ram[((a.addr - 0x10000000) >> 2) % 64];
+    unsigned shift = 8 * (a.addr & 3);
+    uint32_t mask = (a.size == 4) ? ~0u : ((1u << (8 * a.size)) - 1) << shift;
+    if (a.we) {
+      *w = (*w & ~mask) | ((a.data << shift) & mask);
+      return true;
+    }
+    uint32_t expected = (*w & mask) >> shift;
+    if (a.size < 4 && a.is_signed) {
+      uint32_t sign = 1u << (8 * a.size - 1);
+      if (expected & sign) expected |= ~((sign << 1) - 1);
+    }
+    if (dut->dm_do != expected) {
+      char buf[80];
+      std::snprintf(buf, sizeof(buf), "dm_do 0x%08x, expected 0x%08x",
+		    dut->dm_do, expected);
+      error = buf;
+      return false;
+    }
+    return true;
+  }
+
+  std::string error;
+
+private:
+  Vmmu* dut;
+  rng_t rng;
+
+  // One clock with a random fetch. The IO write the MMU holds is done
+  // at the edge
+  bool tick()
+  {
+    uint32_t im_addr = 4 * rng.below(1024);
+    dut->im_addr = im_addr;
+    dut->clk = 0;
+    dut->eval();
+    dut->im_data = rom[dut->im_addr_out % 1024];
+    dut->io_data_read = io_port[(dut->io_addr >> 2) % 64];
+    dut->eval();
+    if (dut->io_en && dut->io_we) {
+      io_port[(dut->io_addr >> 2) % 64] = dut->io_data_write;
+    }
+    dut->clk = 1;
+    dut->eval();
+    dut->io_data_read = io_port[(dut->io_addr >> 2) % 64];
+    dut->eval();
+    ++clocks;
+    if (dut->im_do != rom[(im_addr >> 2) % 1024]) {
+      char buf[80];
+      std::snprintf(buf, sizeof(buf), "fetch of 0x%x: im_do 0x%08x, "
+		    "expected 0x%08x", im_addr, dut->im_do,
+		    rom[(im_addr >> 2) % 1024]);
+      error = buf;
+      return false;
+    }
+    return true;
+  }
+};
+
+int main(int argc, char** argv)
+{
+  Verilated::commandArgs(argc, argv);
+
+  uint64_t seed = 1;
+  uint64_t count = 2000000;
+  for (int i=1; i<argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 6, "+seed=") == 0) seed = std::strtoull(&argv[i][6], nullptr, 0);
+    else if (arg.compare(0, 7, "+count=") == 0) count = std::strtoull(&argv[i][7], nullptr, 0);
+  }
+
+  mmu_stress_t tb(seed);
+  // The last accesses, printed on a mismatch
+  mmu_access_t last[8];
+  auto start = std::chrono::steady_clock::now();
+  uint64_t n;
+  for (n=0; n<count; ++n) {
+    last[n % 8] = tb.next();
+    if (!tb.run(last[n % 8])) break;
+  }
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  std::printf("(TT) %llu accesses in %llu clocks, %.2f s, %.2f M accesses/s\n",
+	      (unsigned long long)n, (unsigned long long)tb.clocks, seconds,
+	      n / seconds / 1e6);
+  if (n == count) {
+    std::printf("(TT) MMU stress PASSED\n");
+    return 0;
+  }
+  std::printf("(TT) Access %llu: %s, +seed=%llu. The last accesses:\n",
+	      (unsigned long long)n, tb.error.c_str(),
+	      (unsigned long long)seed);
+  for (uint64_t i = n < 7 ? 0 : n - 7; i <= n; ++i) {
+    std::printf("(TT)   %s\n", last[i % 8].str().c_str());
+  }
+  std::printf("(TT) MMU stress FAILED\n");
+  return 1;
+}
@@ -1,9 +1,11 @@
 /*
-* Instruction ROM to be synthesized as EBRAM
+* Instruction ROM to be synthesized as EBRAM. Port c is the fetch port
+* of the second hart. Yosys duplicates the EBRAM for it, and removes it
+* when doutc is not used
 */
 module EBRAM_ROM(
 		clk, 
-                addra, douta, addrb, doutb
+                addra, douta, addrb, doutb, addrc, doutc
 		);
    parameter 
      DEPTH = 512,
@@ -11,14 +13,15 @@ module EBRAM_ROM(
      WIDTH = 32;
    
    input wire clk;
-   input wire [DEPTH_LOG-1:0] addra, addrb;
-   output reg [WIDTH-1:0] 	 douta, doutb;
+   input wire [DEPTH_LOG-1:0] addra, addrb, addrc;
+   output reg [WIDTH-1:0] 	 douta, doutb, doutc;
 
    reg [WIDTH-1:0] 	 ROM [DEPTH-1:0] /*verilator public*/;
 
    always @ (posedge clk) begin
 	douta <= ROM[addra];
 	doutb <= ROM[addrb];
+	doutc <= ROM[addrc];
    end
    
 endmodule // BRAM_SSP
@@ -0,0 +1,152 @@
+/*
+ * Data port arbiter between the harts, in front of the MMU
+ *
+ * One hart is granted the MMU data port per clock. On a conflict, the
+ * hart that lost the last conflict wins, and the other one sees
+ * dm_stall and holds its instruction. The granted hart keeps the port
+ * in the next clock for the second word of a misaligned access, and
+ * for the write of an AMO. dm_do goes to both harts, and only the hart
+ * that issued the load writes it back.
+ *
+ * LR/SC reservations: LR.W reserves a word for its hart. SC.W of the
+ * hart, or a write to the word by the other hart, clears it. SC.W
+ * fails without writing unless its hart holds the reservation of the
+ * address. DMA writes do not clear reservations.
+ *
+ * With NUM_HARTS = 1, hart 1 never requests, and the arbiter only
+ * keeps the reservation of hart 0.
+ */
+`include "core/config.vh"
+
+module arbiter(
+  input wire clk,
+  input wire resetb,
+  // Hart 0
+  input wire dm_we_0,
+  input wire [31:0] dm_addr_0,
+  input wire [31:0] dm_di_0,
+  input wire [3:0] dm_be_0,
+  input wire [2:0] dm_be_hi_0,
+  input wire dm_is_signed_0,
+  input wire dm_lock_0,
+  input wire dm_lr_0,
+  input wire dm_sc_0,
+  output wire dm_stall_0,
+  output wire dm_sc_fail_0,
+  // Hart 1
+  input wire dm_we_1,
+  input wire [31:0] dm_addr_1,
+  input wire [31:0] dm_di_1,
+  input wire [3:0] dm_be_1,
+  input wire [2:0] dm_be_hi_1,
+  input wire dm_is_signed_1,
+  input wire dm_lock_1,
+  input wire dm_lr_1,
+  input wire dm_sc_1,
+  output wire dm_stall_1,
+  output wire dm_sc_fail_1,
+  // To MMU
+  output wire dm_we,
+  output wire [31:0] dm_addr,
+  output wire [31:0] dm_di,
+  output wire [3:0] dm_be,
+  output wire [2:0] dm_be_hi,
+  output wire dm_is_signed,
+  input wire mmu_stall,
+  // A hart lost arbitration in this clock, for statistics
+  output wire [1:0] arb_stall
+  );
+
+  parameter NUM_HARTS = `NUM_HARTS;
+
+  wire req_0, req_1;
+  // Hart granted in this clock, and in the last clock
+  reg sel;
+  reg sel_p;
+  // sel_p keeps the port
+  reg lock;
+  // Hart granted on a conflict
+  reg prio;
+  reg resv_valid_0, resv_valid_1;
+  reg [31:2] resv_addr_0, resv_addr_1;
+  wire gnt_0, gnt_1;
+
+  assign req_0 = dm_be_0 != 4'b0;
+  assign req_1 = (NUM_HARTS > 1) & (dm_be_1 != 4'b0);
+
+  always @ (*) begin : ARBITRATE
+    if (lock)
+      sel = sel_p;
+    else if (req_0 & req_1)
+      sel = prio;
+    else
+      sel = req_1;
+  end
+
+  assign gnt_0 = req_0 & ~sel;
+  assign gnt_1 = req_1 & sel;
+  assign arb_stall = {req_1 & ~sel, req_0 & sel};
+  // The MMU stalls the granted hart for the second word
+  assign dm_stall_0 = sel ? req_0 : mmu_stall;
+  assign dm_stall_1 = sel ? mmu_stall : req_1;
+
+  assign dm_we = sel ? dm_we_1 : dm_we_0;
+  assign dm_addr = sel ? dm_addr_1 : dm_addr_0;
+  assign dm_di = sel ? dm_di_1 : dm_di_0;
+  assign dm_be = sel ? dm_be_1 : dm_be_0;
+  assign dm_be_hi = sel ? dm_be_hi_1 : dm_be_hi_0;
+  assign dm_is_signed = sel ? dm_is_signed_1 : dm_is_signed_0;
+
+  assign dm_sc_fail_0 = ~(resv_valid_0 & resv_addr_0 == dm_addr_0[31:2]);
+  assign dm_sc_fail_1 = ~(resv_valid_1 & resv_addr_1 == dm_addr_1[31:2]);
+
+  // A granted write hits a reservation, also with its second word
+  function write_hits;
+    input we;
+    input [31:0] addr;
+    input [2:0] be_hi;
+    input [31:2] resv_addr;
+    begin
+      write_hits = we & (resv_addr == addr[31:2]
+			 | (be_hi != 3'b0 & resv_addr == addr[31:2] + 30'd1));
+    end
+  endfunction
+
+  always @ (posedge clk) begin : ARBITER_PIPELINE
+    if (!resetb) begin
+      sel_p <= 1'b0;
+      lock <= 1'b0;
+      prio <= 1'b0;
+      resv_valid_0 <= 1'b0;
+      resv_valid_1 <= 1'b0;
+      resv_addr_0 <= 30'b0;
+      resv_addr_1 <= 30'b0;
+    end
+    else if (clk) begin
+      sel_p <= sel;
+      lock <= mmu_stall | (sel ? gnt_1 & dm_lock_1 : gnt_0 & dm_lock_0);
+      if (req_0 & req_1 & ~lock) prio <= ~sel;
+      // Hart 0 reservation
+      if (gnt_0 & dm_lr_0) begin
+        resv_valid_0 <= 1'b1;
+        resv_addr_0 <= dm_addr_0[31:2];
+      end
+      else if ((gnt_0 & dm_sc_0)
+               | (gnt_1 & write_hits(dm_we_1, dm_addr_1, dm_be_hi_1,
+                                     resv_addr_0))) begin
+        resv_valid_0 <= 1'b0;
+      end
+      // Hart 1 reservation
+      if (gnt_1 & dm_lr_1) begin
+        resv_valid_1 <= 1'b1;
+        resv_addr_1 <= dm_addr_1[31:2];
+      end
+      else if ((gnt_1 & dm_sc_1)
+               | (gnt_0 & write_hits(dm_we_0, dm_addr_0, dm_be_hi_0,
+                                     resv_addr_1))) begin
+        resv_valid_1 <= 1'b0;
+      end
+    end
+  end
+
+endmodule
@@ -2,13 +2,38 @@ module board_top
   (
    input wire clki,
    input wire resetb,
-   output wire [7:0] gpio0
+   output wire [7:0] gpio0,
+   output wire uart_tx,
+   input wire uart_rx,
+   input wire [2:0] irq_lines,
+   // SPI flash, also the configuration flash. Dual I/O only needs IO0
+   // and IO1, WP# and HOLD# are pulled up on the board
+   output wire flash_csb,
+   output wire flash_clk,
+   inout wire [1:0] flash_io
    );
 
    wire 	     clk;
    SB_GB clk_gb(.USER_SIGNAL_TO_GLOBAL_BUFFER(clki),
 		.GLOBAL_BUFFER_OUTPUT(clk));
 
-   cpu_top U0(.clk(clk), .resetb(resetb), .gpio0(gpio0));
+   wire [3:0] 	     flash_io_oe, flash_io_do, flash_io_di;
+
+   cpu_top U0(.clk(clk), .resetb(resetb), .gpio0(gpio0),
+	      .uart_tx(uart_tx), .uart_rx(uart_rx), .irq_lines(irq_lines),
+	      .flash_csb(flash_csb), .flash_clk(flash_clk),
+	      .flash_io_oe(flash_io_oe), .flash_io_do(flash_io_do),
+	      .flash_io_di(flash_io_di));
+
+   // Tristate pads of the flash data lines
+   genvar i;
+   generate
+      for (i = 0; i < 2; i = i + 1) begin : FLASH_IO
+	 SB_IO #(.PIN_TYPE(6'b1010_01)) flash_io_pad
+	   (.PACKAGE_PIN(flash_io[i]), .OUTPUT_ENABLE(flash_io_oe[i]),
+	    .D_OUT_0(flash_io_do[i]), .D_IN_0(flash_io_di[i]));
+      end
+   endgenerate
+   assign flash_io_di[3:2] = 2'b11;
    
 endmodule // board_top
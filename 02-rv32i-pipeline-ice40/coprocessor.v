@@ -0,0 +1,139 @@
+/*
+ Sample coprocessor on the core's custom-0/custom-1 port
+
+ custom-0 functions, selected by funct3:
+ - 0: CRC32 byte step. rd = crc32(rs1, rs2[7:0]), 8 clocks
+ - 1: CRC32 word step. rd = crc32(rs1, rs2), 32 clocks
+ - 2: Q16.16 multiply. rd = (rs1 * rs2) >>> 16, single clock
+ - 3: Q16.16 multiply-accumulate. acc += (rs1 * rs2) >>> 16, rd = acc
+ - 4: Set accumulator. acc = rs1, rd = old acc
+ The CRC is the reflected IEEE 802.3 polynomial (0xEDB88320), computed
+ one bit per clock. The caller does the initial and final inversion.
+
+ All other custom-0 functions and all of custom-1 complete in a single
+ clock and return 0.
+
+ Single clock functions answer combinationally. Multi-clock functions
+ latch the operands, then raise cop_ready for one clock when done. If
+ cop_valid drops before that, the core has flushed the instruction and
+ the operation is abandoned.
+ */
+module coprocessor
+  (
+   input wire 	      clk,
+   input wire 	      resetb,
+   input wire 	      cop_valid,
+   /* verilator lint_off UNUSED */
+   input wire [31:0]  cop_inst,
+   /* verilator lint_on UNUSED */
+   input wire [31:0]  cop_rs1,
+   input wire [31:0]  cop_rs2,
+   output reg 	      cop_ready,
+   output reg [31:0]  cop_result
+   );
+
+   localparam CRC32_POLY = 32'hEDB88320;
+
+   localparam
+     FN_CRC32_B = 3'd0,
+     FN_CRC32_W = 3'd1,
+     FN_QMUL = 3'd2,
+     FN_QMAC = 3'd3,
+     FN_SETACC = 3'd4;
+
+   localparam
+     S_IDLE = 2'd0,
+     S_BUSY = 2'd1,
+     S_DONE = 2'd2;
+
+   reg [1:0]   state;
+   reg [4:0]   count;
+   reg [31:0]  crc;
+   reg [31:0]  acc;
+
+   // custom-1 is inst[5] set
+   wire        custom0;
+   wire [2:0]  funct3;
+   assign custom0 = ~cop_inst[5];
+   assign funct3 = cop_inst[14:12];
+
+   wire        multi_clock;
+   assign multi_clock = custom0 &
+			(funct3 == FN_CRC32_B || funct3 == FN_CRC32_W);
+
+   // Q16.16 product
+   /* verilator lint_off UNUSED */
+   wire [63:0] product;
+   /* verilator lint_on UNUSED */
+   wire [31:0] qmul;
+   assign product = $signed(cop_rs1) * $signed(cop_rs2);
+   assign qmul = product[47:16];
+
+   always @ (*) begin : RESULT
+      cop_ready = 1'b0;
+      cop_result = 32'b0;
+      if (state == S_DONE) begin
+	 cop_ready = cop_valid;
+	 cop_result = crc;
+      end
+      else if (state == S_IDLE && cop_valid && !multi_clock) begin
+	 cop_ready = 1'b1;
+	 if (custom0) begin
+	    case (funct3)
+	      FN_QMUL: cop_result = qmul;
+	      FN_QMAC: cop_result = acc + qmul;
+	      FN_SETACC: cop_result = acc;
+	      default: cop_result = 32'b0;
+	    endcase // case (funct3)
+	 end
+      end
+   end
+
+   always @ (posedge clk) begin : COPROCESSOR_FSM
+      if (!resetb) begin
+	 state <= S_IDLE;
+	 count <= 5'b0;
+	 crc <= 32'b0;
+	 acc <= 32'b0;
+      end
+      else if (clk) begin
+	 if (!cop_valid) begin
+	    // Abandoned, or nothing to do
+	    state <= S_IDLE;
+	 end
+	 else begin
+	    case (state)
+	      S_IDLE: begin
+		 if (multi_clock) begin
+		    state <= S_BUSY;
+		    if (funct3 == FN_CRC32_B) begin
+		       crc <= cop_rs1 ^ {24'b0, cop_rs2[7:0]};
+		       count <= 5'd7;
+		    end
+		    else begin
+		       crc <= cop_rs1 ^ cop_rs2;
+		       count <= 5'd31;
+		    end
+		 end
+		 else if (custom0 && funct3 == FN_QMAC) begin
+		    acc <= acc + qmul;
+		 end
+		 else if (custom0 && funct3 == FN_SETACC) begin
+		    acc <= cop_rs1;
+		 end
+	      end
+	      S_BUSY: begin
+		 crc <= {1'b0, crc[31:1]} ^ (crc[0] ? CRC32_POLY : 32'b0);
+		 count <= count - 5'd1;
+		 if (count == 5'd0) state <= S_DONE;
+	      end
+	      default: begin
+		 // Result taken by the core
+		 state <= S_IDLE;
+	      end
+	    endcase // case (state)
+	 end
+      end
+   end
+
+endmodule // coprocessor
@@ -0,0 +1,49 @@
+#ifndef __COPROCESSOR_MODEL_H__
+#define __COPROCESSOR_MODEL_H__
+
+#include <cstdint>
+
+// Reference model of the sample coprocessor in coprocessor.v. execute()
+// is called once per completed custom instruction, in program order
+class coprocessor_model_t
+{
+public:
+  coprocessor_model_t() : acc(0) {}
+
+  void reset() { acc = 0; }
+
+  uint32_t execute(uint32_t inst, uint32_t rs1, uint32_t rs2)
+  {
+    bool custom0 = (inst & 0x20) == 0;
+    uint32_t funct3 = (inst >> 12) & 0x7;
+    if (!custom0) return 0;
+    switch (funct3) {
+    case 0: return crc32(rs1 ^ (rs2 & 0xFF), 8);
+    case 1: return crc32(rs1 ^ rs2, 32);
+    case 2: return qmul(rs1, rs2);
+    case 3: acc += qmul(rs1, rs2); return acc;
+    case 4: { uint32_t old = acc; acc = rs1; return old; }
+    default: return 0;
+    }
+  }
+
+private:
+  uint32_t acc;
+
+  static uint32_t crc32(uint32_t crc, int bits)
+  {
+    for (int i=0; i<bits; ++i) {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+    return crc;
+  }
+
+  static uint32_t qmul(uint32_t a, uint32_t b)
+  {
+    int64_t product = static_cast<int64_t>(static_cast<int32_t>(a))
+      * static_cast<int32_t>(b);
+    return static_cast<uint32_t>(static_cast<uint64_t>(product) >> 16);
+  }
+};
+
+#endif
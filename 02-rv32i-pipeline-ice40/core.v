@@ -3,15 +3,44 @@
  
  Capability:
  - RV32I base instruction set
+ - Optional RV32C compressed instructions (ENABLE_RVC)
+ - Optional Zbb bit manipulation subset (ENABLE_ZBB)
+ - Optional coprocessor port for custom-0/custom-1 (ENABLE_COP)
+ - Optional misaligned loads and stores in hardware (ENABLE_MISALIGNED_HW)
+ - Optional LR.W/SC.W and AMO*.W (ENABLE_AMO)
+ - Optional RV32E with 16 registers (ENABLE_RV32E)
  - Precise exception
- - No interrupts
+ - Timer and external interrupts, WFI
  
  Vectors:
  - Reset:	0x00000000
  - Exception:	0x00000004
  
  Interface:
- - To/From MMU
+ - To/From MMU. im_valid low means im_do is not the word at im_addr
+   yet, and FD stalls and fetches the same word again. A misaligned
+   access crossing a word boundary also sets dm_be_hi, the byte
+   enables of the next word. The MMU asserts
+   dm_stall for one clock while it accesses the first word, and FD
+   holds the instruction for the second. With more than one hart,
+   dm_stall also holds an access another hart is granted the port for
+ - Atomics. An AMO reads in one clock and writes in the next one, with
+   dm_lock asserted in the read clock, so that the port is not given
+   away in between. LR and SC are marked by dm_lr and dm_sc, and the
+   SC writes only when dm_sc_fail is low. rd gets the old memory word,
+   or the SC result
+ - To/From Coprocessor. A custom-0/custom-1 instruction in FD asserts
+   cop_valid with the instruction and both source operands. FD stalls
+   until the coprocessor asserts cop_ready with cop_result in the same
+   clock, then the result is written back in XB like an ALU result.
+   cop_valid drops without cop_ready if the instruction is flushed by a
+   trap, and the coprocessor must then abandon the operation.
+ - To the branch trace encoder, trace.v. trace_valid is set in the clock
+   the instruction at trace_pc goes on from FD, with trace_br and
+   trace_taken for a conditional branch, or trace_jr for JALR and MRET.
+   trace_trap is set in the clock a trap flushes the instruction at
+   trace_pc. trace_target is the next PC. The encoder only watches,
+   the core never waits for it
  
  Microarchitecture:
  - Two-stage pipeline
@@ -24,28 +53,89 @@ module core
    // Top
    clk, resetb,
    // MMU
-   dm_we, im_addr, im_do, dm_addr, dm_di, dm_do, dm_be, dm_is_signed,
+   dm_we, im_addr, im_do, im_valid, dm_addr, dm_di, dm_do, dm_be, dm_is_signed,
+   dm_be_hi, dm_stall,
+   dm_lock, dm_lr, dm_sc, dm_sc_fail,
    // IRQ
-   irq_mtimecmp
+   irq_mtimecmp, irq_external, irq_local,
+   // Coprocessor
+   cop_valid, cop_inst, cop_rs1, cop_rs2, cop_ready, cop_result,
+   // Statistics
+   retire,
+   // Branch trace
+   trace_valid, trace_br, trace_taken, trace_jr, trace_trap, trace_pc,
+   trace_target
    );
 `include "core/aluop.vh"
 `include "core/exception_vector.vh"
+`include "core/config.vh"
+   parameter
+     // Accept RV32C compressed instructions
+     ENABLE_RVC = `ENABLE_RVC,
+     // Zbb operations in the XB ALU
+     ENABLE_ZBB = `ENABLE_ZBB,
+     // Read by mhartid
+     HART_ID = 0;
+
    input wire clk, resetb;
 
    // Interface to MMU
    input wire [31:0] im_do/*verilator public*/, dm_do;
+   input wire 	     im_valid;
    output 	     dm_we, dm_is_signed;
    output [31:0]     im_addr, dm_addr, dm_di;
    output [3:0]      dm_be;
+   output [2:0]      dm_be_hi;
+   input wire 	     dm_stall;
+   // Atomics
+   output wire 	     dm_lock, dm_lr, dm_sc;
+   input wire 	     dm_sc_fail;
 
-   wire 	     dm_we, dm_is_signed;
-   wire [31:0] 	     dm_addr, dm_di;
+   wire 	     dm_we /*verilator public*/;
+   wire 	     dm_is_signed;
+   wire [31:0] 	     dm_addr /*verilator public*/;
+   wire [31:0] 	     dm_di;
    reg [31:0] 	     im_addr;
-   wire [3:0] 	     dm_be;
+   wire [3:0] 	     dm_be /*verilator public*/;
+   wire [2:0] 	     dm_be_hi;
    
    // Timer interrupt
    input wire irq_mtimecmp;
+   // External interrupt
+   input wire irq_external;
+   // Local interrupts, causes 16-31
+   input wire [15:0] irq_local;
+
+   // Interface to Coprocessor
+   output wire 	     cop_valid /*verilator public*/;
+   output wire [31:0] cop_inst /*verilator public*/;
+   output wire [31:0] cop_rs1 /*verilator public*/;
+   output wire [31:0] cop_rs2 /*verilator public*/;
+   input wire 	      cop_ready /*verilator public*/;
+   input wire [31:0]  cop_result /*verilator public*/;
+
+   // An instruction leaves XB
+   output wire 	      retire;
+
+   // Redirects of FD, for the branch trace
+   output wire 	      trace_valid, trace_br, trace_taken, trace_jr;
+   output wire 	      trace_trap;
+   output wire [31:0] trace_pc, trace_target;
    
+   // Instruction Fetch. With RV32C, a 32-bit instruction may straddle
+   // two ROM words, so the upper half of the previous word is kept
+   reg [31:2] 	     fetch_addr_p;
+   reg [15:0] 	     fetch_buf;
+   reg [31:0] 	     FD_inst_raw;
+   reg 		     FD_fetch_stall;
+   // The fetched word is not there yet, e.g. an XIP cache miss
+   wire 	     FD_fetch_wait;
+   wire [31:0] 	     FD_inst /*verilator public*/;
+   wire 	     FD_inst_compressed;
+   wire 	     FD_stall /*verilator public*/;
+   // FD keeps its instruction, so fetch keeps the same word
+   wire 	     FD_hold_fetch;
+
    // Instruction Decode
    wire [31:0] 	     FD_imm;
    wire 	     FD_alu_is_signed;
@@ -54,9 +144,22 @@ module core
    wire 	     FD_regwrite;
    wire 	     FD_jump, FD_link, FD_jr, FD_br;
    wire [3:0] 	     FD_dm_be;
+   wire [2:0] 	     FD_dm_be_hi;
    wire 	     FD_dm_we;
    wire 	     FD_dm_is_signed;
    wire 	     FD_csr_read, FD_csr_write, FD_csr_set, FD_csr_clear, FD_csr_imm;
+   wire 	     FD_cop;
+   // WFI waiting for an enabled interrupt
+   wire 	     FD_wfi;
+   wire 	     FD_wfi_stall /*verilator public*/;
+   // Atomics. An AMO stalls in the read clock
+   wire 	     FD_lr, FD_sc, FD_amo;
+   wire 	     FD_amo_stall;
+   reg 		     amo_phase;
+   // A misaligned access went to the MMU, and FD still holds it. Its
+   // first word may be written, so interrupts wait until it is done
+   reg 		     FD_split_busy;
+   reg [31:0] 	     FD_amo_data;
    wire [4:0] 	     FD_a_rs1, FD_a_rs2, FD_a_rd;
    wire [2:0] 	     FD_funct3;
    /* verilator lint_off UNUSED */
@@ -70,7 +173,7 @@ module core
    wire 	     FD_exception_store_misaligned;
 
    // Program Counter
-   wire 	     FD_initiate_exception;
+   wire 	     FD_initiate_exception /*verilator public*/;
    reg [31:0] FD_PC /*verilator public*/;
    reg [31:0] 	     nextPC /*verilator public*/;
 
@@ -99,27 +202,94 @@ module core
    reg 	       XB_FD_exception_store_misaligned;
    reg [31:0]  XB_PC;
    wire        FD_bubble;
+   // No memory access from FD
+   wire        FD_mem_kill;
    reg FD_reset;
    reg 	       XB_bubble;
 
    // XB ALU
    reg [31:0]  XB_aluop1, XB_aluop2, XB_aluout;
+   // Zbb bit counts of operator 1
+   /* verilator lint_off UNUSED */
+   reg [5:0]   XB_clz, XB_ctz, XB_cpop;
+   /* verilator lint_on UNUSED */
 
    // CSR Register file and Exception Handling Unit
    wire [31:0] XB_csr_out;
    wire        XB_csr_read, XB_csr_write, XB_csr_set, XB_csr_clear, XB_csr_imm;
    wire [31:0] CSR_mepc, CSR_mtvec;
+   wire        CSR_irq_wakeup;
    reg 	       XB_csr_writeback;
 
-   assign dm_be = FD_bubble ? 4'b0 : FD_dm_be;
-   assign dm_we = (FD_exception_store_misaligned | FD_bubble) ?
-     1'b0 : FD_dm_we;
+   // Coprocessor result
+   reg 	       XB_cop_writeback;
+   reg [31:0]  XB_cop_result;
+
+   // Old memory word of an AMO, or SC result
+   reg 	       XB_amo_writeback;
+   reg [31:0]  XB_amo_result;
+
+   // A stall for the MMU or the coprocessor must not cancel the access
+   assign FD_mem_kill = FD_initiate_exception | FD_fetch_stall;
+   assign dm_be = FD_mem_kill ? 4'b0 : FD_dm_be;
+   assign dm_be_hi = FD_mem_kill ? 3'b0 : FD_dm_be_hi;
+   assign dm_we = (FD_exception_store_misaligned | FD_mem_kill) ? 1'b0
+     : FD_sc ? ~dm_sc_fail
+     : FD_amo ? amo_phase
+     : FD_dm_we;
    assign dm_is_signed = FD_dm_is_signed;
 
+   // Align the fetched word(s) to FD_PC
+   assign FD_fetch_wait = ~im_valid;
+   always @ (*) begin : FETCH_ALIGN
+      FD_fetch_stall = FD_fetch_wait;
+      if (ENABLE_RVC == 0 || FD_PC[1] == 1'b0) begin
+	 FD_inst_raw = im_do;
+      end
+      else if (fetch_addr_p != FD_PC[31:2]) begin
+	 // Lower half was buffered, upper half is in the next word
+	 FD_inst_raw = {im_do[15:0], fetch_buf};
+      end
+      else begin
+	 // Instruction begins in the upper half of the fetched word. If
+	 // it is a 32-bit one, wait a clock for the following word
+	 FD_inst_raw = {16'b0, im_do[31:16]};
+	 FD_fetch_stall = FD_fetch_wait | (im_do[17:16] == 2'b11);
+      end
+   end
+
+   generate
+      if (ENABLE_RVC != 0) begin : RVC
+	 rvc_expander rvc_exp
+	   (
+	    .inst_in(FD_inst_raw), .inst_out(FD_inst),
+	    .is_compressed(FD_inst_compressed)
+	    );
+      end
+      else begin : NO_RVC
+	 assign FD_inst = FD_inst_raw;
+	 assign FD_inst_compressed = 1'b0;
+      end
+   endgenerate
+
+   // FD holds its instruction and sends a bubble to XB
+   assign FD_stall = FD_fetch_stall | (cop_valid & ~cop_ready) | dm_stall
+		     | FD_wfi_stall | FD_amo_stall;
+   assign FD_wfi_stall = FD_wfi & ~FD_fetch_stall & ~CSR_irq_wakeup;
+   assign FD_hold_fetch = ((FD_stall & ~FD_fetch_stall) | FD_fetch_wait)
+			  & ~FD_initiate_exception;
+
+   // Coprocessor request. Not valid until the whole instruction is
+   // fetched, or when FD is flushed
+   assign cop_valid = FD_cop & ~FD_fetch_stall & ~FD_initiate_exception;
+   assign cop_inst = FD_inst;
+   assign cop_rs1 = FD_d_rs1;
+   assign cop_rs2 = FD_d_rs2;
+
    instruction_decoder inst_dec
    (
      .FD_reset(FD_reset),
-     .inst(im_do), .aluout_1_0(FD_aluout[1:0]),
+     .inst(FD_inst), .aluout_1_0(FD_aluout[1:0]),
      .immediate(FD_imm),
      .alu_is_signed(FD_alu_is_signed),
      .aluop1_sel(FD_aluop1_sel), .aluop2_sel(FD_aluop2_sel), 
@@ -127,10 +297,12 @@ module core
      .pc_update(FD_pc_update), .pc_mepc(FD_pc_mepc),
      .regwrite(FD_regwrite), .jump(FD_jump), .link(FD_link),
      .jr(FD_jr), .br(FD_br),
-     .dm_be(FD_dm_be), .dm_we(FD_dm_we), 
+     .dm_be(FD_dm_be), .dm_be_hi(FD_dm_be_hi), .dm_we(FD_dm_we), 
      .mem_is_signed(FD_dm_is_signed),
      .csr_read(FD_csr_read), .csr_write(FD_csr_write),
      .csr_set(FD_csr_set), .csr_clear(FD_csr_clear), .csr_imm(FD_csr_imm),
+     .cop(FD_cop), .wfi(FD_wfi),
+     .lr(FD_lr), .sc(FD_sc), .amo(FD_amo),
      .a_rs1(FD_a_rs1), .a_rs2(FD_a_rs2), .a_rd(FD_a_rd), 
      .funct3(FD_funct3), .funct7(FD_funct7),
      .exception_illegal_instruction(FD_exception_illegal_instruction),
@@ -167,26 +339,41 @@ module core
 
       // Update PC. Priority from high to low:
       //
-      // Illegal Instruction Exception, Misaligned Exception, MRET,
-      // Branch, Jump, Jump Register, Increment
+      // Illegal Instruction Exception, Misaligned Exception, Stall,
+      // MRET, Branch, Jump, Jump Register, Increment
       nextPC = (FD_initiate_exception) ? CSR_mtvec
+	       : (FD_stall) ? FD_PC
 	       : (FD_pc_update & FD_pc_mepc) ? CSR_mepc
 	       : (do_branch) ? FD_imm + FD_PC
 	       : (FD_jump) ? FD_PC + FD_imm
 	       : (FD_jr) ? {FD_aluout[31:1], 1'b0}
+	       : (FD_inst_compressed) ? FD_PC + 32'd2
 	       : FD_PC + 32'd4;
-      FD_exception_instruction_misaligned = nextPC[1:0] != 2'b00;
-      
-      im_addr = nextPC;
+      // With RV32C, instructions are halfword aligned
+      FD_exception_instruction_misaligned
+	= (ENABLE_RVC != 0) ? nextPC[0] : nextPC[1:0] != 2'b00;
+
+      // If next PC is the upper half of the word just fetched, that
+      // half is buffered, and the following word is fetched instead
+      if (FD_hold_fetch)
+	im_addr = {fetch_addr_p, 2'b00};
+      else if (ENABLE_RVC != 0 && nextPC[1] && nextPC[31:2] == fetch_addr_p)
+	im_addr = {nextPC[31:2] + 30'd1, 2'b00};
+      else
+	im_addr = nextPC;
    end
 
    // Update the Program Counter
    always @ (posedge clk) begin : PROGRAM_COUNTER
       if (!resetb) begin
 	 FD_PC <= 32'hFFFFFFFC;
+	 fetch_addr_p <= 30'h3FFFFFFF;
+	 fetch_buf <= 16'b0;
       end
       else if (clk) begin
 	 FD_PC <= nextPC;
+	 fetch_addr_p <= im_addr[31:2];
+	 if (!FD_hold_fetch) fetch_buf <= im_do[31:16];
       end // if (clk)
    end
    
@@ -249,8 +436,64 @@ module core
 	default:
 	  XB_aluout = 32'bX;
       endcase // case (XB_alu_op)
+      // Zbb operations, left out of the ALU when disabled
+      if (ENABLE_ZBB != 0) begin
+	 case (XB_alu_op)
+	   `ALU_ANDN: XB_aluout = XB_aluop1 & ~XB_aluop2;
+	   `ALU_ORN: XB_aluout = XB_aluop1 | ~XB_aluop2;
+	   `ALU_XNOR: XB_aluout = ~(XB_aluop1 ^ XB_aluop2);
+	   `ALU_MIN: begin
+	      XB_aluout = (XB_alu_is_signed)
+		? ($signed(XB_aluop1) < $signed(XB_aluop2) ? XB_aluop1 : XB_aluop2)
+		: ($unsigned(XB_aluop1) < $unsigned(XB_aluop2) ? XB_aluop1 : XB_aluop2);
+	   end
+	   `ALU_MAX: begin
+	      XB_aluout = (XB_alu_is_signed)
+		? ($signed(XB_aluop1) < $signed(XB_aluop2) ? XB_aluop2 : XB_aluop1)
+		: ($unsigned(XB_aluop1) < $unsigned(XB_aluop2) ? XB_aluop2 : XB_aluop1);
+	   end
+	   `ALU_ROL: begin
+	      XB_aluout = (XB_aluop1 << XB_aluop2[4:0])
+		| (XB_aluop1 >> (6'd32 - {1'b0, XB_aluop2[4:0]}));
+	   end
+	   `ALU_ROR: begin
+	      XB_aluout = (XB_aluop1 >> XB_aluop2[4:0])
+		| (XB_aluop1 << (6'd32 - {1'b0, XB_aluop2[4:0]}));
+	   end
+	   `ALU_CLZ: XB_aluout = {26'b0, XB_clz};
+	   `ALU_CTZ: XB_aluout = {26'b0, XB_ctz};
+	   `ALU_CPOP: XB_aluout = {26'b0, XB_cpop};
+	   `ALU_REV8: begin
+	      XB_aluout = {XB_aluop1[0+:8], XB_aluop1[8+:8],
+			   XB_aluop1[16+:8], XB_aluop1[24+:8]};
+	   end
+	   `ALU_ORCB: begin
+	      XB_aluout = {{8{|XB_aluop1[24+:8]}}, {8{|XB_aluop1[16+:8]}},
+			   {8{|XB_aluop1[8+:8]}}, {8{|XB_aluop1[0+:8]}}};
+	   end
+	   default: begin
+	      // Base operations are computed above
+	   end
+	 endcase // case (XB_alu_op)
+      end
    end // block: XB_ALU
 
+   // Zbb bit counting. Count leading zeros, trailing zeros and set
+   // bits of ALU operator 1
+   integer     k;
+   always @ (*) begin : XB_BIT_COUNT
+      XB_clz = 6'd32;
+      XB_ctz = 6'd32;
+      XB_cpop = 6'd0;
+      for (k = 0; k < 32; k = k + 1) begin
+	 // Highest set bit is found last
+	 if (XB_aluop1[k]) XB_clz = 6'd31 - k[5:0];
+	 // Lowest set bit is found last
+	 if (XB_aluop1[31-k]) XB_ctz = 6'd31 - k[5:0];
+	 XB_cpop = XB_cpop + {5'b0, XB_aluop1[k]};
+      end
+   end
+
    // Here, the naming is confusing because the signals are actually
    // in FD stage, due to the internally pipelined CSR_EHU module
    assign XB_csr_read = FD_bubble ? 1'b0 : FD_csr_read;
@@ -259,47 +502,93 @@ module core
    assign XB_csr_clear = FD_bubble ? 1'b0 : FD_csr_clear;
    assign XB_csr_imm = FD_csr_imm;
    
-   csr_ehu CSR_EHU0
+   csr_ehu #(.HART_ID(HART_ID)) CSR_EHU0
      (
       .clk(clk), .resetb(resetb), .XB_bubble(XB_bubble),
       .read(XB_csr_read), .write(XB_csr_write),
       .set(XB_csr_set), .clear(XB_csr_clear),
       .imm(XB_csr_imm), .a_rd(FD_a_rd),
       .initiate_exception(FD_initiate_exception),
+      .mret(FD_pc_update & FD_pc_mepc & ~FD_bubble),
+      .irq_hold(FD_split_busy),
       .XB_FD_exception_illegal_instruction(XB_FD_exception_illegal_instruction),
       .XB_FD_exception_instruction_misaligned(XB_FD_exception_instruction_misaligned),
       .XB_FD_exception_ecall(XB_FD_exception_ecall),
       .XB_FD_exception_ebreak(XB_FD_exception_ebreak),
       .XB_FD_exception_load_misaligned(XB_FD_exception_load_misaligned),
       .XB_FD_exception_store_misaligned(XB_FD_exception_store_misaligned),
-      .irq_mtimecmp(irq_mtimecmp),
+      .irq_mtimecmp(irq_mtimecmp), .irq_external(irq_external),
+      .irq_local(irq_local),
       .src_dst(FD_imm[11:0]),
       .d_rs1(FD_d_rs1), .uimm(FD_a_rs1), .FD_aluout(FD_aluout),
-      .nextPC(nextPC), .XB_pc(XB_PC[31:2]), .data_out(XB_csr_out), 
-      .csr_mepc(CSR_mepc), .csr_mtvec(CSR_mtvec)
+      .nextPC(nextPC), .XB_pc(XB_PC[31:1]), .data_out(XB_csr_out), 
+      .csr_mepc(CSR_mepc), .csr_mtvec(CSR_mtvec),
+      .csr_irq_wakeup(CSR_irq_wakeup)
       );
 
    // Writeback path select
    always @ (*) begin : XB_Writeback_Path
       // MemToReg: Load memory to register
       // csr_writeback: CSR to register
-      XB_d_rd = XB_memtoreg ? dm_do
+      // cop_writeback: Coprocessor result to register
+      // amo_writeback: Old memory word, or SC result to register
+      XB_d_rd = XB_amo_writeback ? XB_amo_result
+		: XB_memtoreg ? dm_do
 		: XB_csr_writeback ? XB_csr_out
+		: XB_cop_writeback ? XB_cop_result
 		: XB_aluout;
    end
 
    // MMU Interface
    assign dm_addr = FD_aluout;
-   assign dm_di = FD_d_rs2;
+   assign dm_di = (FD_amo & amo_phase) ? FD_amo_data : FD_d_rs2;
+
+   // AMO. The word read in the first clock is on dm_do in the second
+   // one, which writes the operation result. The requested port is
+   // locked for the second clock, so dm_do is still this read
+   assign FD_amo_stall = FD_amo & ~amo_phase;
+   assign dm_lock = FD_amo_stall & ~FD_mem_kill;
+   assign dm_lr = FD_lr & ~FD_mem_kill;
+   assign dm_sc = FD_sc & ~FD_mem_kill;
+   always @ (*) begin : AMO_ALU
+      case (FD_funct7[6:2])
+	5'b00001: FD_amo_data = FD_d_rs2;
+	5'b00000: FD_amo_data = dm_do + FD_d_rs2;
+	5'b00100: FD_amo_data = dm_do ^ FD_d_rs2;
+	5'b01100: FD_amo_data = dm_do & FD_d_rs2;
+	5'b01000: FD_amo_data = dm_do | FD_d_rs2;
+	5'b10000: FD_amo_data = ($signed(dm_do) < $signed(FD_d_rs2))
+		    ? dm_do : FD_d_rs2;
+	5'b10100: FD_amo_data = ($signed(dm_do) < $signed(FD_d_rs2))
+		    ? FD_d_rs2 : dm_do;
+	5'b11000: FD_amo_data = (dm_do < FD_d_rs2) ? dm_do : FD_d_rs2;
+	5'b11100: FD_amo_data = (dm_do < FD_d_rs2) ? FD_d_rs2 : dm_do;
+	default: FD_amo_data = 32'bX;
+      endcase // case (FD_funct7[6:2])
+   end
+
+   assign retire = ~XB_bubble;
+
+   assign trace_valid = ~FD_bubble;
+   assign trace_br = FD_br;
+   assign trace_taken = do_branch;
+   assign trace_jr = FD_jr | (FD_pc_update & FD_pc_mepc);
+   assign trace_trap = FD_initiate_exception;
+   assign trace_pc = FD_PC;
+   assign trace_target = nextPC;
 
-   // Flush instructions on exception.
-   assign FD_bubble = FD_initiate_exception;
+   // Flush instructions on exception. A stalled FD also issues a bubble
+   assign FD_bubble = FD_initiate_exception | FD_stall;
    // The main pipeline
    always @ (posedge clk) begin : CORE_PIPELINE
       if (!resetb) begin
 	 // Initialize stage registers with side effects
 	 XB_regwrite <= 1'b0;
 	 XB_csr_writeback <= 1'b0;
+	 XB_cop_writeback <= 1'b0;
+	 XB_amo_writeback <= 1'b0;
+	 amo_phase <= 1'b0;
+	 FD_split_busy <= 1'b0;
 	 XB_FD_exception_illegal_instruction <= 1'b0;
 	 XB_FD_exception_ecall <= 1'b0;
 	 XB_FD_exception_ebreak <= 1'b0;
@@ -330,9 +619,10 @@ module core
 	    XB_d_rs2 <= FD_d_rs2;
 	 end
 	 else begin
-	    // If Linking, the operation is PC + 4
+	    // If Linking, the operation is PC + 4, or PC + 2 for a
+	    // compressed instruction
 	    XB_d_rs1 <= FD_PC;
-	    XB_d_rs2 <= 32'h4;
+	    XB_d_rs2 <= FD_inst_compressed ? 32'h2 : 32'h4;
 	 end
 	 XB_imm <= FD_imm;
 	 XB_a_rs1 <= FD_a_rs1;
@@ -343,13 +633,22 @@ module core
 	 XB_aluop2_sel <= FD_aluop2_sel;
 	 XB_alu_op <= FD_alu_op;
 	 XB_alu_is_signed <= FD_alu_is_signed;
-	 XB_PC <= FD_PC;
+	 XB_cop_result <= cop_result;
+	 XB_amo_result <= FD_sc ? {31'b0, dm_sc_fail} : dm_do;
+	 // The read clock of an AMO was granted
+	 amo_phase <= FD_amo_stall & ~dm_stall & ~FD_mem_kill;
+	 FD_split_busy <= (FD_dm_be_hi != 3'b0) & dm_stall & ~FD_mem_kill;
+	 // The bubbles behind a waiting WFI carry the PC after it, so
+	 // that an interrupt returns past the WFI
+	 XB_PC <= FD_wfi_stall ? FD_PC + 32'd4 : FD_PC;
 	 //// Side effect signals
 	 XB_bubble <= FD_bubble;
 	 if (!FD_bubble) begin
 	    // Side effect signals propagate only if instruction is
 	    // not a bubble
 	    XB_csr_writeback <= XB_csr_read;
+	    XB_cop_writeback <= FD_cop;
+	    XB_amo_writeback <= FD_amo | FD_sc;
 	    XB_regwrite <= FD_regwrite;
 	    XB_FD_exception_illegal_instruction
 	      <= FD_exception_illegal_instruction;
@@ -19,5 +19,18 @@
  `define ALU_SRL 6
  `define ALU_SRA 7
  `define ALU_SUB 8
+ // Zbb
+ `define ALU_ANDN 9
+ `define ALU_ORN 10
+ `define ALU_XNOR 11
+ `define ALU_MIN 12
+ `define ALU_MAX 13
+ `define ALU_ROL 14
+ `define ALU_ROR 15
+ `define ALU_CLZ 16
+ `define ALU_CTZ 17
+ `define ALU_CPOP 18
+ `define ALU_REV8 19
+ `define ALU_ORCB 20
 
 `endif
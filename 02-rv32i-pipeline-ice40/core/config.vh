@@ -0,0 +1,64 @@
+`ifndef _config_vh_
+ `define _config_vh_
+
+// Build options. Override from the command line, e.g.
+// verilator -DENABLE_RVC=1, or yosys read_verilog -DENABLE_RVC=1
+
+// RV32C compressed instructions
+ `ifndef ENABLE_RVC
+  `define ENABLE_RVC 0
+ `endif
+
+// Zbb bit manipulation subset: clz, ctz, cpop, min[u], max[u], rev8,
+// orc.b, andn, orn, xnor, rol, ror, rori
+ `ifndef ENABLE_ZBB
+  `define ENABLE_ZBB 0
+ `endif
+
+// Coprocessor port for custom-0/custom-1 instructions, and the sample
+// coprocessor in coprocessor.v
+ `ifndef ENABLE_COP
+  `define ENABLE_COP 0
+ `endif
+
+// Misaligned loads and stores are split into two accesses by the MMU,
+// instead of raising Load/Store Address Misaligned
+ `ifndef ENABLE_MISALIGNED_HW
+  `define ENABLE_MISALIGNED_HW 0
+ `endif
+
+// A extension subset: LR.W, SC.W and the AMO*.W word operations
+ `ifndef ENABLE_AMO
+  `define ENABLE_AMO 0
+ `endif
+
+// Instruction fetch from SPI flash at 0x01000000, through the cache in
+// xip.v
+ `ifndef ENABLE_XIP
+  `define ENABLE_XIP 0
+ `endif
+
+// RV32E: 16 registers, x16-x31 raise Illegal Instruction
+ `ifndef ENABLE_RV32E
+  `define ENABLE_RV32E 0
+ `endif
+
+// Register file in two EBRs instead of flip-flops, read at the falling
+// edge of the clock
+ `ifndef ENABLE_RF_EBR
+  `define ENABLE_RF_EBR 0
+ `endif
+
+// Branch trace encoder of hart 0, trace.v, drained through the IO port
+// at 0x80000070
+ `ifndef ENABLE_TRACE
+  `define ENABLE_TRACE 0
+ `endif
+
+// Number of harts sharing the ROM, the data memory and the IO ports.
+// 1 or 2
+ `ifndef NUM_HARTS
+  `define NUM_HARTS 1
+ `endif
+
+`endif
@@ -6,6 +6,17 @@
  * All exceptions are handled in the XB stage. The naming prefix XB_FD_
  * means an exception originates from FD stage, but currently is in XB
  * stage.
+ *
+ * Interrupts: machine external (cause 11), timer (7) and 16 local lines
+ * (16-31), enabled by mie and shown in mip. With mtvec MODE = 1, an
+ * interrupt jumps to BASE + 4 * cause, exceptions to BASE.
+ *
+ * An interrupt is taken when it becomes pending and enabled, and again
+ * after an MRET if it is still pending then. A handler thus runs to its
+ * MRET without being taken again, and a level the handler leaves
+ * pending, or raises again, is not lost. While irq_hold is set, no
+ * interrupt is taken, and one that becomes pending meanwhile is taken
+ * after it.
  */
 
 module csr_ehu
@@ -14,7 +25,7 @@ module csr_ehu
    clk, resetb, XB_bubble,
    // Control
    read, write, set, clear, imm, a_rd,
-   initiate_exception,
+   initiate_exception, mret, irq_hold,
    // Exception In
    XB_FD_exception_illegal_instruction,
    XB_FD_exception_ecall,
@@ -22,20 +33,36 @@ module csr_ehu
    XB_FD_exception_instruction_misaligned,
    XB_FD_exception_load_misaligned,
    XB_FD_exception_store_misaligned,
-   irq_mtimecmp,
+   irq_mtimecmp, irq_external, irq_local,
    // Data
    src_dst, d_rs1, uimm, FD_aluout, 
    nextPC, XB_pc, 
-   data_out, csr_mepc, csr_mtvec
+   data_out, csr_mepc, csr_mtvec, csr_irq_wakeup
    );
 `include "core/csrlist.vh"
+`include "core/config.vh"
+   parameter
+     // RV32C: mepc keeps bit 1, misa reports C
+     ENABLE_RVC = `ENABLE_RVC,
+     // misa reports A
+     ENABLE_AMO = `ENABLE_AMO,
+     // misa reports E instead of I
+     ENABLE_RV32E = `ENABLE_RV32E,
+     // Read by mhartid
+     HART_ID = 0;
+
    input wire clk, resetb, XB_bubble;
    // CSR read, write, set, clear; imm means operand is an immediate
    // or from register
    input wire read, write, set, clear, imm;
    input wire [4:0] a_rd;
+   // MRET in FD, not a bubble
+   input wire mret;
+   // FD must not be flushed by an interrupt, e.g. a misaligned store
+   // has written its first word
+   input wire irq_hold;
    input wire [11:0] src_dst;
-   input wire [31:2] XB_pc;
+   input wire [31:1] XB_pc;
    input wire [31:0] d_rs1, FD_aluout, nextPC;
    input wire [4:0]  uimm;
    input wire	     XB_FD_exception_illegal_instruction;
@@ -45,35 +72,68 @@ module csr_ehu
    input wire	     XB_FD_exception_load_misaligned;
    input wire	     XB_FD_exception_store_misaligned;
    input wire        irq_mtimecmp;
+   // Machine external interrupt, DMA
+   input wire        irq_external;
+   // Local interrupts, mip and mie bits 16-31
+   input wire [15:0] irq_local;
    output reg [31:0] data_out;
    output reg 	     initiate_exception;
    output wire [31:0] csr_mepc;
    output wire [31:0] csr_mtvec;
+   // An enabled interrupt is pending, wakes up WFI
+   output wire 	      csr_irq_wakeup;
    reg 		      XB_exception_illegal_instruction;
-   reg [31:2] 	      mepc;
+   reg [31:1] 	      mepc /*verilator public*/;
    reg [31:0] 	      mscratch, mcause, mtval;
-   reg [31:2] 	      mtvec;
+   reg [31:2] 	      mtvec /*verilator public*/;
+   // mtvec MODE, vectored
+   reg 		      mtvec_vectored /*verilator public*/;
    reg 		      mpie, mie;
-   reg 		      mtie;
-   reg [63:0] 	      mcycle, minstret;
+   reg 		      mtie /*verilator public*/;
+   reg 		      meie /*verilator public*/;
+   reg [15:0] 	      mie_local /*verilator public*/;
+   reg [63:0] 	      mcycle /*verilator public*/;
+   reg [63:0] 	      minstret /*verilator public*/;
 
+   // Interrupts pending and enabled at the last clock, cleared by an
+   // MRET in XB so that those still pending are taken again
    reg 		     irq_mtimecmp_p;
+   reg 		     irq_external_p;
+   reg [15:0] 	     irq_local_p;
+   reg 		     XB_mret;
 
    wire 	      FD_exception, XB_exception;
-   // Output for PC update
-   assign csr_mepc = {mepc[31:2], 2'b0};
-   // Output for Machine Trap Vector Base Addr
-   assign csr_mtvec = {mtvec[31:2], 2'b0};
+   // Output for PC update. Without RV32C, mepc is word aligned
+   assign csr_mepc = {mepc[31:2], (ENABLE_RVC != 0) ? mepc[1] : 1'b0, 1'b0};
+   assign csr_irq_wakeup = (mtie & irq_mtimecmp) | (meie & irq_external)
+			   | ((mie_local & irq_local) != 16'b0);
 
    // Exception Handling Unit. XB exceptions have higher priority
    // since XB instruction is senior. XB must not be a bubble
-   reg 		      initiate_irq_mtimecmp,
+   reg 		      initiate_irq_mtimecmp, initiate_irq_external,
+		      initiate_irq_local,
 		      initiate_illinst, initiate_misaligned, 
 		      initiate_ecall, initiate_ebreak;
+   reg [15:0] 	      local_edge;
+   // Cause of the interrupt taken, without bit 31
+   reg [4:0] 	      irq_cause;
+   integer 	      i;
    always @ (*) begin : EXCEPTION_HANDLING_UNIT
-      // Timer interrupt is executed only once 
+      // Timer interrupt is executed only once, when it is both pending
+      // and enabled. One pending while mtie is 0 is taken as mtie is set
       initiate_irq_mtimecmp
-	= mtie & irq_mtimecmp & ~irq_mtimecmp_p;
+	= ~irq_hold & mtie & irq_mtimecmp & ~irq_mtimecmp_p;
+      // So is external interrupt
+      initiate_irq_external
+	= ~irq_hold & meie & irq_external & ~irq_external_p;
+      // And local interrupts, the lowest line first. A line pending
+      // while disabled is taken as its mie bit is set
+      local_edge = {16{~irq_hold}} & mie_local & irq_local & ~irq_local_p;
+      initiate_irq_local = local_edge != 16'b0;
+      irq_cause = 5'd7;
+      for (i = 15; i >= 0; i = i - 1)
+	if (local_edge[i]) irq_cause = 5'd16 + i[4:0];
+      if (initiate_irq_external) irq_cause = 5'd11;
       initiate_ecall
         = ~XB_bubble & XB_FD_exception_ecall;
       initiate_ebreak
@@ -86,8 +146,8 @@ module csr_ehu
 			XB_FD_exception_load_misaligned |
 			XB_FD_exception_store_misaligned);
 
-      initiate_exception = initiate_irq_mtimecmp 
-			   | initiate_ecall | initiate_ebreak
+      initiate_exception = initiate_irq_mtimecmp | initiate_irq_external
+			   | initiate_irq_local | initiate_ecall | initiate_ebreak
 			   | initiate_illinst | initiate_misaligned;
       //initiate_exception = initiate_illinst | initiate_misaligned;
    end
@@ -100,7 +160,16 @@ module csr_ehu
 			 XB_FD_exception_load_misaligned |
 			 XB_FD_exception_store_misaligned;
    // There exists an exception from XB stage
-   assign XB_exception = XB_exception_illegal_instruction | initiate_irq_mtimecmp;
+   assign XB_exception = XB_exception_illegal_instruction
+			 | initiate_irq_mtimecmp | initiate_irq_external
+			 | initiate_irq_local;
+
+   // Output for Machine Trap Vector Base Addr, or the vector of the
+   // interrupt
+   assign csr_mtvec = {mtvec[31:2], 2'b0}
+     + ((mtvec_vectored & (initiate_irq_mtimecmp | initiate_irq_external
+			   | initiate_irq_local))
+	? {25'b0, irq_cause, 2'b0} : 32'b0);
 
    // The operand to operate on target CSR
    wire [31:0] 	     operand;
@@ -121,23 +190,36 @@ module csr_ehu
       if (!resetb) begin
          mcycle <= 64'b0;
          minstret <= 64'b0;
-         mepc <= 30'bX;
+         mepc <= 31'bX;
          data_out <= 32'bX;
          mtvec[31:2] <= 30'h1; // or, 0x4
+	 mtvec_vectored <= 1'b0;
          // No interrupt on reset
          mpie <= 1'b0;
          mie <= 1'b0;
 	 mtie <= 1'b0;
+	 meie <= 1'b0;
+	 mie_local <= 16'b0;
          badaddr_p <= 32'bX;
          nextPC_p <= 32'bX;
 	 irq_mtimecmp_p <= 1'b0;
+	 irq_external_p <= 1'b0;
+	 irq_local_p <= 16'b0;
+	 XB_mret <= 1'b0;
       end
       else if (clk) begin
          XB_exception_illegal_instruction = 1'b0;
          mcycle <= mcycle + 64'b1;
          // On trap, mpie is updated
          if (initiate_exception) mpie <= mie;
-	 irq_mtimecmp_p <= irq_mtimecmp;
+	 XB_mret <= mret;
+	 // While held, an interrupt not taken yet stays so
+	 irq_mtimecmp_p <= ~XB_mret & mtie & irq_mtimecmp
+			   & (~irq_hold | irq_mtimecmp_p);
+	 irq_external_p <= ~XB_mret & meie & irq_external
+			   & (~irq_hold | irq_external_p);
+	 irq_local_p <= XB_mret ? 16'b0 : mie_local & irq_local
+			& (irq_hold ? irq_local_p : 16'hFFFF);
 
          if (!XB_bubble) begin
             // Instruction is committed when it is not a bubble
@@ -158,7 +240,7 @@ module csr_ehu
               if (really_read) data_out <= 32'b0;
            end
            `CSR_MHARTID: begin
-              if (really_read) data_out <= 32'b0;
+              if (really_read) data_out <= HART_ID;
            end
 	   `CSR_MSTATUS: begin
               if (really_read) 
@@ -177,21 +259,51 @@ module csr_ehu
               end
 	   end
 	   `CSR_MISA: begin
-              // 32-bit, I subset. Read RISC-V Spec Vol 2
-              if (really_read) data_out <= 32'b0100_0000_0000_0000_0000_0001_0000_0000;
+              // 32-bit, I or E subset, optionally A and C. Read RISC-V
+              // Spec Vol 2
+              if (really_read)
+		data_out <= 32'b0100_0000_0000_0000_0000_0000_0000_0000
+			    | ((ENABLE_RV32E != 0) ? 32'b1_0000
+			       : 32'b1_0000_0000)
+			    | ((ENABLE_RVC != 0) ? 32'b100 : 32'b0)
+			    | ((ENABLE_AMO != 0) ? 32'b1 : 32'b0);
 	   end
 	   `CSR_MIE: begin
-	      if (really_read) data_out <= {24'b0, mtie, 7'b0};
-	      if (really_write) mtie <= operand[7];
-	      if (really_set) mtie <= mtie | operand[7];
-	      if (really_clear) mtie <= mtie & ~operand[7];
+	      if (really_read)
+		data_out <= {mie_local, 4'b0, meie, 3'b0, mtie, 7'b0};
+	      if (really_write) begin
+		 mtie <= operand[7];
+		 meie <= operand[11];
+		 mie_local <= operand[31:16];
+	      end
+	      if (really_set) begin
+		 mtie <= mtie | operand[7];
+		 meie <= meie | operand[11];
+		 mie_local <= mie_local | operand[31:16];
+	      end
+	      if (really_clear) begin
+		 mtie <= mtie & ~operand[7];
+		 meie <= meie & ~operand[11];
+		 mie_local <= mie_local & ~operand[31:16];
+	      end
 	   end
 	   `CSR_MTVEC: begin
-	      // Direct
-	      if (really_read) data_out <= {mtvec[31:2], 2'b0};
-	      if (really_write) mtvec[31:2] <= operand[31:2];
-	      if (really_set) mtvec[31:2] <= mtvec[31:2] | operand[31:2];
-	      if (really_clear) mtvec[31:2] <= mtvec[31:2] & ~operand[31:2];
+	      // Direct or vectored. MODE 2 and 3 are reserved, and read
+	      // as direct
+	      if (really_read) data_out <= {mtvec[31:2], 1'b0, mtvec_vectored};
+	      if (really_write) begin
+		 mtvec[31:2] <= operand[31:2];
+		 mtvec_vectored <= operand[1:0] == 2'b01;
+	      end
+	      if (really_set) begin
+		 mtvec[31:2] <= mtvec[31:2] | operand[31:2];
+		 mtvec_vectored <= {operand[1], operand[0] | mtvec_vectored}
+				   == 2'b01;
+	      end
+	      if (really_clear) begin
+		 mtvec[31:2] <= mtvec[31:2] & ~operand[31:2];
+		 mtvec_vectored <= mtvec_vectored & ~operand[0];
+	      end
 	   end
 	   `CSR_MSCRATCH: begin
 	      if (really_read) data_out <= mscratch;
@@ -200,10 +312,10 @@ module csr_ehu
 	      if (really_clear) mscratch <= mscratch & ~operand;
 	   end
 	   `CSR_MEPC: begin
-	      if (really_read) data_out <= {mepc, 2'b0};
-	      if (really_write) mepc[31:2] <= operand[31:2];
-	      if (really_set) mepc[31:2] <= mepc[31:2] | operand[31:2];
-	      if (really_clear) mepc[31:2] <= mepc & ~operand[31:2];
+	      if (really_read) data_out <= csr_mepc;
+	      if (really_write) mepc[31:1] <= operand[31:1];
+	      if (really_set) mepc[31:1] <= mepc[31:1] | operand[31:1];
+	      if (really_clear) mepc[31:1] <= mepc[31:1] & ~operand[31:1];
 	   end
            `CSR_MCAUSE: begin
               if (really_read) data_out <= mcause;
@@ -218,7 +330,9 @@ module csr_ehu
               if (really_clear) mtval <= mtval & ~operand;
            end
 	   `CSR_MIP: begin
-	      if (really_read) data_out <= {24'b0, irq_mtimecmp, 7'b0};
+	      if (really_read)
+		data_out <= {irq_local, 4'b0, irq_external, 3'b0,
+			     irq_mtimecmp, 7'b0};
 	   end
 	   `CSR_MCYCLE: begin
               if (really_read) data_out <= mcycle[0+:32];
@@ -268,10 +382,13 @@ module csr_ehu
             // internal pipeline of the CSR. CSR has one stage
             // pipeline, so even though the exception is supposed to
             // happen in XB stage, a CSR exception's PC is in FD stage
-            // Note that timer interrupt has higher priority
-	    mepc <= XB_pc[31:2];
-            if (initiate_irq_mtimecmp) begin
-	       mcause <= {1'b0, 31'd7};
+            // Note that interrupts have higher priority, external
+            // before local, before timer. Interrupt causes have bit 31
+            // set
+	    mepc <= XB_pc[31:1];
+            if (initiate_irq_external | initiate_irq_local
+		| initiate_irq_mtimecmp) begin
+	       mcause <= {1'b1, 26'b0, irq_cause};
 	       mtval <= 32'b0;
             end
             else if (XB_exception_illegal_instruction) begin
@@ -280,7 +397,7 @@ module csr_ehu
             end
          end
          else if (FD_exception) begin
-            mepc <= XB_pc[31:2];
+            mepc <= XB_pc[31:1];
             if (XB_FD_exception_instruction_misaligned) begin
                mcause <= 32'd0;
                mtval <= nextPC_p;
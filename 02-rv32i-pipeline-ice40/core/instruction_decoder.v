@@ -1,9 +1,23 @@
 /*
- This module is the RV32I instruction decoder
+ This module is the RV32I instruction decoder, with the optional Zbb
+ bit manipulation subset
 
  The Instruction Decoder takes the current instruction as input,
  outputs necessary control signals and data items. It may raise
  exceptions including Illegal Instruction, and Load/Store misaligned.
+
+ With ENABLE_MISALIGNED_HW, a misaligned halfword or word access is not
+ an exception. Byte enables of the bytes past the word boundary are
+ output on dm_be_hi, and the MMU completes the access in two clocks.
+
+ With ENABLE_AMO, LR.W, SC.W and AMO*.W are decoded. Their address is
+ rs1, so the immediate is 0. The core sequences the read and the write
+ of an AMO, and writes back the SC result. A misaligned atomic raises
+ Load/Store Address Misaligned, even with ENABLE_MISALIGNED_HW.
+
+ With ENABLE_RV32E, an instruction naming x16-x31 as a source or
+ destination register raises Illegal Instruction. Fields that hold a
+ shift amount, a CSR immediate or a Zbb operation are not registers.
  */
 module instruction_decoder
   (
@@ -14,8 +28,9 @@ module instruction_decoder
    alu_is_signed, aluop1_sel, aluop2_sel, alu_op,
    pc_update, pc_mepc,
    regwrite, jump, link, jr, br,
-   dm_be, dm_we, mem_is_signed,
+   dm_be, dm_be_hi, dm_we, mem_is_signed,
    csr_read, csr_write, csr_set, csr_clear, csr_imm,
+   cop, wfi, lr, sc, amo,
    a_rs1, a_rs2, a_rd, funct3, funct7,
    // Exceptions
    // bug_invalid_instr_format_onehot,
@@ -27,6 +42,19 @@ module instruction_decoder
    );
 `include "core/aluop.vh"
 `include "core/opcode.vh"
+`include "core/config.vh"
+   parameter
+     // Decode the Zbb subset
+     ENABLE_ZBB = `ENABLE_ZBB,
+     // Send custom-0/custom-1 to the coprocessor
+     ENABLE_COP = `ENABLE_COP,
+     // Misaligned accesses are done by the MMU instead of trapping
+     ENABLE_MISALIGNED_HW = `ENABLE_MISALIGNED_HW,
+     // Decode LR/SC and AMOs
+     ENABLE_AMO = `ENABLE_AMO,
+     // Registers x16-x31 are illegal
+     ENABLE_RV32E = `ENABLE_RV32E;
+
    // The instruction to be decoded
    input wire FD_reset;
    input wire [31:0] inst;
@@ -47,12 +75,20 @@ module instruction_decoder
    output 	     br;
    // Data Memory Byte Enable
    output [3:0]      dm_be;
+   // Byte enable of the next word, for a misaligned access
+   output [2:0]      dm_be_hi;
    // Data Memory write enable
    output 	     dm_we;
    // Treat memory item as Signed/Unsigned
    output 	     mem_is_signed;
    // Control Status Register operations
    output 	     csr_read, csr_write, csr_set, csr_clear, csr_imm;
+   // Custom instruction executed by the coprocessor
+   output 	     cop;
+   // Wait For Interrupt
+   output 	     wfi;
+   // Load Reserved, Store Conditional, Atomic read-modify-write
+   output 	     lr, sc, amo;
    // Register address: RS1, RS2, Rd writeback
    output [4:0]      a_rs1, a_rs2, a_rd;
    // The funct3 field
@@ -90,6 +126,9 @@ module instruction_decoder
 	`AUIPC: instr_IURJBS = 6'b010000;
 	// R-Types
 	`OP: instr_IURJBS = 6'b001000;
+	`CUST_0: instr_IURJBS = 6'b001000;
+	`CUST_1: instr_IURJBS = 6'b001000;
+	`AMO: instr_IURJBS = 6'b001000;
 	// J-Types
 	`JAL: instr_IURJBS = 6'b000100;
 	// B-Types
@@ -118,7 +157,8 @@ module instruction_decoder
 	       : {{21{inst[31]}}, inst[30:20]};
 	end
 	6'b010000: immediate = {inst[31:12], 12'b0};
-	6'b001000: immediate = 32'bX;
+	// The address of an atomic is rs1 + 0
+	6'b001000: immediate = (opcode[6:2] == `AMO) ? 32'b0 : 32'bX;
 	6'b000100: immediate = {{12{inst[31]}}, inst[19:12], inst[20], inst[30:21], 1'b0};
 	6'b000010: immediate = {{20{inst[31]}}, inst[7], inst[30:25], inst[11:8], 1'b0};
 	6'b000001: immediate = {{21{inst[31]}}, inst[30:25], inst[11:8], inst[7]};
@@ -135,9 +175,13 @@ module instruction_decoder
    reg 	      alu_is_signed, pc_update, pc_mepc, regwrite, jump, link, jr;
    reg 	      br;
    reg [3:0]  dm_be;
+   reg [2:0]  dm_be_hi;
    reg 	      dm_we;
    reg 	      mem_is_signed;
    reg 	      csr_read, csr_write, csr_set, csr_clear, csr_imm;
+   reg 	      cop;
+   reg 	      wfi;
+   reg 	      lr, sc, amo;
    
    reg [4:0]  a_rs1, a_rs2, a_rd;
    reg 	      exception_illegal_instruction;
@@ -162,6 +206,7 @@ module instruction_decoder
       pc_mepc = 1'b0;
       // Default memory actions
       dm_be = 4'b0;
+      dm_be_hi = 3'b0;
       dm_we = 1'b0;
       mem_is_signed = 1'b0;
       // Default branch actions
@@ -175,6 +220,12 @@ module instruction_decoder
       csr_set = 1'b0;
       csr_clear = 1'b0;
       csr_imm = 1'b0;
+      // Default no coprocessor
+      cop = 1'b0;
+      wfi = 1'b0;
+      lr = 1'b0;
+      sc = 1'b0;
+      amo = 1'b0;
       // Default no exception
       exception_illegal_instruction = 1'b0;
       exception_load_misaligned = 1'b0;
@@ -192,8 +243,19 @@ module instruction_decoder
               3'b000: begin : ADDI
                 alu_op = `ALU_ADD;
               end
-              3'b001: begin : SLLI
-                alu_op = `ALU_SLL;
+              3'b001: begin : SLLI_CLZ_CTZ_CPOP
+                if (ENABLE_ZBB != 0 && funct7 == 7'b0110000) begin
+                  // Zbb unary operations, selected by the rs2 field
+                  case (inst[24:20])
+                    5'b00000: alu_op = `ALU_CLZ;
+                    5'b00001: alu_op = `ALU_CTZ;
+                    5'b00010: alu_op = `ALU_CPOP;
+                    default: exception_illegal_instruction = 1'b1;
+                  endcase // case (inst[24:20])
+                end
+                else begin
+                  alu_op = `ALU_SLL;
+                end
               end
               3'b010: begin : SLTI
                 alu_op = `ALU_SLT;
@@ -205,8 +267,15 @@ module instruction_decoder
               3'b100: begin : XORI
                 alu_op = `ALU_XOR;
               end
-              3'b101: begin : SRLI_SRAI
-                alu_op = inst[30] ? `ALU_SRA : `ALU_SRL;
+              3'b101: begin : SRLI_SRAI_RORI_REV8_ORCB
+                if (ENABLE_ZBB != 0 && funct7 == 7'b0110000)
+                  alu_op = `ALU_ROR;
+                else if (ENABLE_ZBB != 0 && inst[31:20] == 12'h698)
+                  alu_op = `ALU_REV8;
+                else if (ENABLE_ZBB != 0 && inst[31:20] == 12'h287)
+                  alu_op = `ALU_ORCB;
+                else
+                  alu_op = inst[30] ? `ALU_SRA : `ALU_SRL;
               end
               3'b110: begin : ORI
                 alu_op = `ALU_OR;
@@ -246,8 +315,9 @@ module instruction_decoder
                   alu_op = `ALU_ADD;
                 end
               end
-              3'b001: begin : SLL
-                alu_op = `ALU_SLL;
+              3'b001: begin : SLL_ROL
+                alu_op = (ENABLE_ZBB != 0 && funct7 == 7'b0110000)
+                  ? `ALU_ROL : `ALU_SLL;
               end
               3'b010: begin : SLT
                 alu_op = `ALU_SLT;
@@ -256,11 +326,23 @@ module instruction_decoder
                 alu_op = `ALU_SLT;
                 alu_is_signed = 1'b0;
               end
-              3'b100: begin : XOR
-                alu_op = `ALU_XOR;
+              3'b100: begin : XOR_XNOR_MIN
+                if (ENABLE_ZBB != 0 && funct7 == 7'b0100000)
+                  alu_op = `ALU_XNOR;
+                else if (ENABLE_ZBB != 0 && funct7 == 7'b0000101)
+                  alu_op = `ALU_MIN;
+                else
+                  alu_op = `ALU_XOR;
               end
-              3'b101: begin : SRL_SRA
-                alu_op = funct7[5] ? `ALU_SRA : `ALU_SRL;
+              3'b101: begin : SRL_SRA_ROR_MINU
+                if (ENABLE_ZBB != 0 && funct7 == 7'b0110000)
+                  alu_op = `ALU_ROR;
+                else if (ENABLE_ZBB != 0 && funct7 == 7'b0000101) begin
+                  alu_op = `ALU_MIN;
+                  alu_is_signed = 1'b0;
+                end
+                else
+                  alu_op = funct7[5] ? `ALU_SRA : `ALU_SRL;
                 // if (funct7[5]) begin : SRA
                 //    alu_op = `ALU_SRA;
                 // end
@@ -268,11 +350,23 @@ module instruction_decoder
                 //    alu_op = `ALU_SRL;
                 // end
               end
-              3'b110: begin : OR
-                alu_op = `ALU_OR;
+              3'b110: begin : OR_ORN_MAX
+                if (ENABLE_ZBB != 0 && funct7 == 7'b0100000)
+                  alu_op = `ALU_ORN;
+                else if (ENABLE_ZBB != 0 && funct7 == 7'b0000101)
+                  alu_op = `ALU_MAX;
+                else
+                  alu_op = `ALU_OR;
               end
-              3'b111: begin : AND
-                alu_op = `ALU_AND;
+              3'b111: begin : AND_ANDN_MAXU
+                if (ENABLE_ZBB != 0 && funct7 == 7'b0100000)
+                  alu_op = `ALU_ANDN;
+                else if (ENABLE_ZBB != 0 && funct7 == 7'b0000101) begin
+                  alu_op = `ALU_MAX;
+                  alu_is_signed = 1'b0;
+                end
+                else
+                  alu_op = `ALU_AND;
               end
             endcase // case (funct3)
           end
@@ -333,14 +427,24 @@ module instruction_decoder
               end
               3'b001, 3'b101: begin : LH
                 mem_is_signed = (funct3 == 3'b001) ? 1'b1 : 1'b0;
-                exception_load_misaligned = aluout_1_0[0] ? 1'b1 : 1'b0;
-                dm_be = aluout_1_0[0] ? 4'b0000
-                : aluout_1_0[1] ? 4'b1100 : 4'b0011;
+                if (ENABLE_MISALIGNED_HW != 0) begin
+                  {dm_be_hi, dm_be} = 7'b0000011 << aluout_1_0;
+                end
+                else begin
+                  exception_load_misaligned = aluout_1_0[0] ? 1'b1 : 1'b0;
+                  dm_be = aluout_1_0[0] ? 4'b0000
+                  : aluout_1_0[1] ? 4'b1100 : 4'b0011;
+                end
               end
               3'b010: begin : LW
-                dm_be = 4'b1111;
-                exception_load_misaligned 
-                = (aluout_1_0[0] | aluout_1_0[1]) ? 1'b1 : 1'b0;
+                if (ENABLE_MISALIGNED_HW != 0) begin
+                  {dm_be_hi, dm_be} = 7'b0001111 << aluout_1_0;
+                end
+                else begin
+                  dm_be = 4'b1111;
+                  exception_load_misaligned 
+                  = (aluout_1_0[0] | aluout_1_0[1]) ? 1'b1 : 1'b0;
+                end
               end
               default: begin 
               exception_illegal_instruction = 1'b1;
@@ -368,14 +472,24 @@ module instruction_decoder
               endcase // case (aluout_1_0[1:0])
             end
             3'b001: begin : SH
-              exception_store_misaligned = aluout_1_0[0] ? 1'b1 : 1'b0;
-              dm_be = aluout_1_0[0] ? 4'b0
-              : aluout_1_0[1] ? 4'b1100 : 4'b0011;
+              if (ENABLE_MISALIGNED_HW != 0) begin
+                {dm_be_hi, dm_be} = 7'b0000011 << aluout_1_0;
+              end
+              else begin
+                exception_store_misaligned = aluout_1_0[0] ? 1'b1 : 1'b0;
+                dm_be = aluout_1_0[0] ? 4'b0
+                : aluout_1_0[1] ? 4'b1100 : 4'b0011;
+              end
             end
             3'b010: begin : SW
-              dm_be = 4'b1111;
-              exception_store_misaligned
-              = (aluout_1_0[0] | aluout_1_0[1]) ? 1'b1 : 1'b0;
+              if (ENABLE_MISALIGNED_HW != 0) begin
+                {dm_be_hi, dm_be} = 7'b0001111 << aluout_1_0;
+              end
+              else begin
+                dm_be = 4'b1111;
+                exception_store_misaligned
+                = (aluout_1_0[0] | aluout_1_0[1]) ? 1'b1 : 1'b0;
+              end
             end
             default: begin 
             exception_illegal_instruction = 1'b1;
@@ -385,6 +499,51 @@ module instruction_decoder
       `MISC_MEM: begin
         // NOP since this core is in order commit
       end
+      `CUST_0, `CUST_1: begin
+        // The coprocessor computes rd from rs1 and rs2
+        if (ENABLE_COP != 0) begin
+          cop = 1'b1;
+          regwrite = 1'b1;
+        end
+        else begin
+          exception_illegal_instruction = 1'b1;
+        end
+      end
+      `AMO: begin
+        // Word atomics. aq/rl are ignored, since memory accesses are
+        // done in program order. A misaligned one accesses nothing
+        regwrite = 1'b1;
+        if (ENABLE_AMO != 0 && funct3 == 3'b010) begin
+          case (inst[31:27])
+            5'b00010: begin : LR_W
+              mem_is_signed = 1'b1;
+              exception_load_misaligned = aluout_1_0 != 2'b00;
+              exception_illegal_instruction = inst[24:20] != 5'b0;
+              lr = aluout_1_0 == 2'b00;
+              dm_be = lr ? 4'b1111 : 4'b0;
+            end
+            5'b00011: begin : SC_W
+              exception_store_misaligned = aluout_1_0 != 2'b00;
+              sc = aluout_1_0 == 2'b00;
+              dm_be = sc ? 4'b1111 : 4'b0;
+              dm_we = 1'b1;
+            end
+            5'b00000, 5'b00001, 5'b00100, 5'b01000, 5'b01100,
+              5'b10000, 5'b10100, 5'b11000, 5'b11100: begin : AMO_W
+              // The core writes in the clock after the read
+              exception_store_misaligned = aluout_1_0 != 2'b00;
+              amo = aluout_1_0 == 2'b00;
+              dm_be = amo ? 4'b1111 : 4'b0;
+            end
+            default: begin
+              exception_illegal_instruction = 1'b1;
+            end
+          endcase // case (inst[31:27])
+        end
+        else begin
+          exception_illegal_instruction = 1'b1;
+        end
+      end
       `SYSTEM: begin
         // Environment instructions are implemented via software
         // trap
@@ -397,8 +556,12 @@ module instruction_decoder
                 exception_ebreak = immediate[0];
               end
               7'b0001000: begin : SRET_WFI
-                // Software trap
-                exception_illegal_instruction = 1'b1;
+                // WFI stalls FD until an interrupt is pending.
+                // SRET traps, no S-mode
+                if (inst[24:20] == 5'b00101)
+                  wfi = 1'b1;
+                else
+                  exception_illegal_instruction = 1'b1;
               end
               7'b0011000: begin : MRET
                 // MRET jumps to MEPC
@@ -456,6 +619,18 @@ module instruction_decoder
 end 
       /* verilator lint_on CASEOVERLAP */
 
+      // RV32E has 16 registers. rs1 is read by all but the U and J
+      // types and the CSR immediate forms, rs2 by the R, B and S types
+      if (ENABLE_RV32E != 0 && !FD_reset
+	  && (  (regwrite & inst[11])
+	      | (inst[19] & (instr_IURJBS[5] | instr_IURJBS[3]
+			     | instr_IURJBS[1] | instr_IURJBS[0])
+		 & ~csr_imm)
+	      | (inst[24] & (instr_IURJBS[3] | instr_IURJBS[1]
+			     | instr_IURJBS[0])))) begin
+	 exception_illegal_instruction = 1'b1;
+      end
+
       if (  exception_illegal_instruction
 	  | exception_load_misaligned
 	  | exception_store_misaligned) begin
@@ -0,0 +1,190 @@
+/*
+ This module is the RV32C compressed instruction expander
+
+ The expander sits in front of the instruction decoder. A 16-bit
+ instruction (lowest two bits not 11) is rewritten into its 32-bit
+ RV32I equivalent, so the decoder and the rest of the pipeline do not
+ need to know about the C extension. A 32-bit instruction passes
+ through unchanged.
+
+ Reserved and floating point encodings expand into an instruction with
+ a reserved major opcode, so that the decoder raises Illegal Instruction.
+ Read the RISC-V Spec Vol 1, Chapter 12 for details.
+ */
+module rvc_expander
+  (
+   input wire [31:0] inst_in,
+   output reg [31:0] inst_out,
+   output wire 	     is_compressed
+   );
+
+   // Major opcodes of the expanded instructions
+   localparam
+     OPC_LOAD = 7'b0000011,
+     OPC_OP_IMM = 7'b0010011,
+     OPC_STORE = 7'b0100011,
+     OPC_OP = 7'b0110011,
+     OPC_LUI = 7'b0110111,
+     OPC_BRANCH = 7'b1100011,
+     OPC_JALR = 7'b1100111,
+     OPC_JAL = 7'b1101111,
+     // RES_0, always decoded as illegal
+     OPC_ILLEGAL = 7'b1010111;
+
+   wire [15:0] c;
+   assign c = inst_in[15:0];
+   assign is_compressed = c[1:0] != 2'b11;
+
+   // Full and popular (x8-x15) register fields
+   wire [4:0]  rd, rs2, rd_p, rs2_p;
+   assign rd = c[11:7];
+   assign rs2 = c[6:2];
+   assign rd_p = {2'b01, c[9:7]};
+   assign rs2_p = {2'b01, c[4:2]};
+
+   // Immediates, already sign/zero extended to the width of the
+   // 32-bit instruction field they are placed into
+   wire [11:0] imm_ci, imm_addi4spn, imm_lw, imm_lwsp, imm_swsp, imm_addi16sp;
+   wire [20:0] imm_cj;
+   wire [12:0] imm_cb;
+   wire [19:0] imm_lui;
+   assign imm_ci = {{7{c[12]}}, c[6:2]};
+   assign imm_addi4spn = {2'b0, c[10:7], c[12:11], c[5], c[6], 2'b0};
+   assign imm_lw = {5'b0, c[5], c[12:10], c[6], 2'b0};
+   assign imm_lwsp = {4'b0, c[3:2], c[12], c[6:4], 2'b0};
+   assign imm_swsp = {4'b0, c[8:7], c[12:9], 2'b0};
+   assign imm_addi16sp = {{3{c[12]}}, c[4:3], c[5], c[2], c[6], 4'b0};
+   assign imm_cj = {{10{c[12]}}, c[8], c[10:9], c[6], c[7], c[2], c[11],
+		    c[5:3], 1'b0};
+   assign imm_cb = {{5{c[12]}}, c[6:5], c[2], c[11:10], c[4:3], 1'b0};
+   assign imm_lui = {{15{c[12]}}, c[6:2]};
+
+   localparam INST_ILLEGAL = {25'b0, OPC_ILLEGAL};
+
+   always @ (*) begin : EXPAND
+      inst_out = INST_ILLEGAL;
+      if (!is_compressed) begin
+	 inst_out = inst_in;
+      end
+      else begin
+	 case ({c[1:0], c[15:13]})
+	   // Quadrant 0
+	   5'b00_000: begin : C_ADDI4SPN
+	      // addi rd', x2, nzuimm
+	      if (imm_addi4spn != 12'b0)
+		inst_out = {imm_addi4spn, 5'd2, 3'b000, rs2_p, OPC_OP_IMM};
+	   end
+	   5'b00_010: begin : C_LW
+	      // lw rd', uimm(rs1')
+	      inst_out = {imm_lw, rd_p, 3'b010, rs2_p, OPC_LOAD};
+	   end
+	   5'b00_110: begin : C_SW
+	      // sw rs2', uimm(rs1')
+	      inst_out = {imm_lw[11:5], rs2_p, rd_p, 3'b010, imm_lw[4:0],
+			  OPC_STORE};
+	   end
+	   // Quadrant 1
+	   5'b01_000: begin : C_ADDI
+	      // addi rd, rd, imm. C.NOP when rd is x0
+	      inst_out = {imm_ci, rd, 3'b000, rd, OPC_OP_IMM};
+	   end
+	   5'b01_001, 5'b01_101: begin : C_JAL_J
+	      // jal x1/x0, offset
+	      inst_out = {imm_cj[20], imm_cj[10:1], imm_cj[11], imm_cj[19:12],
+			  c[15] ? 5'd0 : 5'd1, OPC_JAL};
+	   end
+	   5'b01_010: begin : C_LI
+	      // addi rd, x0, imm
+	      inst_out = {imm_ci, 5'd0, 3'b000, rd, OPC_OP_IMM};
+	   end
+	   5'b01_011: begin : C_ADDI16SP_LUI
+	      if (rd == 5'd2) begin
+		 // addi x2, x2, nzimm
+		 if (imm_addi16sp != 12'b0)
+		   inst_out = {imm_addi16sp, 5'd2, 3'b000, 5'd2, OPC_OP_IMM};
+	      end
+	      else begin
+		 // lui rd, nzimm
+		 if (imm_lui != 20'b0)
+		   inst_out = {imm_lui, rd, OPC_LUI};
+	      end
+	   end
+	   5'b01_100: begin : C_MISC_ALU
+	      case (c[11:10])
+		2'b00, 2'b01: begin : C_SRLI_SRAI
+		   // shamt[5] must be zero on RV32
+		   if (!c[12])
+		     inst_out = {1'b0, c[10], 5'b0, c[6:2], rd_p, 3'b101, rd_p,
+				 OPC_OP_IMM};
+		end
+		2'b10: begin : C_ANDI
+		   inst_out = {imm_ci, rd_p, 3'b111, rd_p, OPC_OP_IMM};
+		end
+		2'b11: begin : C_SUB_XOR_OR_AND
+		   // c[12] set are RV64 only
+		   if (!c[12]) begin
+		      case (c[6:5])
+			2'b00: inst_out = {7'b0100000, rs2_p, rd_p, 3'b000, rd_p, OPC_OP};
+			2'b01: inst_out = {7'b0000000, rs2_p, rd_p, 3'b100, rd_p, OPC_OP};
+			2'b10: inst_out = {7'b0000000, rs2_p, rd_p, 3'b110, rd_p, OPC_OP};
+			2'b11: inst_out = {7'b0000000, rs2_p, rd_p, 3'b111, rd_p, OPC_OP};
+		      endcase // case (c[6:5])
+		   end
+		end
+	      endcase // case (c[11:10])
+	   end
+	   5'b01_110, 5'b01_111: begin : C_BEQZ_BNEZ
+	      // beq/bne rs1', x0, offset
+	      inst_out = {imm_cb[12], imm_cb[10:5], 5'd0, rd_p, 2'b00, c[13],
+			  imm_cb[4:1], imm_cb[11], OPC_BRANCH};
+	   end
+	   // Quadrant 2
+	   5'b10_000: begin : C_SLLI
+	      if (!c[12])
+		inst_out = {7'b0, c[6:2], rd, 3'b001, rd, OPC_OP_IMM};
+	   end
+	   5'b10_010: begin : C_LWSP
+	      // lw rd, uimm(x2). rd must not be x0
+	      if (rd != 5'd0)
+		inst_out = {imm_lwsp, 5'd2, 3'b010, rd, OPC_LOAD};
+	   end
+	   5'b10_100: begin : C_JR_MV_EBREAK_JALR_ADD
+	      if (!c[12]) begin
+		 if (rs2 == 5'd0) begin
+		    // jalr x0, 0(rs1). rs1 must not be x0
+		    if (rd != 5'd0)
+		      inst_out = {12'b0, rd, 3'b000, 5'd0, OPC_JALR};
+		 end
+		 else begin
+		    // add rd, x0, rs2
+		    inst_out = {7'b0, rs2, 5'd0, 3'b000, rd, OPC_OP};
+		 end
+	      end
+	      else begin
+		 if (rs2 == 5'd0) begin
+		    if (rd == 5'd0)
+		      inst_out = 32'h00100073; // ebreak
+		    else
+		      // jalr x1, 0(rs1)
+		      inst_out = {12'b0, rd, 3'b000, 5'd1, OPC_JALR};
+		 end
+		 else begin
+		    // add rd, rd, rs2
+		    inst_out = {7'b0, rs2, rd, 3'b000, rd, OPC_OP};
+		 end
+	      end
+	   end
+	   5'b10_110: begin : C_SWSP
+	      // sw rs2, uimm(x2)
+	      inst_out = {imm_swsp[11:5], rs2, 5'd2, 3'b010, imm_swsp[4:0],
+			  OPC_STORE};
+	   end
+	   default: begin
+	      // Floating point and reserved encodings
+	      inst_out = INST_ILLEGAL;
+	   end
+	 endcase // case ({c[1:0], c[15:13]})
+      end
+   end // block: EXPAND
+
+endmodule // rvc_expander
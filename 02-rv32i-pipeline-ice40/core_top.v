@@ -1,6 +1,16 @@
 /*
-Top module of CPU core. Connects the core and MMU
+Top module of CPU core. Connects the core, MMU and the optional
+coprocessor
+
+With NUM_HARTS = 2, a second core with its own register file and CSRs
+fetches from the same ROM. The data accesses of both harts go through
+the arbiter to the MMU. Hart 1 has its own mtimecmp, and the external
+interrupt goes to hart 0 only. Both harts start at the reset vector,
+and read mhartid to tell each other apart. Only hart 0 fetches from
+the XIP flash.
 */
+`include "core/config.vh"
+
 module core_top
 (
   input wire 	      clk, 
@@ -9,46 +19,244 @@ module core_top
   //input wire [31:0]  rom_data, 
   //output wire [13:2] rom_addr_2, 
   //input wire [31:0]  rom_data_2, 
-  output wire [7:0]  io_addr,
-  output wire 	      io_en, 
-  output wire 	      io_we, 
-  input wire [31:0]  io_data_read, 
-  output wire [31:0] io_data_write,
-  input wire irq_mtimecmp
+  // IO bus master
+  output wire 	      wb_stb,
+  output wire 	      wb_we,
+  output wire [7:2]  wb_adr,
+  output wire [3:0]  wb_sel,
+  output wire [31:0] wb_dat_w,
+  input wire [31:0]  wb_dat_r,
+  input wire 	      wb_ack,
+  input wire irq_mtimecmp,
+  input wire irq_external,
+  // Local interrupts of hart 0
+  input wire [15:0] irq_local,
+  // Timer interrupt of hart 1, unused with NUM_HARTS = 1
+  /* verilator lint_off UNUSED */
+  input wire irq_mtimecmp1,
+  /* verilator lint_on UNUSED */
+  // DMA master port
+  input wire dma_req,
+  input wire [31:0] dma_addr,
+  input wire dma_we,
+  input wire [31:0] dma_di,
+  output wire dma_gnt,
+  output wire [31:0] dma_do,
+  // SPI flash of XIP
+  output wire flash_csb,
+  output wire flash_clk,
+  output wire [3:0] flash_io_oe,
+  output wire [3:0] flash_io_do,
+  input wire [3:0] flash_io_di,
+  // Branch trace of hart 0
+  output wire trace_valid,
+  output wire trace_br,
+  output wire trace_taken,
+  output wire trace_jr,
+  output wire trace_trap,
+  output wire [31:0] trace_pc,
+  output wire [31:0] trace_target
   //input wire mtime_we,
   //output wire [31:0] mtime_dout
 );
 
+// Arbiter to MMU
 wire 	      dm_we;
-wire [31:0] 	      im_addr;
-wire [31:0] 	      im_do;
 wire [31:0] 	      dm_addr;
 wire [31:0] 	      dm_di;
 wire [31:0] 	      dm_do;
 wire [3:0] 	      dm_be;
+wire [2:0] 	      dm_be_hi;
+wire 	      dm_stall;
 wire 	      dm_is_signed;
+// Hart 0
+wire 	      dm_we_0;
+wire [31:0] 	      im_addr;
+wire [31:0] 	      im_do;
+wire 	      im_valid;
+wire [31:0] 	      dm_addr_0;
+wire [31:0] 	      dm_di_0;
+wire [3:0] 	      dm_be_0;
+wire [2:0] 	      dm_be_hi_0;
+wire 	      dm_stall_0;
+wire 	      dm_is_signed_0;
+wire 	      dm_lock_0, dm_lr_0, dm_sc_0, dm_sc_fail_0;
+// Unused without ENABLE_COP
+/* verilator lint_off UNUSED */
+wire 	      cop_valid;
+wire [31:0] 	      cop_inst, cop_rs1, cop_rs2;
+/* verilator lint_on UNUSED */
+wire 	      cop_ready;
+wire [31:0] 	      cop_result;
+// Hart 1, tied off with NUM_HARTS = 1
+wire 	      dm_we_1;
+wire [31:0] 	      im_addr_1;
+/* verilator lint_off UNUSED */
+wire [31:0] 	      im_do_1;
+wire 	      dm_stall_1, dm_sc_fail_1;
+/* verilator lint_on UNUSED */
+wire [31:0] 	      dm_addr_1;
+wire [31:0] 	      dm_di_1;
+wire [3:0] 	      dm_be_1;
+wire [2:0] 	      dm_be_hi_1;
+wire 	      dm_is_signed_1;
+wire 	      dm_lock_1, dm_lr_1, dm_sc_1;
+// Statistics for the simulator
+/* verilator lint_off UNUSED */
+wire [1:0] 	      hart_retire /*verilator public*/;
+wire [1:0] 	      hart_arb_stall /*verilator public*/;
+wire [1:0] 	      num_harts /*verilator public*/;
+/* verilator lint_on UNUSED */
+
+parameter ENABLE_COP = `ENABLE_COP;
+parameter NUM_HARTS = `NUM_HARTS;
+
+assign num_harts = NUM_HARTS[1:0];
 
 core CPU0
 (
   .clk(clk), .resetb(resetb),
-  .dm_we(dm_we), .im_addr(im_addr), .im_do(im_do),
-  .dm_addr(dm_addr), .dm_di(dm_di), .dm_do(dm_do),
-  .dm_be(dm_be), .dm_is_signed(dm_is_signed),
-  .irq_mtimecmp(irq_mtimecmp)
+  .dm_we(dm_we_0), .im_addr(im_addr), .im_do(im_do), .im_valid(im_valid),
+  .dm_addr(dm_addr_0), .dm_di(dm_di_0), .dm_do(dm_do),
+  .dm_be(dm_be_0), .dm_is_signed(dm_is_signed_0),
+  .dm_be_hi(dm_be_hi_0), .dm_stall(dm_stall_0),
+  .dm_lock(dm_lock_0), .dm_lr(dm_lr_0), .dm_sc(dm_sc_0),
+  .dm_sc_fail(dm_sc_fail_0),
+  .irq_mtimecmp(irq_mtimecmp), .irq_external(irq_external),
+  .irq_local(irq_local),
+  .cop_valid(cop_valid), .cop_inst(cop_inst),
+  .cop_rs1(cop_rs1), .cop_rs2(cop_rs2),
+  .cop_ready(cop_ready), .cop_result(cop_result),
+  .retire(hart_retire[0]),
+  .trace_valid(trace_valid), .trace_br(trace_br),
+  .trace_taken(trace_taken), .trace_jr(trace_jr),
+  .trace_trap(trace_trap), .trace_pc(trace_pc),
+  .trace_target(trace_target)
+);
+
+generate
+  if (ENABLE_COP != 0) begin : COP
+    coprocessor COP0
+    (
+      .clk(clk), .resetb(resetb),
+      .cop_valid(cop_valid), .cop_inst(cop_inst),
+      .cop_rs1(cop_rs1), .cop_rs2(cop_rs2),
+      .cop_ready(cop_ready), .cop_result(cop_result)
+    );
+  end
+  else begin : NO_COP
+    // Never reached, custom instructions are illegal without ENABLE_COP
+    assign cop_ready = 1'b0;
+    assign cop_result = 32'b0;
+  end
+endgenerate
+
+generate
+  if (NUM_HARTS > 1) begin : HART1
+    // Unused without ENABLE_COP
+    /* verilator lint_off UNUSED */
+    wire cop_valid_1;
+    wire [31:0] cop_inst_1, cop_rs1_1, cop_rs2_1;
+    /* verilator lint_on UNUSED */
+    wire cop_ready_1;
+    wire [31:0] cop_result_1;
+    // Only hart 0 is traced
+    /* verilator lint_off UNUSED */
+    wire trace_valid_1, trace_br_1, trace_taken_1, trace_jr_1;
+    wire trace_trap_1;
+    wire [31:0] trace_pc_1, trace_target_1;
+    /* verilator lint_on UNUSED */
+
+    core #(.HART_ID(1)) CPU1
+    (
+      .clk(clk), .resetb(resetb),
+      .dm_we(dm_we_1), .im_addr(im_addr_1), .im_do(im_do_1), .im_valid(1'b1),
+      .dm_addr(dm_addr_1), .dm_di(dm_di_1), .dm_do(dm_do),
+      .dm_be(dm_be_1), .dm_is_signed(dm_is_signed_1),
+      .dm_be_hi(dm_be_hi_1), .dm_stall(dm_stall_1),
+      .dm_lock(dm_lock_1), .dm_lr(dm_lr_1), .dm_sc(dm_sc_1),
+      .dm_sc_fail(dm_sc_fail_1),
+      .irq_mtimecmp(irq_mtimecmp1), .irq_external(1'b0),
+      .irq_local(16'b0),
+      .cop_valid(cop_valid_1), .cop_inst(cop_inst_1),
+      .cop_rs1(cop_rs1_1), .cop_rs2(cop_rs2_1),
+      .cop_ready(cop_ready_1), .cop_result(cop_result_1),
+      .retire(hart_retire[1]),
+      .trace_valid(trace_valid_1), .trace_br(trace_br_1),
+      .trace_taken(trace_taken_1), .trace_jr(trace_jr_1),
+      .trace_trap(trace_trap_1), .trace_pc(trace_pc_1),
+      .trace_target(trace_target_1)
+    );
+
+    if (ENABLE_COP != 0) begin : COP
+      coprocessor COP1
+      (
+        .clk(clk), .resetb(resetb),
+        .cop_valid(cop_valid_1), .cop_inst(cop_inst_1),
+        .cop_rs1(cop_rs1_1), .cop_rs2(cop_rs2_1),
+        .cop_ready(cop_ready_1), .cop_result(cop_result_1)
+      );
+    end
+    else begin : NO_COP
+      assign cop_ready_1 = 1'b0;
+      assign cop_result_1 = 32'b0;
+    end
+  end
+  else begin : NO_HART1
+    assign dm_we_1 = 1'b0;
+    assign im_addr_1 = 32'b0;
+    assign dm_addr_1 = 32'b0;
+    assign dm_di_1 = 32'b0;
+    assign dm_be_1 = 4'b0;
+    assign dm_be_hi_1 = 3'b0;
+    assign dm_is_signed_1 = 1'b0;
+    assign dm_lock_1 = 1'b0;
+    assign dm_lr_1 = 1'b0;
+    assign dm_sc_1 = 1'b0;
+    assign hart_retire[1] = 1'b0;
+  end
+endgenerate
+
+arbiter ARB0
+(
+  .clk(clk), .resetb(resetb),
+  .dm_we_0(dm_we_0), .dm_addr_0(dm_addr_0), .dm_di_0(dm_di_0),
+  .dm_be_0(dm_be_0), .dm_be_hi_0(dm_be_hi_0),
+  .dm_is_signed_0(dm_is_signed_0), .dm_lock_0(dm_lock_0),
+  .dm_lr_0(dm_lr_0), .dm_sc_0(dm_sc_0),
+  .dm_stall_0(dm_stall_0), .dm_sc_fail_0(dm_sc_fail_0),
+  .dm_we_1(dm_we_1), .dm_addr_1(dm_addr_1), .dm_di_1(dm_di_1),
+  .dm_be_1(dm_be_1), .dm_be_hi_1(dm_be_hi_1),
+  .dm_is_signed_1(dm_is_signed_1), .dm_lock_1(dm_lock_1),
+  .dm_lr_1(dm_lr_1), .dm_sc_1(dm_sc_1),
+  .dm_stall_1(dm_stall_1), .dm_sc_fail_1(dm_sc_fail_1),
+  .dm_we(dm_we), .dm_addr(dm_addr), .dm_di(dm_di),
+  .dm_be(dm_be), .dm_be_hi(dm_be_hi), .dm_is_signed(dm_is_signed),
+  .mmu_stall(dm_stall), .arb_stall(hart_arb_stall)
 );
 
 mmu MMU0
 (
   .clk(clk), .resetb(resetb),
   .dm_we(dm_we),
-  .im_addr(im_addr), .im_do(im_do),
+  .im_addr(im_addr), .im_do(im_do), .im_valid(im_valid),
+  .im_addr_1(im_addr_1), .im_do_1(im_do_1),
   .dm_addr(dm_addr), .dm_di(dm_di), .dm_do(dm_do),
   .dm_be(dm_be), .is_signed(dm_is_signed),
+  .dm_be_hi(dm_be_hi), .dm_stall(dm_stall),
   //.im_addr_out(rom_addr), .im_data(rom_data),
   //.im_addr_out_2(rom_addr_2), .im_data_2(rom_data_2),
-  .io_addr(io_addr), .io_en(io_en), .io_we(io_we),
-  .io_data_read(io_data_read), .io_data_write(io_data_write)
+  .wb_stb(wb_stb), .wb_we(wb_we), .wb_adr(wb_adr), .wb_sel(wb_sel),
+  .wb_dat_w(wb_dat_w), .wb_dat_r(wb_dat_r), .wb_ack(wb_ack),
+  .dma_req(dma_req), .dma_addr(dma_addr), .dma_we(dma_we),
+  .dma_di(dma_di), .dma_gnt(dma_gnt),
+  .flash_csb(flash_csb), .flash_clk(flash_clk),
+  .flash_io_oe(flash_io_oe), .flash_io_do(flash_io_do),
+  .flash_io_di(flash_io_di)
 );
 
+// DMA reads come back like core loads
+assign dma_do = dm_do;
+
 
 endmodule
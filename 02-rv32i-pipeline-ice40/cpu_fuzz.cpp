@@ -0,0 +1,966 @@
+// Coverage guided differential fuzzer of cpu_top against iss.h
+//
+// Random RV32I/Zicsr programs that fit the 2 KiB ROM run on the RTL,
+// clocked directly without SystemC as in mmu_tb, and on the functional
+// model of iss.h, and must end with the same registers and main memory.
+// Every clock of the RTL marks an edge between two pipeline states: the
+// opcode and funct3 in FD, whether FD stalls, goes on, branches or
+// traps, and what it reads of the result of the instruction in XB.
+// A program that hits an edge for the first time, or a new number of
+// times, joins the corpus the next programs are mutated from. Workers,
+// one process and model each, share the edges seen.
+//
+// cpu_fuzz [+jobs=<n>] [+seconds=<n>] [+execs=<n>] [+seed=<n>]
+//          [+out=<dir>] [+replay=<program.bin>]
+//
+// A divergence is reduced to a short program that still diverges the
+// same way, written to <dir> as div-<worker>-<n>.bin, and as a .S of
+// .word lines that the test/ rules assemble. +replay runs a program on
+// both and prints where they differ.
+
+#include <verilated.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Vcpu_top.h"
+#include "Vcpu_top_cpu_top.h"
+#include "Vcpu_top_io_port.h"
+#include "Vcpu_top_core_top.h"
+#include "Vcpu_top_core.h"
+#include "Vcpu_top_mmu.h"
+#include "Vcpu_top_regfile.h"
+#include "Vcpu_top_csr_ehu.h"
+#include "Vcpu_top_EBRAM_ROM.h"
+#include "Vcpu_top_SPRAM_16Kx16.h"
+
+#include "disasm.h"
+#include "iss.h"
+
+// xorshift64*, as in mmu_tb
+struct rng_t
+{
+  uint64_t s;
+
+  explicit rng_t(uint64_t seed) : s(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+  uint32_t next()
+  {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return (s * 0x2545F4914F6CDD1Dull) >> 32;
+  }
+
+  // 0 .. n-1
+  uint32_t below(uint32_t n)
+  {
+    return (static_cast<uint64_t>(next()) * n) >> 32;
+  }
+};
+
+//////////////////////////////////////////////////
+
+// Registers of a program. Items write x0-x23 and read any. x24 is the
+// base of JALR, x25 the loop counter, x26 points to the middle of the
+// memory window, and the trap handler keeps its temporary in x27 and
+// folds each mepc into x28 and mcause into x29. x30 and x31 get
+// mscratch and mtval at the end
+static const unsigned DEST_REGS = 24;
+enum { X_LINK = 24, X_COUNT = 25, X_BASE = 26, X_TEMP = 27, X_EPC = 28,
+       X_CAUSE = 29, X_SCRATCH = 30, X_TVAL = 31 };
+
+// Loads and stores reach base - 2048 .. base + 2047, the first 4 KiB of
+// main memory, which is compared at the end
+static const uint32_t WINDOW = 0x10000000;
+static const uint32_t WINDOW_WORDS = 1024;
+static const unsigned ROM_WORDS = iss_t::ROM_BYTES / 4;
+
+// One instruction of a program, or a loop. Jumps and branches go
+// forward only, by skip items, and loops run a body of skip items imm
+// times, so that every program ends, whatever items are dropped
+struct fuzz_item_t
+{
+  enum kind_t {
+    OP, OP_IMM, LUI, AUIPC, LOAD, STORE, BRANCH, JAL, JALR, CSR, LOOP,
+    TRAP, FENCE, KINDS
+  };
+
+  uint8_t kind;
+  // funct3, and funct7 bit 5 of OP and the right shifts. TRAP: ECALL,
+  // EBREAK or an illegal word
+  uint8_t funct3;
+  bool alt;
+  uint8_t rd, rs1, rs2;
+  // Immediate, CSR number or loop count. BRANCH, JAL and JALR: added
+  // to the target, 2 makes it misaligned
+  int32_t imm;
+  uint8_t skip;
+};
+
+// CSRs an item may access: writable ones, read-only ones, and one that
+// does not exist. mie and mtvec, and the counters, which the model does
+// not count in clocks, are left out
+static const uint16_t fuzz_csrs[] = {
+  0x340, 0x341, 0x342, 0x343, 0x300, 0x301, 0xF11, 0xF12, 0xF13, 0xF14,
+  0x7C0
+};
+
+struct fuzz_program_t
+{
+  // Initial values of the registers an item may write, and of x30 and
+  // x31. The others are set by the prologue
+  uint32_t init[32];
+  // mscratch, mepc, mcause, mtval
+  uint32_t csr_init[4];
+  std::vector<fuzz_item_t> items;
+};
+
+// Encoders of the instruction formats
+static uint32_t enc_r(unsigned funct7, unsigned rs2, unsigned rs1,
+		      unsigned funct3, unsigned rd, unsigned opcode)
+{
+  return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7
+    | opcode;
+}
+
+static uint32_t enc_i(int32_t imm, unsigned rs1, unsigned funct3,
+		      unsigned rd, unsigned opcode)
+{
+  return (static_cast<uint32_t>(imm) & 0xFFF) << 20 | rs1 << 15
+    | funct3 << 12 | rd << 7 | opcode;
+}
+
+static uint32_t enc_s(int32_t imm, unsigned rs2, unsigned rs1,
+		      unsigned funct3)
+{
+  uint32_t u = imm;
+  return ((u >> 5) & 0x7F) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12
+    | (u & 31) << 7 | 0x23;
+}
+
+static uint32_t enc_b(int32_t offset, unsigned rs2, unsigned rs1,
+		      unsigned funct3)
+{
+  uint32_t u = offset;
+  return ((u >> 12) & 1) << 31 | ((u >> 5) & 0x3F) << 25 | rs2 << 20
+    | rs1 << 15 | funct3 << 12 | ((u >> 1) & 0xF) << 8 | ((u >> 11) & 1) << 7
+    | 0x63;
+}
+
+static uint32_t enc_j(int32_t offset, unsigned rd)
+{
+  uint32_t u = offset;
+  return ((u >> 20) & 1) << 31 | ((u >> 1) & 0x3FF) << 21
+    | ((u >> 11) & 1) << 20 | ((u >> 12) & 0xFF) << 12 | rd << 7 | 0x6F;
+}
+
+static void emit_li(std::vector<uint32_t>& w, unsigned rd, uint32_t v)
+{
+  int32_t lo = static_cast<int32_t>(v << 20) >> 20;
+  uint32_t hi = v - lo;
+  if (hi == 0) {
+    w.push_back(enc_i(lo, 0, 0, rd, 0x13));
+    return;
+  }
+  w.push_back(hi | rd << 7 | 0x37);
+  if (lo != 0) w.push_back(enc_i(lo, rd, 0, rd, 0x13));
+}
+
+// The ROM image of a program: the reset jump, the trap handler at the
+// mtvec of reset, the prologue, the items and the epilogue, which
+// halts with testbench command 3. Longer than the ROM when there are
+// too many items
+static std::vector<uint32_t> assemble(const fuzz_program_t& p)
+{
+  std::vector<uint32_t> w;
+  w.push_back(0);
+  // Handler at 0x4. mret goes to the instruction after the one that
+  // trapped
+  w.push_back(enc_i(0x342, 0, 2, X_TEMP, 0x73));
+  w.push_back(enc_i(4, X_CAUSE, 1, X_CAUSE, 0x13));
+  w.push_back(enc_r(0, X_TEMP, X_CAUSE, 4, X_CAUSE, 0x33));
+  w.push_back(enc_i(0x341, 0, 2, X_TEMP, 0x73));
+  w.push_back(enc_i(1, X_EPC, 1, X_EPC, 0x13));
+  w.push_back(enc_r(0, X_TEMP, X_EPC, 4, X_EPC, 0x33));
+  w.push_back(enc_i(4, X_TEMP, 0, X_TEMP, 0x13));
+  w.push_back(enc_i(0x341, X_TEMP, 1, 0, 0x73));
+  w.push_back(0x30200073);
+  w[0] = enc_j(4 * w.size(), 0);
+
+  for (unsigned r=1; r<32; ++r) {
+    if (r == X_BASE) emit_li(w, r, WINDOW + 2048);
+    else if (r >= X_LINK && r <= X_CAUSE) emit_li(w, r, 0);
+    else emit_li(w, r, p.init[r]);
+  }
+  for (unsigned i=0; i<4; ++i) {
+    emit_li(w, X_TEMP, p.csr_init[i]);
+    w.push_back(enc_i(0x340 + i, X_TEMP, 1, 0, 0x73));
+  }
+  emit_li(w, X_TEMP, 0);
+
+  // Loops and their bodies. A loop in a body is a NOP, and a jump into
+  // a body from outside goes to the start of its loop instead
+  const int n = p.items.size();
+  std::vector<int> loop_of(n + 1, -1), loop_end(n, -1);
+  for (int i=0, end=-1, loop=-1; i<n; ++i) {
+    if (i <= end) loop_of[i] = loop;
+    else if (p.items[i].kind == fuzz_item_t::LOOP) {
+      loop = i;
+      end = std::min(i + p.items[i].skip, n - 1);
+      loop_end[end] = i;
+    }
+  }
+  auto target_of = [&](int i) {
+    int t = std::min(i + 1 + p.items[i].skip, n);
+    if (loop_of[t] >= 0 && loop_of[t] != loop_of[i]) t = loop_of[t];
+    return t;
+  };
+  auto size_of = [&](int i) {
+    const fuzz_item_t& it = p.items[i];
+    return (it.kind == fuzz_item_t::JALR ? 2 : 1) + (loop_end[i] >= 0 ? 2 : 0);
+  };
+  std::vector<uint32_t> addr(n + 1);
+  addr[0] = 4 * w.size();
+  for (int i=0; i<n; ++i) addr[i + 1] = addr[i] + 4 * size_of(i);
+
+  for (int i=0; i<n; ++i) {
+    const fuzz_item_t& it = p.items[i];
+    uint32_t pc = 4 * w.size();
+    int32_t offset = addr[target_of(i)] - pc + it.imm;
+    switch (it.kind) {
+    case fuzz_item_t::OP:
+      w.push_back(enc_r(it.alt ? 0x20 : 0, it.rs2, it.rs1, it.funct3, it.rd,
+			0x33));
+      break;
+    case fuzz_item_t::OP_IMM: {
+      int32_t imm = it.imm;
+      if (it.funct3 == 1 || it.funct3 == 5) imm = (imm & 31) | it.alt << 10;
+      w.push_back(enc_i(imm, it.rs1, it.funct3, it.rd, 0x13));
+      break;
+    }
+    case fuzz_item_t::LUI:
+      w.push_back((it.imm & 0xFFFFF000) | it.rd << 7 | 0x37);
+      break;
+    case fuzz_item_t::AUIPC:
+      w.push_back((it.imm & 0xFFFFF000) | it.rd << 7 | 0x17);
+      break;
+    case fuzz_item_t::LOAD:
+      w.push_back(enc_i(it.imm, X_BASE, it.funct3, it.rd, 0x03));
+      break;
+    case fuzz_item_t::STORE:
+      w.push_back(enc_s(it.imm, it.rs2, X_BASE, it.funct3));
+      break;
+    case fuzz_item_t::BRANCH:
+      w.push_back(enc_b(offset, it.rs2, it.rs1, it.funct3));
+      break;
+    case fuzz_item_t::JAL:
+      w.push_back(enc_j(offset, it.rd));
+      break;
+    case fuzz_item_t::JALR:
+      w.push_back(0x17 | X_LINK << 7);
+      w.push_back(enc_i(offset, X_LINK, 0, it.rd, 0x67));
+      break;
+    case fuzz_item_t::CSR:
+      w.push_back(enc_i(it.imm, it.rs1, it.funct3, it.rd, 0x73));
+      break;
+    case fuzz_item_t::LOOP:
+      if (loop_of[i] >= 0) w.push_back(enc_i(0, 0, 0, 0, 0x13));
+      else w.push_back(enc_i(it.imm, 0, 0, X_COUNT, 0x13));
+      break;
+    case fuzz_item_t::TRAP:
+      w.push_back(it.funct3 == 0 ? 0x00000073
+		  : it.funct3 == 1 ? 0x00100073 : 0xFFFFFFFF);
+      break;
+    case fuzz_item_t::FENCE:
+      w.push_back(0x0FF0000F);
+      break;
+    }
+    if (loop_end[i] >= 0) {
+      w.push_back(enc_i(-1, X_COUNT, 0, X_COUNT, 0x13));
+      int32_t back = addr[loop_end[i]] + 4 - 4 * w.size();
+      w.push_back(enc_b(back, 0, X_COUNT, 1));
+    }
+  }
+
+  w.push_back(enc_i(0x340, 0, 2, X_SCRATCH, 0x73));
+  w.push_back(enc_i(0x343, 0, 2, X_TVAL, 0x73));
+  w.push_back(0x80000000 | X_BASE << 7 | 0x37);
+  w.push_back(enc_i(3, 0, 0, X_TEMP, 0x13));
+  w.push_back(enc_s(0, X_TEMP, X_BASE, 2));
+  w.push_back(enc_j(0, 0));
+  return w;
+}
+
+// Random programs and mutations of them
+class fuzz_gen_t
+{
+public:
+  explicit fuzz_gen_t(uint64_t seed) : rng(seed) {}
+
+  fuzz_program_t program()
+  {
+    fuzz_program_t p;
+    for (auto& v : p.init) v = value();
+    for (auto& v : p.csr_init) v = value();
+    unsigned n = 20 + rng.below(200);
+    for (unsigned i=0; i<n; ++i) p.items.push_back(item());
+    while (assemble(p).size() > ROM_WORDS) p.items.pop_back();
+    return p;
+  }
+
+  // One to four changes of p, with items of other spliced in now and
+  // then
+  fuzz_program_t mutate(const fuzz_program_t& from,
+			const fuzz_program_t& other)
+  {
+    fuzz_program_t p = from;
+    for (unsigned k = 1 + rng.below(4); k > 0; --k) {
+      auto& items = p.items;
+      size_t i = items.empty() ? 0 : rng.below(items.size());
+      switch (rng.below(items.empty() ? 2 : 8)) {
+      case 0:
+	p.init[1 + rng.below(31)] = value();
+	break;
+      case 1:
+	items.insert(items.begin() + i, item());
+	break;
+      case 2:
+	items[i] = item();
+	break;
+      case 3:
+	items.erase(items.begin() + i);
+	break;
+      case 4:
+	tweak(items[i]);
+	break;
+      case 5: {
+	// A run of items again, right after it
+	size_t len = 1 + rng.below(std::min<size_t>(8, items.size() - i));
+	std::vector<fuzz_item_t> run(items.begin() + i,
+				     items.begin() + i + len);
+	items.insert(items.begin() + i + len, run.begin(), run.end());
+	break;
+      }
+      case 6:
+	if (!other.items.empty()) {
+	  size_t j = rng.below(other.items.size());
+	  items.resize(i);
+	  items.insert(items.end(), other.items.begin() + j,
+		       other.items.end());
+	}
+	break;
+      default:
+	p.csr_init[rng.below(4)] = value();
+	break;
+      }
+    }
+    while (assemble(p).size() > ROM_WORDS) p.items.pop_back();
+    return p;
+  }
+
+private:
+  rng_t rng;
+  // Destinations of the last items, read again more often than others
+  uint8_t recent[4] = {1, 2, 3, 4};
+
+  uint32_t value()
+  {
+    static const uint32_t special[] = {
+      0, 1, 2, 0xFFFFFFFF, 0x80000000, 0x7FFFFFFF, 0xFFFFF800, 0x7FF,
+      0x800, 31, 32, WINDOW + 2048
+    };
+    switch (rng.below(4)) {
+    case 0: return special[rng.below(sizeof(special) / sizeof(special[0]))];
+    case 1: return rng.below(64) - 32;
+    default: return rng.next();
+    }
+  }
+
+  uint8_t dest()
+  {
+    uint8_t rd = rng.below(32) == 0 ? 0 : 1 + rng.below(DEST_REGS - 1);
+    if (rd != 0) {
+      std::memmove(recent + 1, recent, sizeof(recent) - 1);
+      recent[0] = rd;
+    }
+    return rd;
+  }
+
+  uint8_t source()
+  {
+    return rng.below(2) ? recent[rng.below(4)] : rng.below(32);
+  }
+
+  int32_t imm12()
+  {
+    static const int32_t special[] = {0, 1, -1, 2047, -2048, 31, 32, -32};
+    if (rng.below(3) == 0) return special[rng.below(8)];
+    return static_cast<int32_t>(rng.next() << 20) >> 20;
+  }
+
+  // Near the last accesses more often than not, aligned but for one in
+  // sixteen
+  int32_t offset(unsigned size)
+  {
+    int32_t off = rng.below(2) ? static_cast<int32_t>(rng.below(128)) - 64
+      : static_cast<int32_t>(rng.below(4096)) - 2048;
+    off &= ~(size - 1);
+    if (rng.below(16) == 0) off |= 1 + rng.below(size == 1 ? 1 : size - 1);
+    return std::max(-2048, std::min(2047, off));
+  }
+
+  fuzz_item_t item()
+  {
+    static const uint8_t weights[fuzz_item_t::KINDS] = {
+      20, 20, 4, 3, 12, 12, 10, 3, 3, 6, 3, 2, 1
+    };
+    unsigned r = rng.below(99);
+    uint8_t kind = 0;
+    while (r >= weights[kind]) r -= weights[kind++];
+    fuzz_item_t it = {};
+    it.kind = kind;
+    it.rs1 = source();
+    it.rs2 = source();
+    it.rd = dest();
+    it.funct3 = rng.below(8);
+    it.alt = rng.below(2);
+    it.imm = imm12();
+    it.skip = rng.below(4) ? rng.below(4) : rng.below(32);
+    switch (kind) {
+    case fuzz_item_t::OP:
+      it.alt = it.alt && (it.funct3 == 0 || it.funct3 == 5);
+      break;
+    case fuzz_item_t::OP_IMM:
+      it.alt = it.alt && it.funct3 == 5;
+      break;
+    case fuzz_item_t::LUI:
+    case fuzz_item_t::AUIPC:
+      it.imm = value();
+      break;
+    case fuzz_item_t::LOAD: {
+      static const uint8_t loads[] = {0, 1, 2, 4, 5};
+      it.funct3 = loads[rng.below(5)];
+      it.imm = offset(1 << (it.funct3 & 3));
+      break;
+    }
+    case fuzz_item_t::STORE:
+      it.funct3 = rng.below(3);
+      it.imm = offset(1 << it.funct3);
+      break;
+    case fuzz_item_t::BRANCH:
+      if (it.funct3 == 2 || it.funct3 == 3) it.funct3 = 0;
+      it.imm = rng.below(16) == 0 ? 2 : 0;
+      break;
+    case fuzz_item_t::JAL:
+      it.imm = rng.below(16) == 0 ? 2 : 0;
+      break;
+    case fuzz_item_t::JALR:
+      it.imm = rng.below(8) == 0 ? 1 + rng.below(3) : 0;
+      break;
+    case fuzz_item_t::CSR:
+      if (it.funct3 == 0 || it.funct3 == 4) it.funct3 = 2;
+      it.imm = fuzz_csrs[rng.below(sizeof(fuzz_csrs) / sizeof(fuzz_csrs[0]))];
+      break;
+    case fuzz_item_t::LOOP:
+      it.imm = 1 + rng.below(8);
+      it.skip = rng.below(12);
+      break;
+    case fuzz_item_t::TRAP:
+      it.funct3 = rng.below(3);
+      break;
+    }
+    return it;
+  }
+
+  void tweak(fuzz_item_t& it)
+  {
+    switch (rng.below(5)) {
+    case 0: it.rd = dest(); break;
+    case 1: it.rs1 = source(); break;
+    case 2: it.rs2 = source(); break;
+    case 3: it.skip = rng.below(8); break;
+    default:
+      switch (it.kind) {
+      case fuzz_item_t::OP_IMM: it.imm = imm12(); break;
+      case fuzz_item_t::LUI:
+      case fuzz_item_t::AUIPC: it.imm = value(); break;
+      case fuzz_item_t::LOAD:
+      case fuzz_item_t::STORE: it.imm = offset(1 << (it.funct3 & 3)); break;
+      case fuzz_item_t::LOOP: it.imm = 1 + rng.below(8); break;
+      default: it.alt = !it.alt && (it.kind != fuzz_item_t::OP
+				    || it.funct3 == 0 || it.funct3 == 5);
+      }
+    }
+  }
+};
+
+//////////////////////////////////////////////////
+
+// Registers and memory window at the end of a run
+struct fuzz_state_t
+{
+  bool halted = false;
+  uint32_t x[32];
+  uint32_t ram[WINDOW_WORDS];
+  uint64_t clocks = 0;
+};
+
+// Edges are counted in a map of this many bytes
+static const unsigned MAP_SIZE = 65536;
+
+// Vcpu_top in the default build, reset for each program
+class cpu_fuzz_t
+{
+public:
+  // Times each edge was hit in the last run
+  uint8_t hits[MAP_SIZE];
+  uint64_t clocks = 0;
+
+  cpu_fuzz_t()
+  {
+    dut = new Vcpu_top;
+    dut->uart_rx = 1;
+    dut->irq_lines = 0;
+    dut->flash_io_di = 0;
+  }
+
+  ~cpu_fuzz_t()
+  {
+    dut->final();
+    delete dut;
+  }
+
+  // Runs words from reset until the halt command, or max_clocks
+  void run(const std::vector<uint32_t>& words, uint64_t max_clocks,
+	   fuzz_state_t& out)
+  {
+    auto mmu = dut->cpu_top->CT0->MMU0;
+    for (unsigned i=0; i<ROM_WORDS; ++i) {
+      mmu->rom0->ROM[i] = i < words.size() ? words[i] : 0;
+    }
+    // As iss_t fills its memory
+    for (unsigned i=0; i<WINDOW_WORDS; ++i) {
+      mmu->ram0->RAM[i] = 0xAAAA;
+      mmu->ram1->RAM[i] = 0xAAAA;
+    }
+    std::memset(hits, 0, sizeof(hits));
+    dut->resetb = 0;
+    tick();
+    tick();
+    dut->resetb = 1;
+    state = 0;
+    xb_inst = 0;
+
+    auto io = dut->cpu_top->IO0;
+    out.halted = false;
+    for (out.clocks = 0; out.clocks < max_clocks && !out.halted;
+	 ++out.clocks) {
+      cover();
+      out.halted = io->wb_ack && io->wb_we && io->wb_adr == 0
+	&& io->wb_dat_w == 3;
+      tick();
+    }
+    // The halt store is the last instruction that counts
+    tick();
+    auto& rf = dut->cpu_top->CT0->CPU0->RF->data;
+    out.x[0] = 0;
+    for (int r=1; r<32; ++r) out.x[r] = rf[r];
+    for (unsigned i=0; i<WINDOW_WORDS; ++i) {
+      out.ram[i] = mmu->ram0->RAM[i] | mmu->ram1->RAM[i] << 16;
+    }
+  }
+
+private:
+  Vcpu_top* dut;
+  // Pipeline state of the last clock, and the instruction now in XB
+  uint32_t state = 0;
+  uint32_t xb_inst = 0;
+
+  void tick()
+  {
+    dut->clk = 0;
+    dut->eval();
+    dut->clk = 1;
+    dut->eval();
+    ++clocks;
+  }
+
+  // The edge from the state of the last clock to this one
+  void cover()
+  {
+    auto cpu = dut->cpu_top->CT0->CPU0;
+    uint32_t inst = cpu->FD_inst;
+    uint32_t pc = cpu->FD_PC;
+    uint32_t next = cpu->nextPC;
+    unsigned flow = next == pc ? 0
+      : next == (cpu->CSR_EHU0->mtvec << 2) ? 1
+      : next == pc + 4 ? 2 : 3;
+    // XB writes a register FD reads
+    unsigned xb_op = (xb_inst >> 2) & 31;
+    unsigned xb_rd = (xb_inst >> 7) & 31;
+    bool xb_writes = xb_rd != 0 && (xb_op == 0x00 || xb_op == 0x04
+				    || xb_op == 0x05 || xb_op == 0x0C
+				    || xb_op == 0x0D || xb_op == 0x19
+				    || xb_op == 0x1B || xb_op == 0x1C);
+    unsigned dep = xb_writes
+      ? (((inst >> 15) & 31) == xb_rd) | (((inst >> 20) & 31) == xb_rd) << 1
+      : 0;
+    uint32_t now = ((inst >> 2) & 31) | ((inst >> 12) & 7) << 5 | flow << 8
+      | dep << 10 | (xb_writes && xb_op == 0x00) << 12;
+    uint32_t edge = ((state << 13 | now) * 0x9E3779B1u) >> 16;
+    if (hits[edge] != 0xFF) ++hits[edge];
+    state = now;
+    // What goes on to XB, a bubble when FD stalls or traps
+    xb_inst = flow >= 2 ? inst : 0;
+  }
+};
+
+// The end state of the model, with the instructions it retired
+static void run_iss(const std::vector<uint32_t>& words, uint64_t max,
+		    fuzz_state_t& out, uint64_t& instret)
+{
+  std::unique_ptr<iss_t> s(new iss_t);
+  s->quiet = true;
+  for (uint32_t i=0; i<iss_t::ROM_BYTES; ++i) {
+    s->write_byte(i, i / 4 < words.size() ? words[i / 4] >> (8 * (i & 3)) : 0);
+  }
+  while (!s->stopped() && s->instret < max) s->step();
+  out.halted = s->test_halt;
+  std::memcpy(out.x, s->x, sizeof(out.x));
+  out.x[0] = 0;
+  std::memcpy(out.ram, s->ram, sizeof(out.ram));
+  instret = s->instret;
+}
+
+// How a program ran on both
+enum verdict_t { SAME, ISS_NO_END, RTL_NO_END, DIFFERENT };
+
+// Instructions a program may take on the model, and clocks per
+// instruction on the RTL before it counts as hung
+static const uint64_t MAX_INSTRUCTIONS = 200000;
+static const uint64_t CLOCKS_PER_INSTRUCTION = 8;
+
+static verdict_t compare(cpu_fuzz_t& tb, const std::vector<uint32_t>& words,
+			 std::string* diff = nullptr)
+{
+  fuzz_state_t ref, dut;
+  uint64_t instret;
+  run_iss(words, MAX_INSTRUCTIONS, ref, instret);
+  if (!ref.halted) return ISS_NO_END;
+  tb.run(words, CLOCKS_PER_INSTRUCTION * instret + 1000, dut);
+  std::ostringstream s;
+  s << std::hex;
+  verdict_t v = SAME;
+  if (!dut.halted) {
+    s << "no halt after " << std::dec << dut.clocks << " clocks, "
+      << instret << " instructions on the model" << std::hex;
+    v = RTL_NO_END;
+  }
+  else {
+    int shown = 0;
+    for (int r=1; r<32; ++r) {
+      if (dut.x[r] == ref.x[r]) continue;
+      v = DIFFERENT;
+      if (shown++ < 4) {
+	s << (shown > 1 ? ", " : "") << "x" << std::dec << r << std::hex
+	  << "=0x" << dut.x[r] << " (0x" << ref.x[r] << ")";
+      }
+    }
+    for (unsigned i=0; i<WINDOW_WORDS; ++i) {
+      if (dut.ram[i] == ref.ram[i]) continue;
+      v = DIFFERENT;
+      if (shown++ < 4) {
+	s << (shown > 1 ? ", " : "") << "[0x" << WINDOW + 4 * i << "]=0x"
+	  << dut.ram[i] << " (0x" << ref.ram[i] << ")";
+      }
+    }
+    if (shown > 4) s << ", " << std::dec << shown - 4 << " more";
+  }
+  if (diff) *diff = s.str();
+  return v;
+}
+
+// Drops items while the program still diverges the same way, halves,
+// quarters, ... down to single items, then sets initial values to 0
+static fuzz_program_t reduce(cpu_fuzz_t& tb, fuzz_program_t p, verdict_t v)
+{
+  int budget = 2000;
+  auto fails = [&](const fuzz_program_t& q) {
+    --budget;
+    return compare(tb, assemble(q)) == v;
+  };
+  for (size_t chunk = p.items.size() / 2; chunk > 0 && budget > 0;
+       chunk /= 2) {
+    for (size_t i=0; i < p.items.size() && budget > 0;) {
+      fuzz_program_t rest = p;
+      rest.items.erase(rest.items.begin() + i,
+		       rest.items.begin() + std::min(i + chunk,
+						     p.items.size()));
+      if (fails(rest)) p = rest;
+      else i += chunk;
+    }
+  }
+  for (int r=1; r<32 && budget > 0; ++r) {
+    if (p.init[r] == 0) continue;
+    fuzz_program_t q = p;
+    q.init[r] = 0;
+    if (fails(q)) p = q;
+  }
+  for (int i=0; i<4 && budget > 0; ++i) {
+    if (p.csr_init[i] == 0) continue;
+    fuzz_program_t q = p;
+    q.csr_init[i] = 0;
+    if (fails(q)) p = q;
+  }
+  return p;
+}
+
+static bool write_program(const std::string& path,
+			  const std::vector<uint32_t>& words,
+			  const std::string& why)
+{
+  std::ofstream bin(path + ".bin", std::ios::binary);
+  std::ofstream s(path + ".S");
+  if (!bin.is_open() || !s.is_open()) return false;
+  bin.write(reinterpret_cast<const char*>(words.data()), 4 * words.size());
+  s << "# cpu_fuzz reproducer: " << why << std::endl
+    << "# x28 folds the mepc, and x29 the mcause, of each trap" << std::endl;
+  for (size_t i=0; i<words.size(); ++i) {
+    s << "\t.word 0x" << std::hex << std::setfill('0') << std::setw(8)
+      << words[i] << "\t# 0x" << std::setw(3) << 4 * i << " "
+      << disasm(words[i]) << std::endl;
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////
+
+// What the workers share, in memory mapped before they are forked
+struct fuzz_shared_t
+{
+  // Hit count classes seen of each edge, one bit each
+  uint8_t seen[MAP_SIZE];
+  uint64_t execs;
+  uint64_t clocks;
+  uint64_t divergences;
+  uint64_t iss_no_end;
+  uint64_t corpus;
+  uint32_t stop;
+};
+
+// Hit counts 1, 2, 3, 4-7, 8-15, 16-31, 32-127 and 128 up
+static uint8_t hit_class(uint8_t n)
+{
+  return n == 0 ? 0 : n < 4 ? 1 << (n - 1) : n < 8 ? 8 : n < 16 ? 16
+    : n < 32 ? 32 : n < 128 ? 64 : 128;
+}
+
+// Marks the edges of the last run as seen. true when one was not
+static bool merge_hits(fuzz_shared_t* shared, const uint8_t* hits)
+{
+  bool fresh = false;
+  for (unsigned i=0; i<MAP_SIZE; ++i) {
+    if (!hits[i]) continue;
+    uint8_t c = hit_class(hits[i]);
+    if (shared->seen[i] & c) continue;
+    __atomic_fetch_or(&shared->seen[i], c, __ATOMIC_RELAXED);
+    fresh = true;
+  }
+  return fresh;
+}
+
+static void add(uint64_t& counter, uint64_t n)
+{
+  __atomic_fetch_add(&counter, n, __ATOMIC_RELAXED);
+}
+
+// One worker. Reports go to stdout a line at a time
+static void fuzz_worker(int id, uint64_t seed, uint64_t max_execs,
+			const std::string& out_dir, fuzz_shared_t* shared)
+{
+  cpu_fuzz_t tb;
+  fuzz_gen_t gen(seed);
+  rng_t pick(seed ^ 0xC0FFEE);
+  std::vector<fuzz_program_t> corpus;
+  // Kinds and funct3 of the items of each reproducer written, so that
+  // the same one is not written again with other operands
+  std::vector<std::vector<int>> reported;
+  const size_t MAX_CORPUS = 1024;
+  const size_t MAX_REPORTS = 4;
+  while (!__atomic_load_n(&shared->stop, __ATOMIC_RELAXED)
+	 && __atomic_load_n(&shared->execs, __ATOMIC_RELAXED) < max_execs) {
+    fuzz_program_t p = corpus.empty() || pick.below(16) == 0 ? gen.program()
+      : gen.mutate(corpus[pick.below(corpus.size())],
+		   corpus[pick.below(corpus.size())]);
+    std::vector<uint32_t> words = assemble(p);
+    uint64_t clocks = tb.clocks;
+    verdict_t v = compare(tb, words);
+    add(shared->execs, 1);
+    if (v == ISS_NO_END) {
+      add(shared->iss_no_end, 1);
+      continue;
+    }
+    if (v == SAME) {
+      if (merge_hits(shared, tb.hits)) {
+	if (corpus.size() < MAX_CORPUS) {
+	  corpus.push_back(p);
+	  add(shared->corpus, 1);
+	}
+	else corpus[pick.below(MAX_CORPUS)] = p;
+      }
+      add(shared->clocks, tb.clocks - clocks);
+      continue;
+    }
+    add(shared->divergences, 1);
+    if (reported.size() >= MAX_REPORTS) continue;
+    p = reduce(tb, p, v);
+    words = assemble(p);
+    add(shared->clocks, tb.clocks - clocks);
+    std::vector<int> shape;
+    for (auto& it : p.items) {
+      shape.push_back(it.kind << 4 | it.funct3 << 1 | it.alt);
+    }
+    if (std::find(reported.begin(), reported.end(), shape) != reported.end()) {
+      continue;
+    }
+    std::string diff;
+    compare(tb, words, &diff);
+    std::ostringstream path;
+    path << out_dir << "/div-" << id << "-" << reported.size();
+    reported.push_back(shape);
+    std::ostringstream line;
+    line << "(TT) Divergence, " << p.items.size() << " items: " << diff;
+    if (write_program(path.str(), words, diff)) {
+      line << ", written to " << path.str() << ".S";
+    }
+    line << std::endl;
+    std::cout << line.str() << std::flush;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  Verilated::commandArgs(argc, argv);
+
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  double seconds = 60;
+  uint64_t max_execs = ~0ull;
+  uint64_t seed = 1;
+  std::string out_dir = "tb_out/fuzz";
+  std::string replay;
+  for (int i=1; i<argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 6, "+jobs=") == 0) jobs = std::atoi(&argv[i][6]);
+    else if (arg.compare(0, 9, "+seconds=") == 0) seconds = std::atof(&argv[i][9]);
+    else if (arg.compare(0, 7, "+execs=") == 0) max_execs = std::strtoull(&argv[i][7], nullptr, 0);
+    else if (arg.compare(0, 6, "+seed=") == 0) seed = std::strtoull(&argv[i][6], nullptr, 0);
+    else if (arg.compare(0, 5, "+out=") == 0) out_dir = arg.substr(5);
+    else if (arg.compare(0, 8, "+replay=") == 0) replay = arg.substr(8);
+  }
+
+  if (!replay.empty()) {
+    std::ifstream f(replay, std::ios::binary);
+    std::vector<uint32_t> words(ROM_WORDS, 0);
+    if (!f.is_open()) {
+      std::cerr << replay << ": cannot open" << std::endl;
+      return 1;
+    }
+    f.read(reinterpret_cast<char*>(words.data()), iss_t::ROM_BYTES);
+    cpu_fuzz_t tb;
+    std::string diff;
+    verdict_t v = compare(tb, words, &diff);
+    if (v == ISS_NO_END) {
+      std::cout << "(TT) Replay: no halt on the model" << std::endl;
+      return 1;
+    }
+    if (v == SAME) {
+      std::cout << "(TT) Replay PASSED" << std::endl;
+      return 0;
+    }
+    std::cout << "(TT) Replay: " << diff
+	      << (v == DIFFERENT ? ", the model in ()" : "") << std::endl
+	      << "(TT) Replay FAILED" << std::endl;
+    return 1;
+  }
+
+  jobs = std::max(1, jobs);
+  mkdir(out_dir.c_str(), 0777);
+  std::cout << "(TT) Fuzzing cpu_top against iss.h, +seed=" << seed
+	    << " +jobs=" << jobs << std::endl << std::flush;
+  auto shared = static_cast<fuzz_shared_t*>(
+    mmap(nullptr, sizeof(fuzz_shared_t), PROT_READ | PROT_WRITE,
+	 MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  if (shared == MAP_FAILED) {
+    std::cerr << "mmap failed" << std::endl;
+    return 1;
+  }
+  std::memset(shared, 0, sizeof(*shared));
+
+  std::vector<pid_t> pids;
+  for (int w=0; w<jobs; ++w) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      fuzz_worker(w, seed * 1000003 + w, max_execs, out_dir, shared);
+      _exit(0);
+    }
+    pids.push_back(pid);
+  }
+
+  // Progress every 10 s, until the time is up or the workers are done
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = [&]() {
+    return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  };
+  auto edges = [&]() {
+    unsigned n = 0;
+    for (unsigned i=0; i<MAP_SIZE; ++i) n += shared->seen[i] != 0;
+    return n;
+  };
+  size_t running = pids.size();
+  double next_report = 10;
+  while (running > 0) {
+    usleep(100000);
+    while (running > 0 && waitpid(-1, nullptr, WNOHANG) > 0) --running;
+    double t = elapsed();
+    if (t >= seconds) __atomic_store_n(&shared->stop, 1, __ATOMIC_RELAXED);
+    if (t >= next_report) {
+      next_report += 10;
+      std::printf("(SS) %.0f s: %llu executions, %.0f/s, %u edges, "
+		  "%llu divergences\n", t,
+		  (unsigned long long)shared->execs, shared->execs / t,
+		  edges(), (unsigned long long)shared->divergences);
+      std::fflush(stdout);
+    }
+  }
+
+  double t = elapsed();
+  std::printf("(SS) Executions: %llu\n", (unsigned long long)shared->execs);
+  std::printf("(SS) Executions/s: %.1f\n", shared->execs / t);
+  std::printf("(SS) Clocks/s: %.0f\n", shared->clocks / t);
+  std::printf("(SS) Edges: %u\n", edges());
+  std::printf("(SS) Corpus: %llu\n", (unsigned long long)shared->corpus);
+  std::printf("(SS) Programs with no end on the model: %llu\n",
+	      (unsigned long long)shared->iss_no_end);
+  std::printf("(SS) Divergences: %llu\n",
+	      (unsigned long long)shared->divergences);
+  std::cout << "(TT) Fuzzing " << (shared->divergences ? "FAILED" : "PASSED")
+	    << std::endl;
+  return shared->divergences ? 1 : 0;
+}
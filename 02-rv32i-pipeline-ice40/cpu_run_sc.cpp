@@ -3,20 +3,34 @@
 #include <sstream>
 #include <fstream>
 #include <iomanip>
+#include <cstring>
+#include <vector>
+#include <memory>
 
 
 #include "Vcpu_top.h"
 #include "Vcpu_top_cpu_top.h"
 #include "Vcpu_top_io_port.h"
+#include "Vcpu_top_timer.h"
+#include "Vcpu_top_dma.h"
+#include "Vcpu_top_uart.h"
 #include "Vcpu_top_core_top.h"
 #include "Vcpu_top_core_top.h"
 #include "Vcpu_top_core.h"
 #include "Vcpu_top_mmu.h"
+#include "Vcpu_top_xip.h"
 #include "Vcpu_top_regfile.h"
+#include "Vcpu_top_csr_ehu.h"
 #include "Vcpu_top_EBRAM_ROM.h"
 #include "Vcpu_top_SPRAM_16Kx16.h"
 
 #include "disasm.h"
+#include "coprocessor_model.h"
+#include "uart_model.h"
+#include "semihost.h"
+#include "irq_latency.h"
+#include "spi_flash_model.h"
+#include "gdb_stub.h"
 
 class cpu_run_t : public sc_module
 {
@@ -29,31 +43,64 @@ public:
   sc_in<bool> clk_tb;
   sc_signal<bool> resetb_tb;
   sc_signal<uint32_t> gpio0_tb;
+  sc_signal<bool> uart_tx_tb, uart_rx_tb;
+  sc_signal<uint32_t> irq_lines_tb;
+  sc_signal<bool> flash_csb_tb, flash_clk_tb;
+  sc_signal<uint32_t> flash_io_oe_tb, flash_io_do_tb, flash_io_di_tb;
+  // Drives irq_lines[0] when enabled
+  std::unique_ptr<irq_latency_t> irq_latency;
+  uart_model_t uart;
+  semihost_t semihost;
+  spi_flash_model_t flash;
+  uint64_t cycles = 0;
+  // Loopback port of the GDB stub, with +gdb
+  int gdb_port = 0;
 
   bool test_passes, test_fails, test_halt;
   uint32_t test_result_base_addr;
 
   SC_HAS_PROCESS(cpu_run_t);
-  cpu_run_t(sc_module_name name, const std::string& path)
+  cpu_run_t(sc_module_name name, const std::string& path,
+	    uint64_t max_cycles = 4096)
     : sc_module(name)
     , program(path)
+    , max_cycles(max_cycles)
     , clk_tb("clk_tb")
     , resetb_tb("resetb_tb")
     , gpio0_tb("gpio0_tb")
+    , uart_tx_tb("uart_tx_tb"), uart_rx_tb("uart_rx_tb")
+    , irq_lines_tb("irq_lines_tb")
+    , flash_csb_tb("flash_csb_tb"), flash_clk_tb("flash_clk_tb")
+    , flash_io_oe_tb("flash_io_oe_tb"), flash_io_do_tb("flash_io_do_tb")
+    , flash_io_di_tb("flash_io_di_tb")
   {
     SC_CTHREAD(test_thread, clk_tb.pos());
 
     test_result_base_addr = 0;
+    uart_rx_tb.write(true);
 
     dut = new Vcpu_top("dut");
     dut->clk(clk_tb);
     dut->resetb(resetb_tb);
     dut->gpio0(gpio0_tb);
+    dut->uart_tx(uart_tx_tb);
+    dut->uart_rx(uart_rx_tb);
+    dut->irq_lines(irq_lines_tb);
+    dut->flash_csb(flash_csb_tb);
+    dut->flash_clk(flash_clk_tb);
+    dut->flash_io_oe(flash_io_oe_tb);
+    dut->flash_io_do(flash_io_do_tb);
+    dut->flash_io_di(flash_io_di_tb);
     ROM = dut->cpu_top->CT0->MMU0->rom0->ROM;
     FD_PC = &(dut->cpu_top->CT0->CPU0->FD_PC);
-    FD_inst = &(dut->cpu_top->CT0->CPU0->im_do);
+    FD_inst = &(dut->cpu_top->CT0->CPU0->FD_inst);
     // FD_disasm_opcode = 
     //   (char*)dut->cpu_top->CT0->CPU0->inst_dec->disasm_opcode;
+    semihost.read_byte = [this](uint32_t addr) { return read_byte(addr); };
+    semihost.write_byte = [this](uint32_t addr, uint8_t byte) {
+      write_byte(addr, byte);
+    };
+    semihost.clocks = [this]() { return cycles; };
   }
 
   std::string reverse(char* s) {
@@ -78,6 +125,27 @@ public:
     return word;
   }
 
+  // Byte of ROM or data memory, outside of the MMU
+  uint8_t read_byte(uint32_t addr)
+  {
+    if (addr < 0x1000) return ROM[addr >> 2] >> (8 * (addr & 3));
+    uint32_t i = (addr - 0x10000000) >> 2;
+    if (i >= 16384) return 0;
+    auto ram = (addr & 2) ? dut->cpu_top->CT0->MMU0->ram1
+      : dut->cpu_top->CT0->MMU0->ram0;
+    return ram->RAM[i] >> (8 * (addr & 1));
+  }
+
+  void write_byte(uint32_t addr, uint8_t byte)
+  {
+    uint32_t i = (addr - 0x10000000) >> 2;
+    if (i >= 16384) return;
+    auto ram = (addr & 2) ? dut->cpu_top->CT0->MMU0->ram1
+      : dut->cpu_top->CT0->MMU0->ram0;
+    uint16_t shift = 8 * (addr & 1);
+    ram->RAM[i] = (ram->RAM[i] & ~(0xFF << shift)) | (byte << shift);
+  }
+
   void initialize_memory() 
   {
     for (int i=0; i<1024; ++i) {
@@ -119,8 +187,22 @@ public:
   }
 
   void poll_io(void);
+  void check_coprocessor(void);
+  void count_dma(void);
+  void count_harts(void);
+  void count_io_bus(void);
+  void tick_uart(void);
+  void tick_irq_latency(void);
+  void tick_flash(void);
+  void count_xip(void);
+  uint64_t skip_idle(uint64_t budget);
+  bool attach_gdb(void);
+  bool debug_clock(void);
   //void tb_handshake(void);
+  void report_statistics(uint64_t cycles);
   
+  // The ROM gets the first 2 KB of the program, and the flash all of
+  // it, for programs that go on in XIP
   bool load_program(const std::string& path)
   {
     for (int i=0; i<512; ++i) {
@@ -130,20 +212,19 @@ public:
     if (f.is_open()) {
       f.seekg(0, f.end);
       int size = f.tellg();
-      if (size == 0 || size > 2048) {
+      if (size == 0 || size > 0x100000) {
 	return false;
       }
-      if (size % 4 != 0) {
+      // RV32C programs may end on a halfword
+      if (size % 2 != 0) {
 	return false;
       }
       f.seekg(0, f.beg);
       auto buf = new char[size];
       f.read(buf, size);
 
-      auto words = (uint32_t*) buf;
-      for (int i=0; i<size/4; ++i) {
-        ROM[i] = words[i];
-      }
+      std::memcpy(ROM, buf, size < 2048 ? size : 2048);
+      flash.load(buf, size, spi_flash_model_t::IMAGE_OFFSET);
       f.close();
       delete[] buf;
       return true;
@@ -156,22 +237,58 @@ public:
   void test_thread(void);
 private:
   std::string program;
+  uint64_t max_cycles;
+  coprocessor_model_t cop_model;
+  uint64_t cop_ops = 0;
+  uint64_t cop_mismatches = 0;
+  uint64_t skipped_cycles = 0;
+  uint64_t dma_busy_cycles = 0;
+  uint64_t dma_words = 0;
+  uint64_t hart_instret[2] = {0, 0};
+  uint64_t hart_arb_stalls[2] = {0, 0};
+  uint64_t io_beats = 0;
+  uint64_t io_busy_cycles = 0;
+  uint64_t io_stall_cycles = 0;
+  uint64_t xip_fetches = 0;
+  uint64_t xip_misses = 0;
+  uint64_t xip_stall_cycles = 0;
+  uint64_t xip_lines = 0;
+  uint64_t xip_prefetched = 0;
+  // The XIP fetch stalled since its last hit
+  bool xip_waiting = false;
+  std::unique_ptr<gdb_stub_t> gdb;
+  // What the debugger waits for: the instruction in FD to go on, then a
+  // stop, or running on after a stop
+  enum { DEBUG_RUN, DEBUG_STEP, DEBUG_STEP_RUN } debug_mode = DEBUG_RUN;
+  // FD took the next instruction since the stepping began
+  bool debug_advanced = false;
+  // Stop reason once the step is done, a watchpoint hit
+  std::string debug_reason;
+  // Registers GDB wrote while the instruction in XB writes them back,
+  // written again after the writeback
+  std::vector<std::pair<int, uint32_t>> debug_rewrites;
+
+  bool debug_stop(int signal, const std::string& reason);
 };
 
 void cpu_run_t::poll_io()
 {
-  bool en = dut->cpu_top->IO0->io_en;
-  bool we = dut->cpu_top->IO0->io_we;
-  uint8_t addr8 = dut->cpu_top->IO0->io_addr;
+  auto io = dut->cpu_top->IO0;
+  // A write beat is taken in the clock it is acknowledged
+  bool ack = io->wb_ack;
+  bool we = io->wb_we;
+  uint8_t adr = io->wb_adr;
   {
     // Testbench command
     test_passes = false;
     test_fails = false;
     test_halt = false;
-    if (en && we) {
+    if (ack && we) {
+      // Semihosting doorbell, 0x4
+      if (adr == 1) semihost.service(io->wb_dat_w);
       // IO domain address is 0x0
-      if (addr8 == 0) {
-        switch (dut->cpu_top->IO0->io_data_write) {
+      if (adr == 0) {
+        switch (io->wb_dat_w) {
 	case 0:
 	  scan_memory_for_base_address();
 	  break;
@@ -193,6 +310,252 @@ void cpu_run_t::poll_io()
   }
 }
 
+// Compare every completed custom instruction with the reference model
+void cpu_run_t::check_coprocessor()
+{
+  auto cpu = dut->cpu_top->CT0->CPU0;
+  if (!(cpu->cop_valid && cpu->cop_ready)) return;
+  ++cop_ops;
+  uint32_t expected = cop_model.execute(cpu->cop_inst, cpu->cop_rs1,
+					cpu->cop_rs2);
+  if (cpu->cop_result != expected) {
+    ++cop_mismatches;
+    std::cout << "(TT) Coprocessor mismatch at FD_PC=0x" << std::hex
+	      << *FD_PC << ": 0x" << cpu->cop_result
+	      << ", expected 0x" << expected << std::endl;
+  }
+}
+
+void cpu_run_t::count_dma()
+{
+  auto dma = dut->cpu_top->IO0->DMA0;
+  if (dma->busy) ++dma_busy_cycles;
+  if (dma->dma_gnt && dma->dma_we) ++dma_words;
+}
+
+// Instructions and data port arbitration losses of each hart
+void cpu_run_t::count_harts()
+{
+  auto ct = dut->cpu_top->CT0;
+  for (int h=0; h<2; ++h) {
+    if (ct->hart_retire & (1 << h)) ++hart_instret[h];
+    if (ct->hart_arb_stall & (1 << h)) ++hart_arb_stalls[h];
+  }
+}
+
+// Beats, and clocks a beat is held or stalled on the IO bus
+void cpu_run_t::count_io_bus()
+{
+  auto io = dut->cpu_top->IO0;
+  if (!io->wb_stb) return;
+  ++io_busy_cycles;
+  if (io->wb_ack) ++io_beats;
+  if (io->wb_stall) ++io_stall_cycles;
+}
+
+// Host end of the UART, one clock
+void cpu_run_t::tick_uart()
+{
+  if (!uart.enabled()) return;
+  auto u = dut->cpu_top->IO0->UART0;
+  // The RX FIFO holds 16 bytes, one may still be in the receiver
+  bool rx_room = u->rx_count + u->rx_busy < 16;
+  uart_rx_tb.write(uart.tick(uart_tx_tb.read(), u->div, rx_room));
+}
+
+// Interrupt line 0 of the latency harness, local interrupt 17
+void cpu_run_t::tick_irq_latency()
+{
+  if (!irq_latency) return;
+  auto csr = dut->cpu_top->CT0->CPU0->CSR_EHU0;
+  bool level = irq_latency->tick(cycles, *FD_PC, csr->mtvec << 2,
+				 csr->mtvec_vectored, csr->mepc << 1);
+  irq_lines_tb.write(level ? 1 : 0);
+}
+
+// The SPI flash, one clock
+void cpu_run_t::tick_flash()
+{
+  flash_io_di_tb.write(flash.tick(flash_csb_tb.read(), flash_clk_tb.read(),
+				  flash_io_oe_tb.read(),
+				  flash_io_do_tb.read()));
+}
+
+// XIP fetches, and the ones that waited for the flash. A fetch is
+// counted each clock it hits, so a word fetched again while FD stalls
+// for something else counts again
+void cpu_run_t::count_xip()
+{
+  auto xip = dut->cpu_top->CT0->MMU0->XIP0;
+  if (xip->line_done) {
+    ++xip_lines;
+    if (xip->fill_prefetch) ++xip_prefetched;
+  }
+  if (!xip->fetch_p) {
+    xip_waiting = false;
+  }
+  else if (!xip->fetch_hit) {
+    ++xip_stall_cycles;
+    xip_waiting = true;
+  }
+  else {
+    ++xip_fetches;
+    if (xip_waiting) ++xip_misses;
+    xip_waiting = false;
+  }
+}
+
+// While WFI waits for the timer interrupt, nothing but mtime changes.
+// Move mtime and mcycle to just before the next mtimecmp event, instead
+// of simulating every idle clock. Returns the number of clocks skipped
+uint64_t cpu_run_t::skip_idle(uint64_t budget)
+{
+  auto cpu = dut->cpu_top->CT0->CPU0;
+  auto timer = dut->cpu_top->IO0->TIMER0;
+  // Hart 1 may still run
+  if (dut->cpu_top->CT0->num_harts > 1) return 0;
+  // The latency harness counts every clock
+  if (irq_latency) return 0;
+  if (!cpu->FD_wfi_stall || !cpu->CSR_EHU0->mtie) return 0;
+  // The DMA is still copying
+  if (dut->cpu_top->IO0->DMA0->busy) return 0;
+  // A posted IO write is still on the bus
+  if (dut->cpu_top->IO0->wb_stb) return 0;
+  // A line is read from the flash
+  if (dut->cpu_top->CT0->MMU0->XIP0->filling) return 0;
+  // A byte is on a UART line, or about to be sent to the RX line
+  auto u = dut->cpu_top->IO0->UART0;
+  if (u->tx_busy || u->rx_busy || uart.busy()) return 0;
+  // Leave two clocks for the comparator to raise the interrupt
+  if (timer->mtimecmp < timer->mtime + 2) return 0;
+  uint64_t skip = timer->mtimecmp - timer->mtime - 1;
+  if (skip > budget) skip = budget;
+  timer->mtime += skip;
+  cpu->CSR_EHU0->mcycle += skip;
+  skipped_cycles += skip;
+  return skip;
+}
+
+// Waits for GDB, and gives it the registers and memory of the model.
+// Registers read with the writeback in XB, as GDB sees the instructions
+// before FD done. A register written goes to the instructions after
+// the one in FD, which may already have read its operands. The pc can
+// only be written with its value, as FD already has the word of the ROM
+// fetched at it. Writes to the ROM go to its array, so GDB can patch
+// the program
+bool cpu_run_t::attach_gdb()
+{
+  gdb.reset(new gdb_stub_t);
+  auto cpu = dut->cpu_top->CT0->CPU0;
+  gdb->read_reg = [this, cpu](int r) -> uint32_t {
+    auto rf = cpu->RF;
+    if (r == 32) return *FD_PC;
+    // An RV32E register file has 16
+    size_t n = sizeof(rf->data) / sizeof(rf->data[0]);
+    if (r == 0 || static_cast<size_t>(r) >= n) return 0;
+    if (rf->we_rd && rf->a_rd == r) return rf->d_rd;
+    return rf->data[r];
+  };
+  gdb->write_reg = [this, cpu](int r, uint32_t value) {
+    auto rf = cpu->RF;
+    if (r == 32) return value == *FD_PC;
+    if (r == 0) return true;
+    // The EBRs are not visible, data is only their copy
+    if (rf->ENABLE_RF_EBR) return false;
+    if (static_cast<size_t>(r) >= sizeof(rf->data) / sizeof(rf->data[0])) {
+      return value == 0;
+    }
+    rf->data[r] = value;
+    if (rf->we_rd && rf->a_rd == r) debug_rewrites.push_back({r, value});
+    return true;
+  };
+  gdb->read_byte = [this](uint32_t addr) { return read_byte(addr); };
+  gdb->write_byte = [this](uint32_t addr, uint8_t byte) {
+    if (addr >= 0x1000) {
+      write_byte(addr, byte);
+      return;
+    }
+    uint32_t shift = 8 * (addr & 3);
+    ROM[addr >> 2] = (ROM[addr >> 2] & ~(0xFFu << shift)) | (byte << shift);
+  };
+  // Stopped at the first clock
+  debug_mode = DEBUG_STEP;
+  debug_advanced = true;
+  return gdb->listen(gdb_port);
+}
+
+// A clock the debugger has to look at: a breakpoint may be in FD, or the
+// simulation is stepping, watching or stopped at reset. Returns false
+// when GDB kills the simulation
+bool cpu_run_t::debug_clock()
+{
+  auto cpu = dut->cpu_top->CT0->CPU0;
+  for (auto& w : debug_rewrites) cpu->RF->data[w.first] = w.second;
+  debug_rewrites.clear();
+
+  if (debug_mode != DEBUG_RUN && debug_advanced) {
+    if (debug_mode == DEBUG_STEP) {
+      if (!debug_stop(5, debug_reason)) return false;
+    }
+    else {
+      debug_mode = DEBUG_RUN;
+    }
+  }
+  if (debug_mode == DEBUG_RUN && gdb) {
+    if (gdb->breakpoint(*FD_PC)) {
+      if (!debug_stop(5, "")) return false;
+    }
+    else if (gdb->interrupted(cycles)) {
+      if (!debug_stop(2, "")) return false;
+    }
+  }
+  // Detached, or GDB went away
+  if (!gdb || !gdb->connected()) {
+    gdb.reset();
+    return true;
+  }
+
+  // An access of the data port a watchpoint covers, stopping after its
+  // instruction
+  if (gdb->watching() && cpu->dm_be) {
+    auto w = gdb->watch(cpu->dm_addr, cpu->dm_be, cpu->dm_we);
+    if (w) {
+      debug_mode = DEBUG_STEP;
+      debug_reason = gdb_stub_t::watch_reason(*w);
+    }
+  }
+  // FD takes the next instruction at this rising edge
+  if (debug_mode != DEBUG_RUN) {
+    debug_advanced = !cpu->FD_stall || cpu->FD_initiate_exception;
+  }
+  gdb->every_clock = debug_mode != DEBUG_RUN || gdb->watching()
+    || !debug_rewrites.empty();
+  return true;
+}
+
+// Serves GDB until it resumes. Returns false when it kills the simulation
+bool cpu_run_t::debug_stop(int signal, const std::string& reason)
+{
+  switch (gdb->stopped(signal, reason)) {
+  case gdb_stub_t::KILL:
+    return false;
+  case gdb_stub_t::DETACH:
+    gdb.reset();
+    debug_mode = DEBUG_RUN;
+    return true;
+  case gdb_stub_t::STEP:
+    debug_mode = DEBUG_STEP;
+    break;
+  case gdb_stub_t::CONTINUE:
+    // Past the instruction stopped at, then to the next breakpoint
+    debug_mode = DEBUG_STEP_RUN;
+    break;
+  }
+  debug_advanced = false;
+  debug_reason.clear();
+  return true;
+}
+
 // Handshake happens when 0x80000000 writes non-zero
 //void cpu_run_t::tb_handshake()
 //{
@@ -229,6 +592,76 @@ void cpu_run_t::scan_memory_for_base_address()
   }
 }
 
+void cpu_run_t::report_statistics(uint64_t cycles)
+{
+  uint64_t instret = dut->cpu_top->CT0->CPU0->CSR_EHU0->minstret;
+  std::cout << "(SS) Cycles: " << std::dec << cycles << std::endl;
+  std::cout << "(SS) Skipped idle cycles: " << skipped_cycles << std::endl;
+  std::cout << "(SS) Instructions: " << instret << std::endl;
+  if (instret != 0) {
+    std::cout << "(SS) CPI: " << std::fixed << std::setprecision(3)
+	      << static_cast<double>(cycles) / instret << std::endl;
+  }
+  if (dut->cpu_top->CT0->num_harts > 1) {
+    for (int h=0; h<2; ++h) {
+      std::cout << "(SS) Hart " << std::dec << h << " instructions: "
+		<< hart_instret[h] << std::endl;
+      if (hart_instret[h] != 0) {
+	std::cout << "(SS) Hart " << h << " CPI: " << std::fixed
+		  << std::setprecision(3)
+		  << static_cast<double>(cycles) / hart_instret[h]
+		  << std::endl;
+      }
+      std::cout << "(SS) Hart " << h << " arbitration stall cycles: "
+		<< hart_arb_stalls[h] << std::endl;
+    }
+  }
+  if (dma_words != 0) {
+    std::cout << "(SS) DMA words: " << std::dec << dma_words << std::endl;
+    std::cout << "(SS) DMA busy cycles: " << dma_busy_cycles << std::endl;
+    std::cout << "(SS) DMA bandwidth: " << std::fixed << std::setprecision(3)
+	      << 4.0 * dma_words / dma_busy_cycles << " bytes/cycle"
+	      << std::endl;
+  }
+  if (io_beats != 0) {
+    std::cout << "(SS) IO bus beats: " << std::dec << io_beats << std::endl;
+    std::cout << "(SS) IO bus stall cycles: " << io_stall_cycles
+	      << std::endl;
+    std::cout << "(SS) IO bus utilization: " << std::fixed
+	      << std::setprecision(3)
+	      << static_cast<double>(io_busy_cycles) / cycles << std::endl;
+  }
+  if (xip_fetches != 0) {
+    std::cout << "(SS) XIP fetches: " << std::dec << xip_fetches << std::endl;
+    std::cout << "(SS) XIP hit rate: " << std::fixed << std::setprecision(3)
+	      << 1.0 - static_cast<double>(xip_misses) / xip_fetches
+	      << std::endl;
+    std::cout << "(SS) XIP fetch stall cycles: " << std::dec
+	      << xip_stall_cycles << std::endl;
+    std::cout << "(SS) XIP lines filled: " << xip_lines << std::endl;
+    std::cout << "(SS) XIP lines prefetched: " << xip_prefetched << std::endl;
+    std::cout << "(SS) Flash reads: " << flash.transactions << std::endl;
+    std::cout << "(SS) Flash bytes read: " << flash.read_bytes << std::endl;
+  }
+  if (semihost.requests != 0) {
+    std::cout << "(SS) Semihosting requests: " << std::dec
+	      << semihost.requests << std::endl;
+    std::cout << "(SS) Semihosting bytes: " << semihost.bytes << std::endl;
+  }
+  if (irq_latency) irq_latency->report();
+  if (uart.enabled()) {
+    std::cout << "(SS) UART TX bytes: " << std::dec << uart.tx_bytes
+	      << std::endl;
+    std::cout << "(SS) UART RX bytes: " << uart.rx_bytes << std::endl;
+  }
+  if (cop_ops != 0) {
+    std::cout << "(SS) Coprocessor operations: " << std::dec << cop_ops
+	      << std::endl;
+    std::cout << "(SS) Coprocessor mismatches: " << cop_mismatches
+	      << std::endl;
+  }
+}
+
 void cpu_run_t::dump_memory()
 {
   bool begin_dump = false;
@@ -265,9 +698,24 @@ void cpu_run_t::test_thread()
     exit(1);
   }
   reset();
-  for (int i=0; i<4096; ++i) {
+  if (gdb_port && !attach_gdb()) {
+    std::cerr << "GDB attach failed!" << std::endl;
+    exit(1);
+  }
+  for (cycles = 0; cycles<max_cycles; ++cycles) {
+    // Past the stop at reset, no more than a PC compare until GDB needs
+    // the clock
+    if (gdb && gdb->attention(*FD_PC, cycles) && !debug_clock()) break;
     poll_io();
-    view_snapshot_hex();
+    check_coprocessor();
+    count_dma();
+    count_harts();
+    count_io_bus();
+    tick_uart();
+    tick_irq_latency();
+    tick_flash();
+    count_xip();
+    if (!gdb_port) view_snapshot_hex();
     if (test_passes) {
       std::cout << "A test passes!" << std::endl;
     }
@@ -278,10 +726,18 @@ void cpu_run_t::test_thread()
       std::cout << "End of the test." << std::endl;
       break;
     }
+    if (semihost.exited) {
+      std::cout << "Exit with code " << std::dec << semihost.exit_code
+		<< std::endl;
+      break;
+    }
+    cycles += skip_idle(max_cycles - cycles - 1);
     wait();
   }
+  if (gdb) gdb->exited(semihost.exit_code);
   // TODO: Dump memory
   dump_memory();
+  report_statistics(cycles);
   sc_stop();
 }
 
@@ -291,15 +747,46 @@ int sc_main(int argc, char** argv)
 {
   Verilated::commandArgs(argc, argv);
 
-  assert(argc == 2);
+  // cpu_run <program> [max cycles] [+uart_pty] [+uart_in=<file>]
+  //         [+uart_out=<file>|-] [+irq_latency[=<seed>]] [+gdb[=<port>]]
+  std::vector<std::string> args;
+  std::string uart_in, uart_out;
+  bool uart_pty = false;
+  bool irq_latency = false;
+  uint32_t irq_seed = 1;
+  int gdb_port = 0;
+  for (int i=1; i<argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "+uart_pty") uart_pty = true;
+    else if (arg == "+irq_latency") irq_latency = true;
+    else if (arg.rfind("+irq_latency=", 0) == 0) {
+      irq_latency = true;
+      irq_seed = std::stoul(arg.substr(13));
+    }
+    else if (arg == "+gdb") gdb_port = 3333;
+    else if (arg.rfind("+gdb=", 0) == 0) gdb_port = std::stoi(arg.substr(5));
+    else if (arg.rfind("+uart_in=", 0) == 0) uart_in = arg.substr(9);
+    else if (arg.rfind("+uart_out=", 0) == 0) uart_out = arg.substr(10);
+    else if (arg[0] != '+') args.push_back(arg);
+  }
+  assert(args.size() == 1 || args.size() == 2);
 
-  auto tb = new cpu_run_t("cpu0", argv[1]);
+  uint64_t max_cycles = (args.size() == 2) ? std::stoull(args[1]) : 4096;
+  auto tb = new cpu_run_t("cpu0", args[0], max_cycles);
+  if (uart_pty ? !tb->uart.open_pty()
+      : !tb->uart.open_files(uart_in, uart_out)) {
+    std::cerr << "UART open failed!" << std::endl;
+    exit(1);
+  }
+  if (irq_latency) tb->irq_latency.reset(new irq_latency_t(17, irq_seed));
+  tb->gdb_port = gdb_port;
 
   sc_clock sysclk("sysclk", 10, SC_NS);
   tb->clk_tb(sysclk);
   
   sc_start();
 
+  int exit_code = tb->semihost.exit_code;
   delete tb;
-  exit(0);
+  exit(exit_code);
 }
@@ -5,30 +5,63 @@ module cpu_top
   (
    input wire clk,
    input wire resetb,
-   output wire [7:0] gpio0
+   output wire [7:0] gpio0,
+   output wire uart_tx,
+   input wire uart_rx,
+   // Interrupt lines, local interrupts 17-19
+   input wire [2:0] irq_lines,
+   // SPI flash of XIP. IO2 and IO3 are WP# and HOLD# in dual mode
+   output wire flash_csb,
+   output wire flash_clk,
+   output wire [3:0] flash_io_oe,
+   output wire [3:0] flash_io_do,
+   input wire [3:0] flash_io_di
    );
 
-   wire [7:0] io_addr;
-   wire       io_en, io_we;
-   wire [31:0] io_data_read;
-   wire [31:0] io_data_write;
-   wire        irq_mtimecmp;
+   wire        wb_stb, wb_we, wb_ack;
+   wire [7:2]  wb_adr;
+   wire [3:0]  wb_sel;
+   wire [31:0] wb_dat_w, wb_dat_r;
+   wire        irq_mtimecmp, irq_mtimecmp1;
+   wire        irq_dma, irq_uart;
+   wire        dma_req, dma_we, dma_gnt;
+   wire [31:0] dma_addr, dma_di, dma_do;
+   wire        trace_valid, trace_br, trace_taken, trace_jr, trace_trap;
+   wire [31:0] trace_pc, trace_target;
 
    core_top CT0 
      (
       .clk(clk), .resetb(resetb),
-      .io_addr(io_addr), .io_en(io_en), .io_we(io_we),
-      .io_data_read(io_data_read), .io_data_write(io_data_write),
-      .irq_mtimecmp(irq_mtimecmp)
+      .wb_stb(wb_stb), .wb_we(wb_we), .wb_adr(wb_adr), .wb_sel(wb_sel),
+      .wb_dat_w(wb_dat_w), .wb_dat_r(wb_dat_r), .wb_ack(wb_ack),
+      .irq_mtimecmp(irq_mtimecmp), .irq_external(irq_dma),
+      .irq_local({12'b0, irq_lines, irq_uart}),
+      .irq_mtimecmp1(irq_mtimecmp1),
+      .dma_req(dma_req), .dma_addr(dma_addr), .dma_we(dma_we),
+      .dma_di(dma_di), .dma_gnt(dma_gnt), .dma_do(dma_do),
+      .flash_csb(flash_csb), .flash_clk(flash_clk),
+      .flash_io_oe(flash_io_oe), .flash_io_do(flash_io_do),
+      .flash_io_di(flash_io_di),
+      .trace_valid(trace_valid), .trace_br(trace_br),
+      .trace_taken(trace_taken), .trace_jr(trace_jr),
+      .trace_trap(trace_trap), .trace_pc(trace_pc),
+      .trace_target(trace_target)
       );
 
    io_port IO0
      (
       .clk(clk), .resetb(resetb),
-      .io_addr(io_addr), .io_en(io_en), .io_we(io_we),
-      .io_data_read(io_data_read), .io_data_write(io_data_write),
-      .irq_mtimecmp(irq_mtimecmp),
-      .gpio0(gpio0)
+      .wb_stb(wb_stb), .wb_we(wb_we), .wb_adr(wb_adr), .wb_sel(wb_sel),
+      .wb_dat_w(wb_dat_w), .wb_dat_r(wb_dat_r), .wb_ack(wb_ack),
+      .irq_mtimecmp(irq_mtimecmp), .irq_mtimecmp1(irq_mtimecmp1),
+      .irq_dma(irq_dma), .irq_uart(irq_uart),
+      .dma_req(dma_req), .dma_addr(dma_addr), .dma_we(dma_we),
+      .dma_di(dma_di), .dma_gnt(dma_gnt), .dma_do(dma_do),
+      .gpio0(gpio0), .uart_tx(uart_tx), .uart_rx(uart_rx),
+      .trace_valid(trace_valid), .trace_br(trace_br),
+      .trace_taken(trace_taken), .trace_jr(trace_jr),
+      .trace_trap(trace_trap), .trace_pc(trace_pc),
+      .trace_target(trace_target)
       );
 
 
@@ -2,6 +2,12 @@
 
 #include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <sys/wait.h>
 
 //#include "rom_1024x32_t.hpp"
 #include "Vcpu_top.h"
@@ -13,9 +19,21 @@
 #include "Vcpu_top_regfile.h"
 #include "Vcpu_top_EBRAM_ROM.h"
 #include "disasm.h"
+#include "spi_flash_model.h"
+#include "subarch_manifest.h"
 
 //////////////////////////////////////////////////
 
+// Outcome of one test, and its (TT) lines
+struct test_result_t
+{
+  size_t index = 0;
+  bool passed = false;
+  // Clocks simulated, reset included
+  uint64_t clocks = 0;
+  std::string log;
+};
+
 class cpu_top_tb_t : public sc_module
 {
 public:
@@ -29,22 +47,51 @@ public:
   sc_in<bool> clk_tb;
   sc_signal<bool> resetb_tb;
   sc_signal<uint32_t> gpio0_tb;
+  // UART TX is looped back to RX
+  sc_signal<bool> uart_loop_tb;
+  sc_signal<uint32_t> irq_lines_tb;
+  sc_signal<bool> flash_csb_tb, flash_clk_tb;
+  sc_signal<uint32_t> flash_io_oe_tb, flash_io_do_tb, flash_io_di_tb;
+  // Holds the program image too, for XIP
+  spi_flash_model_t flash;
+
+  // Tests to run, in order, with their index in the manifest
+  std::vector<std::pair<size_t, const subarch_test_t*>> selected_tests;
+  // Print FD and x1 every clock
+  bool trace = false;
+  // Results are written to this pipe instead of stdout, by a worker
+  int result_fd = -1;
+  std::vector<test_result_t> results;
 
   SC_CTOR(cpu_top_tb_t)
     : clk_tb("clk_tb")
     , resetb_tb("resetb_tb")
     , gpio0_tb("gpio0_tb")
+    , uart_loop_tb("uart_loop_tb")
+    , irq_lines_tb("irq_lines_tb")
+    , flash_csb_tb("flash_csb_tb"), flash_clk_tb("flash_clk_tb")
+    , flash_io_oe_tb("flash_io_oe_tb"), flash_io_do_tb("flash_io_do_tb")
+    , flash_io_di_tb("flash_io_di_tb")
   {
     SC_CTHREAD(test_thread, clk_tb.pos());
+    SC_CTHREAD(flash_thread, clk_tb.pos());
 
     dut = new Vcpu_top("dut");
     dut->clk(clk_tb);
     dut->resetb(resetb_tb);
     dut->gpio0(gpio0_tb);
+    dut->uart_tx(uart_loop_tb);
+    dut->uart_rx(uart_loop_tb);
+    dut->irq_lines(irq_lines_tb);
+    dut->flash_csb(flash_csb_tb);
+    dut->flash_clk(flash_clk_tb);
+    dut->flash_io_oe(flash_io_oe_tb);
+    dut->flash_io_do(flash_io_do_tb);
+    dut->flash_io_di(flash_io_di_tb);
     ROM = dut->cpu_top->CT0->MMU0->rom0->ROM;
     FD_PC = &(dut->cpu_top->CT0->CPU0->FD_PC);
-    FD_inst = &(dut->cpu_top->CT0->CPU0->im_do);
-    // FD_disasm_opcode = 
+    FD_inst = &(dut->cpu_top->CT0->CPU0->FD_inst);
+    // FD_disasm_opcode =
     //   (char*)dut->cpu_top->CT0->CPU0->inst_dec->disasm_opcode;
   }
 
@@ -53,12 +100,6 @@ public:
     delete dut;
   }
 
-  std::string reverse(char* s) {
-    std::string str(s);
-    std::reverse(str.begin(), str.end());
-    return str;
-  }
-
   void reset()
   {
     resetb_tb.write(false);
@@ -80,7 +121,8 @@ public:
       if (size == 0 || size > 2048) {
 	return false;
       }
-      if (size % 4 != 0) {
+      // RV32C programs may end on a halfword
+      if (size % 2 != 0) {
 	return false;
       }
       f.seekg(0, f.beg);
@@ -89,10 +131,8 @@ public:
       // std::vector<unsigned char> buf
       //   (std::istreambuf_iterator<char>(f), {});
 
-      auto words = (uint32_t*) buf;
-      for (int i=0; i<size/4; ++i) {
-        ROM[i] = words[i];
-      }
+      std::memcpy(ROM, buf, size);
+      flash.load(buf, size, spi_flash_model_t::IMAGE_OFFSET);
       f.close();
       delete[] buf;
       //update.write(!update.read());
@@ -103,463 +143,291 @@ public:
     }
   }
 
-  bool report_failure(uint32_t failure_vec, uint32_t prev_PC) 
+  uint32_t reg(int r)
   {
-      if (*FD_PC == failure_vec || disasm(*FD_inst) == "ILLEGAL ") {
-	std::cout << "(TT) Test failed! prevPC = 0x" 
-          << std::hex << prev_PC << std::endl;
-        return true;
-      }
-      return false;
+    auto& data = dut->cpu_top->CT0->CPU0->RF->data;
+    // An RV32E register file has 16
+    if (static_cast<size_t>(r) >= sizeof(data) / sizeof(data[0])) return 0;
+    return data[r];
   }
 
-  void view_snapshot_pc()
+  void view_snapshot_hex(std::ostream& out)
   {
-    std::cout << "(TT) Opcode=" << disasm(*FD_inst)
-      << std::hex 
-      << ", FD_PC=0x" 
-      << *FD_PC
-      //<< ", inst: "
-      //<< dut->cpu_top->CT0->CPU0->im_do
-      //<< ", ex:mepc:br:j:jr" 
-      << std::endl;
-  }
-  void view_snapshot_hex()
-  {
-      std::cout << "(TT) Opcode=" << disasm(*FD_inst)
-		<< ", FD_PC=0x" 
-                << std::hex 
-                << *FD_PC
-		<< ", x1 = 0x" << std::hex
-		<< dut->cpu_top->CT0->CPU0->RF->data[1]
-		<< std::endl;
+      out << "(TT) Opcode=" << disasm(*FD_inst)
+	  << ", FD_PC=0x"
+	  << std::hex
+	  << *FD_PC
+	  << ", x1 = 0x" << std::hex
+	  << reg(1)
+	  << std::dec
+	  << std::endl;
   }
 
-  void view_snapshot_int()
-  {
-      std::cout << "(TT) Opcode=" << disasm(*FD_inst)
-		<< ", FD_PC=0x" 
-                << std::hex 
-                << *FD_PC
-		<< ", x1 = "
-                << std::dec
-		<< static_cast<int32_t>(dut->cpu_top->CT0->CPU0->RF->data[1])
-		<< std::endl;
-  }
+  bool run_test(const subarch_test_t& t, std::ostream& out);
   void test_thread(void);
 
-  void test0(void);
-  void test1(void);
-  void test2(void);
-  void test3(void);
-  void test4(void);
-  void test5(void);
-  void test6(void);
-  void test7(void);
-  void test8(void);
-  void test9(void);
-  void test10(void);
-  void test11(void);
-  void test12(void);
-  void test13(void);
-  void test14(void);
-  void test15(void);
-};
-
-
-void cpu_top_tb_t::test0()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 0: NOP and J Test " << std::endl
-    << "(TT) 1. Waveform must be inspected" << std::endl
-    << "(TT) 2. Before reset, PC is at 0xFFFFFFFC." << std::endl
-    << "(TT) 3. Reset PC is 0x0, which then jumps to 0xC." << std::endl
-    << "(TT) 4. Then, increments at steps of 0x4." << std::endl
-    << "(TT) 5. Then, jumps to 0xC after 0x20." << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
-  if (!load_program("tb_out/00-nop.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    for (int i=0; i<12; ++i) {
-      view_snapshot_pc();
-      wait();
-    }
-  }
-}
-
-void cpu_top_tb_t::test1()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 1: OP-IMM Test " << std::endl
-    << "(TT) 1. Waveform must be inspected" << std::endl
-    << "(TT) 2. OP-IMM's start at PC=10, depositing x1 in XB stage" << std::endl
-    << "(TT) 3. x1=1,2,3,4,5,6,1,2,1,0,1,-1,-1" << std::endl
-    << "(TT) 4. Loops to 0x0C at 0x40" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
-  if (!load_program("tb_out/01-opimm.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    for (int i=0; i<20; ++i) {
-      view_snapshot_int();
+  // The flash, one clock at a time
+  void flash_thread(void)
+  {
+    while (true) {
+      flash_io_di_tb.write(flash.tick(flash_csb_tb.read(),
+				      flash_clk_tb.read(),
+				      flash_io_oe_tb.read(),
+				      flash_io_do_tb.read()));
       wait();
     }
   }
-}
+};
 
-void cpu_top_tb_t::test2()
+bool cpu_top_tb_t::run_test(const subarch_test_t& t, std::ostream& out)
 {
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 2: OP Test " << std::endl
-    << "(TT) 1. Waveform must be inspected" << std::endl
-    << "(TT) 2. OP's start at PC=14." << std::endl
-    << "(TT) 3. x1=4,3,1,0,1,0,1,2,4,2,-2,-1,1,0,1" << std::endl
-    << "(TT) 4. Loops to 0x0C at 50" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
-
- if (!load_program("tb_out/02-op.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    for (int i=0; i<24; ++i) {
-      view_snapshot_int();
-      wait();
-    }
+  out << "(TT) --------------------------------------------------" << std::endl
+      << "(TT) Test " << t.name << ": " << t.program << std::endl;
+  if (!load_program(t.program)) {
+    out << "(TT) Test failed! Program loading failed" << std::endl
+	<< "(TT) Test " << t.name << " FAILED" << std::endl;
+    return false;
   }
-}
-void cpu_top_tb_t::test3()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 3: Branch Test " << std::endl
-    << "(TT) 1. Waveform must be inspected" << std::endl
-    << "(TT) 2. Each type of branch instruction executes twice" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
-  if (!load_program("tb_out/03-br.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
+  reset();
 
-    for (int i=0; i<48; ++i) {
-      view_snapshot_pc();
-      wait();
+  // Values of FD_PC or a register, repeats dropped
+  std::vector<std::vector<uint32_t>> traces(t.sequences.size());
+  std::vector<int> visits(t.visits.size(), 0);
+  bool passed = true;
+  uint32_t prev_PC = 0;
+  for (int i=0; i<t.clocks; ++i) {
+    if (trace) view_snapshot_hex(out);
+    uint32_t pc = *FD_PC;
+    if ((t.has_fail_pc && pc == t.fail_pc)
+	|| disasm(*FD_inst) == "ILLEGAL ") {
+      out << "(TT) Test failed! prevPC = 0x"
+	  << std::hex << prev_PC << std::dec << std::endl;
+      passed = false;
+      break;
     }
-  }
-}
-void cpu_top_tb_t::test4()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 4: LUI/AUIPC Test " << std::endl
-    << "(TT) 1. Waveform must be inspected" << std::endl
-    << "(TT) 2. First, x1 will be loaded with 0xDEADBEEF" << std::endl
-    << "(TT) 3. Then, x1 will be loaded with PC=0x14" << std::endl
-    << "(TT) 4. Loops at 0x18" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
-
- if (!load_program("tb_out/04-lui.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    for (int i=0; i<16; ++i) {
-      view_snapshot_hex();
-      wait();
+    for (size_t k=0; k<t.sequences.size(); ++k) {
+      int r = t.sequences[k].reg;
+      uint32_t value = (r == subarch_test_t::sequence_t::PC) ? pc : reg(r);
+      if (traces[k].empty() || traces[k].back() != value) {
+	traces[k].push_back(value);
+      }
     }
-  }
-}
-void cpu_top_tb_t::test5()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 5: JAL/JALR Test " << std::endl
-    << "(TT) 1. Waveform must be inspected" << std::endl
-    << "(TT) 2. PC=00,0C,18,10,1C,14,0C,18,10,1C,..." << std::endl
-    << "(TT) 3. x1=XX,XX,XX,10,10,14,20,20,10,10,..." << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
-    
-  if (!load_program("tb_out/05-jalr.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    for (int i=0; i<16; ++i) {
-      view_snapshot_hex();
-      wait();
+    for (size_t k=0; k<t.visits.size(); ++k) {
+      if (pc == t.visits[k].pc && prev_PC != pc) ++visits[k];
     }
+    prev_PC = pc;
+    wait();
   }
-}
-  
-void cpu_top_tb_t::test6()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 6: CSRR Test " << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
-    
-  if (!load_program("tb_out/06-csrr.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<96; ++i) {
-      if (report_failure(0x10, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
+
+  for (size_t k=0; passed && k<t.sequences.size(); ++k) {
+    if (!subarch_test_t::contains(traces[k], t.sequences[k].values)) {
+      int r = t.sequences[k].reg;
+      out << "(TT) Test failed! ";
+      if (r == subarch_test_t::sequence_t::PC) out << "FD_PC";
+      else out << "x" << r;
+      out << " went through" << std::hex;
+      for (uint32_t v : traces[k]) out << " 0x" << v;
+      out << std::dec << std::endl;
+      passed = false;
     }
   }
-}
-void cpu_top_tb_t::test7()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 7: CSRWI Test " << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
- if (!load_program("tb_out/07-csrwi.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<96; ++i) {
-      //view_snapshot_int();
-      if (report_failure(0x10, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
+  for (size_t k=0; passed && k<t.visits.size(); ++k) {
+    if (visits[k] < t.visits[k].count) {
+      out << "(TT) Test failed! 0x" << std::hex << t.visits[k].pc
+	  << std::dec << " reached " << visits[k] << " times, expected "
+	  << t.visits[k].count << std::endl;
+      passed = false;
     }
   }
+  out << "(TT) Test " << t.name << (passed ? " passed" : " FAILED")
+      << std::endl;
+  return passed;
 }
 
-void cpu_top_tb_t::test8()
+void cpu_top_tb_t::test_thread()
 {
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 8: CSRW Test " << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
- if (!load_program("tb_out/08-csrw.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<96; ++i) {
-      if (report_failure(0x10, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
-    }
-  }
-}
+  reset();
 
-void cpu_top_tb_t::test9()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 9: CSRSI Test " << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
- if (!load_program("tb_out/09-csrsi.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<96; ++i) {
-      if (report_failure(0x10, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
+  for (auto& sel : selected_tests) {
+    std::ostringstream out;
+    test_result_t r;
+    r.index = sel.first;
+    sc_time start = sc_time_stamp();
+    r.passed = run_test(*sel.second, out);
+    r.clocks = (sc_time_stamp() - start) / sc_time(10, SC_NS);
+    r.log = out.str();
+    if (result_fd < 0) {
+      std::cout << r.log << std::flush;
     }
-  }
-}
-
-void cpu_top_tb_t::test10()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 10: CSRS Test " << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
- if (!load_program("tb_out/10-csrs.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<96; ++i) {
-      if (report_failure(0x10, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
+    else {
+      // index passed clocks length, then the log
+      std::ostringstream rec;
+      rec << r.index << " " << r.passed << " " << r.clocks << " "
+	  << r.log.size() << "\n"
+	  << r.log;
+      std::string s = rec.str();
+      for (size_t done = 0; done < s.size();) {
+	ssize_t n = write(result_fd, s.data() + done, s.size() - done);
+	if (n <= 0) break;
+	done += n;
+      }
     }
+    results.push_back(r);
   }
-}
 
-void cpu_top_tb_t::test11()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 11: CSRCI Test " << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
- if (!load_program("tb_out/11-csrci.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<96; ++i) {
-      if (report_failure(0x10, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
-    }
-  }
+  sc_stop();
 }
 
-void cpu_top_tb_t::test12()
+////////////////////////
+
+// Runs tests on one model, which lives until the process exits
+static std::vector<test_result_t>
+run_tests(const std::vector<std::pair<size_t, const subarch_test_t*>>& tests,
+	  bool trace, int result_fd)
 {
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 12: CSRC Test " << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
- if (!load_program("tb_out/12-csrc.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<96; ++i) {
-      //view_snapshot_hex();
-      if (report_failure(0x10, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
-    }
-  }
+  auto tb = new cpu_top_tb_t("tb");
+  tb->selected_tests = tests;
+  tb->trace = trace;
+  tb->result_fd = result_fd;
+
+  sc_clock sysclk("sysclk", 10, SC_NS);
+  tb->clk_tb(sysclk);
+
+  sc_start();
+
+  auto results = tb->results;
+  delete tb;
+  return results;
 }
 
-void cpu_top_tb_t::test13()
+// Reads the records of a worker, see test_thread
+static void read_results(int fd, std::vector<test_result_t>& results)
 {
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 13: CSR Atomic Test " << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
- if (!load_program("tb_out/13-csr.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
-  }
-  else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<48; ++i) {
-      //view_snapshot_int();
-      if (report_failure(0x10, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
-    }
+  std::string data;
+  char buf[4096];
+  for (ssize_t n; (n = read(fd, buf, sizeof(buf))) > 0;) {
+    data.append(buf, n);
+  }
+  std::istringstream in(data);
+  test_result_t r;
+  size_t size;
+  while (in >> r.index >> r.passed >> r.clocks >> size) {
+    in.get();
+    r.log.resize(size);
+    in.read(&r.log[0], size);
+    results.push_back(r);
   }
 }
 
-void cpu_top_tb_t::test14()
+int sc_main(int argc, char** argv)
 {
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 14: Memory " << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
- if (!load_program("tb_out/14-mem.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
+  Verilated::commandArgs(argc, argv);
+
+  // cpu_top_tb [+manifest=<file>] [+jobs=<n>] [+trace] [test]...
+  std::string manifest = "test/subarch.txt";
+  int jobs = 1;
+  bool trace = false;
+  std::vector<std::string> names;
+  for (int i=1; i<argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 10, "+manifest=") == 0) manifest = arg.substr(10);
+    else if (arg.compare(0, 6, "+jobs=") == 0) jobs = std::atoi(&argv[i][6]);
+    else if (arg == "+trace") trace = true;
+    else if (arg[0] != '+') names.push_back(arg);
+  }
+
+  std::vector<subarch_test_t> tests;
+  if (!parse_subarch_manifest(manifest, tests)) return 1;
+  // Named tests, or all that need no build option
+  std::vector<std::pair<size_t, const subarch_test_t*>> selected;
+  if (names.empty()) {
+    for (size_t i=0; i<tests.size(); ++i) {
+      if (tests[i].needs.empty()) selected.push_back({i, &tests[i]});
+    }
   }
-  else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<160; ++i) {
-      //view_snapshot_hex();
-      if (report_failure(0x10, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
+  for (auto& name : names) {
+    auto it = std::find_if(tests.begin(), tests.end(),
+			   [&](const subarch_test_t& t) {
+			     return t.name == name;
+			   });
+    if (it == tests.end()) {
+      std::cerr << "No such test: " << name << std::endl;
+      return 1;
     }
+    selected.push_back({static_cast<size_t>(it - tests.begin()), &*it});
   }
-}
 
-void cpu_top_tb_t::test15()
-{
-  std::cout
-    << "(TT) --------------------------------------------------" << std::endl
-    << "(TT) Test 15: Exception" << std::endl
-    << "(TT) 1. On failure, a message is displayed" << std::endl
-    << "(TT) 2. Failure vector is PC=0x10" << std::endl
-    << "(TT) --------------------------------------------------" << std::endl;
- if (!load_program("tb_out/15-exception.bin")) {
-    std::cerr << "Program loading failed!" << std::endl;
+  std::vector<test_result_t> results;
+  auto start = std::chrono::steady_clock::now();
+  jobs = std::max(1, std::min<int>(jobs, selected.size()));
+  if (jobs == 1) {
+    results = run_tests(selected, trace, -1);
   }
   else {
-    reset();
-    uint32_t prev_PC = 0;
-    for (int i=0; i<384; ++i) {
-//      view_snapshot_hex();
-      if (report_failure(0x0C, prev_PC)) break;
-      prev_PC = *FD_PC;
-      wait();
+    // One model per worker process. The longest tests are dealt out
+    // first, each to the worker with the fewest clocks so far
+    std::vector<std::pair<size_t, const subarch_test_t*>> order = selected;
+    std::stable_sort(order.begin(), order.end(),
+		     [](const std::pair<size_t, const subarch_test_t*>& a,
+			const std::pair<size_t, const subarch_test_t*>& b) {
+		       return a.second->clocks > b.second->clocks;
+		     });
+    std::vector<std::vector<std::pair<size_t, const subarch_test_t*>>>
+      share(jobs);
+    std::vector<long> load(jobs, 0);
+    for (auto& sel : order) {
+      int w = std::min_element(load.begin(), load.end()) - load.begin();
+      share[w].push_back(sel);
+      load[w] += sel.second->clocks;
     }
-  }
-}
-
-void cpu_top_tb_t::test_thread()
-{
-  reset();
-
-  test0();
-  test1();
-  test2();
-  test3();
-  test4();
-  test5();
-  test6();
-  test7();
-  test8();
-  test9();
-  test10();
-  test11();
-  test12();
-  test13();
-  test14();
-  test15();
-
-  sc_stop();
-}
-
-////////////////////////
-
-int sc_main(int argc, char** argv)
-{
-  Verilated::commandArgs(argc, argv);
-
-  auto tb = new cpu_top_tb_t("tb");
-
-  sc_clock sysclk("sysclk", 10, SC_NS);
-  tb->clk_tb(sysclk);
-  
-  sc_start();
-
-  delete tb;
-  exit(0);
+    std::cout << std::flush;
+    std::vector<pid_t> pids;
+    std::vector<int> fds;
+    for (int w=0; w<jobs; ++w) {
+      int fd[2];
+      if (pipe(fd) != 0) {
+	std::cerr << "pipe failed" << std::endl;
+	return 1;
+      }
+      pid_t pid = fork();
+      if (pid == 0) {
+	close(fd[0]);
+	run_tests(share[w], trace, fd[1]);
+	close(fd[1]);
+	_exit(0);
+      }
+      close(fd[1]);
+      pids.push_back(pid);
+      fds.push_back(fd[0]);
+    }
+    for (int w=0; w<jobs; ++w) {
+      read_results(fds[w], results);
+      close(fds[w]);
+      waitpid(pids[w], nullptr, 0);
+    }
+    std::sort(results.begin(), results.end(),
+	      [](const test_result_t& a, const test_result_t& b) {
+		return a.index < b.index;
+	      });
+    for (auto& r : results) std::cout << r.log;
+  }
+
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+
+  // A test a worker did not report, e.g. it crashed, failed
+  int passed = 0;
+  uint64_t clocks = 0;
+  for (auto& r : results) {
+    passed += r.passed;
+    clocks += r.clocks;
+  }
+  std::cout << "(TT) --------------------------------------------------"
+	    << std::endl
+	    << "(TT) " << passed << " of " << selected.size()
+	    << " tests passed" << std::endl
+	    << "(TT) " << clocks << " clocks in " << std::fixed
+	    << std::setprecision(2) << seconds << " s, "
+	    << clocks / seconds / 1e6 << " M clocks/s" << std::endl;
+  return (passed == static_cast<int>(selected.size())) ? 0 : 1;
 }
@@ -0,0 +1,138 @@
+#ifndef __DBT_H__
+#define __DBT_H__
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "iss.h"
+
+// Block translating front end of iss.h. A basic block is decoded once
+// into its iss_op_t, and run from the cache afterwards. A block ends
+// at a control transfer or SYSTEM instruction, or after MAX_BLOCK
+// instructions. Each block remembers the blocks it went on to, so that
+// loops and calls go from block to block without a lookup. The timer
+// interrupt is checked between blocks.
+//
+// Translations are dropped when the host writes a ROM page they came
+// from, e.g. a new program or a breakpoint. The data port cannot write
+// the ROM, so the firmware cannot change its code.
+class dbt_t
+{
+public:
+  static const unsigned MAX_BLOCK = 64;
+  static const unsigned CACHE_SIZE = 1024;
+
+  uint64_t blocks_run = 0;
+  uint64_t translations = 0;
+  uint64_t chained = 0;
+  uint64_t flushes = 0;
+
+  explicit dbt_t(iss_t& s) : s(s)
+  {
+    for (auto& b : cache) b = nullptr;
+    s.on_code_write = [this]() { stale = true; };
+  }
+
+  ~dbt_t()
+  {
+    s.on_code_write = nullptr;
+    flush();
+  }
+
+  // Runs until the model stops or waits in a WFI, or about budget
+  // instructions more, the last block run to its end
+  void run(uint64_t budget)
+  {
+    uint64_t end = s.instret + budget;
+    block_t* b = find(s.pc);
+    while (!s.stopped() && !s.wfi && s.instret < end) {
+      ++blocks_run;
+      const iss_op_t* o = b->ops.data();
+      const iss_op_t* last = o + b->ops.size();
+      int r = iss_op_t::NEXT;
+      for (; o != last; ++o) {
+	r = o->fn(s, *o);
+	if (r != iss_op_t::NEXT) break;
+	++s.instret;
+      }
+      if (r == iss_op_t::NEXT) s.pc = b->end_pc;
+      else if (r == iss_op_t::JUMP) ++s.instret;
+      if (s.check_irq() || r == iss_op_t::TRAP || stale) {
+	b = find(s.pc);
+	continue;
+      }
+      // The successor, from one of the two links of the block
+      int k = (s.pc == b->next_pc[0]) ? 0 : (s.pc == b->next_pc[1]) ? 1 : -1;
+      if (k >= 0 && b->next[k]) {
+	++chained;
+	b = b->next[k];
+	continue;
+      }
+      block_t* n = find(s.pc);
+      if (k < 0) k = b->next[0] ? 1 : 0;
+      b->next_pc[k] = s.pc;
+      b->next[k] = n;
+      b = n;
+    }
+  }
+
+  // Drops every translation, and the links between them
+  void flush()
+  {
+    for (auto& kv : blocks) delete kv.second;
+    blocks.clear();
+    for (auto& b : cache) b = nullptr;
+    s.code_pages = 0;
+    stale = false;
+    ++flushes;
+  }
+
+private:
+  struct block_t
+  {
+    uint32_t pc, end_pc;
+    std::vector<iss_op_t> ops;
+    uint32_t next_pc[2];
+    block_t* next[2];
+  };
+
+  iss_t& s;
+  std::unordered_map<uint32_t, block_t*> blocks;
+  // Direct mapped on pc, in front of blocks
+  block_t* cache[CACHE_SIZE];
+  // A code page was written, flush before the next block
+  bool stale = false;
+
+  block_t* find(uint32_t pc)
+  {
+    if (stale) flush();
+    block_t*& c = cache[(pc >> 2) % CACHE_SIZE];
+    if (c && c->pc == pc) return c;
+    auto it = blocks.find(pc);
+    c = (it != blocks.end()) ? it->second : translate(pc);
+    return c;
+  }
+
+  block_t* translate(uint32_t pc)
+  {
+    ++translations;
+    block_t* b = new block_t;
+    b->pc = pc;
+    b->next_pc[0] = b->next_pc[1] = 0;
+    b->next[0] = b->next[1] = nullptr;
+    uint32_t addr = pc;
+    for (unsigned n=0; n<MAX_BLOCK; ++n) {
+      iss_op_t o = iss_t::decode(s.fetch(addr), addr);
+      s.code_pages |= 1u << ((addr & (iss_t::ROM_BYTES - 1)) >> iss_t::PAGE_BITS);
+      b->ops.push_back(o);
+      addr += 4;
+      if (o.ends_block) break;
+    }
+    b->end_pc = addr;
+    blocks[pc] = b;
+    return b;
+  }
+};
+
+#endif // __DBT_H__
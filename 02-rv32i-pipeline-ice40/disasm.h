@@ -10,8 +10,9 @@ inline std::string disasm(uint32_t instruction) {
   const uint32_t mask_funct7_5 = 1 << 30;
   uint32_t op_6_2 = (instruction & mask_op_6_2) >> 2;
   uint32_t funct3 = (instruction & mask_funct3) >> 12;
-  uint32_t a_rs1 = (instruction & a_rs1) >> 15;
-  uint32_t a_rs2 = (instruction & a_rs2) >> 20;
+  uint32_t a_rs1 = (instruction & mask_a_rs1) >> 15;
+  uint32_t a_rs2 = (instruction & mask_a_rs2) >> 20;
+  uint32_t imm_11_0 = instruction >> 20;
   uint32_t funct7 = (instruction & mask_funct7) >> 25;
   uint32_t funct7_5 = (instruction & mask_funct7_5) >> 30;
   switch (op_6_2) {
@@ -20,18 +21,72 @@ inline std::string disasm(uint32_t instruction) {
   case 0b00100:
     switch (funct3) {
     case 0b000: return "ADDI    ";
-    case 0b001: return "SLLI    ";
+    case 0b001:
+      if (funct7 == 0b0110000) {
+        switch (a_rs2) {
+        case 0b00000: return "CLZ     ";
+        case 0b00001: return "CTZ     ";
+        case 0b00010: return "CPOP    ";
+        default: return "OP-IMM  ";
+        }
+      }
+      return "SLLI    ";
     case 0b010: return "SLTI    ";
     case 0b011: return "SLTIU   ";
     case 0b100: return "XORI    ";
-    case 0b101: return funct7_5 ? "SRAI    " : "SRLI    ";
+    case 0b101:
+      if (funct7 == 0b0110000) return "RORI    ";
+      if (imm_11_0 == 0x698) return "REV8    ";
+      if (imm_11_0 == 0x287) return "ORC.B   ";
+      return funct7_5 ? "SRAI    " : "SRLI    ";
     case 0b110: return "ORI     ";
     case 0b111: return "ANDI    ";
     default: return "OP-IMM  ";
     }
+  case 0b00010: return "CUSTOM0 ";
   case 0b00101: return "AUIPC   ";
+  case 0b01010: return "CUSTOM1 ";
+  case 0b01011:
+    switch (funct7 >> 2) {
+    case 0b00010: return "LR.W    ";
+    case 0b00011: return "SC.W    ";
+    case 0b00001: return "AMOSWAP ";
+    case 0b00000: return "AMOADD  ";
+    case 0b00100: return "AMOXOR  ";
+    case 0b01100: return "AMOAND  ";
+    case 0b01000: return "AMOOR   ";
+    case 0b10000: return "AMOMIN  ";
+    case 0b10100: return "AMOMAX  ";
+    case 0b11000: return "AMOMINU ";
+    case 0b11100: return "AMOMAXU ";
+    default: return "AMO     ";
+    }
   case 0b01000: return "STORE   ";
   case 0b01100: 
+    if (funct7 == 0b0100000) {
+      switch (funct3) {
+      case 0b100: return "XNOR    ";
+      case 0b110: return "ORN     ";
+      case 0b111: return "ANDN    ";
+      default: break;
+      }
+    }
+    else if (funct7 == 0b0000101) {
+      switch (funct3) {
+      case 0b100: return "MIN     ";
+      case 0b101: return "MINU    ";
+      case 0b110: return "MAX     ";
+      case 0b111: return "MAXU    ";
+      default: return "OP?     ";
+      }
+    }
+    else if (funct7 == 0b0110000) {
+      switch (funct3) {
+      case 0b001: return "ROL     ";
+      case 0b101: return "ROR     ";
+      default: return "OP?     ";
+      }
+    }
     switch (funct3) {
     case 0b000: return funct7_5 ? "SUB     " : "ADD     ";
     case 0b001: return "SLL     ";
@@ -59,7 +114,9 @@ inline std::string disasm(uint32_t instruction) {
   case 0b11100:
     switch (funct3) {
     case 0b000:
-      return (funct7 == 0b0011000 && a_rs1 == 0b00010 && a_rs1 == 0b00000)
+      if (funct7 == 0b0001000 && a_rs2 == 0b00101 && a_rs1 == 0b00000)
+	return "WFI     ";
+      return (funct7 == 0b0011000 && a_rs2 == 0b00010 && a_rs1 == 0b00000)
 	? "MRET    " : "SYSTEM   ";
     case 0b001: return "CSSRW   ";
     case 0b010: return "CSRRS   ";
@@ -0,0 +1,146 @@
+/*
+ * DMA controller sitting on IO address space
+ * SRC    - 0x80000020, source address
+ * DST    - 0x80000024, destination address
+ * LEN    - 0x80000028, number of words left
+ * STRIDE - 0x8000002C, [15:0] source and [31:16] destination stride in
+ *          bytes, signed. A stride of 0 fills a buffer from one word, or
+ *          writes to one IO register
+ * CTRL   - 0x80000030, write [0] start, [1] interrupt enable. Any write
+ *          clears done. Read [0] busy, [1] interrupt enable, [2] done
+ *          Register writes are ignored while busy
+ *
+ * Words are copied one at a time through the MMU, which grants the DMA
+ * the data port in clocks the core does not access memory. A word takes
+ * at least three clocks: read, data, write. irq_dma is pending while
+ * done and interrupt enable are both set.
+ */
+
+module dma(
+  input wire clk,
+  input wire resetb,
+  // Register port
+  input wire [4:2] io_addr_4_2,
+  input wire io_we,
+  input wire [31:0] io_din,
+  output reg [31:0] io_dout,
+  // Master port to the MMU
+  output reg dma_req,
+  output reg [31:0] dma_addr,
+  output reg dma_we /*verilator public*/,
+  output wire [31:0] dma_di,
+  input wire dma_gnt /*verilator public*/,
+  input wire [31:0] dma_do,
+  // IRQ
+  output wire irq_dma
+  );
+
+  localparam
+    S_IDLE = 2'd0,
+    S_READ = 2'd1,
+    S_DATA = 2'd2,
+    S_WRITE = 2'd3;
+
+  reg [31:0] src, dst, len;
+  reg [15:0] src_stride, dst_stride;
+  reg [1:0] state;
+  reg irq_enable, done;
+  reg [31:0] data;
+  wire busy /*verilator public*/;
+
+  assign busy = state != S_IDLE;
+  assign irq_dma = done & irq_enable;
+  assign dma_di = data;
+
+  // Master port request
+  always @ (*) begin : DMA_REQUEST
+    dma_req = 1'b0;
+    dma_addr = 32'bX;
+    dma_we = 1'b0;
+    case (state)
+      S_READ: begin
+        dma_req = 1'b1;
+        dma_addr = src;
+      end
+      S_WRITE: begin
+        dma_req = 1'b1;
+        dma_addr = dst;
+        dma_we = 1'b1;
+      end
+      default: begin
+      end
+    endcase
+  end
+
+  always @ (posedge clk) begin : DMA_PIPELINE
+    if (!resetb) begin
+      src <= 32'b0;
+      dst <= 32'b0;
+      len <= 32'b0;
+      src_stride <= 16'd4;
+      dst_stride <= 16'd4;
+      state <= S_IDLE;
+      irq_enable <= 1'b0;
+      done <= 1'b0;
+      data <= 32'bX;
+    end
+    else if (clk) begin
+      case (state)
+        S_IDLE: begin
+          if (io_we) begin
+            case (io_addr_4_2)
+              3'b000: src <= io_din;
+              3'b001: dst <= io_din;
+              3'b010: len <= io_din;
+              3'b011: begin
+                src_stride <= io_din[15:0];
+                dst_stride <= io_din[31:16];
+              end
+              3'b100: begin
+                irq_enable <= io_din[1];
+                done <= 1'b0;
+                if (io_din[0] && len != 32'b0) state <= S_READ;
+              end
+              default: begin
+              end
+            endcase
+          end
+        end
+        S_READ: begin
+          if (dma_gnt) state <= S_DATA;
+        end
+        S_DATA: begin
+          // Read data is out of the MMU one clock after the grant
+          data <= dma_do;
+          state <= S_WRITE;
+        end
+        default: begin
+          if (dma_gnt) begin
+            src <= src + {{16{src_stride[15]}}, src_stride};
+            dst <= dst + {{16{dst_stride[15]}}, dst_stride};
+            len <= len - 32'd1;
+            if (len == 32'd1) begin
+              state <= S_IDLE;
+              done <= 1'b1;
+            end
+            else begin
+              state <= S_READ;
+            end
+          end
+        end
+      endcase
+    end
+  end
+
+  always @ (*) begin : DMA_REGISTER_READ
+    case (io_addr_4_2)
+      3'b000: io_dout = src;
+      3'b001: io_dout = dst;
+      3'b010: io_dout = len;
+      3'b011: io_dout = {dst_stride, src_stride};
+      3'b100: io_dout = {29'b0, done, irq_enable, busy};
+      default: io_dout = 32'b0;
+    endcase
+  end
+
+endmodule
@@ -0,0 +1,487 @@
+#ifndef __GDB_STUB_H__
+#define __GDB_STUB_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// GDB remote serial protocol server of cpu_run, on a loopback TCP port:
+//
+//   $ tb_out/cpu_run tb_out/hello-semihost 1000000 +gdb=3333
+//   $ riscv32-unknown-elf-gdb -ex 'target remote :3333' hello-semihost.elf
+//
+// The simulation waits for GDB before the first instruction, and stops
+// again only when GDB has to look at the model: after a single step, at
+// a breakpoint, after an access a watchpoint covers, or on ^C. While it
+// is stopped, GDB reads and writes the registers and memory of the model
+// through the callbacks, and the simulator resumes when stopped()
+// returns.
+//
+// Software and hardware breakpoints are the same: the simulator compares
+// FD_PC. Patching an EBREAK into the program would only enter the trap
+// handler of the firmware, as the core has no debug mode. attention() is
+// the one check of a clock while nothing is being debugged: a lookup of
+// the PC in a small table with a counter for each hash of the breakpoint
+// addresses, so only a PC that may be a breakpoint costs more.
+class gdb_stub_t
+{
+public:
+  // What GDB asked the simulation to do when it resumes
+  enum resume_t { CONTINUE, STEP, KILL, DETACH };
+  // Z2, Z3, Z4
+  enum watch_type_t { WATCH_WRITE = 2, WATCH_READ = 3, WATCH_ACCESS = 4 };
+  struct watchpoint_t {
+    uint32_t addr;
+    uint32_t len;
+    int type;
+  };
+  static const int NUM_REGS = 33;	// x0-x31, then the pc
+  static const int FILTER_SIZE = 1024;
+  // Clocks between two looks for ^C
+  static const uint64_t POLL_CLOCKS = 0x10000;
+
+  // Registers and memory of the model. write_reg returns false when the
+  // register cannot be written
+  std::function<uint32_t(int)> read_reg;
+  std::function<bool(int, uint32_t)> write_reg;
+  std::function<uint8_t(uint32_t)> read_byte;
+  std::function<void(uint32_t, uint8_t)> write_byte;
+
+  // Set by the simulator while it has to look at every clock: stepping,
+  // or watching the data port
+  bool every_clock = true;
+
+  gdb_stub_t()
+  {
+    std::memset(filter, 0, sizeof(filter));
+  }
+
+  ~gdb_stub_t()
+  {
+    if (fd >= 0) close(fd);
+  }
+
+  // Waits for GDB to connect to the loopback port
+  bool listen(int port)
+  {
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0) return false;
+    int one = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+	|| ::listen(server, 1) < 0) {
+      close(server);
+      return false;
+    }
+    printf("(TT) Waiting for GDB on localhost:%d\n", port);
+    fflush(stdout);
+    fd = accept(server, nullptr, nullptr);
+    close(server);
+    if (fd < 0) return false;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return true;
+  }
+
+  bool connected() const { return fd >= 0; }
+
+  // The clock may need the exact checks: a breakpoint may be at pc, the
+  // simulator is stepping or watching, or it is time to poll for ^C.
+  // The clock may jump ahead, over idle clocks
+  bool attention(uint32_t pc, uint64_t clock) const
+  {
+    return every_clock || filter[(pc >> 1) & (FILTER_SIZE - 1)] != 0
+      || clock - last_poll >= POLL_CLOCKS;
+  }
+
+  bool breakpoint(uint32_t pc) const
+  {
+    return std::find(breakpoints.begin(), breakpoints.end(), pc)
+      != breakpoints.end();
+  }
+
+  bool watching() const { return !watchpoints.empty(); }
+
+  // The watchpoint a data port access hits, or null. be has a bit for
+  // each byte of the word at addr
+  const watchpoint_t* watch(uint32_t addr, uint32_t be, bool we) const
+  {
+    for (auto& w : watchpoints) {
+      if (w.type == WATCH_WRITE && !we) continue;
+      if (w.type == WATCH_READ && we) continue;
+      for (int i=0; i<4; ++i) {
+	uint32_t a = (addr & ~3u) + i;
+	if ((be >> i & 1) && a - w.addr < w.len) return &w;
+      }
+    }
+    return nullptr;
+  }
+
+  // Stop reason of a watchpoint hit
+  static std::string watch_reason(const watchpoint_t& w)
+  {
+    const char* kind = w.type == WATCH_WRITE ? "watch"
+      : w.type == WATCH_READ ? "rwatch" : "awatch";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s:%x;", kind, w.addr);
+    return buf;
+  }
+
+  // GDB sent ^C, looked for once POLL_CLOCKS have passed since the
+  // last look. Does not block
+  bool interrupted(uint64_t clock)
+  {
+    if (fd < 0 || clock - last_poll < POLL_CLOCKS) return false;
+    last_poll = clock;
+    pollfd p = { fd, POLLIN, 0 };
+    if (poll(&p, 1, 0) <= 0) return false;
+    char c;
+    if (recv(fd, &c, 1, 0) != 1) {
+      // GDB went away, the simulation runs on
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    return c == 0x03;
+  }
+
+  // The simulation stopped with a signal, 5 for a trap and 2 for an
+  // interrupt, and the reason of the stop reply, e.g. watch:<addr>;
+  // Serves GDB until it resumes the simulation
+  resume_t stopped(int signal, const std::string& reason = "")
+  {
+    last_signal = signal;
+    last_reason = reason;
+    if (running) send_packet(stop_reply());
+    running = false;
+    std::string packet;
+    while (receive_packet(packet)) {
+      resume_t r;
+      if (serve(packet, r)) {
+	running = r == CONTINUE || r == STEP;
+	return r;
+      }
+    }
+    close(fd);
+    fd = -1;
+    return DETACH;
+  }
+
+  // The program ended
+  void exited(int code)
+  {
+    if (fd < 0) return;
+    char buf[8];
+    snprintf(buf, sizeof(buf), "W%02x", code & 0xFF);
+    send_packet(buf);
+    close(fd);
+    fd = -1;
+  }
+
+private:
+  int fd = -1;
+  bool no_ack = false;
+  // GDB waits for a stop reply
+  bool running = false;
+  int last_signal = 5;
+  std::string last_reason;
+  std::vector<uint32_t> breakpoints;
+  std::vector<watchpoint_t> watchpoints;
+  // Breakpoints for each hash of the PC
+  uint8_t filter[FILTER_SIZE];
+  // Clock of the last look for ^C
+  uint64_t last_poll = 0;
+
+  std::string stop_reply() const
+  {
+    char buf[8];
+    snprintf(buf, sizeof(buf), "T%02x", last_signal);
+    return buf + last_reason;
+  }
+
+  static std::string hex32(uint32_t v)
+  {
+    // Target byte order
+    char buf[9];
+    snprintf(buf, sizeof(buf), "%02x%02x%02x%02x", v & 0xFF, v >> 8 & 0xFF,
+	     v >> 16 & 0xFF, v >> 24);
+    return buf;
+  }
+
+  static int nibble(char c)
+  {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  static uint32_t parse_hex(const std::string& s, size_t& pos)
+  {
+    uint32_t v = 0;
+    for (; pos < s.size() && nibble(s[pos]) >= 0; ++pos) {
+      v = (v << 4) | nibble(s[pos]);
+    }
+    return v;
+  }
+
+  // Little-endian word of 8 hex digits at pos
+  static uint32_t parse_hex32(const std::string& s, size_t pos)
+  {
+    uint32_t v = 0;
+    for (int i=0; i<4; ++i) {
+      uint32_t byte = nibble(s[pos + 2*i]) << 4 | nibble(s[pos + 2*i + 1]);
+      v |= (byte & 0xFF) << (8*i);
+    }
+    return v;
+  }
+
+  bool send_packet(const std::string& data)
+  {
+    uint8_t sum = 0;
+    for (char c : data) sum += c;
+    char tail[4];
+    snprintf(tail, sizeof(tail), "#%02x", sum);
+    std::string packet = "$" + data + tail;
+    while (true) {
+      if (send(fd, packet.data(), packet.size(), MSG_NOSIGNAL)
+	  != static_cast<ssize_t>(packet.size())) {
+	return false;
+      }
+      if (no_ack) return true;
+      char c;
+      do {
+	if (recv(fd, &c, 1, 0) != 1) return false;
+      } while (c != '+' && c != '-');
+      if (c == '+') return true;
+    }
+  }
+
+  bool receive_packet(std::string& data)
+  {
+    char c;
+    while (true) {
+      do {
+	// ^C while stopped is dropped
+	if (recv(fd, &c, 1, 0) != 1) return false;
+      } while (c != '$');
+      data.clear();
+      uint8_t sum = 0;
+      while (true) {
+	if (recv(fd, &c, 1, 0) != 1) return false;
+	if (c == '#') break;
+	data += c;
+	sum += c;
+      }
+      char cs[2];
+      if (recv(fd, cs, 1, 0) != 1 || recv(fd, cs + 1, 1, 0) != 1) {
+	return false;
+      }
+      if (no_ack) return true;
+      bool good = nibble(cs[0]) << 4 == (sum & 0xF0)
+	&& nibble(cs[1]) == (sum & 0x0F);
+      send(fd, good ? "+" : "-", 1, MSG_NOSIGNAL);
+      if (good) return true;
+    }
+  }
+
+  // Answers a packet. true when it resumes the simulation, with what to do
+  bool serve(const std::string& p, resume_t& r)
+  {
+    size_t pos = 1;
+    switch (p.empty() ? 0 : p[0]) {
+    case '?':
+      send_packet(stop_reply());
+      return false;
+    case 'g': {
+      std::string out;
+      for (int i=0; i<NUM_REGS; ++i) out += hex32(read_reg(i));
+      send_packet(out);
+      return false;
+    }
+    case 'G': {
+      bool ok = true;
+      for (size_t i=0; i<NUM_REGS && 8*(i + 1) < p.size(); ++i) {
+	ok &= write_reg(i, parse_hex32(p, 1 + 8*i));
+      }
+      send_packet(ok ? "OK" : "E01");
+      return false;
+    }
+    case 'p': {
+      uint32_t n = parse_hex(p, pos);
+      send_packet(n < NUM_REGS ? hex32(read_reg(n)) : "E01");
+      return false;
+    }
+    case 'P': {
+      uint32_t n = parse_hex(p, pos);
+      bool ok = n < NUM_REGS && pos + 9 <= p.size()
+	&& write_reg(n, parse_hex32(p, pos + 1));
+      send_packet(ok ? "OK" : "E01");
+      return false;
+    }
+    case 'm': {
+      uint32_t addr = parse_hex(p, pos);
+      uint32_t len = parse_hex(p, ++pos);
+      std::string out;
+      char buf[3];
+      for (uint32_t i=0; i<len && i<0x1000; ++i) {
+	snprintf(buf, sizeof(buf), "%02x", read_byte(addr + i));
+	out += buf;
+      }
+      send_packet(out);
+      return false;
+    }
+    case 'M': {
+      uint32_t addr = parse_hex(p, pos);
+      uint32_t len = parse_hex(p, ++pos);
+      ++pos;
+      if (pos + 2*len > p.size()) {
+	send_packet("E01");
+	return false;
+      }
+      for (uint32_t i=0; i<len; ++i) {
+	write_byte(addr + i, nibble(p[pos + 2*i]) << 4 | nibble(p[pos + 2*i + 1]));
+      }
+      send_packet("OK");
+      return false;
+    }
+    case 'c':
+    case 's':
+      // Resuming at another address is not supported, GDB writes the pc
+      r = p[0] == 'c' ? CONTINUE : STEP;
+      return true;
+    case 'Z':
+    case 'z':
+      send_packet(point(p));
+      return false;
+    case 'k':
+      r = KILL;
+      return true;
+    case 'D':
+      send_packet("OK");
+      r = DETACH;
+      return true;
+    case 'H':
+      send_packet("OK");
+      return false;
+    case 'q':
+      send_packet(query(p));
+      return false;
+    case 'Q':
+      if (p == "QStartNoAckMode") {
+	send_packet("OK");
+	no_ack = true;
+      }
+      else {
+	send_packet("");
+      }
+      return false;
+    default:
+      send_packet("");
+      return false;
+    }
+  }
+
+  // Z and z: sets or clears a break or watchpoint
+  std::string point(const std::string& p)
+  {
+    size_t pos = 1;
+    uint32_t type = parse_hex(p, pos);
+    uint32_t addr = parse_hex(p, ++pos);
+    uint32_t len = parse_hex(p, ++pos);
+    bool set = p[0] == 'Z';
+    if (type <= 1) {
+      auto it = std::find(breakpoints.begin(), breakpoints.end(), addr);
+      uint8_t& count = filter[(addr >> 1) & (FILTER_SIZE - 1)];
+      if (set && it == breakpoints.end()) {
+	breakpoints.push_back(addr);
+	++count;
+      }
+      else if (!set && it != breakpoints.end()) {
+	breakpoints.erase(it);
+	--count;
+      }
+      return "OK";
+    }
+    if (type <= 4) {
+      auto it = std::find_if(watchpoints.begin(), watchpoints.end(),
+			     [&](const watchpoint_t& w) {
+			       return w.addr == addr && w.len == len
+				 && w.type == static_cast<int>(type);
+			     });
+      if (set && it == watchpoints.end()) {
+	watchpoints.push_back({addr, len ? len : 1, static_cast<int>(type)});
+      }
+      else if (!set && it != watchpoints.end()) {
+	watchpoints.erase(it);
+      }
+      return "OK";
+    }
+    return "";
+  }
+
+  std::string query(const std::string& p)
+  {
+    if (p.rfind("qSupported", 0) == 0) {
+      return "PacketSize=4000;qXfer:features:read+;QStartNoAckMode+";
+    }
+    if (p == "qAttached") return "1";
+    if (p == "qC") return "QC1";
+    if (p == "qfThreadInfo") return "m1";
+    if (p == "qsThreadInfo") return "l";
+    if (p == "qSymbol::") return "OK";
+    const std::string xfer = "qXfer:features:read:target.xml:";
+    if (p.rfind(xfer, 0) == 0) {
+      size_t pos = xfer.size();
+      uint32_t offset = parse_hex(p, pos);
+      uint32_t len = parse_hex(p, ++pos);
+      std::string xml = target_xml();
+      if (offset >= xml.size()) return "l";
+      std::string part = xml.substr(offset, len);
+      return (offset + part.size() < xml.size() ? "m" : "l") + part;
+    }
+    return "";
+  }
+
+  static std::string target_xml()
+  {
+    static const char* names[32] = {
+      "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+      "fp", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+      "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+      "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+    };
+    std::string xml =
+      "<?xml version=\"1.0\"?>"
+      "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+      "<target version=\"1.0\"><architecture>riscv:rv32</architecture>"
+      "<feature name=\"org.gnu.gdb.riscv.cpu\">";
+    for (int i=0; i<32; ++i) {
+      const char* type = (i == 1) ? "code_ptr"
+	: (i == 2 || i == 8) ? "data_ptr" : "int";
+      xml += std::string("<reg name=\"") + names[i]
+	+ "\" bitsize=\"32\" type=\"" + type + "\" regnum=\""
+	+ std::to_string(i) + "\"/>";
+    }
+    xml += "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\" regnum=\"32\"/>"
+      "</feature></target>";
+    return xml;
+  }
+};
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * IO bus interconnect, Wishbone style with pipelined handshake
+ *
+ * One master, the MMU, and the slaves of io_map.txt. The address
+ * decoder and the wait states of each slave are generated into
+ * io_map.vh by io_map.py.
+ *
+ * A beat is held on the bus with wb_stb. It is accepted in the clock
+ * wb_stall is low, and acknowledged in that same clock with wb_ack, so
+ * the master can put the next beat on the bus in the following clock.
+ * Back to back beats make a burst. wb_stall is high while the wait
+ * states of the selected slave are counted, or while the slave asserts
+ * its own s_stall, which must not depend on its s_stb.
+ *
+ * A slave sees s_stb only in the clock its beat is accepted, and returns
+ * read data in the same clock. An address no slave decodes is
+ * acknowledged right away, and reads 0.
+ */
+`include "io_map.vh"
+
+module io_bus(
+  input wire clk,
+  input wire resetb,
+  // Master
+  input wire wb_stb,
+  input wire [7:2] wb_adr,
+  output reg [31:0] wb_dat_r,
+  output wire wb_ack,
+  output wire wb_stall,
+  // Slaves, one bit or one word each
+  output wire [`IO_SLAVES-1:0] s_stb,
+  input wire [32*`IO_SLAVES-1:0] s_dat_r,
+  input wire [`IO_SLAVES-1:0] s_stall
+  );
+
+  localparam [4*`IO_SLAVES-1:0] WAIT_STATES = `IO_WAIT_STATES;
+
+  wire [`IO_SLAVES-1:0] sel;
+  reg [3:0] wait_states;
+  reg [3:0] wait_cnt;
+  reg slave_stall;
+  wire waiting;
+  integer i;
+
+  assign sel = `IO_DECODE(wb_adr);
+
+  always @ (*) begin : IO_BUS_MUX
+    wait_states = 4'd0;
+    wb_dat_r = 32'b0;
+    slave_stall = 1'b0;
+    for (i = 0; i < `IO_SLAVES; i = i + 1) begin
+      if (sel[i]) begin
+        wait_states = WAIT_STATES[4*i+:4];
+        wb_dat_r = s_dat_r[32*i+:32];
+        slave_stall = s_stall[i];
+      end
+    end
+  end
+
+  assign waiting = wait_cnt != wait_states;
+  assign wb_stall = wb_stb & (waiting | slave_stall);
+  assign wb_ack = wb_stb & ~wb_stall;
+  assign s_stb = wb_ack ? sel : {`IO_SLAVES{1'b0}};
+
+  always @ (posedge clk) begin : IO_BUS_WAIT
+    if (!resetb) begin
+      wait_cnt <= 4'd0;
+    end
+    else if (clk) begin
+      if (wb_ack)
+        wait_cnt <= 4'd0;
+      else if (wb_stb & waiting)
+        wait_cnt <= wait_cnt + 4'd1;
+    end
+  end
+
+endmodule
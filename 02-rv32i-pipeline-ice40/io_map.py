@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Generate the IO bus address decoder, io_map.vh, from io_map.txt
+
+Usage: io_map.py io_map.txt io_map.vh
+"""
+
+import sys
+
+IO_SIZE = 0x100
+MAX_WAIT = 15
+
+
+def parse(path):
+    slaves = []
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            fields = line.split()
+            if len(fields) != 4:
+                sys.exit(f"{path}:{n}: expected name, base, size, wait")
+            name = fields[0]
+            base, size, wait = (int(x, 0) for x in fields[1:])
+            if size < 4 or size & (size - 1):
+                sys.exit(f"{path}:{n}: size of {name} is not a power of two")
+            if base % size:
+                sys.exit(f"{path}:{n}: {name} is not aligned to its size")
+            if base + size > IO_SIZE:
+                sys.exit(f"{path}:{n}: {name} is out of the IO space")
+            if not 0 <= wait <= MAX_WAIT:
+                sys.exit(f"{path}:{n}: wait states of {name} exceed {MAX_WAIT}")
+            for other in slaves:
+                if base < other['base'] + other['size'] and \
+                   other['base'] < base + size:
+                    sys.exit(f"{path}:{n}: {name} overlaps {other['name']}")
+            slaves.append(dict(name=name, base=base, size=size, wait=wait))
+    return slaves
+
+
+def match(slave):
+    # Address bits 7:2 above the region offset are compared
+    low = slave['size'].bit_length() - 1
+    width = 8 - low
+    if width == 0:
+        return "1'b1"
+    value = slave['base'] >> low
+    return f"(adr[7:{low}] == {width}'b{value:0{width}b})"
+
+
+def generate(slaves, src):
+    n = len(slaves)
+    out = [
+        f"// Generated by io_map.py from {src}. Do not edit",
+        "`ifndef _io_map_vh_",
+        " `define _io_map_vh_",
+        "",
+        f" `define IO_SLAVES {n}",
+        "",
+        "// Slave index, bit of the select vector",
+    ]
+    for i, s in enumerate(slaves):
+        out.append(f" `define IO_{s['name'].upper()} {i}")
+    out += ["", "// Slave select from address bits 7:2, one-hot or 0"]
+    terms = ", ".join(match(s) for s in reversed(slaves))
+    out.append(f" `define IO_DECODE(adr) {{{terms}}}")
+    out += ["", "// Wait states of each slave, 4 bits per slave"]
+    waits = ", ".join(f"4'd{s['wait']}" for s in reversed(slaves))
+    out.append(f" `define IO_WAIT_STATES {{{waits}}}")
+    out += ["", "`endif", ""]
+    return "\n".join(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    slaves = parse(sys.argv[1])
+    if not slaves:
+        sys.exit(f"{sys.argv[1]}: no slaves")
+    with open(sys.argv[2], 'w') as f:
+        f.write(generate(slaves, sys.argv[1]))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,23 @@
+// Generated by io_map.py from io_map.txt. Do not edit
+`ifndef _io_map_vh_
+ `define _io_map_vh_
+
+ `define IO_SLAVES 8
+
+// Slave index, bit of the select vector
+ `define IO_GPIO 0
+ `define IO_SEMIHOST 1
+ `define IO_SCRATCH 2
+ `define IO_TIMER 3
+ `define IO_DMA 4
+ `define IO_MTIMECMP1 5
+ `define IO_UART 6
+ `define IO_TRACE 7
+
+// Slave select from address bits 7:2, one-hot or 0
+ `define IO_DECODE(adr) {(adr[7:4] == 4'b0111), (adr[7:4] == 4'b0110), (adr[7:3] == 5'b01000), (adr[7:5] == 3'b001), (adr[7:4] == 4'b0001), (adr[7:3] == 5'b00001), (adr[7:2] == 6'b000001), (adr[7:2] == 6'b000000)}
+
+// Wait states of each slave, 4 bits per slave
+ `define IO_WAIT_STATES {4'd0, 4'd0, 4'd0, 4'd0, 4'd0, 4'd2, 4'd0, 4'd0}
+
+`endif
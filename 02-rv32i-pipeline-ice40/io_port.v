@@ -1,24 +1,87 @@
+`include "core/config.vh"
+`include "io_map.vh"
+
 module io_port
   (
    input wire 	      clk,
    input wire 	      resetb,
+   // IO bus from the MMU
+   input wire 	      wb_stb/*verilator public*/,
+   input wire 	      wb_we/*verilator public*/,
+   input wire [7:2]   wb_adr/*verilator public*/,
+   input wire [3:0]   wb_sel,
+   input wire [31:0]  wb_dat_w/*verilator public*/,
+   output wire [31:0] wb_dat_r,
+   output wire 	      wb_ack/*verilator public*/,
+   output wire 	      irq_mtimecmp,
+   // mtimecmp of hart 1
+   output wire 	      irq_mtimecmp1,
+   output wire 	      irq_dma,
+   output wire 	      irq_uart,
+   // DMA master port to the MMU
+   output wire 	      dma_req,
+   output wire [31:0] dma_addr,
+   output wire 	      dma_we,
+   output wire [31:0] dma_di,
+   input wire 	      dma_gnt,
+   input wire [31:0]  dma_do,
+   output reg [7:0]   gpio0,
+   output wire 	      uart_tx,
+   input wire 	      uart_rx,
+   // Branch trace of hart 0, unused without ENABLE_TRACE
    /* verilator lint_off UNUSED */
-   input wire [7:0]   io_addr/*verilator public*/,
-   input wire 	      io_en/*verilator public*/,
+   input wire 	      trace_valid,
+   input wire 	      trace_br,
+   input wire 	      trace_taken,
+   input wire 	      trace_jr,
+   input wire 	      trace_trap,
+   input wire [31:0]  trace_pc,
+   input wire [31:0]  trace_target
    /* verilator lint_on UNUSED */
-   input wire 	      io_we/*verilator public*/,
-   input wire [31:0]  io_data_write/*verilator public*/,
-   output wire [31:0] io_data_read,
-   output wire 	      irq_mtimecmp,
-   output reg [7:0]   gpio0
    );
 
-   wire 	      mtime_we;
+   parameter NUM_HARTS = `NUM_HARTS;
+   parameter ENABLE_TRACE = `ENABLE_TRACE;
+
+   wire 	      wb_stall /*verilator public*/;
+   wire [`IO_SLAVES-1:0] s_stb;
+   wire [32*`IO_SLAVES-1:0] s_dat_r;
+   wire [`IO_SLAVES-1:0] s_stall;
+
    wire [31:0] 	      mtime_dout;
+   // Unused with NUM_HARTS = 1
+   /* verilator lint_off UNUSED */
+   wire [63:0] 	      mtime;
+   /* verilator lint_on UNUSED */
+   wire [31:0] 	      mtimecmp1_dout;
+   wire [31:0] 	      dma_dout;
+   wire [31:0] 	      uart_dout;
+   wire [31:0] 	      trace_dout;
+   wire 	      trace_stall;
+   reg [31:0] 	      semihost_desc;
+   reg [31:0] 	      scratch0, scratch1;
+   wire [31:0] 	      scratch_dout;
+   wire [31:0] 	      scratch_mask;
+   wire [31:0] 	      scratch_din;
 
-   assign mtime_we = io_addr[7:4] == 4'b0001 ? io_we : 1'b0;
+   io_bus BUS0
+     (
+      .clk(clk), .resetb(resetb),
+      .wb_stb(wb_stb), .wb_adr(wb_adr), .wb_dat_r(wb_dat_r),
+      .wb_ack(wb_ack), .wb_stall(wb_stall),
+      .s_stb(s_stb), .s_dat_r(s_dat_r), .s_stall(s_stall)
+      );
 
-   assign io_data_read = io_addr[7:4] == 4'b0001 ? mtime_dout : 32'bX;
+   // Only the trace port stalls, while its next packet is read ahead
+   assign s_stall = {{(`IO_SLAVES-1){1'b0}}, trace_stall} << `IO_TRACE;
+   assign s_dat_r[32*`IO_GPIO+:32] = {24'b0, gpio0};
+   assign s_dat_r[32*`IO_SEMIHOST+:32] = semihost_desc;
+   assign s_dat_r[32*`IO_SCRATCH+:32] = scratch_dout;
+   assign s_dat_r[32*`IO_TIMER+:32] = mtime_dout;
+   assign s_dat_r[32*`IO_DMA+:32] = dma_dout;
+   assign s_dat_r[32*`IO_MTIMECMP1+:32] = mtimecmp1_dout;
+   assign s_dat_r[32*`IO_UART+:32] = uart_dout;
+   assign s_dat_r[32*`IO_TRACE+:32] = trace_dout;
 
    // GPIO0 is at 0x80000000, the same address as testbench commands.
    // However, it only uses the lowest byte
@@ -27,8 +90,44 @@ module io_port
 	 gpio0 <= 8'b0;
       end
       else if (clk) begin
-	 if (io_addr[7:2] == 6'b0 && io_we) begin
-	    gpio0 <= io_data_write[7:0];
+	 if (s_stb[`IO_GPIO] && wb_we && wb_sel[0]) begin
+	    gpio0 <= wb_dat_w[7:0];
+	 end
+      end
+   end
+
+   // Semihosting doorbell. cpu_run services the descriptor written here,
+   // see semihost.h. In hardware, the address is only kept
+   always @ (posedge clk) begin : SEMIHOST
+      if (!resetb) begin
+	 semihost_desc <= 32'b0;
+      end
+      else if (clk) begin
+	 if (s_stb[`IO_SEMIHOST] && wb_we) begin
+	    semihost_desc <= wb_dat_w;
+	 end
+      end
+   end
+
+   // Two scratch words with byte lanes, and wait states, to exercise
+   // the bus
+   assign scratch_dout = wb_adr[2] ? scratch1 : scratch0;
+   assign scratch_mask = {{8{wb_sel[3]}}, {8{wb_sel[2]}},
+			  {8{wb_sel[1]}}, {8{wb_sel[0]}}};
+   assign scratch_din = (wb_dat_w & scratch_mask)
+     | (scratch_dout & ~scratch_mask);
+
+   always @ (posedge clk) begin : SCRATCH
+      if (!resetb) begin
+	 scratch0 <= 32'b0;
+	 scratch1 <= 32'b0;
+      end
+      else if (clk) begin
+	 if (s_stb[`IO_SCRATCH] && wb_we) begin
+	    if (wb_adr[2])
+	      scratch1 <= scratch_din;
+	    else
+	      scratch0 <= scratch_din;
 	 end
       end
    end
@@ -36,8 +135,63 @@ module io_port
    timer TIMER0
      (
       .clk(clk), .resetb(resetb),
-      .io_addr_3_2(io_addr[3:2]), .io_we(mtime_we), .io_din(io_data_write),
-      .io_dout(mtime_dout), .irq_mtimecmp(irq_mtimecmp)
+      .io_addr_3_2(wb_adr[3:2]), .io_we(s_stb[`IO_TIMER] & wb_we),
+      .io_din(wb_dat_w), .io_dout(mtime_dout), .mtime_out(mtime),
+      .irq_mtimecmp(irq_mtimecmp)
       );
 
+   generate
+      if (NUM_HARTS > 1) begin : HART1_TIMER
+	 mtimecmp MTIMECMP1
+	   (
+	    .clk(clk), .resetb(resetb),
+	    .io_addr_2(wb_adr[2]), .io_we(s_stb[`IO_MTIMECMP1] & wb_we),
+	    .io_din(wb_dat_w), .io_dout(mtimecmp1_dout),
+	    .mtime(mtime), .irq_mtimecmp(irq_mtimecmp1)
+	    );
+      end
+      else begin : NO_HART1_TIMER
+	 assign mtimecmp1_dout = 32'b0;
+	 assign irq_mtimecmp1 = 1'b0;
+      end
+   endgenerate
+
+   dma DMA0
+     (
+      .clk(clk), .resetb(resetb),
+      .io_addr_4_2(wb_adr[4:2]), .io_we(s_stb[`IO_DMA] & wb_we),
+      .io_din(wb_dat_w), .io_dout(dma_dout),
+      .dma_req(dma_req), .dma_addr(dma_addr), .dma_we(dma_we),
+      .dma_di(dma_di), .dma_gnt(dma_gnt), .dma_do(dma_do),
+      .irq_dma(irq_dma)
+      );
+
+   uart UART0
+     (
+      .clk(clk), .resetb(resetb),
+      .io_addr_3_2(wb_adr[3:2]), .io_stb(s_stb[`IO_UART]), .io_we(wb_we),
+      .io_din(wb_dat_w), .io_dout(uart_dout),
+      .uart_tx(uart_tx), .uart_rx(uart_rx),
+      .irq_uart(irq_uart)
+      );
+
+   generate
+      if (ENABLE_TRACE != 0) begin : TRACE
+	 trace TRACE0
+	   (
+	    .clk(clk), .resetb(resetb),
+	    .trace_valid(trace_valid), .trace_br(trace_br),
+	    .trace_taken(trace_taken), .trace_jr(trace_jr),
+	    .trace_trap(trace_trap), .trace_pc(trace_pc),
+	    .trace_target(trace_target),
+	    .io_addr_3_2(wb_adr[3:2]), .io_stb(s_stb[`IO_TRACE]), .io_we(wb_we),
+	    .io_din(wb_dat_w), .io_dout(trace_dout), .io_stall(trace_stall)
+	    );
+      end
+      else begin : NO_TRACE
+	 assign trace_dout = 32'b0;
+	 assign trace_stall = 1'b0;
+      end
+   endgenerate
+
 endmodule
@@ -0,0 +1,110 @@
+#ifndef __IRQ_LATENCY_H__
+#define __IRQ_LATENCY_H__
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+
+// Interrupt latency harness of cpu_run. Raises an interrupt line at
+// random clocks, and measures the clocks until the first instruction
+// of its vector is in FD, and until FD is back at mepc after MRET. The
+// line is lowered when the vector is reached. Samples are summed up as
+// worst case, average and a histogram
+class irq_latency_t
+{
+public:
+  irq_latency_t(uint32_t cause, uint32_t seed,
+		uint32_t min_gap = 20, uint32_t max_gap = 300)
+    : cause(cause), rng(seed), gap(min_gap, max_gap)
+  {
+    next = gap(rng);
+  }
+
+  // One clock. Returns the level of the line for the next clock
+  bool tick(uint64_t cycle, uint32_t pc, uint32_t mtvec_base,
+	    bool vectored, uint32_t mepc)
+  {
+    switch (state) {
+    case IDLE:
+      if (cycle < next) return false;
+      start = cycle;
+      vector = vectored ? mtvec_base + 4 * cause : mtvec_base;
+      state = ENTRY;
+      return true;
+    case ENTRY:
+      if (pc == vector) {
+	entry.add(cycle - start);
+	ret_pc = mepc;
+	state = RETURN;
+	return false;
+      }
+      if (cycle - start > TIMEOUT) {
+	++missed;
+	schedule(cycle);
+	return false;
+      }
+      return true;
+    default:
+      if (pc == ret_pc) {
+	ret.add(cycle - start);
+	schedule(cycle);
+      }
+      return false;
+    }
+  }
+
+  void report() const
+  {
+    std::cout << "(SS) IRQ latency samples: " << std::dec << entry.count
+	      << ", missed: " << missed << std::endl;
+    entry.report("entry");
+    ret.report("return");
+  }
+
+private:
+  enum { IDLE, ENTRY, RETURN } state = IDLE;
+  static const uint64_t TIMEOUT = 10000;
+
+  struct histogram_t {
+    std::map<uint64_t, uint64_t> bins;
+    uint64_t count = 0, sum = 0, min = UINT64_MAX, max = 0;
+
+    void add(uint64_t clocks)
+    {
+      ++bins[clocks];
+      ++count;
+      sum += clocks;
+      if (clocks < min) min = clocks;
+      if (clocks > max) max = clocks;
+    }
+
+    void report(const char* name) const
+    {
+      if (count == 0) return;
+      std::cout << "(SS) IRQ " << name << " latency min/avg/max: " << min
+		<< "/" << static_cast<double>(sum) / count << "/" << max
+		<< " cycles" << std::endl;
+      for (auto& bin : bins) {
+	std::cout << "(SS)   " << bin.first << " cycles: " << bin.second
+		  << std::endl;
+      }
+    }
+  };
+
+  uint32_t cause;
+  std::mt19937 rng;
+  std::uniform_int_distribution<uint32_t> gap;
+  uint64_t next = 0, start = 0;
+  uint32_t vector = 0, ret_pc = 0;
+  uint64_t missed = 0;
+  histogram_t entry, ret;
+
+  void schedule(uint64_t cycle)
+  {
+    state = IDLE;
+    next = cycle + gap(rng);
+  }
+};
+
+#endif // __IRQ_LATENCY_H__
@@ -0,0 +1,829 @@
+#ifndef __ISS_H__
+#define __ISS_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+
+#include "semihost.h"
+
+class iss_t;
+
+// One decoded instruction, run by fn. rd is 32 for x0, so that its
+// writes go to a register nobody reads. imm is the CSR number of a CSR
+// instruction, and rs1 its immediate for the CSR*I forms
+struct iss_op_t
+{
+  // What fn did: NEXT goes on with the next instruction. JUMP retired
+  // the instruction and set pc. TRAP set pc to the trap vector, and
+  // retired nothing
+  enum result_t { NEXT, JUMP, TRAP };
+
+  int (*fn)(iss_t&, const iss_op_t&);
+  uint32_t pc;
+  int32_t imm;
+  uint8_t rd, rs1, rs2;
+  // Control transfer, SYSTEM or illegal: a translated block ends here
+  bool ends_block;
+};
+
+// Functional model of hart 0 of cpu_top in the default build, with the
+// memory map of mmu.v and io_map.txt: the 2 KiB ROM, which the fetch
+// port wraps around and the data port reads, main memory wrapping at
+// 64 KiB, and on the IO bus the GPIO with the testbench commands of
+// cpu_run, the semihosting doorbell, the scratch words, the timer, the
+// DMA and the UART transmitter. The second mtimecmp and UART receive
+// are not modelled and read 0. CSRs, traps and interrupts follow
+// csr_ehu.v, e.g. mstatus.MIE does not mask interrupts.
+//
+// Each retired instruction is one clock of mcycle and mtime. A DMA
+// copy is done when started, and stays busy for the three clocks a
+// word of dma.v takes. Interrupts are taken at check_irq(), after
+// every instruction when interpreted by step(), and after every block
+// by dbt.h
+class iss_t
+{
+public:
+  static const uint32_t ROM_BYTES = 2048;
+  static const uint32_t RAM_BYTES = 65536;
+  // Code page size for the translation cache
+  static const unsigned PAGE_BITS = 8;
+
+  // x[32] takes the writes to x0
+  uint32_t x[33];
+  uint32_t pc;
+  uint64_t instret;
+
+  // CSRs
+  bool mie, mpie, mtie, meie;
+  uint16_t mie_local;
+  uint32_t mtvec;
+  bool mtvec_vectored;
+  uint32_t mscratch, mepc, mcause, mtval;
+  // mcycle, minstret and mtime are instret plus these. A value written
+  // is what the next instruction reads
+  uint64_t mcycle_offset, minstret_offset, mtime_offset;
+
+  // Timer and its interrupt, pending and enabled at the last check
+  uint64_t mtimecmp;
+  bool irq_mtimecmp_p;
+
+  // DMA registers, see dma.v. Busy until mcycle reaches dma_done_at,
+  // done after that until CTRL is written. The external interrupt was
+  // pending and enabled at the last check
+  uint32_t dma_src, dma_dst, dma_len, dma_stride;
+  bool dma_ie, dma_started;
+  uint64_t dma_done_at;
+  bool irq_external_p;
+
+  // The ROM and main memory of the model, or DMI pointers of a virtual
+  // platform. While one is null, its accesses go to bus_load and
+  // bus_store
+  uint8_t* rom;
+  uint8_t* ram;
+  uint32_t gpio;
+  uint32_t scratch[2];
+  uint32_t uart_ctrl, uart_div;
+
+  // UART bytes sent go here, if set
+  FILE* uart_out = nullptr;
+  // No pass and fail messages
+  bool quiet = false;
+  semihost_t semihost;
+
+  // Testbench commands on the GPIO, see cpu_run
+  bool test_halt = false;
+  uint32_t test_passes = 0, test_fails = 0;
+  // RAM byte offset of the compliance signature, 0 before the scan
+  uint32_t signature_base = 0;
+  // WFI with no interrupt to wake it up
+  bool deadlock = false;
+
+  uint64_t traps = 0;
+  uint64_t interrupts = 0;
+  uint64_t skipped_cycles = 0;
+  uint64_t uart_tx_bytes = 0;
+
+  // ROM pages holding translated code, one bit each, and what to do
+  // when one of them is written
+  uint32_t code_pages = 0;
+  std::function<void(void)> on_code_write;
+
+  // Set by a virtual platform, see vp_sc.cpp. The data port accesses
+  // the model does not do itself go to bus_load and bus_store, instead
+  // of its IO devices, a word at a time. bus_store returns true to stop
+  // the simulation. timer_irq is the level of the timer interrupt, and
+  // a WFI then only sets wfi, for the caller to wait
+  std::function<uint32_t(uint32_t)> bus_load;
+  std::function<bool(uint32_t, uint32_t, uint32_t)> bus_store;
+  std::function<bool(void)> timer_irq;
+  bool wfi = false;
+
+  iss_t() : rom(rom_data), ram(ram_data)
+  {
+    semihost.read_byte = [this](uint32_t addr) { return read_byte(addr); };
+    semihost.write_byte = [this](uint32_t addr, uint8_t byte) {
+      if (is_ram(addr) && ram) ram[ram_offset(addr)] = byte;
+    };
+    semihost.clocks = [this]() { return mcycle(); };
+    std::memset(rom_data, 0, sizeof(rom_data));
+    // As cpu_run fills the memory
+    std::memset(ram_data, 0xAA, sizeof(ram_data));
+    reset();
+  }
+
+  iss_t(const iss_t&) = delete;
+  iss_t& operator=(const iss_t&) = delete;
+
+  static bool is_rom(uint32_t addr) { return (addr >> 12) == 0; }
+  static bool is_ram(uint32_t addr)
+  {
+    return (addr >> 31) == 0 && ((addr >> 28) & 7) != 0;
+  }
+  static bool is_io(uint32_t addr) { return (addr >> 8) == 0x800000; }
+  static uint32_t ram_offset(uint32_t addr)
+  {
+    return (addr - 0x10000000) & (RAM_BYTES - 1);
+  }
+
+  uint64_t mcycle() const { return instret + mcycle_offset; }
+  uint64_t minstret() const { return instret + minstret_offset; }
+  uint64_t mtime() const { return instret + mtime_offset; }
+  bool stopped() const { return test_halt || semihost.exited || deadlock; }
+  bool dma_busy() const { return dma_started && mcycle() < dma_done_at; }
+  bool dma_done() const { return dma_started && mcycle() >= dma_done_at; }
+  bool irq_dma() const { return dma_done() && dma_ie; }
+
+  void reset()
+  {
+    std::memset(x, 0, sizeof(x));
+    pc = 0;
+    instret = 0;
+    mie = mpie = mtie = meie = false;
+    mie_local = 0;
+    mtvec = 0x4;
+    mtvec_vectored = false;
+    mscratch = mepc = mcause = mtval = 0;
+    // The first instruction is fetched a clock after reset
+    mcycle_offset = 1;
+    minstret_offset = mtime_offset = 0;
+    mtimecmp = 0;
+    irq_mtimecmp_p = false;
+    dma_src = dma_dst = dma_len = 0;
+    dma_stride = 0x00040004;
+    dma_ie = dma_started = false;
+    dma_done_at = 0;
+    irq_external_p = false;
+    gpio = 0;
+    scratch[0] = scratch[1] = 0;
+    uart_ctrl = 0;
+    uart_div = 103;
+  }
+
+  // The ROM gets the first 2 KiB of the program, as in cpu_run
+  bool load_program(const std::string& path)
+  {
+    std::ifstream f(path, std::ios::binary);
+    if (!f.is_open()) return false;
+    f.seekg(0, f.end);
+    size_t size = f.tellg();
+    if (size == 0 || size > 0x100000 || size % 2 != 0) return false;
+    f.seekg(0, f.beg);
+    std::string buf(size, '\0');
+    f.read(&buf[0], size);
+    for (uint32_t i=0; i<ROM_BYTES; ++i) {
+      write_byte(i, i < size ? buf[i] : 0);
+    }
+    return true;
+  }
+
+  // Host access to ROM and RAM, outside of the data port. A write to a
+  // ROM page with translated code drops the translations
+  uint8_t read_byte(uint32_t addr) const
+  {
+    if (is_rom(addr) && rom) return rom[addr & (ROM_BYTES - 1)];
+    if (is_ram(addr) && ram) return ram[ram_offset(addr)];
+    return 0;
+  }
+
+  void write_byte(uint32_t addr, uint8_t byte)
+  {
+    if (is_rom(addr) && rom) {
+      addr &= ROM_BYTES - 1;
+      rom[addr] = byte;
+      if ((code_pages >> (addr >> PAGE_BITS)) & 1) {
+	code_pages = 0;
+	if (on_code_write) on_code_write();
+      }
+    }
+    else if (is_ram(addr) && ram) {
+      ram[ram_offset(addr)] = byte;
+    }
+  }
+
+  // The fetch port takes ROM address bits 10:2 of any pc
+  uint32_t fetch(uint32_t addr) const
+  {
+    if (!rom) return bus_load(addr & (ROM_BYTES - 4));
+    uint32_t inst;
+    std::memcpy(&inst, &rom[addr & (ROM_BYTES - 4)], 4);
+    return inst;
+  }
+
+  // Plain interpreter: fetch, decode and run one instruction, then
+  // check the interrupts
+  int step()
+  {
+    iss_op_t o = decode(fetch(pc), pc);
+    int r = o.fn(*this, o);
+    if (r == iss_op_t::NEXT) pc += 4;
+    if (r != iss_op_t::TRAP) ++instret;
+    check_irq();
+    return r;
+  }
+
+  // An interrupt is taken when it becomes both pending and enabled by
+  // its mie bit, as in csr_ehu.v, the DMA before the timer. One pending
+  // while its mie bit is clear is taken once the bit is set, and one
+  // still pending at MRET after it. mepc is the pc of the next
+  // instruction
+  bool check_irq()
+  {
+    bool timer = mtie && (timer_irq ? timer_irq() : mtime() >= mtimecmp);
+    bool external = meie && irq_dma();
+    bool take_timer = timer && !irq_mtimecmp_p;
+    bool take_external = external && !irq_external_p;
+    irq_mtimecmp_p = timer;
+    irq_external_p = external;
+    if (!take_timer && !take_external) return false;
+    ++interrupts;
+    wfi = false;
+    trap(take_external ? 0x8000000B : 0x80000007, pc, 0, true);
+    return true;
+  }
+
+  // Enters the trap vector. ECALL and EBREAK leave mtval alone
+  int trap(uint32_t cause, uint32_t epc, uint32_t tval, bool set_tval)
+  {
+    ++traps;
+    mepc = epc;
+    mcause = cause;
+    if (set_tval) mtval = tval;
+    mpie = mie;
+    pc = mtvec;
+    if (mtvec_vectored && (cause >> 31)) pc += 4 * (cause & 31);
+    return iss_op_t::TRAP;
+  }
+
+  static iss_op_t decode(uint32_t inst, uint32_t pc);
+
+  // Loads and stores of the data port
+  uint32_t load_slow(uint32_t addr);
+  // true when the store stopped the simulation
+  bool store_slow(uint32_t addr, uint32_t data, uint32_t mask);
+
+private:
+  uint32_t io_load(uint32_t offset);
+  bool io_store(uint32_t offset, uint32_t data, uint32_t mask);
+  void dma_start();
+
+  uint8_t rom_data[ROM_BYTES];
+  uint8_t ram_data[RAM_BYTES];
+  bool csr_access(uint32_t csr, uint32_t& value, int op, uint32_t operand);
+
+  template <typename T> static int op_load(iss_t& s, const iss_op_t& o);
+  template <typename T> static int op_store(iss_t& s, const iss_op_t& o);
+  static int op_jump(iss_t& s, const iss_op_t& o, uint32_t target);
+  static int op_csr(iss_t& s, const iss_op_t& o);
+  static int op_wfi(iss_t& s, const iss_op_t& o);
+};
+
+//////////////////////////////////////////////////
+
+template <typename T>
+int iss_t::op_load(iss_t& s, const iss_op_t& o)
+{
+  uint32_t addr = s.x[o.rs1] + o.imm;
+  if (addr & (sizeof(T) - 1)) return s.trap(4, o.pc, addr, true);
+  T v;
+  if (is_ram(addr) && s.ram) {
+    std::memcpy(&v, &s.ram[ram_offset(addr)], sizeof(T));
+  }
+  else v = static_cast<T>(s.load_slow(addr));
+  s.x[o.rd] = static_cast<uint32_t>(static_cast<int32_t>(v));
+  return iss_op_t::NEXT;
+}
+
+template <typename T>
+int iss_t::op_store(iss_t& s, const iss_op_t& o)
+{
+  uint32_t addr = s.x[o.rs1] + o.imm;
+  if (addr & (sizeof(T) - 1)) return s.trap(6, o.pc, addr, true);
+  T v = static_cast<T>(s.x[o.rs2]);
+  if (is_ram(addr) && s.ram) {
+    std::memcpy(&s.ram[ram_offset(addr)], &v, sizeof(T));
+    return iss_op_t::NEXT;
+  }
+  unsigned shift = 8 * (addr & 3);
+  uint32_t mask = static_cast<T>(~0u);
+  // For the pc of a failed test
+  s.pc = o.pc;
+  if (s.store_slow(addr, static_cast<uint32_t>(v) << shift, mask << shift)) {
+    s.pc = o.pc + 4;
+    return iss_op_t::JUMP;
+  }
+  return iss_op_t::NEXT;
+}
+
+inline int iss_t::op_jump(iss_t& s, const iss_op_t& o, uint32_t target)
+{
+  if (target & 3) return s.trap(0, o.pc, target, true);
+  s.pc = target;
+  return iss_op_t::JUMP;
+}
+
+// ROM words through the data port, and the IO bus. Other addresses
+// read 0
+inline uint32_t iss_t::load_slow(uint32_t addr)
+{
+  uint32_t word = 0;
+  if (is_rom(addr) && rom) word = fetch(addr);
+  else if (bus_load) word = bus_load(addr & ~3u);
+  else if (is_io(addr)) word = io_load(addr & 0xFC);
+  return word >> (8 * (addr & 3));
+}
+
+// The data port cannot write the ROM
+inline bool iss_t::store_slow(uint32_t addr, uint32_t data, uint32_t mask)
+{
+  if (bus_store) return bus_store(addr & ~3u, data, mask);
+  if (!is_io(addr)) return false;
+  return io_store(addr & 0xFC, data, mask);
+}
+
+inline uint32_t iss_t::io_load(uint32_t offset)
+{
+  switch (offset) {
+  case 0x00: return gpio & 0xFF;
+  case 0x08: return scratch[0];
+  case 0x0C: return scratch[1];
+  case 0x10: return mtime();
+  case 0x14: return mtime() >> 32;
+  case 0x18: return mtimecmp;
+  case 0x1C: return mtimecmp >> 32;
+  case 0x20: return dma_src;
+  case 0x24: return dma_dst;
+  case 0x28: return dma_len;
+  case 0x2C: return dma_stride;
+  case 0x30: return dma_done() << 2 | dma_ie << 1 | dma_busy();
+  // RX FIFO empty
+  case 0x60: return 0x80000000;
+  // TX empty and idle, RX empty
+  case 0x64: return 0x6;
+  case 0x68: return uart_ctrl;
+  case 0x6C: return uart_div;
+  default: return 0;
+  }
+}
+
+inline bool iss_t::io_store(uint32_t offset, uint32_t data, uint32_t mask)
+{
+  switch (offset) {
+  case 0x00:
+    gpio = data;
+    switch (data) {
+    case 0:
+      // The signature starts after the last 0xFFFFFFFF below the
+      // 0xDEADDEAD marker, in the first 4 KiB
+      for (int i=1023, tail=0; i>=0; --i) {
+	uint32_t word;
+	std::memcpy(&word, &ram[4 * i], 4);
+	if (!tail) tail = word == 0xDEADDEAD;
+	else if (word != 0xFFFFFFFF) {
+	  signature_base = 4 * (i + 1);
+	  break;
+	}
+      }
+      break;
+    case 1:
+      ++test_passes;
+      if (!quiet) std::printf("A test passes!\n");
+      break;
+    case 2:
+      ++test_fails;
+      if (!quiet) std::printf("A test fails at PC=0x%x\n", pc);
+      break;
+    case 3:
+      test_halt = true;
+      break;
+    }
+    break;
+  case 0x04:
+    semihost.service(data);
+    break;
+  case 0x08:
+  case 0x0C: {
+    uint32_t& w = scratch[(offset >> 2) & 1];
+    w = (w & ~mask) | (data & mask);
+    break;
+  }
+  // The timer takes whole words. A write to mtimecmp makes its interrupt
+  // pending again
+  case 0x10:
+    mtime_offset = ((mtime() & ~0xFFFFFFFFull) | data) - (instret + 1);
+    break;
+  case 0x14:
+    mtime_offset = ((mtime() & 0xFFFFFFFFull)
+		    | static_cast<uint64_t>(data) << 32) - (instret + 1);
+    break;
+  case 0x18:
+    mtimecmp = (mtimecmp & ~0xFFFFFFFFull) | data;
+    irq_mtimecmp_p = false;
+    break;
+  case 0x1C:
+    mtimecmp = (mtimecmp & 0xFFFFFFFFull) | static_cast<uint64_t>(data) << 32;
+    irq_mtimecmp_p = false;
+    break;
+  // The DMA ignores writes while busy. Any write to CTRL clears done
+  case 0x20: case 0x24: case 0x28: case 0x2C: case 0x30:
+    if (dma_busy()) break;
+    switch (offset) {
+    case 0x20: dma_src = data; break;
+    case 0x24: dma_dst = data; break;
+    case 0x28: dma_len = data; break;
+    case 0x2C: dma_stride = data; break;
+    case 0x30:
+      dma_ie = (data >> 1) & 1;
+      dma_started = false;
+      if ((data & 1) && dma_len != 0) dma_start();
+      break;
+    }
+    break;
+  case 0x60:
+    ++uart_tx_bytes;
+    if (uart_out) std::fputc(data & 0xFF, uart_out);
+    break;
+  case 0x68:
+    uart_ctrl = data;
+    break;
+  case 0x6C:
+    uart_div = data & 0xFFFF;
+    break;
+  }
+  return stopped();
+}
+
+// Copies len words, word aligned, through the data port. Each word
+// goes through load_slow and store_slow, as dma.v does, but the RAM
+// part is done here. The copy is finished as the CTRL write retires
+inline void iss_t::dma_start()
+{
+  uint32_t src = dma_src, dst = dma_dst;
+  int32_t src_stride = static_cast<int16_t>(dma_stride);
+  int32_t dst_stride = static_cast<int16_t>(dma_stride >> 16);
+  for (uint32_t n=0; n<dma_len; ++n) {
+    uint32_t a = src & ~3u, word;
+    if (is_ram(a) && ram) std::memcpy(&word, &ram[ram_offset(a)], 4);
+    else word = load_slow(a);
+    a = dst & ~3u;
+    if (is_ram(a) && ram) std::memcpy(&ram[ram_offset(a)], &word, 4);
+    else store_slow(a, word, ~0u);
+    src += src_stride;
+    dst += dst_stride;
+  }
+  dma_started = true;
+  dma_done_at = mcycle() + 1 + 3 * static_cast<uint64_t>(dma_len);
+  dma_src = src;
+  dma_dst = dst;
+  dma_len = 0;
+}
+
+// op is 1 write, 2 set, 3 clear, 0 none. false for a CSR csr_ehu.v does
+// not know, whatever the access
+inline bool iss_t::csr_access(uint32_t csr, uint32_t& value, int op,
+			      uint32_t operand)
+{
+  auto update = [&](uint32_t old) {
+    return op == 1 ? operand : op == 2 ? old | operand
+      : op == 3 ? old & ~operand : old;
+  };
+  auto update64 = [&](uint64_t& offset, uint64_t now, bool high) {
+    uint64_t v = now;
+    if (high) v = (v & 0xFFFFFFFFull) | (uint64_t)update(v >> 32) << 32;
+    else v = (v & ~0xFFFFFFFFull) | update(v);
+    offset = v - (instret + 1);
+  };
+  value = 0;
+  switch (csr) {
+  case 0xF11: case 0xF12: case 0xF13: case 0xF14:
+    break;
+  case 0x300: {
+    value = 3u << 11 | mpie << 7 | mie << 3;
+    uint32_t v = update(value);
+    mpie = (v >> 7) & 1;
+    mie = (v >> 3) & 1;
+    break;
+  }
+  case 0x301:
+    value = 0x40000100;
+    break;
+  case 0x304: {
+    value = mie_local << 16 | meie << 11 | mtie << 7;
+    uint32_t v = update(value);
+    mtie = (v >> 7) & 1;
+    meie = (v >> 11) & 1;
+    mie_local = v >> 16;
+    break;
+  }
+  case 0x305: {
+    value = mtvec | mtvec_vectored;
+    uint32_t v = update(value);
+    mtvec = v & ~3u;
+    mtvec_vectored = (v & 3) == 1;
+    break;
+  }
+  case 0x340:
+    value = mscratch;
+    mscratch = update(value);
+    break;
+  case 0x341:
+    value = mepc & ~3u;
+    mepc = update(mepc) & ~1u;
+    break;
+  case 0x342:
+    value = mcause;
+    mcause = update(value);
+    break;
+  case 0x343:
+    value = mtval;
+    mtval = update(value);
+    break;
+  case 0x344:
+    value = irq_dma() << 11
+      | (timer_irq ? timer_irq() : mtime() >= mtimecmp) << 7;
+    break;
+  case 0xB00: case 0xB80:
+    value = mcycle() >> (csr == 0xB80 ? 32 : 0);
+    if (op) update64(mcycle_offset, mcycle(), csr == 0xB80);
+    break;
+  case 0xB02: case 0xB82:
+    value = minstret() >> (csr == 0xB82 ? 32 : 0);
+    if (op) update64(minstret_offset, minstret(), csr == 0xB82);
+    break;
+  default:
+    // Performance monitors are hard wired to 0
+    switch (csr >> 4) {
+    case 0xB0: case 0xB1: case 0xB8: case 0xB9: case 0x32: case 0x33:
+      break;
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+inline int iss_t::op_csr(iss_t& s, const iss_op_t& o)
+{
+  // funct3 is kept in rs2. The set and clear forms with rs1 or uimm 0
+  // write nothing
+  unsigned funct3 = o.rs2;
+  uint32_t operand = (funct3 & 4) ? o.rs1 : s.x[o.rs1];
+  int op = funct3 & 3;
+  if (op != 1 && o.rs1 == 0) op = 0;
+  uint32_t value;
+  if (!s.csr_access(o.imm, value, op, operand)) {
+    return s.trap(2, o.pc, 0, true);
+  }
+  s.x[o.rd] = value;
+  return iss_op_t::NEXT;
+}
+
+// WFI waits for the first enabled interrupt, moving the clock up to it
+// instead of simulating each clock, as cpu_run does
+inline int iss_t::op_wfi(iss_t& s, const iss_op_t& o)
+{
+  bool timer = s.mtie;
+  bool dma = s.meie && s.dma_ie && s.dma_started;
+  if (!timer && !dma) {
+    s.deadlock = true;
+    s.pc = o.pc;
+    return iss_op_t::TRAP;
+  }
+  if (s.timer_irq) {
+    s.wfi = true;
+    return iss_op_t::NEXT;
+  }
+  uint64_t skip = ~0ull;
+  if (timer) skip = s.mtime() < s.mtimecmp ? s.mtimecmp - s.mtime() : 0;
+  if (dma) {
+    uint64_t d = s.dma_busy() ? s.dma_done_at - s.mcycle() : 0;
+    if (d < skip) skip = d;
+  }
+  s.mtime_offset += skip;
+  s.mcycle_offset += skip;
+  s.skipped_cycles += skip;
+  return iss_op_t::NEXT;
+}
+
+// Decoded as instruction_decoder.v does without build options: only
+// inst[6:2] of the opcode and inst[30] of funct7 are looked at
+inline iss_op_t iss_t::decode(uint32_t inst, uint32_t pc)
+{
+  typedef iss_op_t op_t;
+  op_t o;
+  o.pc = pc;
+  o.rd = (inst >> 7) & 31;
+  if (o.rd == 0) o.rd = 32;
+  o.rs1 = (inst >> 15) & 31;
+  o.rs2 = (inst >> 20) & 31;
+  o.imm = static_cast<int32_t>(inst) >> 20;
+  o.ends_block = false;
+  unsigned funct3 = (inst >> 12) & 7;
+  bool alt = (inst >> 30) & 1;
+
+  int (*illegal)(iss_t&, const op_t&) = [](iss_t& s, const op_t& o) {
+    return s.trap(2, o.pc, 0, true);
+  };
+  o.fn = illegal;
+
+  switch ((inst >> 2) & 31) {
+  case 0x0D:
+    o.imm = inst & 0xFFFFF000;
+    o.fn = [](iss_t& s, const op_t& o) {
+      s.x[o.rd] = o.imm;
+      return (int)op_t::NEXT;
+    };
+    break;
+  case 0x05:
+    o.imm = inst & 0xFFFFF000;
+    o.fn = [](iss_t& s, const op_t& o) {
+      s.x[o.rd] = o.pc + o.imm;
+      return (int)op_t::NEXT;
+    };
+    break;
+  case 0x1B:
+    o.imm = ((static_cast<int32_t>(inst) >> 11) & ~0xFFFFF) | (inst & 0xFF000)
+      | ((inst >> 9) & 0x800) | ((inst >> 20) & 0x7FE);
+    o.fn = [](iss_t& s, const op_t& o) {
+      int r = op_jump(s, o, o.pc + o.imm);
+      if (r == op_t::JUMP) s.x[o.rd] = o.pc + 4;
+      return r;
+    };
+    break;
+  case 0x19:
+    o.fn = [](iss_t& s, const op_t& o) {
+      uint32_t link = o.pc + 4;
+      int r = op_jump(s, o, (s.x[o.rs1] + o.imm) & ~1u);
+      if (r == op_t::JUMP) s.x[o.rd] = link;
+      return r;
+    };
+    break;
+  case 0x18:
+    o.imm = ((static_cast<int32_t>(inst) >> 19) & ~0xFFF) | ((inst << 4) & 0x800)
+      | ((inst >> 20) & 0x7E0) | ((inst >> 7) & 0x1E);
+    switch (funct3) {
+#define ISS_BRANCH(F, COND)						\
+    case F:								\
+      o.fn = [](iss_t& s, const op_t& o) {				\
+	uint32_t a = s.x[o.rs1], b = s.x[o.rs2];			\
+	(void)a; (void)b;						\
+	if (COND) return op_jump(s, o, o.pc + o.imm);			\
+	s.pc = o.pc + 4;						\
+	return (int)op_t::JUMP;						\
+      };								\
+      break;
+      ISS_BRANCH(0, a == b)
+      ISS_BRANCH(1, a != b)
+      ISS_BRANCH(4, (int32_t)a < (int32_t)b)
+      ISS_BRANCH(5, (int32_t)a >= (int32_t)b)
+      ISS_BRANCH(6, a < b)
+      ISS_BRANCH(7, a >= b)
+#undef ISS_BRANCH
+    }
+    break;
+  case 0x00:
+    switch (funct3) {
+    case 0: o.fn = op_load<int8_t>; break;
+    case 1: o.fn = op_load<int16_t>; break;
+    case 2: o.fn = op_load<uint32_t>; break;
+    case 4: o.fn = op_load<uint8_t>; break;
+    case 5: o.fn = op_load<uint16_t>; break;
+    }
+    break;
+  case 0x08:
+    o.imm = (static_cast<int32_t>(inst & 0xFE000000) >> 20) | ((inst >> 7) & 31);
+    switch (funct3) {
+    case 0: o.fn = op_store<uint8_t>; break;
+    case 1: o.fn = op_store<uint16_t>; break;
+    case 2: o.fn = op_store<uint32_t>; break;
+    }
+    break;
+  case 0x04:
+#define ISS_ALU(F, EXPR)						\
+    case F:								\
+      o.fn = [](iss_t& s, const op_t& o) {				\
+	uint32_t a = s.x[o.rs1], b = o.imm;				\
+	s.x[o.rd] = EXPR;						\
+	return (int)op_t::NEXT;						\
+      };								\
+      break;
+    switch (funct3) {
+      ISS_ALU(0, a + b)
+      ISS_ALU(2, (int32_t)a < (int32_t)b)
+      ISS_ALU(3, a < b)
+      ISS_ALU(4, a ^ b)
+      ISS_ALU(6, a | b)
+      ISS_ALU(7, a & b)
+      ISS_ALU(1, a << (b & 31))
+    case 5:
+      if (alt) {
+	o.fn = [](iss_t& s, const op_t& o) {
+	  s.x[o.rd] = (int32_t)s.x[o.rs1] >> (o.imm & 31);
+	  return (int)op_t::NEXT;
+	};
+      }
+      else {
+	o.fn = [](iss_t& s, const op_t& o) {
+	  s.x[o.rd] = s.x[o.rs1] >> (o.imm & 31);
+	  return (int)op_t::NEXT;
+	};
+      }
+      break;
+    }
+#undef ISS_ALU
+    break;
+  case 0x0C:
+#define ISS_ALU(F, EXPR)						\
+    case F:								\
+      o.fn = [](iss_t& s, const op_t& o) {				\
+	uint32_t a = s.x[o.rs1], b = s.x[o.rs2];			\
+	s.x[o.rd] = EXPR;						\
+	return (int)op_t::NEXT;						\
+      };								\
+      break;
+    switch (funct3 | alt << 3) {
+      ISS_ALU(0, a + b)
+      ISS_ALU(8, a - b)
+      ISS_ALU(1, a << (b & 31))
+      ISS_ALU(2, (int32_t)a < (int32_t)b)
+      ISS_ALU(3, a < b)
+      ISS_ALU(4, a ^ b)
+      ISS_ALU(5, a >> (b & 31))
+      ISS_ALU(13, (int32_t)a >> (b & 31))
+      ISS_ALU(6, a | b)
+      ISS_ALU(7, a & b)
+    default:
+      // funct7 other than bit 30 is not looked at
+      o = decode(inst & ~0x40000000u, pc);
+      break;
+    }
+#undef ISS_ALU
+    break;
+  case 0x03:
+    // FENCE and FENCE.I, nothing to order
+    o.fn = [](iss_t&, const op_t&) { return (int)op_t::NEXT; };
+    break;
+  case 0x1C:
+    o.ends_block = true;
+    if (funct3 == 4) break;
+    if (funct3 != 0) {
+      o.imm = inst >> 20;
+      o.rs2 = funct3;
+      o.fn = op_csr;
+      break;
+    }
+    switch (inst >> 25) {
+    case 0x00:
+      if (inst & 0x100000) {
+	o.fn = [](iss_t& s, const op_t& o) { return s.trap(3, o.pc, 0, false); };
+      }
+      else {
+	o.fn = [](iss_t& s, const op_t& o) { return s.trap(11, o.pc, 0, false); };
+      }
+      break;
+    case 0x08:
+      if (o.rs2 == 5) o.fn = op_wfi;
+      break;
+    case 0x18:
+      // MRET. An interrupt still pending is taken again
+      o.fn = [](iss_t& s, const op_t&) {
+	s.irq_mtimecmp_p = s.irq_external_p = false;
+	s.pc = s.mepc & ~3u;
+	return (int)op_t::JUMP;
+      };
+      break;
+    }
+    break;
+  }
+  if (o.fn == illegal) o.ends_block = true;
+  switch ((inst >> 2) & 31) {
+  case 0x1B: case 0x19: case 0x18:
+    o.ends_block = true;
+  }
+  return o;
+}
+
+#endif // __ISS_H__
@@ -0,0 +1,136 @@
+// Batch runner of iss_batch.h
+//
+// iss_batch [+lanes=<n>] [+max=<instructions>] [+copies=<n>] [+check]
+//           <program>...
+//
+// Runs each <program>.bin, +copies times, for up to +max instructions,
+// in batches of +lanes lanes, 16 by default. Prints a (TT) line for each
+// run with how it ended and the passes and fails it reported on the
+// GPIO, and the aggregate instructions per second. +check runs each
+// program again on a plain iss_t, which must end in the same state, and
+// prints its instructions per second too.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "iss.h"
+#include "iss_batch.h"
+
+static std::string describe(const iss_t& s)
+{
+  std::ostringstream out;
+  if (s.test_halt) out << "halted";
+  else if (s.semihost.exited) out << "exit " << s.semihost.exit_code;
+  else if (s.deadlock) out << "WFI deadlock";
+  else out << "budget";
+  out << ", " << s.instret << " instructions, " << s.test_passes
+      << " passes, " << s.test_fails << " fails, PC=0x" << std::hex << s.pc;
+  return out.str();
+}
+
+static bool same_state(const iss_t& a, const iss_t& b)
+{
+  return a.pc == b.pc && a.instret == b.instret
+    && std::memcmp(a.x, b.x, 32 * sizeof(uint32_t)) == 0
+    && a.mcause == b.mcause && a.mepc == b.mepc && a.traps == b.traps
+    && a.test_passes == b.test_passes && a.test_fails == b.test_fails
+    && std::memcmp(a.ram, b.ram, iss_t::RAM_BYTES) == 0;
+}
+
+int main(int argc, char** argv)
+{
+  unsigned lanes = 16;
+  uint64_t max_instructions = 100000;
+  unsigned copies = 1;
+  bool check = false;
+  std::vector<std::string> programs;
+  for (int i=1; i<argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.rfind("+lanes=", 0) == 0) lanes = std::stoul(arg.substr(7));
+    else if (arg.rfind("+max=", 0) == 0) max_instructions = std::stoull(arg.substr(5));
+    else if (arg.rfind("+copies=", 0) == 0) copies = std::stoul(arg.substr(8));
+    else if (arg == "+check") check = true;
+    else if (arg[0] != '+') programs.push_back(arg);
+  }
+  if (lanes > iss_batch_t::MAX_LANES) lanes = iss_batch_t::MAX_LANES;
+  if (lanes == 0) lanes = 1;
+  if (programs.empty()) {
+    std::cerr << "Usage: iss_batch [+lanes=<n>] [+max=<instructions>] "
+	      << "[+copies=<n>] [+check] <program>..." << std::endl;
+    return 1;
+  }
+  std::vector<std::string> runs;
+  for (unsigned c=0; c<copies; ++c) {
+    runs.insert(runs.end(), programs.begin(), programs.end());
+  }
+
+  uint64_t instructions = 0, steps = 0, batched = 0, scalar = 0, solo = 0;
+  double seconds = 0, check_seconds = 0;
+  int mismatches = 0;
+  for (size_t first=0; first<runs.size(); first+=lanes) {
+    size_t count = std::min<size_t>(lanes, runs.size() - first);
+    iss_batch_t batch(count);
+    for (size_t i=0; i<count; ++i) {
+      if (!batch.lane[i]->load_program(runs[first + i] + ".bin")) {
+	std::cerr << "Program load failed: " << runs[first + i] << std::endl;
+	return 1;
+      }
+    }
+    batch.reset();
+    auto start = std::chrono::steady_clock::now();
+    batch.run(max_instructions);
+    seconds += std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    steps += batch.steps;
+    batched += batch.batched;
+    scalar += batch.scalar;
+    solo += batch.solo;
+
+    for (size_t i=0; i<count; ++i) {
+      const iss_t& s = *batch.lane[i];
+      instructions += s.instret;
+      std::cout << "(TT) " << runs[first + i] << ": " << describe(s);
+      if (check) {
+	iss_t ref;
+	ref.quiet = true;
+	ref.load_program(runs[first + i] + ".bin");
+	auto start = std::chrono::steady_clock::now();
+	while (!ref.stopped() && ref.instret < max_instructions) ref.step();
+	check_seconds += std::chrono::duration<double>(
+	  std::chrono::steady_clock::now() - start).count();
+	if (same_state(s, ref)) std::cout << ", matches";
+	else {
+	  std::cout << ", MISMATCH with " << describe(ref);
+	  ++mismatches;
+	}
+      }
+      std::cout << std::endl;
+    }
+  }
+
+  std::cout << "(SS) Runs: " << runs.size() << " in " << lanes << " lanes"
+	    << std::endl;
+  std::cout << "(SS) Instructions: " << instructions << std::endl;
+  std::cout << "(SS) Batch steps: " << steps << std::endl;
+  std::cout << "(SS) Instructions run in lanes: " << batched << std::endl;
+  std::cout << "(SS) Instructions run scalar: " << scalar << std::endl;
+  std::cout << "(SS) Instructions run solo: " << solo << std::endl;
+  std::cout << "(SS) Lanes per step: " << std::fixed << std::setprecision(2)
+	    << static_cast<double>(batched + scalar) / steps << std::endl;
+  std::cout << "(SS) Aggregate MIPS: " << instructions / seconds / 1e6
+	    << std::endl;
+  if (check) {
+    std::cout << "(SS) Scalar MIPS: " << instructions / check_seconds / 1e6
+	      << std::endl;
+    std::cout << "(SS) " << mismatches << " mismatches" << std::endl;
+  }
+  return mismatches ? 1 : 0;
+}
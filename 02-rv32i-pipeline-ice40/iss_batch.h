@@ -0,0 +1,390 @@
+#ifndef __ISS_BATCH_H__
+#define __ISS_BATCH_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "iss.h"
+
+// Many independent programs on the model of iss.h at once, one lane
+// each, for regression and fuzzing runs. The registers, pc and instret
+// of the lanes are kept as structure of arrays. Each step takes the
+// lowest pc of the running lanes, and runs its instruction on every
+// lane at that pc with the same instruction word: decoded once, then a
+// loop over the lanes, masked, which the compiler vectorizes. Lanes at
+// other pcs wait, and catch up when their pc is the lowest.
+//
+// ALU, jump and branch instructions, and loads and stores to main
+// memory, are run this way. Anything else, a misaligned or IO access,
+// runs on the iss_t of the lane, which holds its CSRs, memory and
+// devices, with the registers copied in and out. A lane with an
+// interrupt enabled stays in the loops, and only its interrupts are
+// checked on its iss_t after each instruction.
+//
+// Lanes that drift apart, fewer than two to a step on average, run on
+// their own iss_t for a while instead, and are batched again after it
+class iss_batch_t
+{
+public:
+  static const unsigned MAX_LANES = 64;
+
+  // x[r][lane], x[32] takes the writes to x0
+  alignas(64) uint32_t x[33][MAX_LANES];
+  alignas(64) uint32_t pc[MAX_LANES];
+  uint64_t instret[MAX_LANES];
+  std::vector<std::unique_ptr<iss_t>> lane;
+
+  uint64_t steps = 0;
+  uint64_t batched = 0;
+  uint64_t scalar = 0;
+  uint64_t solo = 0;
+
+  // Steps looked at for drift, and instructions run solo after it
+  static const unsigned DRIFT_STEPS = 256;
+  static const uint64_t SOLO_INSTRUCTIONS = 4096;
+
+  explicit iss_batch_t(unsigned lanes)
+  {
+    for (unsigned i=0; i<lanes && i<MAX_LANES; ++i) {
+      lane.emplace_back(new iss_t);
+      lane.back()->quiet = true;
+    }
+  }
+
+  unsigned lanes() const { return lane.size(); }
+
+  // Takes the registers of each lane from its iss_t, after loading.
+  // Lanes with the same ROM need not compare instruction words
+  void reset()
+  {
+    for (unsigned i=0; i<lanes(); ++i) {
+      for (int r=0; r<33; ++r) x[r][i] = lane[i]->x[r];
+      pc[i] = lane[i]->pc;
+      instret[i] = lane[i]->instret;
+      irq_on[i] = (lane[i]->mtie || lane[i]->meie) ? ~0u : 0;
+      rom_class[i] = i;
+      for (unsigned j=0; j<i; ++j) {
+	if (std::memcmp(lane[i]->rom, lane[j]->rom, iss_t::ROM_BYTES) == 0) {
+	  rom_class[i] = rom_class[j];
+	  break;
+	}
+      }
+    }
+  }
+
+  // Runs every lane until it stops, or has retired max_instructions.
+  // The registers are back in the iss_t of each lane afterwards
+  void run(uint64_t max_instructions)
+  {
+    max = max_instructions;
+    for (unsigned i=0; i<lanes(); ++i) update_live(i);
+    while (step()) {}
+    for (unsigned i=0; i<lanes(); ++i) sync_in(i);
+  }
+
+private:
+  uint64_t max = 0;
+  // Steps and lanes run in them, since drift was last looked at
+  unsigned drift_steps = 0;
+  unsigned drift_lanes = 0;
+  // Masks of the lanes still running, and of the lanes with an
+  // interrupt enabled
+  alignas(64) uint32_t live[MAX_LANES];
+  alignas(64) uint32_t irq_on[MAX_LANES];
+  // The first lane with the same ROM
+  alignas(64) uint32_t rom_class[MAX_LANES];
+
+  void update_live(unsigned i)
+  {
+    live[i] = (instret[i] < max && !lane[i]->stopped()) ? ~0u : 0;
+  }
+
+  // The iss_t of lane i gets its registers. Its interrupt state is up
+  // to date: a lane without an interrupt enabled has none pending, and
+  // one with is checked after each instruction
+  void sync_in(unsigned i)
+  {
+    iss_t& s = *lane[i];
+    for (int r=0; r<33; ++r) s.x[r] = x[r][i];
+    s.pc = pc[i];
+    s.instret = instret[i];
+  }
+
+  void sync_out(unsigned i)
+  {
+    iss_t& s = *lane[i];
+    for (int r=0; r<33; ++r) x[r][i] = s.x[r];
+    pc[i] = s.pc;
+    instret[i] = s.instret;
+    irq_on[i] = (s.mtie || s.meie) ? ~0u : 0;
+    update_live(i);
+  }
+
+  void run_scalar(unsigned i)
+  {
+    sync_in(i);
+    lane[i]->step();
+    sync_out(i);
+    ++scalar;
+  }
+
+  // After an instruction run in the loops, as iss_t::step() does.
+  // check_irq() needs only the pc and instret of the lane
+  void check_irq(const uint32_t* m)
+  {
+    for (unsigned i=0; i<lanes(); ++i) {
+      if (!(m[i] & irq_on[i])) continue;
+      iss_t& s = *lane[i];
+      s.pc = pc[i];
+      s.instret = instret[i];
+      if (s.check_irq()) pc[i] = s.pc;
+    }
+  }
+
+  // Every running lane on its own iss_t, for up to SOLO_INSTRUCTIONS
+  void run_solo()
+  {
+    for (unsigned i=0; i<lanes(); ++i) {
+      if (!live[i]) continue;
+      sync_in(i);
+      iss_t& s = *lane[i];
+      uint64_t end = std::min(max, s.instret + SOLO_INSTRUCTIONS);
+      uint64_t start = s.instret;
+      while (s.instret < end && !s.stopped()) s.step();
+      solo += s.instret - start;
+      sync_out(i);
+    }
+  }
+
+  // Lanes run in a step. When they average fewer than two, the lanes
+  // have drifted apart and run solo for a while
+  void drift(unsigned count)
+  {
+    drift_lanes += count;
+    if (++drift_steps < DRIFT_STEPS) return;
+    if (drift_lanes < 2 * DRIFT_STEPS) run_solo();
+    drift_steps = drift_lanes = 0;
+  }
+
+  // One instruction of the lanes at the lowest pc. false when none is
+  // running
+  bool step()
+  {
+    const unsigned n = lanes();
+    uint32_t p = ~0u, any = 0;
+    for (unsigned i=0; i<n; ++i) {
+      p = std::min(p, pc[i] | ~live[i]);
+      any |= live[i];
+    }
+    if (!any) return false;
+    unsigned leader = 0;
+    while (!live[leader] || pc[leader] != p) ++leader;
+    ++steps;
+    uint32_t inst = lane[leader]->fetch(p);
+    uint32_t cls = rom_class[leader];
+    alignas(64) uint32_t m[MAX_LANES];
+    unsigned other = 0;
+    for (unsigned i=0; i<n; ++i) {
+      uint32_t at = live[i] & -(uint32_t)(pc[i] == p);
+      m[i] = at & -(uint32_t)(rom_class[i] == cls);
+      other |= at & ~m[i];
+    }
+    // Lanes at p with another program
+    for (unsigned i=0; other && i<n; ++i) {
+      if (live[i] && pc[i] == p && !m[i] && lane[i]->fetch(p) == inst) {
+	m[i] = ~0u;
+      }
+    }
+    if (!run_batched(inst, p, m)) {
+      unsigned count = 0;
+      for (unsigned i=0; i<n; ++i) {
+	if (m[i]) {
+	  run_scalar(i);
+	  ++count;
+	}
+      }
+      drift(count);
+      return true;
+    }
+    uint64_t count = 0;
+    for (unsigned i=0; i<n; ++i) {
+      instret[i] += m[i] & 1;
+      count += m[i] & 1;
+      live[i] &= -(uint32_t)(instret[i] < max);
+    }
+    batched += count;
+    check_irq(m);
+    drift(count);
+    return true;
+  }
+
+  // Masked loops over the lanes. d is the destination register, and
+  // EXPR of lane i is written where m[i] is set
+#define ISS_LANES(d, EXPR)						\
+  for (unsigned i=0; i<n; ++i) {					\
+    uint32_t v = (EXPR);						\
+    d[i] = (m[i] & v) | (~m[i] & d[i]);					\
+  }
+
+  // Runs inst at p on the lanes of m, and sets their pc. Lanes that
+  // must trap, or access anything but main memory, are moved out of m
+  // and run on their iss_t here. false, having done nothing, for an
+  // instruction left to the iss_t of each lane
+  bool run_batched(uint32_t inst, uint32_t p, uint32_t* m)
+  {
+    const unsigned n = lanes();
+    unsigned rd = (inst >> 7) & 31;
+    if (rd == 0) rd = 32;
+    uint32_t* d = x[rd];
+    const uint32_t* a = x[(inst >> 15) & 31];
+    const uint32_t* b = x[(inst >> 20) & 31];
+    int32_t imm = static_cast<int32_t>(inst) >> 20;
+    unsigned funct3 = (inst >> 12) & 7;
+    bool alt = (inst >> 30) & 1;
+    uint32_t next = p + 4;
+
+    switch ((inst >> 2) & 31) {
+    case 0x0D: {
+      uint32_t u = inst & 0xFFFFF000;
+      ISS_LANES(d, u)
+      break;
+    }
+    case 0x05: {
+      uint32_t u = p + (inst & 0xFFFFF000);
+      ISS_LANES(d, u)
+      break;
+    }
+    case 0x04: {
+      uint32_t u = imm;
+      switch (funct3) {
+      case 0: ISS_LANES(d, a[i] + u) break;
+      case 2: ISS_LANES(d, (int32_t)a[i] < (int32_t)u) break;
+      case 3: ISS_LANES(d, a[i] < u) break;
+      case 4: ISS_LANES(d, a[i] ^ u) break;
+      case 6: ISS_LANES(d, a[i] | u) break;
+      case 7: ISS_LANES(d, a[i] & u) break;
+      case 1: ISS_LANES(d, a[i] << (u & 31)) break;
+      case 5:
+	if (alt) ISS_LANES(d, (int32_t)a[i] >> (u & 31))
+	else ISS_LANES(d, a[i] >> (u & 31))
+	break;
+      }
+      break;
+    }
+    case 0x0C:
+      // funct7 other than bit 30 is not looked at
+      if (funct3 != 0 && funct3 != 5) alt = false;
+      switch (funct3 | alt << 3) {
+      case 0: ISS_LANES(d, a[i] + b[i]) break;
+      case 8: ISS_LANES(d, a[i] - b[i]) break;
+      case 1: ISS_LANES(d, a[i] << (b[i] & 31)) break;
+      case 2: ISS_LANES(d, (int32_t)a[i] < (int32_t)b[i]) break;
+      case 3: ISS_LANES(d, a[i] < b[i]) break;
+      case 4: ISS_LANES(d, a[i] ^ b[i]) break;
+      case 5: ISS_LANES(d, a[i] >> (b[i] & 31)) break;
+      case 13: ISS_LANES(d, (int32_t)a[i] >> (b[i] & 31)) break;
+      case 6: ISS_LANES(d, a[i] | b[i]) break;
+      case 7: ISS_LANES(d, a[i] & b[i]) break;
+      }
+      break;
+    case 0x03:
+      // FENCE and FENCE.I
+      break;
+    case 0x1B: {
+      uint32_t target = p + (((static_cast<int32_t>(inst) >> 11) & ~0xFFFFF)
+			     | (inst & 0xFF000) | ((inst >> 9) & 0x800)
+			     | ((inst >> 20) & 0x7FE));
+      if (target & 3) return false;
+      ISS_LANES(d, next)
+      ISS_LANES(pc, target)
+      return true;
+    }
+    case 0x19: {
+      alignas(64) uint32_t target[MAX_LANES];
+      for (unsigned i=0; i<n; ++i) target[i] = (a[i] + imm) & ~1u;
+      split(m, [&](unsigned i) { return (target[i] & 3) != 0; });
+      ISS_LANES(d, next)
+      ISS_LANES(pc, target[i])
+      return true;
+    }
+    case 0x18: {
+      uint32_t target = p + (((static_cast<int32_t>(inst) >> 19) & ~0xFFF)
+			     | ((inst << 4) & 0x800) | ((inst >> 20) & 0x7E0)
+			     | ((inst >> 7) & 0x1E));
+      alignas(64) uint32_t taken[MAX_LANES];
+      switch (funct3) {
+      case 0: for (unsigned i=0; i<n; ++i) taken[i] = -(a[i] == b[i]); break;
+      case 1: for (unsigned i=0; i<n; ++i) taken[i] = -(a[i] != b[i]); break;
+      case 4: for (unsigned i=0; i<n; ++i) taken[i] = -((int32_t)a[i] < (int32_t)b[i]); break;
+      case 5: for (unsigned i=0; i<n; ++i) taken[i] = -((int32_t)a[i] >= (int32_t)b[i]); break;
+      case 6: for (unsigned i=0; i<n; ++i) taken[i] = -(a[i] < b[i]); break;
+      case 7: for (unsigned i=0; i<n; ++i) taken[i] = -(a[i] >= b[i]); break;
+      default: return false;
+      }
+      if (target & 3) split(m, [&](unsigned i) { return taken[i] != 0; });
+      ISS_LANES(pc, (taken[i] & target) | (~taken[i] & next))
+      return true;
+    }
+    case 0x00: {
+      alignas(64) uint32_t addr[MAX_LANES];
+      for (unsigned i=0; i<n; ++i) addr[i] = a[i] + imm;
+      unsigned size = 1u << (funct3 & 3);
+      if ((funct3 & 3) == 3 || funct3 >= 6) return false;
+      split(m, [&](unsigned i) {
+	  return (addr[i] & (size - 1)) || !iss_t::is_ram(addr[i])
+	    || !lane[i]->ram;
+	});
+      for (unsigned i=0; i<n; ++i) {
+	if (!m[i]) continue;
+	const uint8_t* ram = &lane[i]->ram[iss_t::ram_offset(addr[i])];
+	switch (funct3) {
+	case 0: d[i] = static_cast<int8_t>(ram[0]); break;
+	case 1: { int16_t h; std::memcpy(&h, ram, 2); d[i] = h; break; }
+	case 2: std::memcpy(&d[i], ram, 4); break;
+	case 4: d[i] = ram[0]; break;
+	case 5: { uint16_t h; std::memcpy(&h, ram, 2); d[i] = h; break; }
+	}
+      }
+      break;
+    }
+    case 0x08: {
+      alignas(64) uint32_t addr[MAX_LANES];
+      int32_t s_imm = (static_cast<int32_t>(inst & 0xFE000000) >> 20)
+	| ((inst >> 7) & 31);
+      for (unsigned i=0; i<n; ++i) addr[i] = a[i] + s_imm;
+      if (funct3 > 2) return false;
+      unsigned size = 1u << funct3;
+      split(m, [&](unsigned i) {
+	  return (addr[i] & (size - 1)) || !iss_t::is_ram(addr[i])
+	    || !lane[i]->ram;
+	});
+      for (unsigned i=0; i<n; ++i) {
+	if (!m[i]) continue;
+	std::memcpy(&lane[i]->ram[iss_t::ram_offset(addr[i])], &b[i], size);
+      }
+      break;
+    }
+    default:
+      return false;
+    }
+    ISS_LANES(pc, next)
+    return true;
+  }
+#undef ISS_LANES
+
+  // Lanes of m for which f is true leave m, and run on their iss_t
+  template <typename F> void split(uint32_t* m, F f)
+  {
+    for (unsigned i=0; i<lanes(); ++i) {
+      if (m[i] && f(i)) {
+	m[i] = 0;
+	run_scalar(i);
+      }
+    }
+  }
+};
+
+#endif // __ISS_BATCH_H__
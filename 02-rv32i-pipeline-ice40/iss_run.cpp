@@ -0,0 +1,176 @@
+// Functional simulator of the SoC, see iss.h and dbt.h
+//
+// iss_run <program> [max instructions] [+interp] [+bench]
+//         [+uart_out=<file>|-]
+//
+// Runs <program>.bin like cpu_run, with translated blocks, or the plain
+// interpreter with +interp, and prints the (SS) statistics and the (DD)
+// compliance signature. +bench runs the program both ways, and prints
+// the instructions per second of each. Without interrupts, both must
+// end in the same state.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dbt.h"
+#include "iss.h"
+
+struct run_result_t
+{
+  uint64_t instructions;
+  double seconds;
+
+  double mips() const { return instructions / seconds / 1e6; }
+};
+
+static run_result_t run(iss_t& s, uint64_t max_instructions, bool interp,
+			dbt_t* dbt)
+{
+  auto start = std::chrono::steady_clock::now();
+  if (interp) {
+    while (!s.stopped() && s.instret < max_instructions) s.step();
+  }
+  else {
+    dbt->run(max_instructions);
+  }
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  return {s.instret, seconds};
+}
+
+static void report_statistics(const iss_t& s, const run_result_t& r,
+			      const dbt_t* dbt)
+{
+  std::cout << "(SS) Instructions: " << std::dec << s.instret << std::endl;
+  std::cout << "(SS) Cycles: " << s.mcycle() << std::endl;
+  std::cout << "(SS) Skipped idle cycles: " << s.skipped_cycles << std::endl;
+  std::cout << "(SS) Traps: " << s.traps << std::endl;
+  std::cout << "(SS) Interrupts: " << s.interrupts << std::endl;
+  if (dbt) {
+    std::cout << "(SS) Translations: " << dbt->translations << std::endl;
+    std::cout << "(SS) Blocks run: " << dbt->blocks_run << std::endl;
+    std::cout << "(SS) Blocks chained: " << dbt->chained << std::endl;
+    std::cout << "(SS) Translation flushes: " << dbt->flushes << std::endl;
+  }
+  if (s.semihost.requests != 0) {
+    std::cout << "(SS) Semihosting requests: " << s.semihost.requests
+	      << std::endl;
+  }
+  if (s.uart_tx_bytes != 0) {
+    std::cout << "(SS) UART TX bytes: " << s.uart_tx_bytes << std::endl;
+  }
+  std::cout << "(SS) MIPS: " << std::fixed << std::setprecision(2)
+	    << r.mips() << std::endl;
+}
+
+// The words from the signature base up to 0xDEADDEAD, see cpu_run
+static void dump_signature(const iss_t& s)
+{
+  for (uint32_t i = s.signature_base; i + 4 <= 4096; i += 4) {
+    uint32_t word;
+    std::memcpy(&word, &s.ram[i], 4);
+    if (word == 0xDEADDEAD) break;
+    std::cout << "(DD) " << std::hex << std::setfill('0') << std::setw(8)
+	      << word << std::dec << std::endl;
+  }
+}
+
+static void report_stop(const iss_t& s)
+{
+  if (s.test_halt) std::cout << "End of the test." << std::endl;
+  if (s.semihost.exited) {
+    std::cout << "Exit with code " << s.semihost.exit_code << std::endl;
+  }
+  if (s.deadlock) {
+    std::cout << "WFI with no interrupt to wait for at PC=0x" << std::hex << s.pc
+	      << std::dec << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::string> args;
+  bool interp = false;
+  bool bench = false;
+  std::string uart_out;
+  for (int i=1; i<argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "+interp") interp = true;
+    else if (arg == "+bench") bench = true;
+    else if (arg.rfind("+uart_out=", 0) == 0) uart_out = arg.substr(10);
+    else if (arg[0] != '+') args.push_back(arg);
+  }
+  if (args.size() != 1 && args.size() != 2) {
+    std::cerr << "Usage: iss_run <program> [max instructions] [+interp] "
+	      << "[+bench] [+uart_out=<file>|-]" << std::endl;
+    return 1;
+  }
+  std::string program = args[0] + ".bin";
+  uint64_t max_instructions = (args.size() == 2) ? std::stoull(args[1]) : 4096;
+
+  FILE* uart_file = nullptr;
+  if (uart_out == "-") uart_file = stdout;
+  else if (!uart_out.empty()) {
+    uart_file = std::fopen(uart_out.c_str(), "wb");
+    if (!uart_file) {
+      std::cerr << "UART open failed!" << std::endl;
+      return 1;
+    }
+  }
+
+  // Interpreted first, for +bench
+  std::unique_ptr<iss_t> ref;
+  run_result_t ref_result = {0, 0};
+  if (bench) {
+    ref.reset(new iss_t);
+    ref->quiet = true;
+    if (!ref->load_program(program)) {
+      std::cerr << "Program load failed!" << std::endl;
+      return 1;
+    }
+    ref_result = run(*ref, max_instructions, true, nullptr);
+    std::cout << std::flush;
+  }
+
+  std::unique_ptr<iss_t> s(new iss_t);
+  s->uart_out = uart_file;
+  if (!s->load_program(program)) {
+    std::cerr << "Program load failed!" << std::endl;
+    return 1;
+  }
+  std::unique_ptr<dbt_t> dbt;
+  if (!interp || bench) dbt.reset(new dbt_t(*s));
+  run_result_t r = run(*s, max_instructions, interp && !bench, dbt.get());
+  std::fflush(stdout);
+  report_stop(*s);
+  if (s->signature_base != 0) dump_signature(*s);
+  report_statistics(*s, r, dbt.get());
+
+  int exit_code = s->semihost.exit_code;
+  if (bench) {
+    std::cout << "(SS) Interpreter MIPS: " << std::fixed
+	      << std::setprecision(2) << ref_result.mips() << std::endl;
+    std::cout << "(SS) Translated MIPS: " << r.mips() << std::endl;
+    std::cout << "(SS) Speedup: " << r.mips() / ref_result.mips() << "x"
+	      << std::endl;
+    // Interrupts are taken at block boundaries when translated, so only
+    // runs without them must match
+    if (ref->interrupts == 0 && s->interrupts == 0) {
+      bool same = ref->pc == s->pc && ref->instret == s->instret
+	&& std::memcmp(ref->x, s->x, 32 * sizeof(uint32_t)) == 0
+	&& std::memcmp(ref->ram, s->ram, iss_t::RAM_BYTES) == 0;
+      std::cout << "(SS) Translated and interpreted state "
+		<< (same ? "match" : "MISMATCH") << std::endl;
+      if (!same) exit_code = 1;
+    }
+  }
+  if (uart_file && uart_file != stdout) std::fclose(uart_file);
+  return exit_code;
+}
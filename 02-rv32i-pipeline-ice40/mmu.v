@@ -1,38 +1,79 @@
 /*
- MMU with a bank of main memory and an IO port. The MMU is byte-addressable.
- Access latency is one clock.
+ MMU with a bank of main memory and an IO bus master. The MMU is
+ byte-addressable. Access latency is one clock.
 
  Memory Mapping:
 
  - 0x00000000 - 0x00000FFF ROM instruction memory
+ - 0x01000000 - 0x01FFFFFF SPI flash, execute in place (ENABLE_XIP)
  - 0x10000000 - 0x7FFFFFFF Main memory
  - 0x80000000 - 0x800000FF I/O ports
 
  Exceptions are not generated from MMU
 
+ Misaligned access: when the core sets dm_be_hi, the access crosses a
+ word boundary. The first word is accessed with dm_be while dm_stall is
+ asserted, and the next word with dm_be_hi in the following clock. Load
+ data of both words are merged on dm_do one clock later, as usual
+
+ XIP: with ENABLE_XIP, instructions are also fetched from SPI flash
+ through the cache in xip.v. im_valid is low while the fetched word is
+ not in the cache yet, and the core fetches the same address again.
+ im_do is a NOP then. The data port cannot read the flash
+
+ Second hart: im_addr_1/im_do_1 fetch from the same ROM. Its data
+ accesses come through the arbiter in front of the MMU
+
+ DMA: the DMA controller is granted the data port in clocks the core
+ does not access memory. Its word access goes through the same mapping,
+ and read data is on dm_do one clock later
+
+ IO bus: an IO access is registered into a beat on the IO bus, see
+ io_bus.v. A write is posted, and only stalls while the beat before it
+ is still on the bus. A read stalls until its beat is acknowledged,
+ then completes like a memory read, so it takes at least one clock
+ more. Read data not taken in the clock of the acknowledge is kept
+ for the same access, e.g. by the DMA after the core took the port, or
+ by the core after a fetch stall. The kept word is dropped when its
+ master presents another access instead, as after a trap, or when a
+ write to the word is put on the bus. The DMA is granted an IO access
+ the same way
+
  Memory Bank Configuration: 4 interleaving banks of 8-bit wide SSP-BRAM
 
  Limitations: 
  - Data memory port cannot access instruction memory
  - Instruction memory port can only access instruction memory
- - Instruction memory is ROM
+ - Instruction memory is ROM, or flash for hart 0
 
  */
 
+`include "core/config.vh"
+
 module mmu(
            clk, resetb, dm_we,
-           im_addr, im_do, dm_addr, dm_di, dm_do,
+           im_addr, im_do, im_valid, dm_addr, dm_di, dm_do,
            dm_be, is_signed,
+           // Fetch of the second hart
+           im_addr_1, im_do_1,
+           // Misaligned access
+           dm_be_hi, dm_stall,
+           // DMA master
+           dma_req, dma_addr, dma_we, dma_di, dma_gnt,
            // To Instruction Memory
            // im_addr_out, im_data,
            // im_addr_out_2, im_data_2,
-           // TO IO
-           io_addr, io_en, io_we, io_data_read, io_data_write
+           // IO bus master
+           wb_stb, wb_we, wb_adr, wb_sel, wb_dat_w, wb_dat_r, wb_ack,
+           // SPI flash
+           flash_csb, flash_clk, flash_io_oe, flash_io_do, flash_io_di
            );
    
    parameter 
      WORD_DEPTH = 65536,
-     WORD_DEPTH_LOG = 16;
+     WORD_DEPTH_LOG = 16,
+     // Fetch from SPI flash at 0x01000000
+     ENABLE_XIP = `ENABLE_XIP;
 
    localparam
      DEV_IM = 1,
@@ -45,26 +86,50 @@ module mmu(
    // IM address, DM address, DM data in
    /* verilator lint_off UNUSED */
    input wire [31:0] im_addr, dm_addr, dm_di;
+   // IM address of the second hart
+   input wire [31:0] im_addr_1;
    /* verilator lint_on UNUSED */
    // DM data byte enable, non-encoded
    input wire [3:0]  dm_be;
    // DM sign extend or unsigned extend
    input wire 	     is_signed;
+   // DM byte enable of the next word, for a misaligned access
+   input wire [2:0]  dm_be_hi;
+   // Core holds the access while the first word is accessed
+   output wire 	     dm_stall;
+   // DMA word access request, granted when the core is idle
+   input wire 	     dma_req, dma_we;
+   input wire [31:0] dma_addr, dma_di;
+   output wire 	     dma_gnt;
    // IM addr out to ROM
    // wire [13:2] im_addr_out, im_addr_out_2;
-   // IM data from ROM, IO data from IO bank
+   // IM data from ROM
    //input wire [31:0]  im_data, im_data_2;
-   input wire [31:0] io_data_read;
-   // IO data to IO bank, DM data output
-   output reg [31:0]  io_data_write, dm_do;
+   // DM data output
+   output reg [31:0]  dm_do;
    // A temporary register for dm_do
    reg [31:0] 	      dm_do_tmp;
-   // IM data output
+   // IM data output, and if it is valid
    output wire [31:0]  im_do;
-   // IO address to IO bank
-   output reg [7:0]   io_addr;
-   // IO enable, IO write enable
-   output reg 	      io_en, io_we;
+   output wire 	       im_valid;
+   // IM data output of the second hart
+   output wire [31:0]  im_do_1;
+   // IO bus beat: strobe, write enable, word address, byte select,
+   // write data
+   output reg 	      wb_stb, wb_we;
+   output reg [7:2]   wb_adr;
+   output reg [3:0]   wb_sel;
+   output reg [31:0]  wb_dat_w;
+   // IO bus read data, acknowledge of the beat on the bus
+   input wire [31:0]  wb_dat_r;
+   input wire 	      wb_ack;
+   // SPI flash
+   output wire 	      flash_csb, flash_clk;
+   output wire [3:0]  flash_io_oe, flash_io_do;
+   input wire [3:0]   flash_io_di;
+   // ROM and XIP fetch data, the fetch of the last clock is from XIP
+   wire [31:0] 	      rom_do, xip_do;
+   wire 	      xip_sel, xip_p, xip_hit;
    // Shift bytes and half words to correct bank
    reg [31:0] 	      dm_di_shift;
    // Address mapped to BRAM address
@@ -87,12 +152,77 @@ module mmu(
    reg 			    is_signed_p;
    // IM port 2 pipelined
    reg [31:0] 		    im_data_2_p;
-   // IO Read input, IO read input pipelined, IO write output
-   reg [31:0] 		    io_data_write_tmp;
-   // IO address
-   reg [7:0] 		    io_addr_tmp;
-   // IO enable, IO write enable
-   reg 			    io_en_tmp, io_we_tmp;
+   // The access of this clock is on the IO bus, and is a read
+   wire 		    io_acc, io_read;
+   // IO beat of the DMA on the bus
+   reg 			    wb_dma;
+   // The master of the read on the bus has not moved on to another
+   // access
+   reg 			    wb_own;
+   // IO read data kept for its access: valid, data, address, DMA
+   reg 			    rd_valid;
+   reg [31:0] 		    rd_data;
+   reg [7:2] 		    rd_adr;
+   reg 			    rd_dma;
+   // The IO read completes with data from the bus, or kept
+   wire 		    rd_hit_bus, rd_hit_kept;
+   // The core presents an access in this clock
+   wire 		    core_acc;
+   // The master of the read on the bus, or of the kept data, presents
+   // another access in this clock
+   wire 		    wb_moved, rd_moved;
+   // A write to the word of the kept data is put on the bus
+   wire 		    rd_written;
+   // The IO bus takes a new beat, the IO access waits
+   wire 		    wb_free, io_wait;
+   // IO read data, pipelined
+   reg [31:0] 		    io_data_p;
+   // DMA access selected in this clock, granted unless IO waits
+   wire 		    dma_sel;
+   // The next word of a misaligned access is accessed in this clock
+   reg 			    split_phase;
+   // The first word of a misaligned access waits for the next clock
+   wire 		    split_wait;
+   // Data of the first word is on dm_do_tmp
+   reg 			    split_lo;
+   // Address and byte enable of the word accessed in this clock
+   wire [31:0] 		    dm_addr_eff;
+   wire [3:0] 		    dm_be_eff;
+   wire 		    dm_we_eff;
+   // Misaligned access, pipelined: merge the words, byte offset,
+   // word or halfword, data of the first word
+   reg 			    split_p;
+   reg [1:0] 		    dm_offset_p;
+   reg 			    split_word_p;
+   reg [31:0] 		    dm_lo_p;
+
+   assign split_wait = (dm_be_hi != 3'b0) & ~split_phase;
+   assign dm_stall = split_wait | (io_wait & ~dma_sel);
+   assign dma_sel = dma_req & (dm_be == 4'b0) & ~split_phase;
+   assign dma_gnt = dma_sel & ~io_wait;
+   assign dm_addr_eff = dma_sel ? dma_addr
+			: split_phase ? {dm_addr[31:2] + 30'd1, 2'b00} : dm_addr;
+   assign dm_be_eff = dma_sel ? 4'b1111
+		      : split_phase ? {1'b0, dm_be_hi} : dm_be;
+   assign dm_we_eff = dma_sel ? dma_we : dm_we;
+
+   // IO bus master
+   assign io_acc = (dm_addr_eff[31:8] == 24'h800000) & (dm_be_eff != 4'b0);
+   assign io_read = io_acc & ~dm_we_eff;
+   assign wb_free = ~wb_stb | wb_ack;
+   assign rd_hit_bus = io_read & wb_ack & ~wb_we & (wb_adr == dm_addr_eff[7:2])
+		       & (wb_dma == dma_sel);
+   assign rd_hit_kept = io_read & rd_valid & (rd_adr == dm_addr_eff[7:2])
+			& (rd_dma == dma_sel);
+   assign io_wait = io_acc & (dm_we_eff ? ~wb_free
+			      : ~(rd_hit_bus | rd_hit_kept));
+   assign core_acc = ~dma_sel & (dm_be_eff != 4'b0);
+   assign wb_moved = (wb_dma ? dma_sel : core_acc)
+		     & ~(io_read & (wb_adr == dm_addr_eff[7:2]));
+   assign rd_moved = (rd_dma ? dma_sel : core_acc)
+		     & ~(io_read & (rd_adr == dm_addr_eff[7:2]));
+   assign rd_written = wb_free & io_acc & dm_we_eff
+		       & (rd_adr == dm_addr_eff[7:2]);
 
    // In this implementaion, the IM ROM address is simply the 13:2 bits of IM address input
    //assign im_addr_out[13:2] = im_addr[13:2];
@@ -102,22 +232,38 @@ module mmu(
    // BRAM bank in interleaved configuration
    SPRAM_16Kx16 ram0 (
                        .clk(clk), .wren(ram_we), 
-		       .maskwren({{2{dm_be[1]}},{2{dm_be[0]}}}), 
+		       .maskwren({{2{dm_be_eff[1]}},{2{dm_be_eff[0]}}}), 
                        .addr(ram_addr[WORD_DEPTH_LOG-1:2]),
                        .din(ram_di[0+:16]), .dout(ram_do[0+:16])
                        );
    SPRAM_16Kx16 ram1 (
                        .clk(clk), .wren(ram_we), 
-		       .maskwren({{2{dm_be[3]}},{2{dm_be[2]}}}), 
+		       .maskwren({{2{dm_be_eff[3]}},{2{dm_be_eff[2]}}}), 
                        .addr(ram_addr[WORD_DEPTH_LOG-1:2]),
                        .din(ram_di[16+:16]), .dout(ram_do[16+:16])
                        );
 
    EBRAM_ROM rom0(
-     .clk(clk), .addra(im_addr[10:2]), .douta(im_do),
-     .addrb(dm_addr[10:2]), .doutb(im_data_2_p)
+     .clk(clk), .addra(im_addr[10:2]), .douta(rom_do),
+     .addrb(dm_addr_eff[10:2]), .doutb(im_data_2_p),
+     .addrc(im_addr_1[10:2]), .doutc(im_do_1)
    );
 
+   xip XIP0(
+     .clk(clk), .resetb(resetb),
+     .fetch_sel(xip_sel), .fetch_addr(im_addr[23:2]),
+     .fetch_p(xip_p), .fetch_data(xip_do), .fetch_hit(xip_hit),
+     .flash_csb(flash_csb), .flash_clk(flash_clk),
+     .flash_io_oe(flash_io_oe), .flash_io_do(flash_io_do),
+     .flash_io_di(flash_io_di)
+   );
+
+   assign xip_sel = (ENABLE_XIP != 0) & (im_addr[31:24] == 8'h01);
+   assign im_valid = ~xip_p | xip_hit;
+   assign im_do = ~xip_p ? rom_do
+		  : xip_hit ? xip_do
+		  : 32'h00000013;
+
    // The MMU pipeline
    always @ (posedge clk) begin : MMU_PIPELINE
       if (!resetb) begin
@@ -126,59 +272,93 @@ module mmu(
 	 dm_be_p <= 4'b0;
 	 // First instruction is initialized as NOP
 	 //im_do <= 32'b0000_0000_0000_00000_000_00000_0010011;
-	 io_data_write <= 32'bX;
 	 //im_data_2_p <= 32'bX;
-	 io_en <= 1'b0;
-	 io_we <= 1'b0;
-	 io_addr <= 8'bX;
+	 wb_stb <= 1'b0;
+	 wb_we <= 1'b0;
+	 wb_adr <= 6'b0;
+	 wb_sel <= 4'b0;
+	 wb_dat_w <= 32'b0;
+	 wb_dma <= 1'b0;
+	 wb_own <= 1'b0;
+	 rd_valid <= 1'b0;
+	 rd_data <= 32'bX;
+	 rd_adr <= 6'b0;
+	 rd_dma <= 1'b0;
+	 io_data_p <= 32'bX;
+	 split_phase <= 1'b0;
+	 split_lo <= 1'b0;
+	 split_p <= 1'b0;
+	 dm_offset_p <= 2'b0;
+	 split_word_p <= 1'b0;
+	 dm_lo_p <= 32'bX;
       end
       else if (clk) begin
 	 // Notice the pipeline. The naming is a bit inconsistent
-	 dm_be_p <= dm_be;
+	 dm_be_p <= dma_gnt ? 4'b1111 : dm_be;
 	 chosen_device_p <= chosen_device_tmp[2:0];
 	 is_signed_p <= is_signed;
 	 //im_do <= im_data;
 	 //im_data_2_p <= im_data_2;
-	 io_data_write <= io_data_write_tmp;
-	 io_en <= io_en_tmp;
-	 io_we <= io_we_tmp;
-	 io_addr <= io_addr_tmp;
+	 // Put the next beat on the IO bus. A read already on the bus, or
+	 // with its data kept, is not issued again
+	 if (wb_free) begin
+	    wb_stb <= io_acc & (dm_we_eff | ~(rd_hit_bus | rd_hit_kept));
+	    wb_we <= dm_we_eff;
+	    wb_adr <= dm_addr_eff[7:2];
+	    wb_sel <= dm_be_eff;
+	    wb_dat_w <= dm_di_shift;
+	    wb_dma <= dma_sel;
+	    wb_own <= 1'b1;
+	 end
+	 else if (wb_moved) begin
+	    wb_own <= 1'b0;
+	 end
+	 // Keep read data the access does not take in this clock, unless
+	 // its master has moved on, e.g. a trap killed the load
+	 if (wb_ack & ~wb_we & ~rd_hit_bus & wb_own & ~wb_moved) begin
+	    rd_valid <= 1'b1;
+	    rd_data <= wb_dat_r;
+	    rd_adr <= wb_adr;
+	    rd_dma <= wb_dma;
+	 end
+	 else if (rd_hit_kept | rd_moved | rd_written) begin
+	    rd_valid <= 1'b0;
+	 end
+	 io_data_p <= rd_hit_bus ? wb_dat_r : rd_data;
+	 // Misaligned access. Either word may wait on the IO bus
+	 split_phase <= split_phase ? io_wait : split_wait & ~io_wait;
+	 split_lo <= split_wait & ~io_wait;
+	 split_p <= split_phase & ~io_wait;
+	 dm_offset_p <= dm_addr[1:0];
+	 split_word_p <= (dm_be | {1'b0, dm_be_hi}) == 4'b1111;
+	 if (split_lo) dm_lo_p <= dm_do_tmp;
       end
    end
 
    /* verilator lint_off UNUSED */
-   reg [31:0] 		    ram_addr_temp, io_addr_temp;
+   reg [31:0] 		    ram_addr_temp;
    /* verilator lint_on UNUSED */
    // Device mapping from address
    // Note: X-Optimism might be a problem. Convert to Tertiary to fix
    always @ (*) begin : DM_ADDR_MAP
-      ram_addr_temp = dm_addr - 32'h10000000;
-      io_addr_temp = dm_addr - 32'h80000000;
-      io_addr_tmp = io_addr_temp[7:0];;
-      io_en_tmp = 1'b0;
-      io_we_tmp = 1'b0;
-      io_data_write_tmp = 32'bX;
+      ram_addr_temp = dm_addr_eff - 32'h10000000;
       ram_we = 1'b0;
       ram_addr = {(WORD_DEPTH_LOG-2){1'bX}};
       ram_di = 32'bX;
       chosen_device_tmp = DEV_UNKN;
-      if (dm_addr[31:12] == 20'b0) begin
+      if (dm_addr_eff[31:12] == 20'b0) begin
 	 // 0x00000000 - 0x00000FFF
 	 chosen_device_tmp = DEV_IM;
       end
-      else if (dm_addr[31] == 1'b0 && dm_addr[30:28] != 3'b0) begin
+      else if (dm_addr_eff[31] == 1'b0 && dm_addr_eff[30:28] != 3'b0) begin
 	 // 0x10000000 - 0x7FFFFFFF
 	 ram_addr = ram_addr_temp[2+:WORD_DEPTH_LOG-2];
 	 ram_di = dm_di_shift;
-	 ram_we = dm_we;
+	 ram_we = dm_we_eff;
 	 chosen_device_tmp = DEV_DM;
       end
-      else if (dm_addr[31:8] == 24'h800000) begin
-	 // 0x80000000 - 0x800000FF
-	 // io_addr_tmp = io_addr_temp[7:0];
-	 io_en_tmp = 1'b1;
-	 io_we_tmp = dm_we;
-	 io_data_write_tmp = dm_di_shift;
+      else if (dm_addr_eff[31:8] == 24'h800000) begin
+	 // 0x80000000 - 0x800000FF, see the IO bus master
 	 chosen_device_tmp = DEV_IO;
       end
    end // block: DM_ADDR_MAP
@@ -188,9 +368,27 @@ module mmu(
    always @ (*) begin : DM_IN_SHIFT
       dm_di_shift = 32'bX;
       // Byte enable
-      if (dm_be == 4'b1111) begin
+      if (dma_sel) begin
+	 dm_di_shift = dma_di;
+      end
+      else if (split_phase) begin
+	 // Bytes past the word boundary of a misaligned access
+	 case (dm_addr[1:0])
+	   2'b01: dm_di_shift[0+:8] = dm_di[24+:8];
+	   2'b10: dm_di_shift[0+:16] = dm_di[16+:16];
+	   2'b11: dm_di_shift[0+:24] = dm_di[8+:24];
+	   default: dm_di_shift = 32'bX;
+	 endcase // case (dm_addr[1:0])
+      end
+      else if (dm_be == 4'b1111) begin
    	 dm_di_shift = dm_di;
       end
+      else if (dm_be == 4'b1110) begin
+   	 dm_di_shift[8+:24] = dm_di[0+:24];
+      end
+      else if (dm_be == 4'b0110) begin
+   	 dm_di_shift[8+:16] = dm_di[0+:16];
+      end
       else if (dm_be == 4'b1100) begin
    	 dm_di_shift[16+:16] = dm_di[0+:16];
       end
@@ -211,6 +409,10 @@ module mmu(
       end
    end // block: DM_IN_SHIFT
    
+   /* verilator lint_off UNUSED */
+   reg [63:0] 		    dm_split;
+   /* verilator lint_on UNUSED */
+
    // Shifting byte/halfword to correct output position
    // Note: X-Optimism might be a problem. Convert to Tertiary to fix
    always @ (*) begin : DM_OUT_SHIFT
@@ -220,7 +422,7 @@ module mmu(
    	DEV_DM:
    	  dm_do_tmp = ram_do;
    	DEV_IO:
-   	  dm_do_tmp = io_data_read;
+   	  dm_do_tmp = io_data_p;
    	default:
    	  dm_do_tmp = 32'bX;
       endcase // case (chosen_device_reg)
@@ -241,6 +443,12 @@ module mmu(
    	 else
    	   dm_do = {16'b0, dm_do_tmp[0+:16]};
       end
+      else if (dm_be_p == 4'b0110) begin
+   	 if (is_signed_p)
+   	   dm_do = {{16{dm_do_tmp[23]}}, dm_do_tmp[8+:16]};
+   	 else
+   	   dm_do = {16'b0, dm_do_tmp[8+:16]};
+      end
       else if (dm_be_p == 4'b0001) begin
    	 if (is_signed_p)
    	   dm_do = {{24{dm_do_tmp[7]}}, dm_do_tmp[0+:8]};
@@ -265,6 +473,16 @@ module mmu(
    	 else
    	   dm_do = {24'b0, dm_do_tmp[24+:8]};
       end
+      // Misaligned access across words, the first word is in dm_lo_p
+      dm_split = {dm_do_tmp, dm_lo_p} >> {dm_offset_p, 3'b0};
+      if (split_p) begin
+	 if (split_word_p)
+	   dm_do = dm_split[0+:32];
+	 else if (is_signed_p)
+	   dm_do = {{16{dm_split[15]}}, dm_split[0+:16]};
+	 else
+	   dm_do = {16'b0, dm_split[0+:16]};
+      end
    end
    
 endmodule // mmu
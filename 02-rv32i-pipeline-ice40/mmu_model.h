@@ -0,0 +1,114 @@
+#ifndef __MMU_MODEL_H__
+#define __MMU_MODEL_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// One data port access of the MMU, as the core or the DMA drives it.
+// size is 1, 2 or 4 bytes at any offset, an access crossing a word
+// boundary is split with dm_be_hi. A DMA access is an aligned word
+struct mmu_access_t
+{
+  uint32_t addr;
+  uint32_t data;
+  uint8_t size;
+  bool we;
+  bool is_signed;
+  bool dma;
+  // Idle clocks ahead of the access
+  uint8_t gap;
+  // A load dropped after this many clocks, like one a trap kills
+  uint8_t kill;
+
+  // Byte enables of the first and the next word
+  uint32_t be() const { return (mask() << (addr & 3)) & 0xF; }
+  uint32_t be_hi() const { return (mask() << (addr & 3)) >> 4; }
+  bool split() const { return be_hi() != 0; }
+
+  std::string str() const
+  {
+    static const char size_name[] = "?bh?w";
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%s%s%c%s 0x%08x",
+		  dma ? "dma." : "", we ? "s" : "l", size_name[size & 7],
+		  (!we && !is_signed && size != 4) ? "u" : "", addr);
+    std::string s = buf;
+    if (we) {
+      std::snprintf(buf, sizeof(buf), " 0x%08x", data);
+      s += buf;
+    }
+    if (gap) s += " gap=" + std::to_string(gap);
+    if (kill) s += " kill=" + std::to_string(kill);
+    return s;
+  }
+
+private:
+  uint32_t mask() const { return (1u << size) - 1; }
+};
+
+// Reference of the memory behind the MMU data port, byte by byte: ROM
+// read only, main memory wrapping at 64 KiB, and 64 words of IO, which
+// the testbench answers on the IO bus like plain memory
+class mmu_model_t
+{
+public:
+  static const uint32_t ROM_WORDS = 512;
+  static const uint32_t RAM_WORDS = 16384;
+  static const uint32_t IO_WORDS = 64;
+
+  uint32_t rom[ROM_WORDS];
+  uint32_t ram[RAM_WORDS];
+  uint32_t io[IO_WORDS];
+
+  static bool is_rom(uint32_t addr) { return (addr >> 12) == 0; }
+  static bool is_ram(uint32_t addr)
+  {
+    return (addr >> 31) == 0 && ((addr >> 28) & 7) != 0;
+  }
+  static bool is_io(uint32_t addr) { return (addr >> 8) == 0x800000; }
+
+  // Word of the device addr maps to, null if unmapped
+  uint32_t* word(uint32_t addr)
+  {
+    if (is_rom(addr)) return &rom[(addr >> 2) % ROM_WORDS];
+    if (is_ram(addr)) return &ram[((addr - 0x10000000) >> 2) % RAM_WORDS];
+    if (is_io(addr)) return &io[(addr >> 2) % IO_WORDS];
+    return nullptr;
+  }
+
+  // The loaded value as on dm_do, sign or zero extended
+  uint32_t load(const mmu_access_t& a)
+  {
+    uint32_t value = 0;
+    for (unsigned i=0; i<a.size; ++i) {
+      value |= static_cast<uint32_t>(byte(a.addr + i)) << (8 * i);
+    }
+    if (a.size < 4) {
+      uint32_t sign = 1u << (8 * a.size - 1);
+      if (a.is_signed && (value & sign)) value |= ~((sign << 1) - 1);
+    }
+    return value;
+  }
+
+  // The data port cannot write the ROM
+  void store(const mmu_access_t& a)
+  {
+    for (unsigned i=0; i<a.size; ++i) {
+      uint32_t addr = a.addr + i;
+      uint32_t* w = word(addr);
+      if (w == nullptr || is_rom(addr)) continue;
+      unsigned shift = 8 * (addr & 3);
+      *w = (*w & ~(0xFFu << shift)) | (((a.data >> (8 * i)) & 0xFF) << shift);
+    }
+  }
+
+private:
+  uint8_t byte(uint32_t addr)
+  {
+    uint32_t* w = word(addr);
+    return w ? (*w >> (8 * (addr & 3))) & 0xFF : 0;
+  }
+};
+
+#endif // __MMU_MODEL_H__
@@ -0,0 +1,470 @@
+// Randomized stress test of the MMU data port against mmu_model.h
+//
+// Loads and stores of bytes, halfwords and words, signed and unsigned,
+// aligned or split across words, and DMA words, to the ROM, main memory
+// and IO ranges. Every load is checked on dm_do, and every clock the
+// fetch ports are checked against the ROM. The IO bus is answered by a
+// slave with random wait states. Some loads are dropped before they
+// end, as by a trap, and must not leave data behind for later ones. The model is clocked directly, without
+// SystemC, to run millions of accesses per second.
+//
+// mmu_tb [+seed=<n>] [+count=<n>] [+io_wait=<n>] [+repro=<file>]
+//        [+replay=<file>]
+//
+// On a mismatch the accesses up to it are reduced to a short list that
+// still fails, which is printed and written to the +repro file. +replay
+// runs such a list with the same seed.
+
+#include <verilated.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Vmmu.h"
+#include "Vmmu_mmu.h"
+#include "Vmmu_EBRAM_ROM.h"
+#include "Vmmu_SPRAM_16Kx16.h"
+#include "mmu_model.h"
+
+// xorshift64*, cheap next to a clock of the model
+struct rng_t
+{
+  uint64_t s;
+
+  explicit rng_t(uint64_t seed) : s(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+  uint32_t next()
+  {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return (s * 0x2545F4914F6CDD1Dull) >> 32;
+  }
+
+  // 0 .. n-1
+  uint32_t below(uint32_t n)
+  {
+    return (static_cast<uint64_t>(next()) * n) >> 32;
+  }
+};
+
+// The access stream of a seed. Most accesses go to a small window of
+// each range, so loads often read what was just stored
+class mmu_access_gen_t
+{
+public:
+  explicit mmu_access_gen_t(uint64_t seed) : rng(seed ^ 0xACCE55) {}
+
+  mmu_access_t next()
+  {
+    mmu_access_t a = {};
+    static const uint8_t sizes[] = {1, 2, 4};
+    a.size = sizes[rng.below(3)];
+    uint32_t r = rng.below(100);
+    a.dma = r < 10;
+    if (a.dma) a.size = 4;
+    a.we = rng.below(2);
+    a.is_signed = !a.we && a.size < 4 && rng.below(2);
+    a.data = rng.next();
+    a.gap = rng.below(8) == 0 ? 1 + rng.below(3) : 0;
+    a.kill = !a.dma && !a.we && rng.below(16) == 0 ? 1 + rng.below(2) : 0;
+    // Misaligned for one in four halfwords and words
+    uint32_t offset = 0;
+    if (a.size == 1) offset = rng.below(4);
+    else if (!a.dma && rng.below(4) == 0) offset = 1 + rng.below(3);
+    else if (a.size == 2) offset = 2 * rng.below(2);
+
+    uint32_t region = rng.below(100);
+    uint32_t base, words;
+    if (region < 15 && !a.dma) {
+      // ROM, mostly loads, 0x800 and up alias the first half
+      base = 0x00000000;
+      words = 1024;
+      if (rng.below(8) != 0) a.we = false;
+      a.is_signed = !a.we && a.size < 4 && rng.below(2);
+    }
+    else if (region < 40) {
+      base = 0x80000000;
+      words = mmu_model_t::IO_WORDS;
+    }
+    else {
+      // Either end of main memory, and an alias of its start
+      static const uint32_t ram_bases[] = {
+	0x10000000, 0x10000000, 0x10010000, 0x7FFF0000
+      };
+      base = ram_bases[rng.below(4)];
+      words = rng.below(2) ? 64 : mmu_model_t::RAM_WORDS;
+    }
+    uint32_t word = rng.below(words);
+    a.addr = base + 4 * word + offset;
+    // The next word of a split access is in the same range
+    if (a.split() && word == words - 1) a.addr -= 4;
+    return a;
+  }
+
+private:
+  rng_t rng;
+};
+
+// Vmmu with the memories of a seed, and the IO bus slave
+class mmu_stress_t
+{
+public:
+  std::string error;
+  uint64_t clocks = 0;
+
+  mmu_stress_t(uint64_t seed, unsigned io_wait)
+    : fetch_rng(seed ^ 0xF37C4), slave_rng(seed ^ 0x510E), io_wait(io_wait)
+  {
+    rng_t init(seed);
+    for (auto& w : model.rom) w = init.next();
+    for (auto& w : model.ram) w = init.next();
+    for (auto& w : model.io) w = init.next();
+    for (unsigned i=0; i<mmu_model_t::IO_WORDS; ++i) slave_io[i] = model.io[i];
+
+    dut = new Vmmu;
+    for (unsigned i=0; i<mmu_model_t::ROM_WORDS; ++i) {
+      dut->mmu->rom0->ROM[i] = model.rom[i];
+    }
+    for (unsigned i=0; i<mmu_model_t::RAM_WORDS; ++i) {
+      dut->mmu->ram0->RAM[i] = model.ram[i] & 0xFFFF;
+      dut->mmu->ram1->RAM[i] = model.ram[i] >> 16;
+    }
+    dut->flash_io_di = 0;
+    dut->dma_req = 0;
+    idle();
+    dut->resetb = 0;
+    tick();
+    tick();
+    dut->resetb = 1;
+    tick();
+  }
+
+  ~mmu_stress_t()
+  {
+    dut->final();
+    delete dut;
+  }
+
+  // Runs one access to its end. false on a mismatch, see error
+  bool run(const mmu_access_t& a)
+  {
+    for (unsigned i=0; i<a.gap; ++i) {
+      if (!tick()) return false;
+    }
+    if (a.dma) {
+      dut->dma_req = 1;
+      dut->dma_addr = a.addr;
+      dut->dma_we = a.we;
+      dut->dma_di = a.data;
+    }
+    else {
+      dut->dm_addr = a.addr;
+      dut->dm_be = a.be();
+      dut->dm_be_hi = a.be_hi();
+      dut->dm_we = a.we;
+      dut->dm_di = a.data;
+      dut->is_signed = a.is_signed;
+    }
+    // Done in the clock the core is not stalled, or the DMA granted
+    bool done = false;
+    for (int n=0; !done; ++n) {
+      if (n == 64) {
+	error = "no end after 64 clocks";
+	return false;
+      }
+      if (a.kill && n == a.kill) break;
+      if (!tick(a.dma ? &done : nullptr, a.dma ? nullptr : &done)) {
+	return false;
+      }
+    }
+    idle();
+    // What a killed load would have read is not checked
+    if (a.kill && !done) return true;
+    if (a.we) {
+      model.store(a);
+      return true;
+    }
+    uint32_t expected = model.load(a);
+    if (dut->dm_do != expected) {
+      std::ostringstream s;
+      s << std::hex << "dm_do 0x" << dut->dm_do << ", expected 0x" << expected;
+      error = s.str();
+      return false;
+    }
+    return true;
+  }
+
+private:
+  Vmmu* dut;
+  mmu_model_t model;
+  // What the IO bus slave holds, written by the beats on the bus
+  uint32_t slave_io[mmu_model_t::IO_WORDS];
+  rng_t fetch_rng, slave_rng;
+  unsigned io_wait;
+  // Wait states left of the beat on the bus
+  unsigned wait_left = 0;
+
+  void idle()
+  {
+    dut->dm_be = 0;
+    dut->dm_be_hi = 0;
+    dut->dm_we = 0;
+    dut->dma_req = 0;
+  }
+
+  // One clock. granted and unstalled tell if the DMA access, or the
+  // core access, ended at this edge. false on a fetch mismatch
+  bool tick(bool* granted = nullptr, bool* unstalled = nullptr)
+  {
+    uint32_t im_addr = 4 * fetch_rng.below(1024);
+    uint32_t im_addr_1 = 4 * fetch_rng.below(1024);
+    dut->im_addr = im_addr;
+    dut->im_addr_1 = im_addr_1;
+
+    bool ack = dut->wb_stb && wait_left == 0;
+    bool stb = dut->wb_stb;
+    bool we = dut->wb_we;
+    uint32_t adr = dut->wb_adr % mmu_model_t::IO_WORDS;
+    uint32_t sel = dut->wb_sel;
+    uint32_t dat_w = dut->wb_dat_w;
+    dut->wb_ack = ack;
+    dut->wb_dat_r = slave_io[adr];
+    dut->clk = 0;
+    dut->eval();
+    if (granted) *granted = dut->dma_gnt;
+    if (unstalled) *unstalled = !dut->dm_stall;
+
+    dut->clk = 1;
+    dut->eval();
+    ++clocks;
+    if (ack && we) {
+      for (int i=0; i<4; ++i) {
+	if (sel & (1 << i)) {
+	  uint32_t mask = 0xFFu << (8 * i);
+	  slave_io[adr] = (slave_io[adr] & ~mask) | (dat_w & mask);
+	}
+      }
+    }
+    if (dut->wb_stb) {
+      if (ack || !stb) wait_left = slave_rng.below(io_wait + 1);
+      else if (wait_left) --wait_left;
+    }
+
+    uint32_t rom_do = model.rom[(im_addr >> 2) % mmu_model_t::ROM_WORDS];
+    uint32_t rom_do_1 = model.rom[(im_addr_1 >> 2) % mmu_model_t::ROM_WORDS];
+    if (!dut->im_valid || dut->im_do != rom_do || dut->im_do_1 != rom_do_1) {
+      std::ostringstream s;
+      s << std::hex << "fetch of 0x" << im_addr << ", 0x" << im_addr_1
+	<< ": im_do 0x" << dut->im_do << ", im_do_1 0x" << dut->im_do_1
+	<< ", expected 0x" << rom_do << ", 0x" << rom_do_1;
+      error = s.str();
+      return false;
+    }
+    return true;
+  }
+};
+
+// Index of the access that fails, or -1
+static long first_failure(uint64_t seed, unsigned io_wait,
+			  const std::vector<mmu_access_t>& accesses,
+			  std::string* error = nullptr)
+{
+  mmu_stress_t tb(seed, io_wait);
+  for (size_t i=0; i<accesses.size(); ++i) {
+    if (!tb.run(accesses[i])) {
+      if (error) *error = tb.error;
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Drops accesses while the rest still fails: first everything but a
+// short tail, then halves, quarters, ... of what is left
+static std::vector<mmu_access_t> reduce(uint64_t seed, unsigned io_wait,
+					std::vector<mmu_access_t> accesses)
+{
+  int budget = 4000;
+  auto fails = [&](const std::vector<mmu_access_t>& v) {
+    --budget;
+    return first_failure(seed, io_wait, v) >= 0;
+  };
+  for (size_t n=1; n < accesses.size(); n *= 2) {
+    std::vector<mmu_access_t> tail(accesses.end() - n, accesses.end());
+    if (fails(tail)) {
+      accesses = tail;
+      break;
+    }
+  }
+  for (size_t chunk = accesses.size() / 2; chunk > 0 && budget > 0;
+       chunk /= 2) {
+    for (size_t i=0; i < accesses.size() && accesses.size() > 1
+	   && budget > 0;) {
+      std::vector<mmu_access_t> rest(accesses.begin(), accesses.begin() + i);
+      rest.insert(rest.end(),
+		  accesses.begin() + std::min(i + chunk, accesses.size()),
+		  accesses.end());
+      if (!rest.empty() && fails(rest)) accesses = rest;
+      else i += chunk;
+    }
+  }
+  return accesses;
+}
+
+// Reads a list as printed by mmu_access_t::str()
+static bool read_accesses(const std::string& path,
+			  std::vector<mmu_access_t>& accesses)
+{
+  std::ifstream f(path);
+  if (!f.is_open()) {
+    std::cerr << path << ": cannot open" << std::endl;
+    return false;
+  }
+  std::string line;
+  for (int n = 1; std::getline(f, line); ++n) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    std::string op, word;
+    if (!(fields >> op)) continue;
+    mmu_access_t a = {};
+    if (op.compare(0, 4, "dma.") == 0) {
+      a.dma = true;
+      op = op.substr(4);
+    }
+    bool ok = op.size() >= 2 && (op[0] == 'l' || op[0] == 's');
+    a.we = op[0] == 's';
+    if (ok) {
+      switch (op[1]) {
+      case 'b': a.size = 1; break;
+      case 'h': a.size = 2; break;
+      case 'w': a.size = 4; break;
+      default: ok = false;
+      }
+    }
+    ok = ok && (op.size() == 2 || (op == op.substr(0, 2) + "u" && !a.we));
+    a.is_signed = !a.we && a.size < 4 && op.size() == 2;
+    ok = ok && (fields >> word);
+    if (ok) a.addr = std::strtoul(word.c_str(), nullptr, 0);
+    if (ok && a.we) {
+      ok = static_cast<bool>(fields >> word);
+      a.data = std::strtoul(word.c_str(), nullptr, 0);
+    }
+    while (ok && fields >> word) {
+      if (word.compare(0, 4, "gap=") == 0) a.gap = std::atoi(word.c_str() + 4);
+      else if (word.compare(0, 5, "kill=") == 0 && !a.we)
+	a.kill = std::atoi(word.c_str() + 5);
+      else ok = false;
+    }
+    if (!ok) {
+      std::cerr << path << ":" << n << ": bad access" << std::endl;
+      return false;
+    }
+    accesses.push_back(a);
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  Verilated::commandArgs(argc, argv);
+
+  uint64_t seed = 1;
+  uint64_t count = 2000000;
+  unsigned io_wait = 3;
+  std::string repro, replay;
+  for (int i=1; i<argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 6, "+seed=") == 0) seed = std::strtoull(&argv[i][6], nullptr, 0);
+    else if (arg.compare(0, 7, "+count=") == 0) count = std::strtoull(&argv[i][7], nullptr, 0);
+    else if (arg.compare(0, 9, "+io_wait=") == 0) io_wait = std::atoi(&argv[i][9]);
+    else if (arg.compare(0, 7, "+repro=") == 0) repro = arg.substr(7);
+    else if (arg.compare(0, 8, "+replay=") == 0) replay = arg.substr(8);
+  }
+  std::cout << "(TT) MMU stress, +seed=" << seed << " +io_wait=" << io_wait
+	    << std::endl;
+
+  if (!replay.empty()) {
+    std::vector<mmu_access_t> accesses;
+    if (!read_accesses(replay, accesses)) return 1;
+    std::string error;
+    long failed = first_failure(seed, io_wait, accesses, &error);
+    if (failed < 0) {
+      std::cout << "(TT) Replay of " << accesses.size()
+		<< " accesses PASSED" << std::endl;
+      return 0;
+    }
+    std::cout << "(TT) Access " << failed << " " << accesses[failed].str()
+	      << ": " << error << std::endl
+	      << "(TT) Replay FAILED" << std::endl;
+    return 1;
+  }
+
+  // Loads and stores by range, and split and DMA accesses
+  uint64_t loads[3] = {}, stores[3] = {}, splits = 0, dmas = 0, kills = 0;
+  mmu_access_gen_t gen(seed);
+  mmu_stress_t tb(seed, io_wait);
+  auto start = std::chrono::steady_clock::now();
+  uint64_t n;
+  for (n=0; n<count; ++n) {
+    mmu_access_t a = gen.next();
+    if (!tb.run(a)) break;
+    int range = mmu_model_t::is_rom(a.addr) ? 0
+      : mmu_model_t::is_ram(a.addr) ? 1 : 2;
+    ++(a.we ? stores : loads)[range];
+    splits += a.split();
+    dmas += a.dma;
+    kills += a.kill != 0;
+  }
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+
+  std::printf("(TT) %llu accesses in %llu clocks, %.2f s, %.2f M accesses/s\n",
+	      (unsigned long long)n, (unsigned long long)tb.clocks, seconds,
+	      n / seconds / 1e6);
+  static const char* range_names[] = {"ROM", "RAM", "IO"};
+  for (int r=0; r<3; ++r) {
+    std::printf("(TT) %-3s %10llu loads %10llu stores\n", range_names[r],
+		(unsigned long long)loads[r], (unsigned long long)stores[r]);
+  }
+  std::printf("(TT) %llu split, %llu DMA, %llu killed\n",
+	      (unsigned long long)splits, (unsigned long long)dmas,
+	      (unsigned long long)kills);
+
+  if (n == count) {
+    std::cout << "(TT) MMU stress PASSED" << std::endl;
+    return 0;
+  }
+
+  // Rerun the stream up to the mismatch, then make it short
+  std::cout << "(TT) Access " << n << ": " << tb.error << std::endl;
+  mmu_access_gen_t regen(seed);
+  std::vector<mmu_access_t> accesses;
+  for (uint64_t i=0; i<=n; ++i) accesses.push_back(regen.next());
+  accesses = reduce(seed, io_wait, accesses);
+  std::string error;
+  long failed = first_failure(seed, io_wait, accesses, &error);
+  std::cout << "(TT) Reproducer, " << accesses.size()
+	    << " accesses, +seed=" << seed << " +io_wait=" << io_wait
+	    << ", fails with " << error << std::endl;
+  std::ofstream f;
+  if (!repro.empty()) f.open(repro);
+  size_t end = failed < 0 ? accesses.size() : failed + 1;
+  for (size_t i=0; i<end; ++i) {
+    std::cout << "(TT)   " << accesses[i].str() << std::endl;
+    if (f.is_open()) f << accesses[i].str() << std::endl;
+  }
+  if (f.is_open()) {
+    std::cout << "(TT) Written to " << repro << ", run it with +replay="
+	      << repro << std::endl;
+  }
+  std::cout << "(TT) MMU stress FAILED" << std::endl;
+  return 1;
+}
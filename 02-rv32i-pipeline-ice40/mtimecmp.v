@@ -0,0 +1,41 @@
+/*
+* mtimecmp of another hart on IO address space, compared with mtime of
+* the system timer
+* mtimecmp - 0x80000040, hart 1
+* Like the timer, irq_mtimecmp is pending while mtime >= mtimecmp, and a
+* write to mtimecmp clears it for one clock
+*/
+
+module mtimecmp(
+  input wire clk,
+  input wire resetb,
+  input wire io_addr_2,
+  input wire io_we,
+  input wire [31:0] io_din,
+  output wire [31:0] io_dout,
+  input wire [63:0] mtime,
+  output reg irq_mtimecmp
+  );
+
+  reg [63:0] mtimecmp /*verilator public*/;
+
+  always @ (posedge clk) begin : MTIMECMP_PIPELINE
+    if (!resetb) begin
+      mtimecmp <= 64'b0;
+      irq_mtimecmp <= 1'b0;
+    end
+    else if (clk) begin
+      irq_mtimecmp <= mtime >= mtimecmp;
+      if (io_we) begin
+        if (io_addr_2)
+          mtimecmp[32+:32] <= io_din;
+        else
+          mtimecmp[0+:32] <= io_din;
+        irq_mtimecmp <= 1'b0;
+      end
+    end
+  end
+
+  assign io_dout = io_addr_2 ? mtimecmp[32+:32] : mtimecmp[0+:32];
+
+endmodule
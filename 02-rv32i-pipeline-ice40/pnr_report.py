@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""Summarize a place and route run, and check it against a baseline
+
+Usage: pnr_report.py [--fmax-tol PCT] [--area-tol PCT] [--accept]
+                     pnr_report.json module_stat.json pnr_history.csv
+
+pnr_report.json is written by nextpnr-ice40 --report, module_stat.json
+by yosys stat -json of a design synthesized with -noflatten. Prints
+Fmax, the critical path, the device utilization and the cells of each
+module, then compares them with the baseline, the last run of the
+history marked as one. The run is appended to the history unless Fmax
+dropped or logic cells grew by more than the tolerances, or it uses
+more EBRs, SPRAMs or DSPs, in which case it exits with an error. Runs
+are not compared with each other, so small losses that add up fail
+once past the tolerance. --accept appends the run as the new baseline,
+for an expected regression or to keep a gain. The first run of a
+history is its baseline.
+"""
+
+import argparse
+import csv
+import datetime
+import json
+import os
+import subprocess
+import sys
+
+# nextpnr bel types, as columns of the history
+BELS = [
+    ('ICESTORM_LC', 'lc'),
+    ('ICESTORM_RAM', 'ebr'),
+    ('ICESTORM_SPRAM', 'spram'),
+    ('ICESTORM_DSP', 'dsp'),
+]
+FIELDS = (['date', 'commit', 'fmax_mhz', 'lut', 'ff'] + [c for _, c in BELS]
+          + ['baseline'])
+# yosys cells counted per module
+CELLS = [
+    ('LUT', lambda t: t == 'SB_LUT4'),
+    ('FF', lambda t: t.startswith('SB_DFF')),
+    ('EBR', lambda t: t.startswith('SB_RAM40_4K')),
+    ('SPRAM', lambda t: t == 'SB_SPRAM256KA'),
+    ('DSP', lambda t: t == 'SB_MAC16'),
+]
+
+
+def load_json(path):
+    # yosys may log a line or two ahead of the JSON
+    with open(path) as f:
+        text = f.read()
+    start = text.find('{')
+    if start < 0:
+        sys.exit(f"{path}: no JSON")
+    return json.loads(text[start:])
+
+
+def fmax(report):
+    # Lowest achieved Fmax over the clocks, usually just clk
+    clocks = report.get('fmax', {})
+    if not clocks:
+        sys.exit("no Fmax in the nextpnr report")
+    return min(c['achieved'] for c in clocks.values())
+
+
+def critical_path(report):
+    paths = report.get('critical_paths', [])
+    if not paths:
+        return []
+    # The one with the longest total delay
+    path = max(paths, key=lambda p: sum(s['delay'] for s in p['path']))
+    lines = [f"(MM) Critical path {path['from']} -> {path['to']}:"]
+    total = 0.0
+    for step in path['path']:
+        total += step['delay']
+        where = step.get('to', step.get('from', {}))
+        lines.append(f"(MM)   {total:7.2f} ns  {step['type']:<9} "
+                     f"{where.get('cell', '')}.{where.get('port', '')}")
+    return lines
+
+
+def module_cells(stat):
+    rows = {}
+    for name, module in stat.get('modules', {}).items():
+        by_type = module.get('num_cells_by_type', {})
+        rows[name.lstrip('\\')] = [
+            sum(n for t, n in by_type.items() if match(t))
+            for _, match in CELLS]
+    return rows
+
+
+def design_cells(stat):
+    by_type = stat.get('design', {}).get('num_cells_by_type', {})
+    return [sum(n for t, n in by_type.items() if match(t))
+            for _, match in CELLS]
+
+
+def commit():
+    try:
+        rev = subprocess.run(['git', 'rev-parse', '--short', 'HEAD'],
+                             capture_output=True, text=True, check=True)
+        dirty = subprocess.run(['git', 'diff', '--quiet', 'HEAD', '--', '.'])
+    except (OSError, subprocess.CalledProcessError):
+        return 'unknown'
+    return rev.stdout.strip() + ('-dirty' if dirty.returncode else '')
+
+
+def baseline_run(path):
+    # The last run marked as baseline, or the first one
+    if not os.path.exists(path):
+        return None
+    with open(path) as f:
+        runs = list(csv.DictReader(f))
+    marked = [r for r in runs if r.get('baseline') == '1']
+    return marked[-1] if marked else (runs[0] if runs else None)
+
+
+def compare(old, new, tol, higher_is_better):
+    # Change in %, and whether it is a regression past the tolerance
+    if old <= 0:
+        # Not used in the baseline, any use is more
+        return 0.0, new > old and not higher_is_better
+    change = (new - old) * 100.0 / old
+    worse = -change if higher_is_better else change
+    return change, worse > tol
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('report')
+    parser.add_argument('modules')
+    parser.add_argument('history')
+    parser.add_argument('--fmax-tol', type=float, default=5.0)
+    parser.add_argument('--area-tol', type=float, default=5.0)
+    parser.add_argument('--accept', action='store_true')
+    args = parser.parse_args()
+
+    report = load_json(args.report)
+    stat = load_json(args.modules)
+
+    run = dict(date=datetime.date.today().isoformat(), commit=commit(),
+               fmax_mhz=f"{fmax(report):.2f}")
+    lut, ff = design_cells(stat)[:2]
+    run['lut'] = lut
+    run['ff'] = ff
+    util = report.get('utilization', {})
+    for bel, column in BELS:
+        run[column] = util.get(bel, {}).get('used', 0)
+
+    print(f"(MM) Fmax: {run['fmax_mhz']} MHz")
+    for line in critical_path(report):
+        print(line)
+    for bel, column in BELS:
+        if bel in util:
+            print(f"(MM) {bel}: {util[bel]['used']}/{util[bel]['available']}")
+    print(f"(MM) {'Module':<24}" + "".join(f"{name:>8}" for name, _ in CELLS))
+    for name, cells in sorted(module_cells(stat).items()):
+        print(f"(MM) {name:<24}" + "".join(f"{n:>8}" for n in cells))
+
+    failed = False
+    base = baseline_run(args.history)
+    if base:
+        # Any more of a block is a regression, there are few of them
+        checks = [('Fmax', float(base['fmax_mhz']), float(run['fmax_mhz']),
+                   args.fmax_tol, True),
+                  ('LCs', int(base['lc']), run['lc'], args.area_tol, False),
+                  ('EBRs', int(base['ebr']), run['ebr'], 0.0, False),
+                  ('SPRAMs', int(base['spram']), run['spram'], 0.0, False),
+                  ('DSPs', int(base['dsp']), run['dsp'], 0.0, False)]
+        for name, old, new, tol, higher_is_better in checks:
+            change, worse = compare(old, new, tol, higher_is_better)
+            print(f"(MM) {name}: {old} -> {new} ({change:+.1f}%) since "
+                  f"baseline {base['commit']}"
+                  + (", REGRESSION" if worse else ""))
+            failed |= worse
+
+    if failed and not args.accept:
+        sys.exit(f"(MM) Regression past tolerance, not recorded in "
+                 f"{args.history}. Accept it with --accept")
+    new_file = not os.path.exists(args.history)
+    run['baseline'] = 1 if args.accept or not base else ''
+    with open(args.history, 'a', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=FIELDS)
+        if new_file:
+            writer.writeheader()
+        writer.writerow(run)
+
+
+if __name__ == '__main__':
+    main()
@@ -1,18 +1,31 @@
 /*
  This is an Internal-Forwarding Register File(IFRF). It has 3 ports,
- two read-only for rs1 and rs2, and one write-only for rd. 
- 
- x0 always reads 0, and have no effect writing (though it is actually 
+ two read-only for rs1 and rs2, and one write-only for rd.
+
+ x0 always reads 0, and have no effect writing (though it is actually
  written into RF, the value can never be read)
- 
+
  During writeback, if rd address equals to rs1/rs2 address, the source
  register outputs the latest value.
- 
+
  This IFRF is implemented using an array of registers, consuming 32x32=1024
  registers instead of the scarcer BRAMs. More importantly, register access
- is finished in a single clock, allowing the pipeline to be as short as 
+ is finished in a single clock, allowing the pipeline to be as short as
  two stages.
+
+ With ENABLE_RF_EBR, the registers are in two EBRs instead, one copy for
+ each read port, both written at the rising edge. The read ports are
+ clocked at the falling edge, so a source register read in a clock
+ still gets the writes up to its rising edge, and the writeback of the
+ same clock comes through the forwarding as before. The cost is timing:
+ the source addresses must be decoded in the first half of the clock,
+ and the operands come in the second half. data is kept as a copy for
+ the simulators, and is removed by synthesis.
+
+ With ENABLE_RV32E, there are 16 registers, addressed by the low 4
+ bits. The decoder does not let x16-x31 through.
  */
+`include "core/config.vh"
 
 module regfile(
 	       input wire 	  clk, input wire resetb,
@@ -20,31 +33,67 @@ module regfile(
 	       output reg [31:0] d_rs1,
 	       input wire [4:0]   a_rs2,
 	       output reg [31:0] d_rs2,
-	       input wire [4:0]   a_rd,
-	       input wire [31:0] d_rd,
-	       input wire we_rd
+	       input wire [4:0]   a_rd /*verilator public*/,
+	       input wire [31:0] d_rd /*verilator public*/,
+	       input wire we_rd /*verilator public*/
 	       );
 
-   // 32x32 registers
-   reg [31:0] 		  data [0:31] /*verilator public*/;
+   parameter ENABLE_RF_EBR /*verilator public*/ = `ENABLE_RF_EBR;
+   parameter ENABLE_RV32E = `ENABLE_RV32E;
+
+   localparam N = (ENABLE_RV32E != 0) ? 16 : 32;
+   localparam AW = (ENABLE_RV32E != 0) ? 4 : 5;
+
+   // 32x32 registers, or 16x32
+   reg [31:0] 		  data [0:N-1] /*verilator public*/;
+   // Registers read, without forwarding
+   wire [31:0] 		  q_rs1, q_rs2;
    // Temporary variable
    integer 		  i;
 
    always @ (posedge clk) begin : MAIN_CLK_PROCESS
       if (!resetb) begin
 	 // Registers do not initialize
-	 for (i = 0; i < 32; i = i + 1) begin
+	 for (i = 0; i < N; i = i + 1) begin
 	    data[i] <= 32'bX;
 	 end
       end
       else if (clk) begin
 	 // Write back
 	 if (we_rd) begin
-	    data[a_rd] <= d_rd;
+	    data[a_rd[AW-1:0]] <= d_rd;
 	 end
       end
    end // block: MAIN_CLK_PROCESS
 
+   generate
+      if (ENABLE_RF_EBR != 0) begin : EBR
+	 // One copy per read port
+	 reg [31:0] bank1 [0:N-1];
+	 reg [31:0] bank2 [0:N-1];
+	 reg [31:0] q1, q2;
+
+	 always @ (posedge clk) begin : EBR_WRITE
+	    if (we_rd) begin
+	       bank1[a_rd[AW-1:0]] <= d_rd;
+	       bank2[a_rd[AW-1:0]] <= d_rd;
+	    end
+	 end
+
+	 always @ (negedge clk) begin : EBR_READ
+	    q1 <= bank1[a_rs1[AW-1:0]];
+	    q2 <= bank2[a_rs2[AW-1:0]];
+	 end
+
+	 assign q_rs1 = q1;
+	 assign q_rs2 = q2;
+      end
+      else begin : FLOPS
+	 assign q_rs1 = data[a_rs1[AW-1:0]];
+	 assign q_rs2 = data[a_rs2[AW-1:0]];
+      end
+   endgenerate
+
    always @ (*) begin : COMBINATIONAL_PROCESS
       // Forwarding rs1
       if (a_rs1 == 5'b0)
@@ -52,14 +101,14 @@ module regfile(
       else if (we_rd && a_rd != 5'b0 && a_rs1 == a_rd)
 	d_rs1 = d_rd;
       else
-	d_rs1 = data[a_rs1];
+	d_rs1 = q_rs1;
       // Forwarding rs2
       if (a_rs2 == 5'b0)
 	d_rs2 = 32'b0;
       else if (we_rd && a_rd != 5'b0 && a_rs2 == a_rd)
 	d_rs2 = d_rd;
       else
-	d_rs2 = data[a_rs2];
+	d_rs2 = q_rs2;
    end
-   
+
 endmodule // regfile
@@ -0,0 +1,48 @@
+#ifndef __REGFILE_MODEL_H__
+#define __REGFILE_MODEL_H__
+
+#include <cstdint>
+
+// Reference of regfile.v: x0 reads 0, and a source register written in
+// the same clock reads the value being written. Registers read before
+// their first write, or after reset, are unknown
+class regfile_model_t
+{
+public:
+  static const unsigned MAX_REGS = 32;
+
+  explicit regfile_model_t(unsigned regs) : regs(regs) { reset(); }
+
+  void reset() { known = 0; }
+
+  // The value on d_rs of source register a, false if it is unknown
+  bool read(unsigned a, unsigned a_rd, uint32_t d_rd, bool we_rd,
+	    uint32_t& value) const
+  {
+    if (a == 0) {
+      value = 0;
+      return true;
+    }
+    if (we_rd && a_rd != 0 && a == a_rd) {
+      value = d_rd;
+      return true;
+    }
+    value = data[a % regs];
+    return (known >> (a % regs)) & 1;
+  }
+
+  // The write at the rising edge
+  void write(unsigned a_rd, uint32_t d_rd, bool we_rd)
+  {
+    if (!we_rd) return;
+    data[a_rd % regs] = d_rd;
+    known |= 1u << (a_rd % regs);
+  }
+
+private:
+  unsigned regs;
+  uint32_t data[MAX_REGS];
+  uint32_t known;
+};
+
+#endif // __REGFILE_MODEL_H__
@@ -0,0 +1,181 @@
+// Self-checking test of regfile.v against regfile_model.h
+//
+// First every combination of a_rs1, a_rs2, a_rd and we_rd, then random
+// clocks in which most addresses come from a few registers, so that
+// reads hit the writes of the clock before and of the same clock, with
+// a reset now and then. Both read ports are checked every clock, and
+// only mismatches are printed. The same file tests every build of the
+// register file, e.g. ENABLE_RF_EBR or ENABLE_RV32E; the number of
+// registers is the size of data in the Verilated register file. The
+// regfile.v of project 01 is tested with it as well.
+//
+// regfile_tb [+seed=<n>] [+clocks=<n>]
+
+#include <verilated.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "Vregfile.h"
+#include "Vregfile_regfile.h"
+#include "regfile_model.h"
+
+// xorshift64*
+struct rng_t
+{
+  uint64_t s;
+
+  explicit rng_t(uint64_t seed) : s(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+  uint32_t next()
+  {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return (s * 0x2545F4914F6CDD1Dull) >> 32;
+  }
+
+  // 0 .. n-1
+  uint32_t below(uint32_t n)
+  {
+    return (static_cast<uint64_t>(next()) * n) >> 32;
+  }
+};
+
+// Inputs of one clock
+struct regfile_inputs_t
+{
+  unsigned a_rs1, a_rs2, a_rd;
+  uint32_t d_rd;
+  bool we_rd;
+  bool reset;
+};
+
+class regfile_stress_t
+{
+public:
+  Vregfile* dut;
+  unsigned regs;
+  regfile_model_t model;
+  uint64_t clocks = 0;
+  uint64_t checks = 0;
+  int mismatches = 0;
+
+  regfile_stress_t()
+    : dut(new Vregfile)
+    , regs(sizeof(dut->regfile->data) / sizeof(dut->regfile->data[0]))
+    , model(regs)
+  {
+    dut->clk = 1;
+    dut->resetb = 1;
+    dut->we_rd = 0;
+    dut->eval();
+  }
+
+  ~regfile_stress_t()
+  {
+    dut->final();
+    delete dut;
+  }
+
+  // One clock: inputs after the rising edge, the read ports checked
+  // before the next one. The register file forgets its contents as
+  // soon as reset is asserted, for the asynchronous reset of project 01.
+  // false after too many mismatches
+  bool step(const regfile_inputs_t& in)
+  {
+    if (in.reset) model.reset();
+    dut->resetb = !in.reset;
+    dut->a_rs1 = in.a_rs1;
+    dut->a_rs2 = in.a_rs2;
+    dut->a_rd = in.a_rd;
+    dut->d_rd = in.d_rd;
+    dut->we_rd = in.we_rd;
+    dut->clk = 0;
+    dut->eval();
+    check(in, 1, in.a_rs1, dut->d_rs1);
+    check(in, 2, in.a_rs2, dut->d_rs2);
+    dut->clk = 1;
+    dut->eval();
+    ++clocks;
+    if (!in.reset) model.write(in.a_rd, in.d_rd, in.we_rd);
+    return mismatches < 10;
+  }
+
+private:
+  void check(const regfile_inputs_t& in, int port, unsigned a, uint32_t d)
+  {
+    uint32_t expected;
+    if (!model.read(a, in.a_rd, in.d_rd, in.we_rd, expected)) return;
+    ++checks;
+    if (d == expected) return;
+    ++mismatches;
+    std::printf("(TT) Clock %llu: a_rs1 = x%u, a_rs2 = x%u, a_rd = x%u, "
+		"d_rd = 0x%08x, we_rd = %d%s: d_rs%d = 0x%08x, expected "
+		"0x%08x\n", (unsigned long long)clocks, in.a_rs1, in.a_rs2,
+		in.a_rd, in.d_rd, in.we_rd, in.reset ? ", reset" : "", port,
+		d, expected);
+  }
+};
+
+int main(int argc, char** argv)
+{
+  Verilated::commandArgs(argc, argv);
+
+  uint64_t seed = 1;
+  uint64_t count = 10000000;
+  for (int i=1; i<argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 6, "+seed=") == 0) seed = std::strtoull(&argv[i][6], nullptr, 0);
+    else if (arg.compare(0, 8, "+clocks=") == 0) count = std::strtoull(&argv[i][8], nullptr, 0);
+  }
+
+  regfile_stress_t tb;
+  rng_t rng(seed);
+  const unsigned n = tb.regs;
+  bool ok = true;
+  auto start = std::chrono::steady_clock::now();
+
+  // Every register known first, then every combination of addresses,
+  // each with and without a write
+  for (unsigned r=0; r<n && ok; ++r) {
+    ok = tb.step({0, 0, r, rng.next(), true, false});
+  }
+  for (unsigned k=0; k < 2*n*n*n && ok; ++k) {
+    ok = tb.step({k % n, (k / n) % n, (k / n / n) % n, rng.next(),
+		  (k / n / n / n) != 0, false});
+  }
+
+  // A few hot registers, x0 among them now and then
+  unsigned hot[4];
+  for (uint64_t c=0; c<count && ok; ++c) {
+    if (c % 256 == 0) {
+      for (auto& h : hot) h = rng.below(n);
+    }
+    auto reg = [&]() { return rng.below(4) ? hot[rng.below(4)] : rng.below(n); };
+    regfile_inputs_t in;
+    in.a_rs1 = reg();
+    in.a_rs2 = reg();
+    in.a_rd = reg();
+    in.d_rd = rng.next();
+    in.we_rd = rng.below(4) != 0;
+    in.reset = rng.below(100000) == 0;
+    ok = tb.step(in);
+  }
+
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  std::printf("(TT) %u registers, %llu clocks, %llu reads checked in %.2f s,"
+	      " %.2f M clocks/s\n", n, (unsigned long long)tb.clocks,
+	      (unsigned long long)tb.checks, seconds, tb.clocks / seconds / 1e6);
+  if (tb.mismatches) {
+    std::printf("(TT) Register file FAILED, +seed=%llu\n",
+		(unsigned long long)seed);
+    return 1;
+  }
+  std::printf("(TT) Register file PASSED\n");
+  return 0;
+}
@@ -0,0 +1,143 @@
+#ifndef __SEMIHOST_H__
+#define __SEMIHOST_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Semihosting mailbox of cpu_run. The firmware writes the address of a
+// descriptor to the doorbell at 0x80000004:
+//
+//   +0  op
+//   +4  buffer address
+//   +8  length
+//   +12 argument: a file descriptor, open mode or exit code
+//   +16 result, written by the simulator, -1 on error
+//
+// The request is serviced in the clock the doorbell write is on the IO
+// bus, straight from the memory arrays of the model, so the result can
+// be loaded by the next instruction.
+class semihost_t
+{
+public:
+  enum op_t {
+    SH_WRITE = 1,	// Write buffer to fd, 1 is stdout, 2 is stderr
+    SH_READ = 2,	// Read fd into buffer, 0 is stdin
+    SH_OPEN = 3,	// Open the path in buffer, mode 0 read, 1 write,
+			// 2 append. Result is the fd
+    SH_CLOSE = 4,	// Close fd
+    SH_CLOCK = 5,	// Simulated clocks, low 32 bits
+    SH_TIME = 6,	// Host time in seconds
+    SH_EXIT = 7,	// Stop the simulation with the exit code
+  };
+
+  // Byte access to the memory of the model, and the clock count
+  std::function<uint8_t(uint32_t)> read_byte;
+  std::function<void(uint32_t, uint8_t)> write_byte;
+  std::function<uint64_t(void)> clocks;
+
+  bool exited = false;
+  int exit_code = 0;
+  uint64_t requests = 0;
+  uint64_t bytes = 0;
+
+  ~semihost_t()
+  {
+    for (int fd : files) close(fd);
+  }
+
+  void service(uint32_t desc)
+  {
+    ++requests;
+    uint32_t op = read_word(desc);
+    uint32_t buf = read_word(desc + 4);
+    uint32_t len = read_word(desc + 8);
+    uint32_t arg = read_word(desc + 12);
+    int32_t result = -1;
+    // No more than the data memory
+    if (len > 0x10000) len = 0x10000;
+    if ((op == SH_WRITE || op == SH_READ) && !allowed(arg)) op = 0;
+    switch (op) {
+    case SH_WRITE: {
+      std::vector<uint8_t> data(len);
+      for (uint32_t i=0; i<len; ++i) data[i] = read_byte(buf + i);
+      if (arg == 1 || arg == 2) fflush(stdout);
+      result = write(arg, data.data(), len);
+      break;
+    }
+    case SH_READ: {
+      std::vector<uint8_t> data(len);
+      result = read(arg, data.data(), len);
+      for (int32_t i=0; i<result; ++i) write_byte(buf + i, data[i]);
+      break;
+    }
+    case SH_OPEN: {
+      std::string path;
+      for (uint32_t i=0; i<len; ++i) {
+	path += static_cast<char>(read_byte(buf + i));
+      }
+      static const int flags[] = {
+	O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_WRONLY | O_CREAT | O_APPEND
+      };
+      if (arg < 3) result = open(path.c_str(), flags[arg], 0644);
+      if (result >= 0) files.push_back(result);
+      break;
+    }
+    case SH_CLOSE:
+      for (auto it = files.begin(); it != files.end(); ++it) {
+	if (*it == static_cast<int>(arg)) {
+	  files.erase(it);
+	  result = close(arg);
+	  break;
+	}
+      }
+      break;
+    case SH_CLOCK:
+      result = static_cast<int32_t>(clocks());
+      break;
+    case SH_TIME:
+      result = static_cast<int32_t>(time(nullptr));
+      break;
+    case SH_EXIT:
+      exited = true;
+      exit_code = static_cast<int>(arg);
+      result = 0;
+      break;
+    default:
+      break;
+    }
+    if ((op == SH_WRITE || op == SH_READ) && result > 0) bytes += result;
+    write_word(desc + 16, static_cast<uint32_t>(result));
+  }
+
+private:
+  // Files opened by the firmware, only these may be closed
+  std::vector<int> files;
+
+  bool allowed(uint32_t fd)
+  {
+    if (fd <= 2) return true;
+    for (int f : files) if (f == static_cast<int>(fd)) return true;
+    return false;
+  }
+
+  uint32_t read_word(uint32_t addr)
+  {
+    uint32_t word = 0;
+    for (int i=0; i<4; ++i) word |= read_byte(addr + i) << (8 * i);
+    return word;
+  }
+
+  void write_word(uint32_t addr, uint32_t word)
+  {
+    for (int i=0; i<4; ++i) write_byte(addr + i, word >> (8 * i));
+  }
+};
+
+#endif // __SEMIHOST_H__
@@ -0,0 +1,184 @@
+#ifndef __SPI_FLASH_MODEL_H__
+#define __SPI_FLASH_MODEL_H__
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// SPI NOR flash at the XIP controller in xip.v, like a W25Q128. The
+// lines are looked at once a clock: inputs are sampled on the rising
+// edge of SCK, and outputs change on the falling edge, SPI mode 0.
+// Reads with Read (03h), Fast Read (0Bh), Dual I/O Fast Read (BBh) and
+// Quad I/O Fast Read (EBh). The last two enter continuous read mode
+// with mode bits M5-4 = 10, and all ones in address and mode leave it.
+// Other commands are ignored. Unprogrammed bytes read 0xFF
+class spi_flash_model_t
+{
+public:
+  // 16 MB
+  static const uint32_t SIZE = 1 << 24;
+  // The testbenches put the program image at 1 MB, above the
+  // bitstream, where it is fetched at 0x01100000
+  static const uint32_t IMAGE_OFFSET = 0x100000;
+
+  uint64_t transactions = 0;
+  uint64_t commands = 0;
+  uint64_t read_bytes = 0;
+
+  void load(const void* buf, uint32_t size, uint32_t offset)
+  {
+    if (offset >= SIZE) return;
+    if (size > SIZE - offset) size = SIZE - offset;
+    if (mem.size() < offset + size) mem.resize(offset + size, 0xFF);
+    std::memcpy(&mem[offset], buf, size);
+  }
+
+  // One clock. Returns the IO lines, as driven by the flash or the
+  // controller, pulled up where nobody drives
+  uint32_t tick(bool csb, bool sck, uint32_t io_oe, uint32_t io_do)
+  {
+    if (csb) {
+      phase = IDLE;
+      drive_oe = 0;
+    }
+    else {
+      if (last_csb) start();
+      if (sck && !last_sck) rise(lines(io_oe, io_do));
+      else if (!sck && last_sck) fall();
+    }
+    last_csb = csb;
+    last_sck = sck;
+    return lines(io_oe, io_do);
+  }
+
+private:
+  enum { IDLE, CMD, ADDR, MODE, DUMMY, DATA, IGNORE } phase = IDLE;
+  std::vector<uint8_t> mem;
+  bool last_csb = true;
+  bool last_sck = false;
+  // Lines and bits per SCK cycle of address and data, mode bits and
+  // dummy cycles of the read command
+  int width = 1;
+  bool has_mode = false;
+  int dummy = 0;
+  bool continuous = false;
+  int count = 0;
+  uint32_t cmd = 0, addr = 0, mode = 0;
+  // Byte being shifted out, bits left of it
+  uint8_t byte = 0;
+  int out_bits = 0;
+  uint32_t drive = 0, drive_oe = 0;
+
+  uint32_t lines(uint32_t io_oe, uint32_t io_do) const
+  {
+    return (drive & drive_oe) | (io_do & io_oe & ~drive_oe)
+      | (~(io_oe | drive_oe) & 0xF);
+  }
+
+  void start()
+  {
+    ++transactions;
+    count = 0;
+    addr = 0;
+    mode = 0;
+    drive_oe = 0;
+    // Continuous read mode begins with the address
+    phase = continuous ? ADDR : CMD;
+  }
+
+  void rise(uint32_t in)
+  {
+    uint32_t bits = in & ((1u << width) - 1);
+    switch (phase) {
+    case CMD:
+      cmd = (cmd << 1) | (in & 1);
+      if (++count == 8) decode();
+      break;
+    case ADDR:
+      addr = (addr << width) | bits;
+      count += width;
+      if (count == 24) {
+	count = 0;
+	if (has_mode) phase = MODE;
+	else data_or_dummy();
+      }
+      break;
+    case MODE:
+      mode = (mode << width) | bits;
+      count += width;
+      if (count == 8) {
+	count = 0;
+	if ((addr & 0xFFFFFF) == 0xFFFFFF && (mode & 0xFF) == 0xFF) {
+	  // Continuous read mode reset
+	  continuous = false;
+	  phase = IGNORE;
+	}
+	else {
+	  continuous = (mode & 0x30) == 0x20;
+	  data_or_dummy();
+	}
+      }
+      break;
+    case DUMMY:
+      if (++count == dummy) phase = DATA;
+      break;
+    default:
+      break;
+    }
+  }
+
+  void fall()
+  {
+    if (phase != DATA) return;
+    if (out_bits == 0) {
+      uint32_t a = addr & (SIZE - 1);
+      byte = a < mem.size() ? mem[a] : 0xFF;
+      addr = a + 1;
+      out_bits = 8;
+      ++read_bytes;
+    }
+    out_bits -= width;
+    uint32_t bits = (byte >> out_bits) & ((1u << width) - 1);
+    // Single bit reads come out on IO1
+    drive = (width == 1) ? bits << 1 : bits;
+    drive_oe = (width == 1) ? 2 : (1u << width) - 1;
+  }
+
+  void decode()
+  {
+    ++commands;
+    count = 0;
+    width = 1;
+    has_mode = false;
+    dummy = 0;
+    switch (cmd & 0xFF) {
+    case 0x03:
+      break;
+    case 0x0B:
+      dummy = 8;
+      break;
+    case 0xBB:
+      width = 2;
+      has_mode = true;
+      break;
+    case 0xEB:
+      width = 4;
+      has_mode = true;
+      dummy = 4;
+      break;
+    default:
+      phase = IGNORE;
+      return;
+    }
+    phase = ADDR;
+  }
+
+  void data_or_dummy()
+  {
+    count = 0;
+    out_bits = 0;
+    phase = (dummy != 0) ? DUMMY : DATA;
+  }
+};
+
+#endif // __SPI_FLASH_MODEL_H__
@@ -0,0 +1,151 @@
+#ifndef __SUBARCH_MANIFEST_H__
+#define __SUBARCH_MANIFEST_H__
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// One subarch test of test/subarch.txt, see the header of that file
+struct subarch_test_t
+{
+  // Register number, or PC for FD_PC, and the values it goes through
+  struct sequence_t {
+    static const int PC = -1;
+    int reg;
+    std::vector<uint32_t> values;
+  };
+  // FD_PC enters pc at least count times
+  struct visits_t {
+    uint32_t pc;
+    int count;
+  };
+
+  std::string name;
+  std::string program;
+  int clocks = 0;
+  bool has_fail_pc = false;
+  uint32_t fail_pc = 0;
+  std::vector<sequence_t> sequences;
+  std::vector<visits_t> visits;
+  // Build option the test needs. Such tests only run when named
+  std::string needs;
+
+  // values appear one after another in trace, in which repeats of a
+  // value were already dropped
+  static bool contains(const std::vector<uint32_t>& trace,
+		       const std::vector<uint32_t>& values)
+  {
+    if (values.empty()) return true;
+    for (size_t i = 0; i + values.size() <= trace.size(); ++i) {
+      size_t n = 0;
+      while (n < values.size() && trace[i + n] == values[n]) ++n;
+      if (n == values.size()) return true;
+    }
+    return false;
+  }
+};
+
+inline bool parse_subarch_number(const std::string& s, uint32_t& value)
+{
+  if (s.empty()) return false;
+  char* end;
+  long long v = std::strtoll(s.c_str(), &end, 0);
+  if (*end != '\0' || v < INT32_MIN || v > UINT32_MAX) return false;
+  value = static_cast<uint32_t>(v);
+  return true;
+}
+
+// Reads the manifest into tests. Reports the first error with its
+// line, and returns false
+inline bool parse_subarch_manifest(const std::string& path,
+				   std::vector<subarch_test_t>& tests)
+{
+  std::ifstream f(path);
+  if (!f.is_open()) {
+    std::cerr << path << ": cannot open" << std::endl;
+    return false;
+  }
+  std::string line;
+  for (int n = 1; std::getline(f, line); ++n) {
+    auto error = [&](const std::string& what) {
+      std::cerr << path << ":" << n << ": " << what << std::endl;
+      return false;
+    };
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    subarch_test_t t;
+    std::string clocks, fail_pc;
+    if (!(fields >> t.name)) continue;
+    if (!(fields >> t.program >> clocks >> fail_pc)) {
+      return error("expected name, program, clocks and fail_pc");
+    }
+    uint32_t value;
+    if (!parse_subarch_number(clocks, value) || value == 0
+	|| value > 1000000) {
+      return error("bad clock count " + clocks);
+    }
+    t.clocks = value;
+    if (fail_pc != "-") {
+      if (!parse_subarch_number(fail_pc, t.fail_pc)) {
+	return error("bad fail_pc " + fail_pc);
+      }
+      t.has_fail_pc = true;
+    }
+    for (std::string check; fields >> check;) {
+      size_t eq = check.find('=');
+      if (eq == std::string::npos) return error("bad check " + check);
+      std::string key = check.substr(0, eq);
+      std::string arg = check.substr(eq + 1);
+      if (key == "needs") {
+	t.needs = arg;
+      }
+      else if (key == "visits") {
+	size_t colon = arg.find(':');
+	subarch_test_t::visits_t v;
+	uint32_t count;
+	if (colon == std::string::npos
+	    || !parse_subarch_number(arg.substr(0, colon), v.pc)
+	    || !parse_subarch_number(arg.substr(colon + 1), count)) {
+	  return error("bad visits " + arg);
+	}
+	v.count = count;
+	t.visits.push_back(v);
+      }
+      else if (key == "pc" || (key.size() > 1 && key[0] == 'x')) {
+	subarch_test_t::sequence_t s;
+	s.reg = subarch_test_t::sequence_t::PC;
+	if (key != "pc") {
+	  uint32_t reg;
+	  if (!parse_subarch_number(key.substr(1), reg)
+	      || reg == 0 || reg > 31) {
+	    return error("bad register " + key);
+	  }
+	  s.reg = reg;
+	}
+	std::istringstream values(arg);
+	for (std::string v; std::getline(values, v, ',');) {
+	  if (!parse_subarch_number(v, value)) {
+	    return error("bad value " + v);
+	  }
+	  s.values.push_back(value);
+	}
+	if (s.values.empty()) return error("no values for " + key);
+	t.sequences.push_back(s);
+      }
+      else {
+	return error("unknown check " + key);
+      }
+    }
+    for (auto& other : tests) {
+      if (other.name == t.name) return error("test " + t.name + " again");
+    }
+    tests.push_back(t);
+  }
+  return true;
+}
+
+#endif // __SUBARCH_MANIFEST_H__
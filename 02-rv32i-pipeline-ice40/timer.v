@@ -2,7 +2,10 @@
 * 64 Bit system timer sitting on IO address space
 * mtime - 0x80000010
 * mtimecmp - 0x80000018
-* TODO: interrupts
+* irq_mtimecmp is pending while mtime >= mtimecmp. A write to mtimecmp
+* clears it for one clock, so that a value already in the past raises a
+* new interrupt
+* mtime_out goes to the mtimecmp of other harts
 */
 
 module timer(
@@ -13,13 +16,14 @@ module timer(
     input wire io_we,
     input wire [31:0] io_din,
     output wire [31:0] io_dout,
+    output wire [63:0] mtime_out,
     // mtimecmp port
     // IRQ
     output reg irq_mtimecmp
     );
 
-    reg [63:0] mtime;
-    reg [63:0] mtimecmp;
+    reg [63:0] mtime /*verilator public*/;
+    reg [63:0] mtimecmp /*verilator public*/;
 
     always @ (posedge clk) begin : TIMER_PIPELINE
       if (!resetb) begin
@@ -30,6 +34,7 @@ module timer(
       end
       else if (clk) begin
         mtime <= mtime + 1;
+        irq_mtimecmp <= mtime >= mtimecmp;
         if (io_we) begin
           case (io_addr_3_2[3:2])
             2'b00: mtime[0+:32] <= io_din;
@@ -44,12 +49,11 @@ module timer(
         end
       endcase
     end
-    if (mtime == mtimecmp) begin
-      irq_mtimecmp <= 1'b1;
-    end
   end
 end
 
+assign mtime_out = mtime;
+
 assign io_dout = 
   io_addr_3_2[3]
   ? ( io_addr_3_2[2] ? mtimecmp[32+:32] : mtimecmp[0+:32] )
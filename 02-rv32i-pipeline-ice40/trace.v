@@ -0,0 +1,249 @@
+/*
+ * Branch trace encoder of hart 0, sitting on IO address space
+ * DATA   - 0x80000070, read pops a packet of the trace FIFO into [15:0],
+ *          [31] is set when the FIFO was empty
+ * STATUS - 0x80000074, [0] empty, no packet in the FIFO or on its way,
+ *          [1] overflow, cleared by writing 1, [2] tracing,
+ *          [24:16] packets in the FIFO
+ * CTRL   - 0x80000078, [0] enable
+ *
+ * Packets are halfwords, in program order:
+ *
+ *   0bbb bbbb bbbb bbbb  Branch map. Outcomes of up to 14 conditional
+ *                        branches, 1 taken, oldest first, below a 1
+ *   10md dddd dddd dddd  Address. d is a chunk of a signed delta in
+ *                        halfwords, lowest first. m is set when another
+ *                        chunk follows, and the last one sign-extends
+ *   11tt tt00 0000 000l  Control, t is
+ *                        0 SYNC, l set when packets were lost. The PC
+ *                        of the next instruction follows, from 0
+ *                        1 TRAP. The PC of the instruction the trap
+ *                        flushed follows, then the handler
+ *                        2 STOP. The PC of the next instruction follows
+ *
+ * An indirect jump, JALR or MRET, is followed by the address of its
+ * target. Direct jumps and straight code are in the program. Deltas are
+ * from the last address traced: the PC of the last branch or indirect
+ * jump, or the last address packet.
+ *
+ * Enabling starts the trace with a SYNC, disabling ends it with a STOP.
+ * The branch map is flushed before any other packet. The packets of a
+ * clock, up to 8, go to a staging buffer of 16 halfwords, which moves
+ * one a clock into the FIFO, an EBR of 256. Packets that do not fit are
+ * dropped, overflow is set, and the trace starts again with a SYNC. The
+ * core never waits for the encoder. A DATA read waits while a packet is
+ * on its way from the staging buffer.
+ */
+
+module trace(
+  input wire clk,
+  input wire resetb,
+  // Redirects of FD, see core.v
+  input wire trace_valid,
+  input wire trace_br,
+  input wire trace_taken,
+  input wire trace_jr,
+  input wire trace_trap,
+  input wire [31:0] trace_pc,
+  input wire [31:0] trace_target,
+  // Register port, io_stb is the clock of the access
+  input wire [3:2] io_addr_3_2,
+  input wire io_stb,
+  input wire io_we,
+  /* verilator lint_off UNUSED */
+  input wire [31:0] io_din,
+  /* verilator lint_on UNUSED */
+  output reg [31:0] io_dout,
+  output wire io_stall
+  );
+
+  localparam FIFO_DEPTH_LOG = 8;
+  localparam STAGE = 16;
+
+  localparam [3:0] CTRL_SYNC = 4'd0;
+  localparam [3:0] CTRL_TRAP = 4'd1;
+  localparam [3:0] CTRL_STOP = 4'd2;
+
+  reg enable, tracing, lost, overflow;
+  // Branch map, the outcomes below a 1
+  reg [14:0] map;
+  // Last address traced
+  reg [31:0] last;
+
+  reg [16*STAGE-1:0] stage;
+  reg [4:0] stage_n;
+
+  reg [15:0] fifo [0:(1<<FIFO_DEPTH_LOG)-1];
+  // Pointers have one more bit to tell full from empty
+  reg [FIFO_DEPTH_LOG:0] wp, rp;
+  wire [FIFO_DEPTH_LOG:0] fifo_count;
+  wire fifo_full, fifo_empty;
+  // First packet, read ahead of the EBR
+  reg [15:0] head;
+  reg head_valid;
+  wire head_pop;
+
+  // Packets of this clock, the first in the low halfword
+  reg [16*8-1:0] pk;
+  reg [3:0] pk_n;
+  reg [14:0] map_next;
+  reg [31:0] last_next;
+  reg start, stop;
+  wire stage_pop;
+  wire [4:0] stage_kept;
+  wire stage_fits;
+
+  task push(input [15:0] p);
+    begin
+      pk[16*pk_n+:16] = p;
+      pk_n = pk_n + 4'd1;
+    end
+  endtask
+
+  task push_map;
+    begin
+      if (map_next != 15'd1) push({1'b0, map_next});
+      map_next = 15'd1;
+    end
+  endtask
+
+  // In as few chunks as the delta from the last address needs
+  task push_addr(input [31:0] addr);
+    reg [31:0] d;
+    begin
+      d = addr - last_next;
+      d = {d[31], d[31:1]};
+      if (d[31:12] == 20'h0 || d[31:12] == 20'hFFFFF) begin
+        push({3'b100, d[12:0]});
+      end
+      else if (d[31:25] == 7'h0 || d[31:25] == 7'h7F) begin
+        push({3'b101, d[12:0]});
+        push({3'b100, d[25:13]});
+      end
+      else begin
+        push({3'b101, d[12:0]});
+        push({3'b101, d[25:13]});
+        push({3'b100, {7{d[31]}}, d[31:26]});
+      end
+      last_next = addr;
+    end
+  endtask
+
+  always @ (*) begin : TRACE_PACKETS
+    pk = {16*8{1'b0}};
+    pk_n = 4'd0;
+    map_next = map;
+    last_next = last;
+    // A trap waits for the next clock, at its handler
+    start = enable & ~tracing & ~trace_trap;
+    stop = ~enable & tracing;
+    if (start) begin
+      push({2'b11, CTRL_SYNC, 9'b0, lost});
+      last_next = 32'b0;
+      push_addr(trace_pc);
+      map_next = 15'd1;
+    end
+    if (stop) begin
+      push_map;
+      push({2'b11, CTRL_STOP, 10'b0});
+      push_addr(trace_pc);
+    end
+    else if (tracing & trace_trap) begin
+      push_map;
+      push({2'b11, CTRL_TRAP, 10'b0});
+      push_addr(trace_pc);
+      push_addr(trace_target);
+    end
+    else if ((tracing | start) & trace_valid & trace_br) begin
+      map_next = {map_next[13:0], trace_taken};
+      last_next = trace_pc;
+      if (map_next[14]) push_map;
+    end
+    else if ((tracing | start) & trace_valid & trace_jr) begin
+      push_map;
+      last_next = trace_pc;
+      push_addr(trace_target);
+    end
+  end
+
+  assign fifo_count = wp - rp;
+  assign fifo_full = fifo_count[FIFO_DEPTH_LOG];
+  assign fifo_empty = fifo_count == {(FIFO_DEPTH_LOG+1){1'b0}};
+
+  assign stage_pop = (stage_n != 5'd0) & ~fifo_full;
+  assign stage_kept = stage_n - {4'd0, stage_pop};
+  assign stage_fits = stage_kept + {1'b0, pk_n} <= STAGE;
+
+  always @ (posedge clk) begin : TRACE_ENCODER
+    if (!resetb) begin
+      enable <= 1'b0;
+      tracing <= 1'b0;
+      lost <= 1'b0;
+      overflow <= 1'b0;
+      map <= 15'd1;
+      last <= 32'b0;
+      stage_n <= 5'd0;
+      wp <= {(FIFO_DEPTH_LOG+1){1'b0}};
+    end
+    else if (clk) begin
+      if (io_stb & io_we & (io_addr_3_2 == 2'b10)) enable <= io_din[0];
+      if (io_stb & io_we & (io_addr_3_2 == 2'b01) & io_din[1])
+        overflow <= 1'b0;
+      if (stage_pop) begin
+        fifo[wp[FIFO_DEPTH_LOG-1:0]] <= stage[15:0];
+        wp <= wp + 1'b1;
+      end
+      if (stage_fits) begin
+        stage <= (stage >> (stage_pop ? 16 : 0))
+                 | ({{16*(STAGE-8){1'b0}}, pk} << (16*stage_kept));
+        stage_n <= stage_kept + {1'b0, pk_n};
+        map <= map_next;
+        last <= last_next;
+        tracing <= start | (tracing & ~stop);
+        if (start) lost <= 1'b0;
+      end
+      else begin
+        // Dropped, started again with a SYNC
+        stage <= stage >> (stage_pop ? 16 : 0);
+        stage_n <= stage_kept;
+        map <= 15'd1;
+        tracing <= 1'b0;
+        lost <= 1'b1;
+        overflow <= 1'b1;
+      end
+    end
+  end
+
+  assign head_pop = io_stb & ~io_we & (io_addr_3_2 == 2'b00) & head_valid;
+  assign io_stall = (io_addr_3_2 == 2'b00) & ~head_valid &
+                    (~fifo_empty | (stage_n != 5'd0));
+
+  always @ (posedge clk) begin : TRACE_FIFO_READ
+    if (!resetb) begin
+      rp <= {(FIFO_DEPTH_LOG+1){1'b0}};
+      head_valid <= 1'b0;
+    end
+    else if (clk) begin
+      if (~head_valid & ~fifo_empty) begin
+        head <= fifo[rp[FIFO_DEPTH_LOG-1:0]];
+        rp <= rp + 1'b1;
+        head_valid <= 1'b1;
+      end
+      else if (head_pop) begin
+        head_valid <= 1'b0;
+      end
+    end
+  end
+
+  always @ (*) begin : TRACE_REGISTER_READ
+    case (io_addr_3_2)
+      2'b00: io_dout = {~head_valid, 15'b0, head};
+      2'b01: io_dout = {7'b0, fifo_count + {{FIFO_DEPTH_LOG{1'b0}}, head_valid},
+                        13'b0, tracing, overflow,
+                        ~head_valid & fifo_empty & (stage_n == 5'd0)};
+      2'b10: io_dout = {31'b0, enable};
+      default: io_dout = 32'b0;
+    endcase
+  end
+
+endmodule
@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+"""Rebuild the PC flow of hart 0 from the packets of trace.v
+
+Usage: trace_decode.py program trace
+
+program is an ELF, or a .bin loaded at 0. trace holds the packets read
+from DATA, as little endian halfwords, or as text with one hex packet a
+line. Every PC executed is printed, with the SYNC, TRAP and STOP packets
+between them.
+"""
+
+import struct
+import sys
+
+CTRL_SYNC = 0
+CTRL_TRAP = 1
+CTRL_STOP = 2
+
+# Straight code walked without a packet, before giving up
+MAX_WALK = 1 << 20
+
+
+class TraceError(Exception):
+    pass
+
+
+def load(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    mem = {}
+    if data[:4] != b'\x7fELF':
+        for i, b in enumerate(data):
+            mem[i] = b
+        return mem
+    if data[4] != 1 or data[5] != 1:
+        sys.exit(f"{path}: not a little endian ELF32")
+    phoff, = struct.unpack_from('<I', data, 28)
+    phentsize, phnum = struct.unpack_from('<HH', data, 42)
+    for i in range(phnum):
+        p_type, p_offset, _, p_paddr, p_filesz = \
+            struct.unpack_from('<IIIII', data, phoff + i * phentsize)
+        if p_type != 1:
+            continue
+        for j in range(p_filesz):
+            mem[p_paddr + j] = data[p_offset + j]
+    return mem
+
+
+def read_packets(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    try:
+        text = data.decode('ascii')
+        words = text.split()
+        return [int(w, 16) & 0xFFFF for w in words]
+    except (UnicodeDecodeError, ValueError):
+        pass
+    if len(data) % 2:
+        sys.exit(f"{path}: odd number of bytes")
+    return list(struct.unpack(f'<{len(data) // 2}H', data))
+
+
+def sext(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+def fetch(mem, pc):
+    try:
+        low = mem[pc] | mem[pc + 1] << 8
+        if low & 3 != 3:
+            return low, 2
+        return low | (mem[pc + 2] | mem[pc + 3] << 8) << 16, 4
+    except KeyError:
+        raise TraceError(f"PC 0x{pc:08x} is out of the program")
+
+
+def decode(insn, size):
+    """Kind of control transfer, 'br', 'jump', 'jr' or None, and the
+    target of a direct one"""
+    if size == 4:
+        opcode = insn & 0x7F
+        if opcode == 0x63:
+            imm = (insn >> 31 & 1) << 12 | (insn >> 7 & 1) << 11 | \
+                (insn >> 25 & 0x3F) << 5 | (insn >> 8 & 0xF) << 1
+            return 'br', sext(imm, 13)
+        if opcode == 0x6F:
+            imm = (insn >> 31 & 1) << 20 | (insn >> 12 & 0xFF) << 12 | \
+                (insn >> 20 & 1) << 11 | (insn >> 21 & 0x3FF) << 1
+            return 'jump', sext(imm, 21)
+        if opcode == 0x67 or insn == 0x30200073:
+            return 'jr', 0
+        return None, 0
+    quadrant = insn & 3
+    funct3 = insn >> 13
+    if quadrant == 1 and funct3 in (1, 5):
+        # C.JAL, C.J
+        imm = (insn >> 12 & 1) << 11 | (insn >> 11 & 1) << 4 | \
+            (insn >> 9 & 3) << 8 | (insn >> 8 & 1) << 10 | \
+            (insn >> 7 & 1) << 6 | (insn >> 6 & 1) << 7 | \
+            (insn >> 3 & 7) << 1 | (insn >> 2 & 1) << 5
+        return 'jump', sext(imm, 12)
+    if quadrant == 1 and funct3 in (6, 7):
+        # C.BEQZ, C.BNEZ
+        imm = (insn >> 12 & 1) << 8 | (insn >> 10 & 3) << 3 | \
+            (insn >> 5 & 3) << 6 | (insn >> 3 & 3) << 1 | \
+            (insn >> 2 & 1) << 5
+        return 'br', sext(imm, 9)
+    if quadrant == 2 and funct3 == 4 and insn >> 7 & 0x1F and \
+       not insn >> 2 & 0x1F:
+        # C.JR, C.JALR
+        return 'jr', 0
+    return None, 0
+
+
+class Decoder:
+    def __init__(self, mem, packets):
+        self.mem = mem
+        self.packets = packets
+        self.pos = 0
+        self.bits = []
+        self.last = 0
+        self.pc = None
+
+    def peek(self):
+        if self.pos >= len(self.packets):
+            return None
+        return self.packets[self.pos]
+
+    def take(self):
+        p = self.peek()
+        if p is None:
+            raise TraceError("trace ends in an address")
+        self.pos += 1
+        return p
+
+    def address(self, commit=True):
+        # Chunks of 13 bits, lowest first, m set on all but the last
+        pos, delta, shift = self.pos, 0, 0
+        while True:
+            p = self.take()
+            if p >> 14 != 2:
+                raise TraceError(f"packet 0x{p:04x} is not an address")
+            delta |= (p & 0x1FFF) << shift
+            shift += 13
+            if not p & 0x2000:
+                break
+        addr = (self.last + 2 * sext(delta, shift)) & 0xFFFFFFFF
+        if commit:
+            self.last = addr
+        else:
+            self.pos = pos
+        return addr
+
+    def control(self):
+        """Type of the control packet next, once the branch map is
+        used up, and its PC"""
+        p = self.peek()
+        if self.bits or p is None or p >> 14 != 3:
+            return None, None
+        ctrl = p >> 10 & 0xF
+        if ctrl == CTRL_SYNC:
+            return ctrl, None
+        self.pos += 1
+        x = self.address(commit=False)
+        self.pos -= 1
+        return ctrl, x
+
+    def sync(self):
+        p = self.take()
+        if p >> 14 != 3 or p >> 10 & 0xF != CTRL_SYNC:
+            raise TraceError(f"packet 0x{p:04x} is not a SYNC")
+        self.last = 0
+        self.pc = self.address()
+        self.bits = []
+        print("SYNC, packets lost" if p & 1 else "SYNC")
+
+    def outcome(self):
+        if not self.bits:
+            p = self.peek()
+            if p is None or p >> 15:
+                return None
+            self.pos += 1
+            # Below the highest 1, oldest first
+            n = p.bit_length() - 1
+            self.bits = [p >> i & 1 for i in range(n - 1, -1, -1)]
+        return self.bits.pop(0)
+
+    def walk(self):
+        for _ in range(MAX_WALK):
+            ctrl, x = self.control()
+            if ctrl == CTRL_SYNC:
+                # Dropped on overflow, or after a STOP
+                self.sync()
+                continue
+            if ctrl is not None and x == self.pc:
+                self.pos += 1
+                self.address()
+                if ctrl == CTRL_TRAP:
+                    self.pc = self.address()
+                    print(f"TRAP to 0x{self.pc:08x}")
+                    continue
+                if ctrl == CTRL_STOP:
+                    print("STOP")
+                    if self.peek() is None:
+                        return
+                    self.sync()
+                    continue
+                raise TraceError(f"unknown control {ctrl}")
+            insn, size = fetch(self.mem, self.pc)
+            kind, offset = decode(insn, size)
+            if kind == 'br':
+                taken = self.outcome()
+                if taken is None:
+                    return
+                print(f"0x{self.pc:08x}" + (" taken" if taken else ""))
+                self.last = self.pc
+                self.pc += offset if taken else size
+            elif kind == 'jr':
+                if self.peek() is None:
+                    return
+                print(f"0x{self.pc:08x}")
+                self.last = self.pc
+                self.pc = self.address()
+            else:
+                print(f"0x{self.pc:08x}")
+                self.pc += offset if kind == 'jump' else size
+            self.pc &= 0xFFFFFFFF
+        raise TraceError(f"no packet for {MAX_WALK} instructions")
+
+    def run(self):
+        self.sync()
+        self.walk()
+        if self.pos != len(self.packets):
+            raise TraceError(f"{len(self.packets) - self.pos} packets left")
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    d = Decoder(load(sys.argv[1]), read_packets(sys.argv[2]))
+    try:
+        d.run()
+    except TraceError as e:
+        sys.exit(f"{sys.argv[2]}: packet {d.pos}: {e}")
+
+
+if __name__ == '__main__':
+    main()
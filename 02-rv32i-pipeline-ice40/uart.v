@@ -0,0 +1,215 @@
+/*
+ * UART, 8N1, with TX and RX FIFOs, sitting on IO address space
+ * DATA   - 0x80000060, write pushes a byte to the TX FIFO, dropped when
+ *          full. Read pops a byte of the RX FIFO into [7:0], [31] is set
+ *          when the FIFO was empty
+ * STATUS - 0x80000064, [0] TX full, [1] TX empty and idle, [2] RX empty,
+ *          [3] RX full, [4] RX overrun, cleared by writing 1,
+ *          [12:8] TX count, [20:16] RX count
+ * CTRL   - 0x80000068, [0] TX interrupt enable, [1] RX interrupt enable,
+ *          [12:8] TX watermark, [20:16] RX watermark
+ * DIV    - 0x8000006C, [15:0] clocks per bit minus 1. RX needs 1 or more
+ *
+ * irq_uart is pending while TX count < TX watermark, or RX count > RX
+ * watermark, with the interrupt enabled. A byte received while the RX
+ * FIFO is full is dropped and sets overrun. RX samples each bit at its
+ * middle, after a two flip-flop synchronizer.
+ */
+
+module uart(
+  input wire clk,
+  input wire resetb,
+  // Register port, io_stb is the clock of the access
+  input wire [3:2] io_addr_3_2,
+  input wire io_stb,
+  input wire io_we,
+  /* verilator lint_off UNUSED */
+  input wire [31:0] io_din,
+  /* verilator lint_on UNUSED */
+  output reg [31:0] io_dout,
+  // Serial lines
+  output reg uart_tx,
+  input wire uart_rx,
+  // IRQ
+  output wire irq_uart
+  );
+
+  // 115200 baud at 12 MHz
+  parameter DIV_RESET = 16'd103;
+
+  // 16 bytes each
+  localparam FIFO_DEPTH_LOG = 4;
+
+  reg [7:0] tx_fifo [0:15];
+  reg [7:0] rx_fifo [0:15];
+  // Pointers have one more bit to tell full from empty
+  reg [FIFO_DEPTH_LOG:0] tx_wp, tx_rp, rx_wp, rx_rp;
+  wire [FIFO_DEPTH_LOG:0] tx_count;
+  wire [FIFO_DEPTH_LOG:0] rx_count /*verilator public*/;
+  wire tx_full, tx_empty, rx_full, rx_empty;
+  wire tx_push, rx_pop;
+
+  reg [15:0] div /*verilator public*/;
+  reg tx_ie, rx_ie;
+  reg [FIFO_DEPTH_LOG:0] tx_wm, rx_wm;
+  reg rx_overrun;
+
+  // Transmitter: data and stop bits left, clocks left of the bit
+  reg tx_busy /*verilator public*/;
+  reg [8:0] tx_shift;
+  reg [3:0] tx_bits;
+  reg [15:0] tx_baud;
+
+  // Receiver: 0 start bit, 1-8 data bits, 9 stop bit
+  reg [1:0] rx_sync;
+  reg rx_busy /*verilator public*/;
+  reg [7:0] rx_shift;
+  reg [3:0] rx_bits;
+  reg [15:0] rx_baud;
+  wire rx_in;
+
+  assign tx_count = tx_wp - tx_rp;
+  assign rx_count = rx_wp - rx_rp;
+  assign tx_full = tx_count[FIFO_DEPTH_LOG];
+  assign tx_empty = tx_count == 5'd0;
+  assign rx_full = rx_count[FIFO_DEPTH_LOG];
+  assign rx_empty = rx_count == 5'd0;
+  assign tx_push = io_stb & io_we & (io_addr_3_2 == 2'b00) & ~tx_full;
+  assign rx_pop = io_stb & ~io_we & (io_addr_3_2 == 2'b00) & ~rx_empty;
+  assign rx_in = rx_sync[1];
+
+  assign irq_uart = (tx_ie & (tx_count < tx_wm))
+    | (rx_ie & (rx_count > rx_wm));
+
+  always @ (posedge clk) begin : UART_REGISTERS
+    if (!resetb) begin
+      tx_wp <= 5'd0;
+      rx_rp <= 5'd0;
+      div <= DIV_RESET;
+      tx_ie <= 1'b0;
+      rx_ie <= 1'b0;
+      tx_wm <= 5'd0;
+      rx_wm <= 5'd0;
+    end
+    else if (clk) begin
+      if (tx_push) begin
+        tx_fifo[tx_wp[FIFO_DEPTH_LOG-1:0]] <= io_din[7:0];
+        tx_wp <= tx_wp + 5'd1;
+      end
+      if (rx_pop) rx_rp <= rx_rp + 5'd1;
+      if (io_stb & io_we) begin
+        case (io_addr_3_2)
+          2'b10: begin
+            tx_ie <= io_din[0];
+            rx_ie <= io_din[1];
+            tx_wm <= io_din[8+:FIFO_DEPTH_LOG+1];
+            rx_wm <= io_din[16+:FIFO_DEPTH_LOG+1];
+          end
+          2'b11: div <= io_din[15:0];
+          default: begin
+          end
+        endcase
+      end
+    end
+  end
+
+  always @ (posedge clk) begin : UART_TRANSMITTER
+    if (!resetb) begin
+      uart_tx <= 1'b1;
+      tx_rp <= 5'd0;
+      tx_busy <= 1'b0;
+      tx_shift <= 9'b0;
+      tx_bits <= 4'd0;
+      tx_baud <= 16'd0;
+    end
+    else if (clk) begin
+      if (!tx_busy) begin
+        if (!tx_empty) begin
+          // Start bit
+          uart_tx <= 1'b0;
+          tx_shift <= {1'b1, tx_fifo[tx_rp[FIFO_DEPTH_LOG-1:0]]};
+          tx_rp <= tx_rp + 5'd1;
+          tx_bits <= 4'd9;
+          tx_baud <= div;
+          tx_busy <= 1'b1;
+        end
+      end
+      else if (tx_baud != 16'd0) begin
+        tx_baud <= tx_baud - 16'd1;
+      end
+      else if (tx_bits == 4'd0) begin
+        // End of the stop bit
+        tx_busy <= 1'b0;
+      end
+      else begin
+        uart_tx <= tx_shift[0];
+        tx_shift <= {1'b1, tx_shift[8:1]};
+        tx_bits <= tx_bits - 4'd1;
+        tx_baud <= div;
+      end
+    end
+  end
+
+  always @ (posedge clk) begin : UART_RECEIVER
+    if (!resetb) begin
+      rx_sync <= 2'b11;
+      rx_wp <= 5'd0;
+      rx_busy <= 1'b0;
+      rx_shift <= 8'b0;
+      rx_bits <= 4'd0;
+      rx_baud <= 16'd0;
+      rx_overrun <= 1'b0;
+    end
+    else if (clk) begin
+      rx_sync <= {rx_sync[0], uart_rx};
+      if (io_stb & io_we & (io_addr_3_2 == 2'b01) & io_din[4])
+        rx_overrun <= 1'b0;
+      if (!rx_busy) begin
+        if (!rx_in) begin
+          // Falling edge of the start bit, wait for its middle
+          rx_busy <= 1'b1;
+          rx_bits <= 4'd0;
+          rx_baud <= {1'b0, div[15:1]};
+        end
+      end
+      else if (rx_baud != 16'd0) begin
+        rx_baud <= rx_baud - 16'd1;
+      end
+      else begin
+        rx_baud <= div;
+        rx_bits <= rx_bits + 4'd1;
+        if (rx_bits == 4'd0) begin
+          // A glitch, not a start bit
+          if (rx_in) rx_busy <= 1'b0;
+        end
+        else if (rx_bits != 4'd9) begin
+          rx_shift <= {rx_in, rx_shift[7:1]};
+        end
+        else begin
+          rx_busy <= 1'b0;
+          // Framing errors are dropped
+          if (rx_in) begin
+            if (rx_full) begin
+              rx_overrun <= 1'b1;
+            end
+            else begin
+              rx_fifo[rx_wp[FIFO_DEPTH_LOG-1:0]] <= rx_shift;
+              rx_wp <= rx_wp + 5'd1;
+            end
+          end
+        end
+      end
+    end
+  end
+
+  always @ (*) begin : UART_REGISTER_READ
+    case (io_addr_3_2)
+      2'b00: io_dout = {rx_empty, 23'b0, rx_fifo[rx_rp[FIFO_DEPTH_LOG-1:0]]};
+      2'b01: io_dout = {11'b0, rx_count, 3'b0, tx_count, 3'b0, rx_overrun,
+                        rx_full, rx_empty, tx_empty & ~tx_busy, tx_full};
+      2'b10: io_dout = {11'b0, rx_wm, 3'b0, tx_wm, 6'b0, rx_ie, tx_ie};
+      default: io_dout = {16'b0, div};
+    endcase
+  end
+
+endmodule
@@ -0,0 +1,179 @@
+#ifndef __UART_MODEL_H__
+#define __UART_MODEL_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <iostream>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+// Host end of the UART in uart.v. The TX line is decoded and the RX line
+// driven at the divisor the firmware programmed, clock by clock. Bytes
+// come from and go to a pty, or a pair of files. Reads never block, so
+// the simulation runs at full speed while the host is idle. Input is
+// read in chunks, and looked for at most once a frame while there is
+// none. A byte is only sent while the RX FIFO has room for it, like
+// hardware flow control, so input longer than the FIFO is not lost
+class uart_model_t
+{
+public:
+  uart_model_t() {}
+
+  ~uart_model_t()
+  {
+    if (in_fd >= 0 && in_fd != out_fd) close(in_fd);
+    if (out_fd >= 0) close(out_fd);
+  }
+
+  // A new pty, its name is printed for e.g. screen or picocom
+  bool open_pty()
+  {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) return false;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+      cfmakeraw(&tio);
+      tcsetattr(fd, TCSANOW, &tio);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    std::cout << "(MM) UART on " << ptsname(fd) << std::endl;
+    in_fd = out_fd = fd;
+    return true;
+  }
+
+  // Either may be empty. "-" is stdout for output
+  bool open_files(const std::string& in, const std::string& out)
+  {
+    if (!in.empty()) {
+      in_fd = open(in.c_str(), O_RDONLY | O_NONBLOCK);
+      if (in_fd < 0) return false;
+    }
+    if (!out.empty()) {
+      out_fd = (out == "-") ? dup(STDOUT_FILENO)
+	: open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (out_fd < 0) return false;
+    }
+    return true;
+  }
+
+  bool enabled() const { return in_fd >= 0 || out_fd >= 0; }
+
+  // A byte is on the RX line, or waits to go out while the RX FIFO has
+  // room. A byte that waits for the firmware to make room is not
+  bool busy() const { return rx_bit >= 0 || (in_pos < in_len && rx_room); }
+
+  // One clock. rx_room tells if the RX FIFO takes another byte. Returns
+  // the RX line level for the next clock
+  bool tick(bool tx, uint32_t div, bool rx_room)
+  {
+    uint32_t clocks_per_bit = div + 1;
+    this->rx_room = rx_room;
+    decode(tx, clocks_per_bit);
+    return encode(clocks_per_bit);
+  }
+
+  uint64_t tx_bytes = 0;
+  uint64_t rx_bytes = 0;
+
+private:
+  int in_fd = -1;
+  int out_fd = -1;
+  // TX decoder: bit number, -1 while idle, clocks to the next sample
+  int tx_bit = -1;
+  uint32_t tx_count = 0;
+  uint8_t tx_byte = 0;
+  // RX encoder: bit number, -1 while idle, clocks left of the bit
+  int rx_bit = -1;
+  uint32_t rx_count = 0;
+  uint16_t rx_frame = 0;
+  bool rx_room = false;
+  // Input read ahead, clocks to the next look for more
+  uint8_t in_buf[256];
+  ssize_t in_pos = 0;
+  ssize_t in_len = 0;
+  uint32_t in_wait = 0;
+
+  void decode(bool tx, uint32_t clocks_per_bit)
+  {
+    if (tx_bit < 0) {
+      if (tx) return;
+      // Falling edge of the start bit, sample at the middle of each bit
+      tx_bit = 0;
+      tx_count = (clocks_per_bit - 1) / 2;
+    }
+    if (tx_count != 0) {
+      --tx_count;
+      return;
+    }
+    tx_count = clocks_per_bit - 1;
+    if (tx_bit == 0) {
+      tx_bit = tx ? -1 : 1;
+    }
+    else if (tx_bit <= 8) {
+      tx_byte = (tx_byte >> 1) | (tx ? 0x80 : 0);
+      ++tx_bit;
+    }
+    else {
+      tx_bit = -1;
+      if (tx && out_fd >= 0) {
+	++tx_bytes;
+	if (write(out_fd, &tx_byte, 1) != 1) {
+	  std::cerr << "(MM) UART output failed" << std::endl;
+	}
+      }
+    }
+  }
+
+  // Reads more input unless there is some, or it was looked for within
+  // the last frame. The end of a file closes it, a pty may get more
+  void fill(uint32_t clocks_per_bit)
+  {
+    if (in_pos < in_len || in_fd < 0) return;
+    if (in_wait != 0) {
+      --in_wait;
+      return;
+    }
+    in_wait = 10 * clocks_per_bit;
+    ssize_t n = read(in_fd, in_buf, sizeof(in_buf));
+    if (n > 0) {
+      in_pos = 0;
+      in_len = n;
+    }
+    else if (n == 0 && in_fd != out_fd) {
+      close(in_fd);
+      in_fd = -1;
+    }
+    else if (n < 0 && errno != EAGAIN && errno != EIO) {
+      std::cerr << "(MM) UART input failed" << std::endl;
+      if (in_fd != out_fd) close(in_fd);
+      in_fd = -1;
+    }
+  }
+
+  bool encode(uint32_t clocks_per_bit)
+  {
+    if (rx_bit < 0) {
+      fill(clocks_per_bit);
+      if (in_pos == in_len || !rx_room) return true;
+      uint8_t c = in_buf[in_pos++];
+      ++rx_bytes;
+      // Start, data LSB first, stop
+      rx_frame = (1u << 9) | (c << 1);
+      rx_bit = 0;
+      rx_count = clocks_per_bit;
+    }
+    bool level = (rx_frame >> rx_bit) & 1;
+    if (--rx_count == 0) {
+      rx_count = clocks_per_bit;
+      if (++rx_bit == 10) rx_bit = -1;
+    }
+    return level;
+  }
+};
+
+#endif // __UART_MODEL_H__
@@ -0,0 +1,744 @@
+// Loosely timed TLM-2.0 virtual platform of the SoC
+//
+// vp <program> [max instructions] [+quantum=<ns>] [+interp] [+no_dmi]
+//    [+uart_out=<file>|-]
+//
+// The core is iss.h as a TLM initiator, running translated blocks of
+// dbt.h, or the plain interpreter with +interp. It runs ahead of
+// SystemC time by up to the global quantum, 1 us by default, and fetches
+// and loads and stores through DMI pointers to the ROM and main memory,
+// so that only IO accesses are transactions. +no_dmi sends all of them
+// through the bus. Behind the bus, which decodes the memory map of
+// mmu.v, are targets for the ROM, main memory, the timer and the rest of
+// the IO port. The timer interrupt is a signal, which the core sees when
+// it syncs, at the end of a quantum, after an IO store and in WFI.
+//
+// Each instruction is a clock of sysclk of cpu_run. The messages, the
+// (DD) signature and the (SS) statistics are those of iss_run.
+
+#include <systemc.h>
+#include <tlm.h>
+#include <tlm_utils/simple_initiator_socket.h>
+#include <tlm_utils/simple_target_socket.h>
+#include <tlm_utils/tlm_quantumkeeper.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dbt.h"
+#include "iss.h"
+#include "semihost.h"
+
+// ROM or main memory, wrapping at its size. The data port cannot write
+// the ROM, debug accesses can. DMI is granted for all of it, read only
+// for the ROM
+class memory_target_t : public sc_module
+{
+public:
+  tlm_utils::simple_target_socket<memory_target_t> socket;
+  std::vector<uint8_t> data;
+  const bool read_only;
+
+  memory_target_t(sc_module_name name, size_t size, bool read_only,
+		  uint8_t fill)
+    : sc_module(name)
+    , socket("socket")
+    , data(size, fill)
+    , read_only(read_only)
+  {
+    socket.register_b_transport(this, &memory_target_t::b_transport);
+    socket.register_get_direct_mem_ptr(this,
+				       &memory_target_t::get_direct_mem_ptr);
+    socket.register_transport_dbg(this, &memory_target_t::transport_dbg);
+  }
+
+  void b_transport(tlm::tlm_generic_payload& t, sc_time&)
+  {
+    copy(t, false);
+    t.set_dmi_allowed(true);
+  }
+
+  unsigned transport_dbg(tlm::tlm_generic_payload& t)
+  {
+    return copy(t, true);
+  }
+
+  bool get_direct_mem_ptr(tlm::tlm_generic_payload&, tlm::tlm_dmi& dmi)
+  {
+    dmi.set_dmi_ptr(data.data());
+    dmi.set_start_address(0);
+    dmi.set_end_address(data.size() - 1);
+    dmi.set_granted_access(read_only ? tlm::tlm_dmi::DMI_ACCESS_READ
+			   : tlm::tlm_dmi::DMI_ACCESS_READ_WRITE);
+    dmi.set_read_latency(SC_ZERO_TIME);
+    dmi.set_write_latency(SC_ZERO_TIME);
+    return true;
+  }
+
+private:
+  unsigned copy(tlm::tlm_generic_payload& t, bool debug)
+  {
+    uint64_t addr = t.get_address();
+    unsigned char* ptr = t.get_data_ptr();
+    unsigned len = t.get_data_length();
+    unsigned char* be = t.get_byte_enable_ptr();
+    unsigned be_len = t.get_byte_enable_length();
+    for (unsigned i=0; i<len; ++i) {
+      if (be && be[i % be_len] != TLM_BYTE_ENABLED) continue;
+      uint8_t& m = data[(addr + i) % data.size()];
+      if (t.is_read()) ptr[i] = m;
+      else if (!read_only || debug) m = ptr[i];
+    }
+    t.set_response_status(tlm::TLM_OK_RESPONSE);
+    return len;
+  }
+};
+
+// timer.v: mtime counts the clocks of SystemC time, and irq_mtimecmp is
+// high while mtime >= mtimecmp. A write to mtimecmp drops it for a
+// clock, so that a value already in the past raises a new interrupt.
+// Registers are whole words
+class timer_target_t : public sc_module
+{
+public:
+  tlm_utils::simple_target_socket<timer_target_t> socket;
+  sc_signal<bool> irq_mtimecmp;
+
+  SC_HAS_PROCESS(timer_target_t);
+  timer_target_t(sc_module_name name, const sc_time& clock)
+    : sc_module(name)
+    , socket("socket")
+    , irq_mtimecmp("irq_mtimecmp")
+    , clock(clock)
+  {
+    socket.register_b_transport(this, &timer_target_t::b_transport);
+    SC_METHOD(update_irq);
+    sensitive << change;
+  }
+
+  uint64_t mtime(const sc_time& t) const
+  {
+    return static_cast<uint64_t>(t / clock) + mtime_offset;
+  }
+
+  void b_transport(tlm::tlm_generic_payload& t, sc_time& delay)
+  {
+    sc_time now = sc_time_stamp() + delay;
+    uint64_t time = mtime(now);
+    unsigned reg = (t.get_address() >> 2) & 3;
+    uint32_t word;
+    if (t.is_read()) {
+      uint64_t v = (reg < 2) ? time : mtimecmp;
+      word = (reg & 1) ? v >> 32 : v;
+      std::memcpy(t.get_data_ptr(), &word, 4);
+    }
+    else {
+      std::memcpy(&word, t.get_data_ptr(), 4);
+      switch (reg) {
+      case 0: time = (time & ~0xFFFFFFFFull) | word; break;
+      case 1: time = (time & 0xFFFFFFFFull) | static_cast<uint64_t>(word) << 32; break;
+      case 2: mtimecmp = (mtimecmp & ~0xFFFFFFFFull) | word; break;
+      case 3: mtimecmp = (mtimecmp & 0xFFFFFFFFull) | static_cast<uint64_t>(word) << 32; break;
+      }
+      // The value written is read a clock later
+      if (reg < 2) mtime_offset = time - static_cast<uint64_t>((now + clock) / clock);
+      else irq_mtimecmp.write(false);
+      change.cancel();
+      change.notify(delay + clock);
+    }
+    t.set_response_status(tlm::TLM_OK_RESPONSE);
+  }
+
+private:
+  const sc_time clock;
+  uint64_t mtime_offset = 0;
+  uint64_t mtimecmp = 0;
+  sc_event change;
+
+  // Up again when mtime reaches mtimecmp, at most 2^32 clocks ahead
+  void update_irq()
+  {
+    uint64_t time = mtime(sc_time_stamp());
+    bool pending = time >= mtimecmp;
+    irq_mtimecmp.write(pending);
+    if (!pending) {
+      uint64_t n = std::min<uint64_t>(mtimecmp - time, 1ull << 32);
+      change.notify(clock * static_cast<double>(n));
+    }
+  }
+};
+
+// The rest of the IO bus of io_map.txt: the GPIO with the testbench
+// commands of cpu_run, the semihosting doorbell, the scratch words with
+// their wait states and the UART transmitter. The DMA, the second
+// mtimecmp and UART receive are not modelled and read 0. A read takes a
+// clock more than a memory read
+class io_target_t : public sc_module
+{
+public:
+  tlm_utils::simple_target_socket<io_target_t> socket;
+  semihost_t semihost;
+  // UART bytes sent go here, if set
+  FILE* uart_out = nullptr;
+  bool test_halt = false;
+  // RAM byte offset of the compliance signature, 0 before the scan
+  uint32_t signature_base = 0;
+  uint64_t uart_tx_bytes = 0;
+
+  // The memory of the platform, for the signature scan and semihosting,
+  // and the pc of the core, for the fail message
+  std::function<uint8_t(uint32_t)> read_byte;
+  std::function<uint32_t(void)> pc;
+
+  io_target_t(sc_module_name name, const sc_time& clock)
+    : sc_module(name)
+    , socket("socket")
+    , clock(clock)
+  {
+    socket.register_b_transport(this, &io_target_t::b_transport);
+  }
+
+  bool stopped() const { return test_halt || semihost.exited; }
+
+  void b_transport(tlm::tlm_generic_payload& t, sc_time& delay)
+  {
+    uint32_t offset = t.get_address() & 0xFC;
+    unsigned char* be = t.get_byte_enable_ptr();
+    uint32_t word, mask = 0;
+    for (unsigned i=0; i<4; ++i) {
+      if (!be || be[i % t.get_byte_enable_length()] == TLM_BYTE_ENABLED) {
+	mask |= 0xFFu << (8 * i);
+      }
+    }
+    if (t.is_read()) {
+      word = load(offset);
+      std::memcpy(t.get_data_ptr(), &word, 4);
+      delay += clock;
+    }
+    else {
+      std::memcpy(&word, t.get_data_ptr(), 4);
+      store(offset, word, mask);
+    }
+    if (offset == 0x08 || offset == 0x0C) delay += 2 * clock;
+    t.set_response_status(tlm::TLM_OK_RESPONSE);
+  }
+
+private:
+  const sc_time clock;
+  uint32_t gpio = 0;
+  uint32_t scratch[2] = {0, 0};
+  uint32_t uart_ctrl = 0, uart_div = 103;
+
+  uint32_t read_word(uint32_t addr)
+  {
+    uint32_t word = 0;
+    for (int i=0; i<4; ++i) word |= read_byte(addr + i) << (8 * i);
+    return word;
+  }
+
+  uint32_t load(uint32_t offset)
+  {
+    switch (offset) {
+    case 0x00: return gpio & 0xFF;
+    case 0x08: return scratch[0];
+    case 0x0C: return scratch[1];
+    // RX FIFO empty
+    case 0x60: return 0x80000000;
+    // TX empty and idle, RX empty
+    case 0x64: return 0x6;
+    case 0x68: return uart_ctrl;
+    case 0x6C: return uart_div;
+    default: return 0;
+    }
+  }
+
+  void store(uint32_t offset, uint32_t data, uint32_t mask)
+  {
+    switch (offset) {
+    case 0x00:
+      gpio = data;
+      switch (data) {
+      case 0:
+	// The signature starts after the last 0xFFFFFFFF below the
+	// 0xDEADDEAD marker, in the first 4 KiB
+	for (int i=1023, tail=0; i>=0; --i) {
+	  uint32_t word = read_word(0x10000000 + 4 * i);
+	  if (!tail) tail = word == 0xDEADDEAD;
+	  else if (word != 0xFFFFFFFF) {
+	    signature_base = 4 * (i + 1);
+	    break;
+	  }
+	}
+	break;
+      case 1:
+	std::cout << "A test passes!" << std::endl;
+	break;
+      case 2:
+	std::cout << "A test fails at PC=0x" << std::hex << pc() << std::dec
+		  << std::endl;
+	break;
+      case 3:
+	test_halt = true;
+	break;
+      }
+      break;
+    case 0x04:
+      semihost.service(data);
+      break;
+    case 0x08:
+    case 0x0C: {
+      uint32_t& w = scratch[(offset >> 2) & 1];
+      w = (w & ~mask) | (data & mask);
+      break;
+    }
+    case 0x60:
+      ++uart_tx_bytes;
+      if (uart_out) std::fputc(data & 0xFF, uart_out);
+      break;
+    case 0x68:
+      uart_ctrl = data;
+      break;
+    case 0x6C:
+      uart_div = data & 0xFFFF;
+      break;
+    }
+  }
+};
+
+// Decodes the memory map of mmu.v: the ROM, main memory wrapping at
+// 64 KiB, the timer and the rest of the IO bus. Addresses are made
+// local to the target, and DMI ranges global again. Other addresses
+// read 0, and writes to them are ignored
+class bus_t : public sc_module
+{
+public:
+  enum { ROM, RAM, TIMER, IO, TARGETS };
+
+  tlm_utils::simple_target_socket<bus_t> target_socket;
+  tlm_utils::simple_initiator_socket_tagged<bus_t> initiator_socket[TARGETS];
+
+  explicit bus_t(sc_module_name name)
+    : sc_module(name)
+    , target_socket("target_socket")
+  {
+    target_socket.register_b_transport(this, &bus_t::b_transport);
+    target_socket.register_get_direct_mem_ptr(this, &bus_t::get_direct_mem_ptr);
+    target_socket.register_transport_dbg(this, &bus_t::transport_dbg);
+    for (int i=0; i<TARGETS; ++i) {
+      initiator_socket[i].register_invalidate_direct_mem_ptr(
+	this, &bus_t::invalidate_direct_mem_ptr, i);
+    }
+  }
+
+  void b_transport(tlm::tlm_generic_payload& t, sc_time& delay)
+  {
+    uint64_t addr = t.get_address(), offset;
+    int i = decode(addr, offset);
+    if (i < 0) {
+      unmapped(t);
+      return;
+    }
+    t.set_address(offset);
+    initiator_socket[i]->b_transport(t, delay);
+    t.set_address(addr);
+  }
+
+  unsigned transport_dbg(tlm::tlm_generic_payload& t)
+  {
+    uint64_t addr = t.get_address(), offset;
+    int i = decode(addr, offset);
+    if (i < 0) return unmapped(t);
+    t.set_address(offset);
+    unsigned n = initiator_socket[i]->transport_dbg(t);
+    t.set_address(addr);
+    return n;
+  }
+
+  bool get_direct_mem_ptr(tlm::tlm_generic_payload& t, tlm::tlm_dmi& dmi)
+  {
+    uint64_t addr = t.get_address(), offset;
+    int i = decode(addr, offset);
+    if (i < 0) return false;
+    t.set_address(offset);
+    bool granted = initiator_socket[i]->get_direct_mem_ptr(t, dmi);
+    t.set_address(addr);
+    dmi.set_start_address(BASE[i] + dmi.get_start_address());
+    dmi.set_end_address(BASE[i] + dmi.get_end_address());
+    return granted;
+  }
+
+  void invalidate_direct_mem_ptr(int i, sc_dt::uint64 start, sc_dt::uint64 end)
+  {
+    target_socket->invalidate_direct_mem_ptr(BASE[i] + start, BASE[i] + end);
+  }
+
+private:
+  static constexpr uint64_t BASE[TARGETS] = {
+    0x00000000, 0x10000000, 0x80000010, 0x80000000
+  };
+
+  static int decode(uint64_t addr, uint64_t& offset)
+  {
+    uint32_t a = addr;
+    if (iss_t::is_rom(a)) {
+      offset = a & (iss_t::ROM_BYTES - 1);
+      return ROM;
+    }
+    if (iss_t::is_ram(a)) {
+      offset = iss_t::ram_offset(a);
+      return RAM;
+    }
+    if (!iss_t::is_io(a)) return -1;
+    if ((a & 0xF0) == 0x10) {
+      offset = a & 0xF;
+      return TIMER;
+    }
+    offset = a & 0xFF;
+    return IO;
+  }
+
+  static unsigned unmapped(tlm::tlm_generic_payload& t)
+  {
+    if (t.is_read()) std::memset(t.get_data_ptr(), 0, t.get_data_length());
+    t.set_response_status(tlm::TLM_OK_RESPONSE);
+    return t.get_data_length();
+  }
+};
+
+constexpr uint64_t bus_t::BASE[bus_t::TARGETS];
+
+// iss.h as the initiator. Accesses outside of the DMI pointers are
+// transactions, annotated with the time the core has run ahead
+class vp_cpu_t : public sc_module
+{
+public:
+  tlm_utils::simple_initiator_socket<vp_cpu_t> socket;
+  sc_in<bool> irq_mtimecmp;
+  iss_t iss;
+  std::unique_ptr<dbt_t> dbt;
+  // true once the IO port stops the simulation
+  std::function<bool(void)> stopped;
+
+  uint64_t transactions = 0;
+  uint64_t dmi_grants = 0;
+  uint64_t dmi_invalidations = 0;
+  double seconds = 0;
+
+  SC_HAS_PROCESS(vp_cpu_t);
+  vp_cpu_t(sc_module_name name, const sc_time& clock,
+	   uint64_t max_instructions, bool interp, bool use_dmi)
+    : sc_module(name)
+    , socket("socket")
+    , irq_mtimecmp("irq_mtimecmp")
+    , clock(clock)
+    , max_instructions(max_instructions)
+    , use_dmi(use_dmi)
+  {
+    socket.register_invalidate_direct_mem_ptr(
+      this, &vp_cpu_t::invalidate_direct_mem_ptr);
+    SC_THREAD(run);
+
+    // The memory of the platform is behind the socket
+    iss.rom = iss.ram = nullptr;
+    iss.bus_load = [this](uint32_t addr) {
+      return transport(tlm::TLM_READ_COMMAND, addr, 0, ~0u);
+    };
+    iss.bus_store = [this](uint32_t addr, uint32_t data, uint32_t mask) {
+      transport(tlm::TLM_WRITE_COMMAND, addr, data, mask);
+      // So that a write to mtimecmp drops the interrupt before the next
+      // instruction
+      if (iss_t::is_io(addr)) qk.sync();
+      if (stopped && stopped()) iss.test_halt = true;
+      return iss.stopped();
+    };
+    iss.timer_irq = [this]() { return irq_mtimecmp.read(); };
+    if (!interp) dbt.reset(new dbt_t(iss));
+  }
+
+  uint8_t debug_read(uint32_t addr)
+  {
+    uint8_t byte = 0;
+    debug(tlm::TLM_READ_COMMAND, addr, &byte);
+    return byte;
+  }
+
+  void debug_write(uint32_t addr, uint8_t byte)
+  {
+    debug(tlm::TLM_WRITE_COMMAND, addr, &byte);
+  }
+
+private:
+  const sc_time clock;
+  const uint64_t max_instructions;
+  const bool use_dmi;
+  tlm_utils::tlm_quantumkeeper qk;
+  // mcycle up to which the clocks are in the quantum keeper
+  uint64_t counted = 0;
+
+  void run()
+  {
+    qk.reset();
+    acquire_dmi();
+    counted = iss.mcycle();
+    auto start = std::chrono::steady_clock::now();
+    while (!iss.stopped() && iss.instret < max_instructions) {
+      // The rest of the quantum, in instructions
+      sc_time quantum = tlm_utils::tlm_quantumkeeper::get_global_quantum();
+      sc_time local = qk.get_local_time();
+      uint64_t budget = (local < quantum) ? (quantum - local) / clock : 0;
+      budget = std::max<uint64_t>(budget, 1);
+      budget = std::min(budget, max_instructions - iss.instret);
+      if (dbt) dbt->run(budget);
+      else {
+	for (uint64_t n=0; n<budget && !iss.stopped() && !iss.wfi; ++n) {
+	  iss.step();
+	}
+      }
+      account();
+      if (iss.wfi) wait_for_irq();
+      else if (qk.need_sync()) qk.sync();
+    }
+    qk.sync();
+    seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    sc_stop();
+  }
+
+  // Moves the clocks run since the last call into the quantum keeper
+  void account()
+  {
+    qk.inc(clock * static_cast<double>(iss.mcycle() - counted));
+    counted = iss.mcycle();
+  }
+
+  // WFI sleeps until the timer interrupt is pending. The clocks slept
+  // count as cycles, and as skipped cycles, as in iss_run
+  void wait_for_irq()
+  {
+    qk.sync();
+    sc_time start = sc_time_stamp();
+    if (!irq_mtimecmp.read()) wait(irq_mtimecmp.posedge_event());
+    uint64_t slept = static_cast<uint64_t>((sc_time_stamp() - start) / clock);
+    iss.mcycle_offset += slept;
+    iss.skipped_cycles += slept;
+    counted = iss.mcycle();
+    iss.wfi = false;
+    iss.check_irq();
+  }
+
+  uint32_t transport(tlm::tlm_command cmd, uint32_t addr, uint32_t data,
+		     uint32_t mask)
+  {
+    unsigned char be[4];
+    for (int i=0; i<4; ++i) {
+      be[i] = ((mask >> (8 * i)) & 0xFF) ? TLM_BYTE_ENABLED : TLM_BYTE_DISABLED;
+    }
+    tlm::tlm_generic_payload t;
+    t.set_command(cmd);
+    t.set_address(addr);
+    t.set_data_ptr(reinterpret_cast<unsigned char*>(&data));
+    t.set_data_length(4);
+    t.set_streaming_width(4);
+    t.set_byte_enable_ptr(be);
+    t.set_byte_enable_length(4);
+    t.set_dmi_allowed(false);
+    t.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+    account();
+    sc_time before = qk.get_local_time();
+    sc_time delay = before;
+    socket->b_transport(t, delay);
+    qk.inc(delay - before);
+    ++transactions;
+    if (t.is_response_error()) {
+      SC_REPORT_ERROR("vp", t.get_response_string().c_str());
+    }
+    if (t.is_dmi_allowed()) acquire_dmi();
+    return data;
+  }
+
+  void debug(tlm::tlm_command cmd, uint32_t addr, uint8_t* byte)
+  {
+    tlm::tlm_generic_payload t;
+    t.set_command(cmd);
+    t.set_address(addr);
+    t.set_data_ptr(byte);
+    t.set_data_length(1);
+    t.set_streaming_width(1);
+    socket->transport_dbg(t);
+  }
+
+  // The ISS wraps its ROM and main memory addresses, so a pointer must
+  // cover all of it
+  uint8_t* dmi_pointer(uint32_t addr, uint32_t size, bool write)
+  {
+    tlm::tlm_generic_payload t;
+    t.set_command(write ? tlm::TLM_WRITE_COMMAND : tlm::TLM_READ_COMMAND);
+    t.set_address(addr);
+    tlm::tlm_dmi dmi;
+    if (!socket->get_direct_mem_ptr(t, dmi)) return nullptr;
+    if (dmi.get_start_address() != addr
+	|| dmi.get_end_address() < addr + size - 1
+	|| !(write ? dmi.is_read_write_allowed() : dmi.is_read_allowed())) {
+      return nullptr;
+    }
+    ++dmi_grants;
+    return dmi.get_dmi_ptr();
+  }
+
+  void acquire_dmi()
+  {
+    if (!use_dmi) return;
+    if (!iss.rom) iss.rom = dmi_pointer(0, iss_t::ROM_BYTES, false);
+    if (!iss.ram) iss.ram = dmi_pointer(0x10000000, iss_t::RAM_BYTES, true);
+  }
+
+  void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end)
+  {
+    ++dmi_invalidations;
+    if (start < iss_t::ROM_BYTES) iss.rom = nullptr;
+    if (start < 0x10000000 + iss_t::RAM_BYTES && end >= 0x10000000) {
+      iss.ram = nullptr;
+    }
+  }
+};
+
+////////////////////////
+
+// The ROM gets the first 2 KiB of the program, as in cpu_run
+static bool load_program(memory_target_t& rom, const std::string& path)
+{
+  std::ifstream f(path, std::ios::binary);
+  if (!f.is_open()) return false;
+  f.seekg(0, f.end);
+  size_t size = f.tellg();
+  if (size == 0 || size > 0x100000 || size % 2 != 0) return false;
+  f.seekg(0, f.beg);
+  std::string buf(size, '\0');
+  f.read(&buf[0], size);
+  std::fill(rom.data.begin(), rom.data.end(), 0);
+  std::memcpy(rom.data.data(), buf.data(), std::min(size, rom.data.size()));
+  return true;
+}
+
+int sc_main(int argc, char** argv)
+{
+  std::vector<std::string> args;
+  double quantum_ns = 1000;
+  bool interp = false;
+  bool use_dmi = true;
+  std::string uart_out;
+  for (int i=1; i<argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "+interp") interp = true;
+    else if (arg == "+no_dmi") use_dmi = false;
+    else if (arg.rfind("+quantum=", 0) == 0) quantum_ns = std::stod(arg.substr(9));
+    else if (arg.rfind("+uart_out=", 0) == 0) uart_out = arg.substr(10);
+    else if (arg[0] != '+') args.push_back(arg);
+  }
+  if (args.size() != 1 && args.size() != 2) {
+    std::cerr << "Usage: vp <program> [max instructions] [+quantum=<ns>] "
+	      << "[+interp] [+no_dmi] [+uart_out=<file>|-]" << std::endl;
+    return 1;
+  }
+  uint64_t max_instructions = (args.size() == 2) ? std::stoull(args[1]) : 4096;
+
+  FILE* uart_file = nullptr;
+  if (uart_out == "-") uart_file = stdout;
+  else if (!uart_out.empty()) {
+    uart_file = std::fopen(uart_out.c_str(), "wb");
+    if (!uart_file) {
+      std::cerr << "UART open failed!" << std::endl;
+      return 1;
+    }
+  }
+
+  tlm::tlm_global_quantum::instance().set(sc_time(quantum_ns, SC_NS));
+  // sysclk of cpu_run
+  sc_time clock(10, SC_NS);
+
+  memory_target_t rom("rom", iss_t::ROM_BYTES, true, 0);
+  // As cpu_run fills the memory
+  memory_target_t ram("ram", iss_t::RAM_BYTES, false, 0xAA);
+  timer_target_t timer("timer", clock);
+  io_target_t io("io", clock);
+  bus_t bus("bus");
+  vp_cpu_t cpu("cpu", clock, max_instructions, interp, use_dmi);
+
+  cpu.socket.bind(bus.target_socket);
+  bus.initiator_socket[bus_t::ROM].bind(rom.socket);
+  bus.initiator_socket[bus_t::RAM].bind(ram.socket);
+  bus.initiator_socket[bus_t::TIMER].bind(timer.socket);
+  bus.initiator_socket[bus_t::IO].bind(io.socket);
+  cpu.irq_mtimecmp(timer.irq_mtimecmp);
+
+  io.uart_out = uart_file;
+  io.read_byte = [&](uint32_t addr) { return cpu.debug_read(addr); };
+  io.pc = [&]() { return cpu.iss.pc; };
+  io.semihost.read_byte = io.read_byte;
+  io.semihost.write_byte = [&](uint32_t addr, uint8_t byte) {
+    if (iss_t::is_ram(addr)) cpu.debug_write(addr, byte);
+  };
+  io.semihost.clocks = [&]() { return cpu.iss.mcycle(); };
+  cpu.stopped = [&]() { return io.stopped(); };
+
+  if (!load_program(rom, args[0] + ".bin")) {
+    std::cerr << "Program load failed!" << std::endl;
+    return 1;
+  }
+
+  sc_start();
+
+  const iss_t& s = cpu.iss;
+  if (io.test_halt) std::cout << "End of the test." << std::endl;
+  if (io.semihost.exited) {
+    std::cout << "Exit with code " << io.semihost.exit_code << std::endl;
+  }
+  if (s.deadlock) {
+    std::cout << "WFI with no interrupt to wait for at PC=0x" << std::hex
+	      << s.pc << std::dec << std::endl;
+  }
+  // The words from the signature base up to 0xDEADDEAD, see cpu_run
+  for (uint32_t i = io.signature_base; io.signature_base && i + 4 <= 4096; i += 4) {
+    uint32_t word;
+    std::memcpy(&word, &ram.data[i], 4);
+    if (word == 0xDEADDEAD) break;
+    std::cout << "(DD) " << std::hex << std::setfill('0') << std::setw(8)
+	      << word << std::dec << std::endl;
+  }
+
+  std::cout << "(SS) Instructions: " << s.instret << std::endl;
+  std::cout << "(SS) Cycles: " << s.mcycle() << std::endl;
+  std::cout << "(SS) Skipped idle cycles: " << s.skipped_cycles << std::endl;
+  std::cout << "(SS) Traps: " << s.traps << std::endl;
+  std::cout << "(SS) Interrupts: " << s.interrupts << std::endl;
+  if (cpu.dbt) {
+    std::cout << "(SS) Translations: " << cpu.dbt->translations << std::endl;
+    std::cout << "(SS) Blocks run: " << cpu.dbt->blocks_run << std::endl;
+  }
+  std::cout << "(SS) Bus transactions: " << cpu.transactions << std::endl;
+  std::cout << "(SS) DMI grants: " << cpu.dmi_grants << std::endl;
+  std::cout << "(SS) DMI invalidations: " << cpu.dmi_invalidations << std::endl;
+  if (io.semihost.requests != 0) {
+    std::cout << "(SS) Semihosting requests: " << io.semihost.requests
+	      << std::endl;
+  }
+  if (io.uart_tx_bytes != 0) {
+    std::cout << "(SS) UART TX bytes: " << io.uart_tx_bytes << std::endl;
+  }
+  std::cout << "(SS) Simulated time: " << sc_time_stamp() << std::endl;
+  std::cout << "(SS) MIPS: " << std::fixed << std::setprecision(2)
+	    << s.instret / cpu.seconds / 1e6 << std::endl;
+
+  if (uart_file && uart_file != stdout) std::fclose(uart_file);
+  return io.semihost.exit_code;
+}
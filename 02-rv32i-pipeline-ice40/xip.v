@@ -0,0 +1,292 @@
+/*
+ * Execute in place from SPI flash, with an instruction cache
+ *
+ * The fetch port works like the ROM: the word at fetch_addr is on
+ * fetch_data one clock later, and fetch_hit tells if it is valid. On a
+ * miss, the core keeps the same address until it hits. The cache is
+ * direct mapped, 32 lines of 8 words in EBR. A miss fills the whole
+ * line from its first word, and each word hits as soon as it is
+ * written, so the core does not wait for the rest of the line.
+ *
+ * The flash is read with Dual I/O Fast Read (BBh), or with Quad I/O
+ * Fast Read (EBh) when QUAD = 1, in continuous read mode: only the
+ * first read after reset sends the command, later ones begin with the
+ * address. SCK is half the clock, SPI mode 0. At reset, 16 clocks of
+ * all ones take the flash out of continuous read mode, in case it was
+ * left there.
+ *
+ * A read is not ended when its line is filled. SCK stops with CS# low,
+ * and the next line is read without a new address if it is wanted: on
+ * a miss to it, or with PREFETCH = 1 as soon as the core fetches from
+ * the line just filled. A miss to any other line ends the read, also
+ * in the middle of a line, and that line is left invalid.
+ */
+
+module xip(
+  input wire clk,
+  input wire resetb,
+  // Fetch port, fetch_sel when fetch_addr is in the XIP window
+  input wire fetch_sel,
+  input wire [23:2] fetch_addr,
+  output reg fetch_p /*verilator public*/,
+  output reg [31:0] fetch_data,
+  output wire fetch_hit /*verilator public*/,
+  // SPI flash
+  output reg flash_csb,
+  output reg flash_clk,
+  output reg [3:0] flash_io_oe,
+  output reg [3:0] flash_io_do,
+  /* verilator lint_off UNUSED */
+  input wire [3:0] flash_io_di
+  /* verilator lint_on UNUSED */
+  );
+
+  // 0 for Dual I/O, 1 for Quad I/O. Quad needs the QE bit set in the
+  // flash, and IO2/IO3 wired
+  parameter QUAD = 0;
+  // Read the next line while the core runs the one just filled
+  parameter PREFETCH = 1;
+
+  localparam W = QUAD ? 4 : 2;
+  localparam [7:0] READ_CMD = QUAD ? 8'hEB : 8'hBB;
+  // Mode bits M5-4 = 10 keep the flash in continuous read mode
+  localparam [7:0] MODE_CONT = 8'hA0;
+  // SCK cycles of address and mode bits, of dummy cycles, of a word
+  localparam [4:0] ADDR_CLKS = QUAD ? 5'd8 : 5'd16;
+  localparam [4:0] DUMMY_CLKS = QUAD ? 5'd4 : 5'd0;
+  localparam [4:0] WORD_CLKS = QUAD ? 5'd8 : 5'd16;
+  // Data lines, and WP# and HOLD# held high in dual mode
+  localparam [3:0] DATA_OE = QUAD ? 4'b1111 : 4'b0011;
+  localparam [3:0] HOLD_OE = QUAD ? 4'b0000 : 4'b1100;
+
+  localparam [2:0]
+    S_RESET = 3'd0,
+    S_IDLE = 3'd1,
+    S_CMD = 3'd2,
+    S_ADDR = 3'd3,
+    S_DUMMY = 3'd4,
+    S_DATA = 3'd5,
+    S_PAUSE = 3'd6;
+
+  // Tag is the rest of the 16 MB flash address
+  reg [31:0] cache_data [0:255];
+  reg [13:0] cache_tag [0:31];
+  reg [31:0] tag_valid;
+
+  // Fetch, pipelined: address, tag and valid bit of its line, and if
+  // its word was already filled by the read in progress
+  reg [23:2] addr_p;
+  reg [13:0] tag_p;
+  reg valid_p;
+  reg fill_hit_p;
+  wire miss;
+  wire [23:5] req_line;
+
+  // SPI read: state, SCK cycles in the state, bits out and in
+  reg [2:0] state;
+  reg [4:0] clks;
+  reg [31:0] shift_out;
+  /* verilator lint_off UNUSED */
+  reg [31:0] shift_in;
+  /* verilator lint_on UNUSED */
+  wire [31:0] word_in;
+  // The flash is in continuous read mode
+  reg cont_mode;
+  // Line being filled, or read next while paused, and its words
+  reg [23:5] fill_line;
+  reg filling /*verilator public*/;
+  reg fill_prefetch /*verilator public*/;
+  reg [7:0] fill_valid;
+  reg [2:0] fill_word;
+  wire word_done;
+  wire line_done /*verilator public*/;
+  // The core fetches from the line just filled
+  wire follow;
+
+  assign req_line = addr_p[23:5];
+  assign fetch_hit = fetch_p & ((valid_p & (tag_p == addr_p[23:10]))
+                                | fill_hit_p);
+  assign miss = fetch_p & ~fetch_hit;
+  assign follow = (PREFETCH != 0) & fetch_hit
+                  & (req_line == fill_line - 19'd1);
+  assign word_in = {shift_in[31-W:0], flash_io_di[W-1:0]};
+  assign word_done = (state == S_DATA) & flash_clk
+                     & (clks == WORD_CLKS - 5'd1);
+  assign line_done = word_done & (fill_word == 3'd7);
+
+  always @ (posedge clk) begin : XIP_CACHE
+    // Bytes come in at increasing addresses, the first one is the LSB
+    if (word_done)
+      cache_data[{fill_line[9:5], fill_word}]
+        <= {word_in[7:0], word_in[15:8], word_in[23:16], word_in[31:24]};
+    if (line_done)
+      cache_tag[fill_line[9:5]] <= fill_line[23:10];
+    fetch_data <= cache_data[fetch_addr[9:2]];
+    tag_p <= cache_tag[fetch_addr[9:5]];
+  end
+
+  always @ (posedge clk) begin : XIP_FETCH
+    if (!resetb) begin
+      fetch_p <= 1'b0;
+      addr_p <= 22'b0;
+      valid_p <= 1'b0;
+      fill_hit_p <= 1'b0;
+    end
+    else if (clk) begin
+      fetch_p <= fetch_sel;
+      addr_p <= fetch_addr;
+      valid_p <= tag_valid[fetch_addr[9:5]];
+      fill_hit_p <= filling & (fetch_addr[23:5] == fill_line)
+                    & fill_valid[fetch_addr[4:2]];
+    end
+  end
+
+  always @ (posedge clk) begin : XIP_SPI
+    if (!resetb) begin
+      state <= S_RESET;
+      clks <= 5'd0;
+      flash_csb <= 1'b1;
+      flash_clk <= 1'b0;
+      shift_out <= 32'b0;
+      shift_in <= 32'b0;
+      cont_mode <= 1'b0;
+      tag_valid <= 32'b0;
+      fill_line <= 19'b0;
+      filling <= 1'b0;
+      fill_prefetch <= 1'b0;
+      fill_valid <= 8'b0;
+      fill_word <= 3'd0;
+    end
+    else if (clk) begin
+      // SCK toggles every clock while reading. A state ends with the
+      // falling edge of its last SCK cycle
+      if (state != S_IDLE && state != S_PAUSE && !flash_csb)
+        flash_clk <= ~flash_clk;
+      if (flash_clk)
+        clks <= clks + 5'd1;
+      case (state)
+        S_RESET: begin
+          if (flash_csb) begin
+            flash_csb <= 1'b0;
+          end
+          else if (flash_clk && clks == 5'd15) begin
+            flash_csb <= 1'b1;
+            clks <= 5'd0;
+            state <= S_IDLE;
+          end
+        end
+        S_IDLE: begin
+          if (miss) begin
+            flash_csb <= 1'b0;
+            clks <= 5'd0;
+            tag_valid[req_line[9:5]] <= 1'b0;
+            fill_line <= req_line;
+            filling <= 1'b1;
+            fill_prefetch <= 1'b0;
+            fill_valid <= 8'b0;
+            fill_word <= 3'd0;
+            if (cont_mode) begin
+              shift_out <= {req_line, 5'b0, MODE_CONT};
+              state <= S_ADDR;
+            end
+            else begin
+              shift_out <= {READ_CMD, 24'b0};
+              state <= S_CMD;
+            end
+          end
+        end
+        S_CMD: begin
+          if (flash_clk) begin
+            shift_out <= {shift_out[30:0], 1'b0};
+            if (clks == 5'd7) begin
+              clks <= 5'd0;
+              shift_out <= {fill_line, 5'b0, MODE_CONT};
+              state <= S_ADDR;
+            end
+          end
+        end
+        S_ADDR: begin
+          if (flash_clk) begin
+            shift_out <= shift_out << W;
+            if (clks == ADDR_CLKS - 5'd1) begin
+              clks <= 5'd0;
+              cont_mode <= 1'b1;
+              state <= (DUMMY_CLKS != 5'd0) ? S_DUMMY : S_DATA;
+            end
+          end
+        end
+        S_DUMMY: begin
+          if (flash_clk && clks == DUMMY_CLKS - 5'd1) begin
+            clks <= 5'd0;
+            state <= S_DATA;
+          end
+        end
+        S_DATA: begin
+          if (!flash_clk && miss && req_line != fill_line) begin
+            // Wanted elsewhere, SCK stays low
+            flash_clk <= 1'b0;
+            flash_csb <= 1'b1;
+            filling <= 1'b0;
+            state <= S_IDLE;
+          end
+          else if (flash_clk) begin
+            shift_in <= word_in;
+            if (word_done) begin
+              clks <= 5'd0;
+              fill_valid[fill_word] <= 1'b1;
+              fill_word <= fill_word + 3'd1;
+            end
+            if (line_done) begin
+              tag_valid[fill_line[9:5]] <= 1'b1;
+              fill_line <= fill_line + 19'd1;
+              filling <= 1'b0;
+              state <= S_PAUSE;
+            end
+          end
+        end
+        S_PAUSE: begin
+          // A miss to the line just filled is its last word, written
+          // in the same clock it was looked up
+          if (miss && req_line != fill_line
+              && req_line != fill_line - 19'd1) begin
+            flash_csb <= 1'b1;
+            state <= S_IDLE;
+          end
+          else if ((miss && req_line == fill_line) || follow) begin
+            clks <= 5'd0;
+            tag_valid[fill_line[9:5]] <= 1'b0;
+            filling <= 1'b1;
+            fill_prefetch <= ~miss;
+            fill_valid <= 8'b0;
+            fill_word <= 3'd0;
+            state <= S_DATA;
+          end
+        end
+        default: begin
+          state <= S_IDLE;
+        end
+      endcase
+    end
+  end
+
+  always @ (*) begin : XIP_SPI_LINES
+    flash_io_oe = HOLD_OE;
+    flash_io_do = 4'b1111;
+    case (state)
+      S_RESET: begin
+        flash_io_oe = 4'b1111;
+      end
+      S_CMD: begin
+        flash_io_oe = HOLD_OE | 4'b0001;
+        flash_io_do[0] = shift_out[31];
+      end
+      S_ADDR: begin
+        flash_io_oe = HOLD_OE | DATA_OE;
+        flash_io_do[W-1:0] = shift_out[31-:W];
+      end
+      default: begin
+      end
+    endcase
+  end
+
+endmodule